@@ -30,9 +30,26 @@
 #  include <process.h>
 #  include <windows.h>
 #else
+#  include <errno.h>
 #  include <fcntl.h>
 #  include <unistd.h>
+#  include <sys/uio.h>
 #endif
+#if defined(HAVE_ZLIB)
+#  include <zlib.h>
+#endif
+
+/** Maximum number of messages written with a single writev() call. */
+#define FILELOGGER_MAX_IOV    64
+
+/** Suffix of compressed old log files. */
+#define FILELOGGER_GZ_SUFFIX  ".gz"
+
+/** Size of the buffer used to compress old log files. */
+#define FILELOGGER_GZ_BUFSIZE (64 * 1024)
+
+/** Infix of rotated log files waiting to be archived. */
+#define FILELOGGER_STAGED     ".rotating."
 
 
 typedef struct FileLogger {
@@ -42,9 +59,19 @@ typedef struct FileLogger {
    gint           logSize;
    guint64        maxSize;
    guint          maxFiles;
+   guint64        maxSpace;
    gboolean       append;
    gboolean       error;
    GStaticMutex   lock;
+   /* Rotation worker; protected by rotLock, taken after "lock". */
+   GStaticMutex   rotLock;
+   GCond         *rotCond;
+   GThread       *rotThread;
+   GQueue         rotPending;
+   guint          rotSeq;
+   gboolean       rotStop;
+   gboolean       rotRecovered;
+   int            rotPid;
 } FileLogger;
 
 
@@ -213,12 +240,474 @@ FileLoggerGetPath(FileLogger *data,
 }
 
 
+/*
+ *******************************************************************************
+ * FileLoggerFindOld --                                                   */ /**
+ *
+ * Finds the old log file with the given index, which may have been
+ * compressed.
+ *
+ * @param[in] data   Log handler data.
+ * @param[in] index  Index of the old log file.
+ *
+ * @return The path of the old log file, NULL if there's none.
+ *
+ *******************************************************************************
+ */
+
+static gchar *
+FileLoggerFindOld(FileLogger *data,
+                  gint index)
+{
+   gchar *path = FileLoggerGetPath(data, index);
+   gchar *gzpath;
+
+   if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+      return path;
+   }
+
+   gzpath = g_strconcat(path, FILELOGGER_GZ_SUFFIX, NULL);
+   g_free(path);
+   if (g_file_test(gzpath, G_FILE_TEST_IS_REGULAR)) {
+      return gzpath;
+   }
+
+   g_free(gzpath);
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerMoveOld --                                                   */ /**
+ *
+ * Moves a file to the given old log file index, replacing what's there. The
+ * file keeps its ".gz" suffix, if it has one. The file is deleted if it can't
+ * be moved.
+ *
+ * @param[in] data   Log handler data.
+ * @param[in] src    The file to move.
+ * @param[in] index  New index of the file.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerMoveOld(FileLogger *data,
+                  const gchar *src,
+                  gint index)
+{
+   gboolean compressed = g_str_has_suffix(src, FILELOGGER_GZ_SUFFIX);
+   gchar *path = FileLoggerGetPath(data, index);
+   gchar *gzpath = g_strconcat(path, FILELOGGER_GZ_SUFFIX, NULL);
+   gchar *dest = compressed ? gzpath : path;
+   gchar *other = compressed ? path : gzpath;
+
+   if (!g_file_test(other, G_FILE_TEST_IS_DIR)) {
+      g_unlink(other);
+   }
+
+   if (!g_file_test(dest, G_FILE_TEST_IS_DIR) &&
+       (!g_file_test(dest, G_FILE_TEST_EXISTS) ||
+        g_unlink(dest) == 0)) {
+      g_rename(src, dest);
+   } else {
+      g_unlink(src);
+   }
+
+   g_free(gzpath);
+   g_free(path);
+}
+
+
+#if defined(HAVE_ZLIB)
+/*
+ *******************************************************************************
+ * FileLoggerCompress --                                                  */ /**
+ *
+ * Compresses an old log file with gzip, replacing it with a file with the
+ * same name plus ".gz". The original file is kept if compression fails.
+ *
+ * @param[in] path   The file to compress.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerCompress(const gchar *path)
+{
+   gchar *gzpath = g_strconcat(path, FILELOGGER_GZ_SUFFIX, NULL);
+   gchar *tmp = g_strconcat(gzpath, ".tmp", NULL);
+   gchar *buf;
+   gboolean ok = TRUE;
+   gzFile out;
+   FILE *in;
+   size_t n;
+
+   in = g_fopen(path, "rb");
+   if (in == NULL) {
+      goto exit;
+   }
+
+   out = gzopen(tmp, "wb");
+   if (out == NULL) {
+      fclose(in);
+      goto exit;
+   }
+
+   buf = g_malloc(FILELOGGER_GZ_BUFSIZE);
+   while ((n = fread(buf, 1, FILELOGGER_GZ_BUFSIZE, in)) > 0) {
+      if (gzwrite(out, buf, (unsigned) n) != (int) n) {
+         ok = FALSE;
+         break;
+      }
+   }
+   ok = ok && !ferror(in);
+   g_free(buf);
+   fclose(in);
+
+   ok = gzclose(out) == Z_OK && ok;
+   if (ok && g_rename(tmp, gzpath) == 0) {
+      g_unlink(path);
+   } else {
+      g_unlink(tmp);
+   }
+
+exit:
+   g_free(tmp);
+   g_free(gzpath);
+}
+#endif
+
+
+/*
+ *******************************************************************************
+ * FileLoggerArchive --                                                   */ /**
+ *
+ * Turns a rotated log file into the newest old log file: shifts the indices of
+ * the existing old log files, so that the oldest one has the highest index,
+ * moves the rotated file to index "1", and compresses it. Then deletes the
+ * oldest files until the old log files fit in the configured space; the
+ * newest old log file is always kept.
+ *
+ * This does not touch the active log file, so it doesn't need the logger's
+ * lock.
+ *
+ * @param[in] data   Log handler data.
+ * @param[in] staged The rotated log file.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerArchive(FileLogger *data,
+                  const gchar *staged)
+{
+   GPtrArray *oldfiles = g_ptr_array_new();
+   guint64 total = 0;
+   guint id;
+
+   /*
+    * Find the existing old log files. The last one is deleted if the new one
+    * would make them too many.
+    */
+   for (id = 1; id < data->maxFiles; id++) {
+      gchar *old = FileLoggerFindOld(data, id);
+      if (old == NULL) {
+         break;
+      }
+      g_ptr_array_add(oldfiles, old);
+   }
+
+   if (oldfiles->len == data->maxFiles - 1) {
+      g_unlink(g_ptr_array_index(oldfiles, oldfiles->len - 1));
+      g_free(g_ptr_array_index(oldfiles, oldfiles->len - 1));
+      g_ptr_array_remove_index(oldfiles, oldfiles->len - 1);
+   }
+
+   /* Rename the existing old log files, increasing their index by 1. */
+   for (id = oldfiles->len; id > 0; id--) {
+      FileLoggerMoveOld(data, g_ptr_array_index(oldfiles, id - 1), id + 1);
+      g_free(g_ptr_array_index(oldfiles, id - 1));
+   }
+   g_ptr_array_free(oldfiles, TRUE);
+
+   FileLoggerMoveOld(data, staged, 1);
+#if defined(HAVE_ZLIB)
+   {
+      gchar *newest = FileLoggerGetPath(data, 1);
+      if (g_file_test(newest, G_FILE_TEST_IS_REGULAR)) {
+         FileLoggerCompress(newest);
+      }
+      g_free(newest);
+   }
+#endif
+
+   /* Enforce the space limit, from the newest file to the oldest one. */
+   for (id = 1; id < data->maxFiles; id++) {
+      struct stat fstats;
+      gchar *old = FileLoggerFindOld(data, id);
+
+      if (old == NULL) {
+         break;
+      }
+      if (g_stat(old, &fstats) == 0) {
+         total += fstats.st_size;
+      }
+      if (id > 1 && data->maxSpace > 0 && total > data->maxSpace) {
+         g_unlink(old);
+      }
+      g_free(old);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerRotator --                                                   */ /**
+ *
+ * Rotation worker: archives the rotated log files in the order they were
+ * rotated, and sleeps while there are none. Exits once it's been asked to
+ * stop and all rotated files have been archived.
+ *
+ * @param[in] _data  Log handler data.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+FileLoggerRotator(gpointer _data)
+{
+   FileLogger *data = _data;
+
+   g_static_mutex_lock(&data->rotLock);
+   while (TRUE) {
+      gchar *staged = g_queue_pop_head(&data->rotPending);
+
+      if (staged != NULL) {
+         g_static_mutex_unlock(&data->rotLock);
+         FileLoggerArchive(data, staged);
+         g_free(staged);
+         g_static_mutex_lock(&data->rotLock);
+      } else if (data->rotStop) {
+         break;
+      } else {
+         g_cond_wait(data->rotCond, g_static_mutex_get_mutex(&data->rotLock));
+      }
+   }
+   g_static_mutex_unlock(&data->rotLock);
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerQueue --                                                     */ /**
+ *
+ * Hands a rotated log file to the rotation worker, starting the worker if
+ * needed. Without thread support, the file is archived right away.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] data   Log handler data.
+ * @param[in] staged The rotated log file; freed by this function.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerQueue(FileLogger *data,
+                gchar *staged)
+{
+   g_static_mutex_lock(&data->rotLock);
+
+   if (data->rotThread != NULL && data->rotPid != (int) getpid()) {
+      /*
+       * This is a forked child: the worker and the files it was given belong
+       * to the parent.
+       */
+      gchar *pending;
+
+      while ((pending = g_queue_pop_head(&data->rotPending)) != NULL) {
+         g_free(pending);
+      }
+      data->rotThread = NULL;
+      data->rotCond = NULL;
+   }
+
+   if (data->rotThread == NULL && g_thread_supported()) {
+      if (data->rotCond == NULL) {
+         data->rotCond = g_cond_new();
+      }
+      data->rotStop = FALSE;
+      data->rotPid = (int) getpid();
+      data->rotThread = g_thread_create(FileLoggerRotator, data, TRUE, NULL);
+   }
+
+   if (data->rotThread != NULL) {
+      g_queue_push_tail(&data->rotPending, staged);
+      g_cond_signal(data->rotCond);
+      staged = NULL;
+   }
+
+   g_static_mutex_unlock(&data->rotLock);
+
+   if (staged != NULL) {
+      FileLoggerArchive(data, staged);
+      g_free(staged);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerCompareSeq --                                                */ /**
+ *
+ * Compares two staging sequence numbers, for sorting.
+ *
+ * @param[in] a   First sequence number.
+ * @param[in] b   Second sequence number.
+ *
+ * @return <0, 0 or >0 if a is lower than, equal to or greater than b.
+ *
+ *******************************************************************************
+ */
+
+static gint
+FileLoggerCompareSeq(gconstpointer a,
+                     gconstpointer b)
+{
+   guint seqA = *(const guint *) a;
+   guint seqB = *(const guint *) b;
+
+   return seqA < seqB ? -1 : (seqA > seqB ? 1 : 0);
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerRecover --                                                   */ /**
+ *
+ * Finds the rotated log files left behind by a process that exited before
+ * archiving them, and archives them, oldest first, before anything else is
+ * rotated. Also moves the staging sequence past theirs, so that they're not
+ * overwritten by new rotated files.
+ *
+ * When no old log files are kept, the leftover files are just deleted.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] data   Log handler data.
+ * @param[in] path   Path of the active log file.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerRecover(FileLogger *data,
+                  const gchar *path)
+{
+   gchar *dirname = g_path_get_dirname(path);
+   gchar *basename = g_path_get_basename(path);
+   gchar *prefix = g_strconcat(basename, FILELOGGER_STAGED, NULL);
+   size_t prefixLen = strlen(prefix);
+   GArray *seqs = g_array_new(FALSE, FALSE, sizeof (guint));
+   const gchar *name;
+   GDir *dir;
+   guint i;
+
+   dir = g_dir_open(dirname, 0, NULL);
+   if (dir == NULL) {
+      goto exit;
+   }
+
+   while ((name = g_dir_read_name(dir)) != NULL) {
+      const gchar *suffix = name + prefixLen;
+      gchar *end;
+      guint64 seq;
+
+      if (strncmp(name, prefix, prefixLen) != 0 ||
+          !g_ascii_isdigit(*suffix)) {
+         continue;
+      }
+      seq = g_ascii_strtoull(suffix, &end, 10);
+      if (*end == '\0' && seq < G_MAXUINT) {
+         guint val = (guint) seq;
+         g_array_append_val(seqs, val);
+      }
+   }
+   g_dir_close(dir);
+
+   g_array_sort(seqs, FileLoggerCompareSeq);
+   for (i = 0; i < seqs->len; i++) {
+      guint seq = g_array_index(seqs, guint, i);
+      gchar *staged = g_strdup_printf("%s" FILELOGGER_STAGED "%u", path, seq);
+
+      data->rotSeq = MAX(data->rotSeq, seq + 1);
+      if (data->maxFiles <= 1) {
+         g_unlink(staged);
+         g_free(staged);
+      } else {
+         FileLoggerQueue(data, staged);
+      }
+   }
+
+exit:
+   g_array_free(seqs, TRUE);
+   g_free(prefix);
+   g_free(basename);
+   g_free(dirname);
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerRotate --                                                    */ /**
+ *
+ * Rotates the (closed) active log file: renames it to a staging name, and
+ * hands it to the rotation worker, which does the rest of the work without
+ * holding up the threads that are logging.
+ *
+ * When no old log files are kept, there's nothing to do: the file is
+ * truncated when it's opened again.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] data   Log handler data.
+ * @param[in] path   Path of the active log file.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerRotate(FileLogger *data,
+                 const gchar *path)
+{
+   gchar *staged;
+
+   if (data->maxFiles <= 1) {
+      return;
+   }
+
+   staged = g_strdup_printf("%s" FILELOGGER_STAGED "%u", path, data->rotSeq++);
+   if (g_rename(path, staged) != 0) {
+      g_free(staged);
+      return;
+   }
+
+   FileLoggerQueue(data, staged);
+}
+
+
 /*
  *******************************************************************************
  * FileLoggerOpen --                                                      */ /**
  *
- * Opens a log file for writing, backing up the existing log file if one is
- * present. Only one old log file is preserved.
+ * Opens a log file for writing, rotating the existing log file if one is
+ * present and it shouldn't be appended to.
  *
  * @note Make sure this function is called with the write lock held.
  *
@@ -238,6 +727,11 @@ FileLoggerOpen(FileLogger *data)
    g_return_val_if_fail(data != NULL, NULL);
    path = FileLoggerGetPath(data, 0);
 
+   if (!data->rotRecovered) {
+      data->rotRecovered = TRUE;
+      FileLoggerRecover(data, path);
+   }
+
    if (g_file_test(path, G_FILE_TEST_EXISTS)) {
       struct stat fstats;
       if (g_stat(path, &fstats) > -1) {
@@ -245,48 +739,7 @@ FileLoggerOpen(FileLogger *data)
       }
 
       if (!data->append || data->logSize >= data->maxSize) {
-         /*
-          * Find the last log file and iterate back, changing the indices as we go,
-          * so that the oldest log file has the highest index (the new log file
-          * will always be index "0"). When not rotating, "maxFiles" is 1, so we
-          * always keep one backup.
-          */
-         gchar *log;
-         guint id;
-         GPtrArray *logfiles = g_ptr_array_new();
-
-         /*
-          * Find the id of the last log file. The pointer array will hold
-          * the names of all existing log files + the name of the last log
-          * file, which may or may not exist.
-          */
-         for (id = 0; id < data->maxFiles; id++) {
-            log = FileLoggerGetPath(data, id);
-            g_ptr_array_add(logfiles, log);
-            if (!g_file_test(log, G_FILE_TEST_IS_REGULAR)) {
-               break;
-            }
-         }
-
-         /* Rename the existing log files, increasing their index by 1. */
-         for (id = logfiles->len - 1; id > 0; id--) {
-            gchar *dest = g_ptr_array_index(logfiles, id);
-            gchar *src = g_ptr_array_index(logfiles, id - 1);
-
-            if (!g_file_test(dest, G_FILE_TEST_IS_DIR) &&
-                (!g_file_test(dest, G_FILE_TEST_EXISTS) ||
-                 g_unlink(dest) == 0)) {
-               g_rename(src, dest);
-            } else {
-               g_unlink(src);
-            }
-         }
-
-         /* Cleanup. */
-         for (id = 0; id < logfiles->len; id++) {
-            g_free(g_ptr_array_index(logfiles, id));
-         }
-         g_ptr_array_free(logfiles, TRUE);
+         FileLoggerRotate(data, path);
          data->logSize = 0;
          data->append = FALSE;
       }
@@ -303,6 +756,46 @@ FileLoggerOpen(FileLogger *data)
 }
 
 
+/*
+ *******************************************************************************
+ * FileLoggerCheckFile --                                                 */ /**
+ *
+ * Opens the log file if it hasn't been done yet, and checks that it can be
+ * written to. Marks the logger as failed otherwise.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] logger The logger instance.
+ *
+ * @return Whether the log file can be written to.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+FileLoggerCheckFile(FileLogger *logger)
+{
+   if (logger->error) {
+      return FALSE;
+   }
+
+   if (logger->file == NULL) {
+      logger->file = FileLoggerOpen(logger);
+      if (logger->file == NULL) {
+         logger->error = TRUE;
+         return FALSE;
+      }
+   }
+
+   if (!FileLoggerIsValid(logger)) {
+      logger->error = TRUE;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
 /*
  *******************************************************************************
  * FileLoggerLog --                                                       */ /**
@@ -329,22 +822,7 @@ FileLoggerLog(const gchar *domain,
 
    g_static_mutex_lock(&logger->lock);
 
-   if (logger->error) {
-      goto exit;
-   }
-
-   if (logger->file == NULL) {
-      if (logger->file == NULL) {
-         logger->file = FileLoggerOpen(data);
-      }
-      if (logger->file == NULL) {
-         logger->error = TRUE;
-         goto exit;
-      }
-   }
-
-   if (!FileLoggerIsValid(logger)) {
-      logger->error = TRUE;
+   if (!FileLoggerCheckFile(logger)) {
       goto exit;
    }
 
@@ -370,6 +848,117 @@ exit:
 }
 
 
+#if !defined(_WIN32)
+/*
+ *******************************************************************************
+ * FileLoggerWritev --                                                    */ /**
+ *
+ * Writes all the given buffers to a file, retrying after short writes.
+ *
+ * @param[in] fd     File descriptor.
+ * @param[in] iov    Buffers to write; modified as data is written.
+ * @param[in] count  Number of buffers.
+ *
+ * @return Number of bytes written, -1 if nothing could be written.
+ *
+ *******************************************************************************
+ */
+
+static gssize
+FileLoggerWritev(int fd,
+                 struct iovec *iov,
+                 int count)
+{
+   gssize total = 0;
+
+   while (count > 0) {
+      ssize_t written = writev(fd, iov, count);
+
+      if (written < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return total > 0 ? total : -1;
+      }
+
+      total += written;
+      while (count > 0 && (size_t) written >= iov->iov_len) {
+         written -= iov->iov_len;
+         iov++;
+         count--;
+      }
+      if (count > 0) {
+         iov->iov_base = (char *) iov->iov_base + written;
+         iov->iov_len -= written;
+      }
+   }
+
+   return total;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerLogBatch --                                                  */ /**
+ *
+ * Logs several messages to the configured destination file, with as few
+ * writev() calls as possible. Log rotation is checked after each call, so a
+ * log file may go over its maximum size by one batch of messages.
+ *
+ * The messages are written directly to the file descriptor. This is fine
+ * since FileLoggerLog() always flushes the I/O channel after writing.
+ *
+ * @param[in] messages  Messages to log.
+ * @param[in] count     Number of messages.
+ * @param[in] data      File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerLogBatch(const gchar **messages,
+                   guint count,
+                   gpointer data)
+{
+   FileLogger *logger = data;
+
+   g_static_mutex_lock(&logger->lock);
+
+   while (count > 0 && FileLoggerCheckFile(logger)) {
+      struct iovec iov[FILELOGGER_MAX_IOV];
+      guint n = MIN(count, G_N_ELEMENTS(iov));
+      gssize written;
+      guint i;
+
+      for (i = 0; i < n; i++) {
+         iov[i].iov_base = (void *) messages[i];
+         iov[i].iov_len = strlen(messages[i]);
+      }
+
+      written = FileLoggerWritev(g_io_channel_unix_get_fd(logger->file),
+                                 iov, n);
+      if (written < 0) {
+         break;
+      }
+
+      if (logger->maxSize > 0) {
+         logger->logSize += (gint) written;
+         if (logger->logSize >= logger->maxSize) {
+            g_io_channel_unref(logger->file);
+            logger->append = FALSE;
+            logger->file = FileLoggerOpen(logger);
+         }
+      }
+
+      messages += n;
+      count -= n;
+   }
+
+   g_static_mutex_unlock(&logger->lock);
+}
+#endif
+
+
 /*
  ******************************************************************************
  * FileLoggerDestroy --                                               */ /**
@@ -385,9 +974,31 @@ static void
 FileLoggerDestroy(gpointer data)
 {
    FileLogger *logger = data;
+   GThread *rotator = NULL;
+   gchar *pending;
+
    if (logger->file != NULL) {
       g_io_channel_unref(logger->file);
    }
+
+   /* Let the rotation worker archive the files it's been given. */
+   g_static_mutex_lock(&logger->rotLock);
+   if (logger->rotThread != NULL && logger->rotPid == (int) getpid()) {
+      rotator = logger->rotThread;
+      logger->rotStop = TRUE;
+      g_cond_signal(logger->rotCond);
+   }
+   g_static_mutex_unlock(&logger->rotLock);
+
+   if (rotator != NULL) {
+      g_thread_join(rotator);
+      g_cond_free(logger->rotCond);
+   }
+   while ((pending = g_queue_pop_head(&logger->rotPending)) != NULL) {
+      g_free(pending);
+   }
+
+   g_static_mutex_free(&logger->rotLock);
    g_static_mutex_free(&logger->lock);
    g_free(logger->path);
    g_free(logger);
@@ -400,10 +1011,16 @@ FileLoggerDestroy(gpointer data)
  *
  * @brief Creates a new file logger based on the given configuration.
  *
+ * Rotated log files are archived by a separate thread, which compresses them
+ * when zlib is available. Rotated files left behind by a previous process are
+ * archived when the log file is first opened.
+ *
  * @param[in] path      Path to log file.
  * @param[in] append    Whether to append to existing log file.
  * @param[in] maxSize   Maximum log file size (in MB, 0 = no limit).
  * @param[in] maxFiles  Maximum number of old files to be kept.
+ * @param[in] maxSpace  Maximum space used by old files (in MB, 0 = maxSize
+ *                      times maxFiles).
  *
  * @return A new logger, or NULL on error.
  *
@@ -414,7 +1031,8 @@ GlibLogger *
 GlibUtils_CreateFileLogger(const char *path,
                            gboolean append,
                            guint maxSize,
-                           guint maxFiles)
+                           guint maxFiles,
+                           guint maxSpace)
 {
    FileLogger *data = NULL;
 
@@ -425,6 +1043,9 @@ GlibUtils_CreateFileLogger(const char *path,
    data->handler.shared = FALSE;
    data->handler.logfn = FileLoggerLog;
    data->handler.dtor = FileLoggerDestroy;
+#if !defined(_WIN32)
+   data->handler.logbatch = FileLoggerLogBatch;
+#endif
 
    data->path = g_filename_from_utf8(path, -1, NULL, NULL, NULL);
    if (data->path == NULL) {
@@ -435,7 +1056,11 @@ GlibUtils_CreateFileLogger(const char *path,
    data->append = append;
    data->maxSize = maxSize * 1024 * 1024;
    data->maxFiles = maxFiles + 1; /* To account for the active log file. */
+   data->maxSpace = (maxSpace > 0 ? (guint64) maxSpace :
+                     (guint64) maxSize * maxFiles) * 1024 * 1024;
    g_static_mutex_init(&data->lock);
+   g_static_mutex_init(&data->rotLock);
+   g_queue_init(&data->rotPending);
 
    return &data->handler;
 }
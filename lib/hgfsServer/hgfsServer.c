@@ -41,6 +41,7 @@
 #include "codeset.h"
 #include "dbllnklst.h"
 #include "file.h"
+#include "hostinfo.h"
 #include "util.h"
 #include "wiper.h"
 #include "hgfsServer.h"
@@ -119,6 +120,27 @@
  */
 #define HGFS_PATH_MAX HGFS_PACKET_MAX
 
+/*
+ * Per-request scratch memory. Large enough for the local name working
+ * buffer plus the case corrected copy of the name returned by the lookup.
+ *
+ * Every handler that resolves a single name for the duration of the request
+ * takes it from the arena: open, search open, getattr, setattr, create dir,
+ * delete file and dir, query volume, symlink create and dir watch. Open
+ * nodes and searches keep their own copies of the name.
+ *
+ * Names looked up by handle (HgfsHandle2FileName) are heap copies of the
+ * node's name, so rename, which takes either kind for both of its names,
+ * and dir watch by handle keep freeing them. The symlink target returned
+ * by getattr is read into a heap buffer by the platform code. The reply
+ * packers write straight into the reply packet and allocate nothing.
+ * Search reads still allocate the copy of each directory entry
+ * (HgfsServerGetDirEntry, which the platform code also calls outside of
+ * any request) and the entry name built by HgfsPlatformSetDirEntry.
+ * Moving them would mean passing the arena through the platform interface.
+ */
+#define HGFS_INPUT_ARENA_SIZE (3 * HGFS_PATH_MAX)
+
 /*
  * Array of FileNodes for opening files.
  */
@@ -128,8 +150,27 @@
 /* Default maximun number of open nodes that have server locks. */
 #define MAX_LOCKED_FILENODES 10
 
+/*
+ * Read access pattern detection. The sequential score of a file saturates
+ * at the maximum so that a few reads of a different kind flip the pattern.
+ */
+#define HGFS_ACCESS_PATTERN_SCORE_MAX 4
+#define HGFS_ACCESS_PATTERN_THRESHOLD 2
+
+/* Size of the readahead window kept ahead of sequential readers. */
+#define HGFS_READAHEAD_WINDOW (16 * HGFS_LARGE_IO_MAX)
+
+/*
+ * Maximum data copied by a single copy file range request, so a large copy
+ * cannot hold up the other requests of the session for too long.
+ */
+#define HGFS_COPY_FILE_RANGE_MAX (64 * 1024 * 1024)
+
 
 struct HgfsTransportSessionInfo {
+   /* Links on the global list of transport sessions. */
+   DblLnkLst_Links links;
+
    /* Default session id. */
    uint64 defaultSessionId;
 
@@ -175,8 +216,26 @@ typedef struct HgfsInputParam {
    HgfsOp op;                    /* Hgfs operation command code */
    uint32 id;                    /* Request ID to be matched with the reply */
    Bool sessionEnabled;          /* Requests have session enabled headers */
+   HgfsArena arena;              /* Scratch memory freed with the request */
+   VmTimeType startTime;         /* When the request was received, in us */
+   uint64 arenaBuf[HGFS_INPUT_ARENA_SIZE / sizeof (uint64)];
 } HgfsInputParam;
 
+/*
+ * Recently released input params are kept for reuse by later requests so
+ * the common request path does not go to the heap for them or for the
+ * scratch memory embedded in them.
+ */
+#define HGFS_INPUT_PARAM_CACHE_MAX   4
+
+static HgfsInputParam *gHgfsInputParamCache[HGFS_INPUT_PARAM_CACHE_MAX];
+static uint32 gHgfsInputParamCacheCount = 0;
+static MXUserExclLock *gHgfsInputParamCacheLock;
+
+/* Input params taken from the cache and from the heap, under the cache lock. */
+static uint64 gHgfsInputParamCacheHits = 0;
+static uint64 gHgfsInputParamCacheMisses = 0;
+
 /*
  * The HGFS server configurable settings.
  * (Note: the guest sets these to all defaults only modifiable from the VMX.)
@@ -201,6 +260,13 @@ static MXUserCondVar  *gHgfsAsyncVar;
 
 static HgfsServerMgrCallbacks *gHgfsMgrData = NULL;
 
+/*
+ * All connected transport sessions, so that the statistics of their
+ * sessions can be reported.
+ */
+static DblLnkLst_Links gHgfsTransportSessionList;
+static MXUserExclLock *gHgfsTransportSessionListLock;
+
 /*
  * Session usage and locking.
  *
@@ -383,6 +449,7 @@ static void HgfsServerClose(HgfsInputParam *input);
 static void HgfsServerSearchClose(HgfsInputParam *input);
 static void HgfsServerSetDirNotifyWatch(HgfsInputParam *input);
 static void HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input);
+static void HgfsServerCopyFileRange(HgfsInputParam *input);
 
 
 /*
@@ -487,6 +554,12 @@ HgfsServerTransportSessionPut(HgfsTransportSessionInfo *transportSession)   // I
    if (Atomic_ReadDec32(&transportSession->refCount) == 1) {
       DblLnkLst_Links *curr, *next;
 
+      MXUser_AcquireExclLock(gHgfsTransportSessionListLock);
+      if (DblLnkLst_IsLinked(&transportSession->links)) {
+         DblLnkLst_Unlink1(&transportSession->links);
+      }
+      MXUser_ReleaseExclLock(gHgfsTransportSessionListLock);
+
       MXUser_AcquireExclLock(transportSession->sessionArrayLock);
 
       DblLnkLst_ForEachSafe(curr, next,  &transportSession->sessionArray) {
@@ -1168,6 +1241,95 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsHandleGetReadAdvice --
+ *
+ *    Update the read access pattern of the file from the offset of a new
+ *    read, and work out the caching hints the platform should give the host
+ *    OS for it.
+ *
+ *    A read that starts where the previous one ended raises the file's
+ *    sequential score, any other read lowers it. The score saturates so
+ *    the pattern follows the recent reads and flips only after a few
+ *    consistent ones. Files opened sequentially are always sequential.
+ *    For sequential files a readahead window is kept ahead of the client
+ *    and is refilled once the client has consumed half of it.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure. advice is filled in on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsHandleGetReadAdvice(HgfsHandle handle,         // IN: Hgfs file handle
+                        HgfsSessionInfo *session,  // IN: Session info
+                        uint64 offset,             // IN: offset of the read
+                        uint32 requiredSize,       // IN: size of the read
+                        HgfsReadAdvice *advice)    // OUT: readahead advice
+{
+   HgfsFileNode *node;
+   HgfsAccessPattern pattern;
+   uint64 readEnd = offset + requiredSize;
+   Bool success = FALSE;
+
+   ASSERT(advice);
+
+   memset(advice, 0, sizeof *advice);
+
+   MXUser_AcquireExclLock(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (node == NULL) {
+      goto exit;
+   }
+
+   if (offset == node->nextReadOffset) {
+      node->sequentialScore = MIN(node->sequentialScore + 1,
+                                  HGFS_ACCESS_PATTERN_SCORE_MAX);
+   } else {
+      node->sequentialScore = MAX(node->sequentialScore - 1,
+                                  -HGFS_ACCESS_PATTERN_SCORE_MAX);
+   }
+   node->nextReadOffset = readEnd;
+
+   pattern = node->accessPattern;
+   if ((node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0 ||
+       node->sequentialScore >= HGFS_ACCESS_PATTERN_THRESHOLD) {
+      pattern = HGFS_ACCESS_PATTERN_SEQUENTIAL;
+   } else if (node->sequentialScore <= -HGFS_ACCESS_PATTERN_THRESHOLD) {
+      pattern = HGFS_ACCESS_PATTERN_RANDOM;
+   }
+
+   if (pattern != node->accessPattern) {
+      LOG(4, ("%s: handle %u access pattern %d -> %d\n", __FUNCTION__,
+              handle, node->accessPattern, pattern));
+      node->accessPattern = pattern;
+      node->readaheadEnd = 0;
+      advice->patternChanged = TRUE;
+   }
+   advice->pattern = pattern;
+
+   if (pattern == HGFS_ACCESS_PATTERN_SEQUENTIAL &&
+       readEnd + HGFS_READAHEAD_WINDOW / 2 > node->readaheadEnd) {
+      advice->readaheadOffset = MAX(readEnd, node->readaheadEnd);
+      advice->readaheadLength = HGFS_READAHEAD_WINDOW;
+      node->readaheadEnd = advice->readaheadOffset + advice->readaheadLength;
+   }
+   success = TRUE;
+
+exit:
+   MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   return success;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -1248,6 +1410,9 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
 
    node->fileDesc = fd;
    node->fileCtx = fileCtx;
+   /* Any access pattern advice was given to the old descriptor. */
+   node->accessPattern = HGFS_ACCESS_PATTERN_UNKNOWN;
+   node->readaheadEnd = 0;
    updated = TRUE;
 
 exit:
@@ -1809,6 +1974,11 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
       newNode->flags |= HGFS_FILE_NODE_SEQUENTIAL_FL;
    }
 
+   newNode->accessPattern = HGFS_ACCESS_PATTERN_UNKNOWN;
+   newNode->sequentialScore = 0;
+   newNode->nextReadOffset = 0;
+   newNode->readaheadEnd = 0;
+
    newNode->serverLock = openInfo->acquiredLock;
    newNode->state = FILENODE_STATE_IN_USE_NOT_CACHED;
    newNode->shareInfo.readPermissions = openInfo->shareInfo.readPermissions;
@@ -2903,6 +3073,23 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op open V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op enumerate streams
+   { NULL,                       0,                                                REQ_SYNC}, // No Op getattr V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op setattr V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op delete V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op linkmove V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsctl V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op access check V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsync V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query volume V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Op oplock acquire
+   { NULL,                       0,                                                REQ_SYNC}, // No Op oplock break
+   { NULL,                       0,                                                REQ_SYNC}, // No Op lock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op unlock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query EAs
+   { NULL,                       0,                                                REQ_SYNC}, // No Op set EAs
+   { HgfsServerCopyFileRange,    sizeof (HgfsRequestCopyFileRangeV4),              REQ_SYNC},
 
 };
 
@@ -2913,6 +3100,7 @@ static struct {
  * HgfsServerInputAllocInit --
  *
  *    Allocates and initializes the input params object with the operation parameters.
+ *    A previously released params object is reused when one is cached.
  *
  * Results:
  *    None.
@@ -2936,9 +3124,27 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
                          const void *requestOpArgs,                 // IN: op args
                          HgfsInputParam **params)                   // OUT: parameters
 {
-   HgfsInputParam *localParams;
+   HgfsInputParam *localParams = NULL;
+
+   if (NULL != gHgfsInputParamCacheLock) {
+      MXUser_AcquireExclLock(gHgfsInputParamCacheLock);
+      if (gHgfsInputParamCacheCount > 0) {
+         localParams = gHgfsInputParamCache[--gHgfsInputParamCacheCount];
+         gHgfsInputParamCacheHits++;
+      } else {
+         gHgfsInputParamCacheMisses++;
+      }
+      MXUser_ReleaseExclLock(gHgfsInputParamCacheLock);
+   }
+
+   if (NULL == localParams) {
+      localParams = Util_SafeMalloc(sizeof *localParams);
+   }
 
-   localParams = Util_SafeCalloc(1, sizeof *localParams);
+   localParams->payloadOffset = 0;
+   localParams->startTime = Hostinfo_SystemTimerUS();
+   HgfsArenaInit(&localParams->arena, localParams->arenaBuf,
+                 sizeof localParams->arenaBuf);
 
    localParams->packet = packet;
    localParams->request = request;
@@ -2965,12 +3171,13 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
  * HgfsServerInputExit --
  *
  *    Tearsdown and frees the input params object with the operation parameters.
+ *    The object is returned to the params cache if there is room for it.
  *
  * Results:
  *    None.
  *
  * Side effects:
- *    None.
+ *    Releases the request's arena memory.
  *
  *-----------------------------------------------------------------------------
  */
@@ -2982,6 +3189,16 @@ HgfsServerInputExit(HgfsInputParam *params)                        // IN: packet
       HgfsServerSessionPut(params->session);
    }
    HgfsServerTransportSessionPut(params->transportSession);
+   HgfsArenaReset(&params->arena);
+
+   if (NULL != gHgfsInputParamCacheLock) {
+      MXUser_AcquireExclLock(gHgfsInputParamCacheLock);
+      if (gHgfsInputParamCacheCount < ARRAYSIZE(gHgfsInputParamCache)) {
+         gHgfsInputParamCache[gHgfsInputParamCacheCount++] = params;
+         params = NULL;
+      }
+      MXUser_ReleaseExclLock(gHgfsInputParamCacheLock);
+   }
    free(params);
 }
 
@@ -3127,6 +3344,46 @@ HgfsServerGetRequestHeaderSize(HgfsInputParam *input)     // IN: parameters
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerRecordOpStats --
+ *
+ *    Accounts a completed request in the session's per operation statistics.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerRecordOpStats(HgfsOpStats *stats,          // IN/OUT: op statistics
+                        HgfsInternalStatus status,   // IN: request status
+                        VmTimeType latency)          // IN: latency in us
+{
+   unsigned int bucket = 0;
+
+   /* Bucket i holds latencies below 2^(i+1) us, the last one the rest. */
+   while (bucket < HGFS_STATS_LATENCY_BUCKETS - 1 &&
+          latency >= ((VmTimeType)2 << bucket)) {
+      bucket++;
+   }
+
+   Atomic_Inc64(&stats->count);
+   if (HGFS_ERROR_SUCCESS != status) {
+      Atomic_Inc64(&stats->errors);
+   }
+   if (latency > 0) {
+      Atomic_Add64(&stats->totalLatency, latency);
+   }
+   Atomic_Inc(&stats->latency[bucket]);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -3200,6 +3457,10 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
    }
 
 exit:
+   if (NULL != input->session && input->op < HGFS_OP_MAX) {
+      HgfsServerRecordOpStats(&input->session->opStats[input->op], status,
+                              Hostinfo_SystemTimerUS() - input->startTime);
+   }
    HgfsServerInputExit(input);
 }
 
@@ -3796,10 +4057,27 @@ HgfsServer_InitState(HgfsServerCallbacks **callbackTable,         // IN/OUT: our
    gHgfsAsyncVar = NULL;
    Atomic_Write(&gHgfsAsyncCounter, 0);
 
+   gHgfsInputParamCacheCount = 0;
+   gHgfsInputParamCacheLock = MXUser_CreateExclLock("inputParamCacheLock",
+                                                    RANK_hgfsInputParamCache);
+   if (NULL == gHgfsInputParamCacheLock) {
+      LOG(4, ("%s: Could not create input params cache lock, "
+              "requests will not reuse input params.\n", __FUNCTION__));
+   }
+
+   DblLnkLst_Init(&gHgfsTransportSessionList);
+   gHgfsTransportSessionListLock =
+      MXUser_CreateExclLock("transportSessionListLock",
+                            RANK_hgfsTransportSessions);
+
    DblLnkLst_Init(&gHgfsSharedFoldersList);
    gHgfsSharedFoldersLock = MXUser_CreateExclLock("sharedFoldersLock",
                                                   RANK_hgfsSharedFolders);
-   if (NULL != gHgfsSharedFoldersLock) {
+   if (NULL == gHgfsTransportSessionListLock) {
+      LOG(4, ("%s: Could not create transport session list mutex.\n",
+              __FUNCTION__));
+      result = FALSE;
+   } else if (NULL != gHgfsSharedFoldersLock) {
       gHgfsAsyncLock = MXUser_CreateExclLock("asyncLock",
                                              RANK_hgfsSharedFolders);
       if (NULL != gHgfsAsyncLock) {
@@ -3884,6 +4162,11 @@ HgfsServer_ExitState(void)
       gHgfsSharedFoldersLock = NULL;
    }
 
+   if (NULL != gHgfsTransportSessionListLock) {
+      MXUser_DestroyExclLock(gHgfsTransportSessionListLock);
+      gHgfsTransportSessionListLock = NULL;
+   }
+
    if (NULL != gHgfsAsyncLock) {
       MXUser_DestroyExclLock(gHgfsAsyncLock);
       gHgfsAsyncLock = NULL;
@@ -3894,6 +4177,14 @@ HgfsServer_ExitState(void)
       gHgfsAsyncVar = NULL;
    }
 
+   if (NULL != gHgfsInputParamCacheLock) {
+      while (gHgfsInputParamCacheCount > 0) {
+         free(gHgfsInputParamCache[--gHgfsInputParamCacheCount]);
+      }
+      MXUser_DestroyExclLock(gHgfsInputParamCacheLock);
+      gHgfsInputParamCacheLock = NULL;
+   }
+
    HgfsPlatformDestroy();
    /*
     * Reset the server manager callbacks.
@@ -3902,6 +4193,141 @@ HgfsServer_ExitState(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_DumpStats --
+ *
+ *    Reports the request memory statistics of the server, then the
+ *    statistics of every session of every connected transport, one line at
+ *    a time, through the caller's print function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_DumpStats(HgfsServerStatsPrintFunc printFunc,   // IN: line printer
+                     void *clientData)                     // IN: printer data
+{
+   DblLnkLst_Links *currTransport;
+   HgfsArenaStats arenaStats;
+   uint64 paramsReused = 0;
+   uint64 paramsAllocated = 0;
+   char line[512];
+
+   ASSERT(printFunc);
+
+   if (!gHgfsInitialized) {
+      printFunc(clientData, "HGFS server not initialized");
+      return;
+   }
+
+   if (NULL != gHgfsInputParamCacheLock) {
+      MXUser_AcquireExclLock(gHgfsInputParamCacheLock);
+      paramsReused = gHgfsInputParamCacheHits;
+      paramsAllocated = gHgfsInputParamCacheMisses;
+      MXUser_ReleaseExclLock(gHgfsInputParamCacheLock);
+   }
+   HgfsArenaGetStats(&arenaStats);
+
+   Str_Snprintf(line, sizeof line,
+                "requests %"FMT64"u: inputParams reused %"FMT64"u "
+                "allocated %"FMT64"u arena allocs %"FMT64"u "
+                "inlineBytes %"FMT64"u peakInlineBytes %"FMT64"u "
+                "heapAllocs %"FMT64"u heapBytes %"FMT64"u",
+                arenaStats.requests, paramsReused, paramsAllocated,
+                arenaStats.allocCount, arenaStats.inlineBytes,
+                arenaStats.peakInlineBytes, arenaStats.overflowCount,
+                arenaStats.overflowBytes);
+   printFunc(clientData, line);
+
+   MXUser_AcquireExclLock(gHgfsTransportSessionListLock);
+   DblLnkLst_ForEach(currTransport, &gHgfsTransportSessionList) {
+      HgfsTransportSessionInfo *transportSession;
+      DblLnkLst_Links *currSession;
+
+      transportSession = DblLnkLst_Container(currTransport,
+                                             HgfsTransportSessionInfo, links);
+
+      MXUser_AcquireExclLock(transportSession->sessionArrayLock);
+      DblLnkLst_ForEach(currSession, &transportSession->sessionArray) {
+         HgfsSessionInfo *session;
+         DblLnkLst_Links *currSearch;
+         uint32 openNodes;
+         uint32 lockedNodes;
+         uint32 freeSearches = 0;
+         uint32 numSearches;
+         HgfsOp op;
+
+         session = DblLnkLst_Container(currSession, HgfsSessionInfo, links);
+
+         MXUser_AcquireExclLock(session->nodeArrayLock);
+         openNodes = session->numCachedOpenNodes;
+         lockedNodes = session->numCachedLockedNodes;
+         MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+         MXUser_AcquireExclLock(session->searchArrayLock);
+         numSearches = session->numSearches;
+         DblLnkLst_ForEach(currSearch, &session->searchFreeList) {
+            freeSearches++;
+         }
+         MXUser_ReleaseExclLock(session->searchArrayLock);
+
+         Str_Snprintf(line, sizeof line,
+                      "session %"FMT64"x: openNodes %u lockedNodes %u "
+                      "searches %u evictions %"FMT64"u",
+                      session->sessionId, openNodes, lockedNodes,
+                      numSearches - freeSearches,
+                      Atomic_Read64(&session->numNodeEvictions));
+         printFunc(clientData, line);
+
+         for (op = 0; op < HGFS_OP_MAX; op++) {
+            HgfsOpStats *stats = &session->opStats[op];
+            uint64 count = Atomic_Read64(&stats->count);
+            size_t len;
+            unsigned int i;
+
+            if (0 == count) {
+               continue;
+            }
+
+            len = Str_Snprintf(line, sizeof line,
+                               "  op %u: count %"FMT64"u errors %"FMT64"u "
+                               "avgLatency %"FMT64"uus latency",
+                               op, count, Atomic_Read64(&stats->errors),
+                               Atomic_Read64(&stats->totalLatency) / count);
+            for (i = 0; i < HGFS_STATS_LATENCY_BUCKETS; i++) {
+               uint32 bucketCount = Atomic_Read(&stats->latency[i]);
+               int n;
+
+               if (0 == bucketCount) {
+                  continue;
+               }
+               n = Str_Snprintf(line + len, sizeof line - len,
+                                i < HGFS_STATS_LATENCY_BUCKETS - 1 ?
+                                " <%uus:%u" : " >=%uus:%u",
+                                i < HGFS_STATS_LATENCY_BUCKETS - 1 ?
+                                2u << i : 1u << i, bucketCount);
+               if (n < 0) {
+                  break;
+               }
+               len += n;
+            }
+            printFunc(clientData, line);
+         }
+      }
+      MXUser_ReleaseExclLock(transportSession->sessionArrayLock);
+   }
+   MXUser_ReleaseExclLock(gHgfsTransportSessionListLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4173,6 +4599,11 @@ HgfsServerSessionConnect(void *transportData,                         // IN: tra
    /* Give our session a reference to hold while we are open. */
    HgfsServerTransportSessionGet(transportSession);
 
+   DblLnkLst_Init(&transportSession->links);
+   MXUser_AcquireExclLock(gHgfsTransportSessionListLock);
+   DblLnkLst_LinkLast(&gHgfsTransportSessionList, &transportSession->links);
+   MXUser_ReleaseExclLock(gHgfsTransportSessionListLock);
+
    *transportSessionData = transportSession;
    return TRUE;
 }
@@ -5049,8 +5480,9 @@ HgfsServerStatFs(const char *pathName, // IN: Path we're interested in
  *    Construct local name based on the crossplatform CPName for the file and the
  *    share information.
  *
- *    The name returned is allocated and must be freed by the caller.
- *    The name length is optionally returned.
+ *    If an arena is supplied the name is allocated from it and is released
+ *    with the request, otherwise it is allocated and must be freed by the
+ *    caller. The name length is optionally returned.
  *
  * Results:
  *    A status code indicating either success (correspondent share exists) or
@@ -5067,6 +5499,7 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
                            size_t cpNameSize,       // IN:  Size of name cpName
                            uint32 caseFlags,        // IN:  Case-sensitivity flags
                            HgfsShareInfo *shareInfo,// OUT: properties of the shared folder
+                           HgfsArena *arena,        // IN/OUT: request arena optional
                            char **bufOut,           // OUT: File name in local fs
                            size_t *outLen)          // OUT: Length of name out optional
 {
@@ -5141,7 +5574,11 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
     */
 
    outSize = HGFS_PATH_MAX;
-   myBufOut = (char *) malloc(outSize * sizeof *myBufOut);
+   if (NULL != arena) {
+      myBufOut = HgfsArenaAlloc(arena, outSize * sizeof *myBufOut);
+   } else {
+      myBufOut = (char *) malloc(outSize * sizeof *myBufOut);
+   }
    if (!myBufOut) {
       LOG(4, ("%s: out of memory allocating string\n", __FUNCTION__));
 
@@ -5258,7 +5695,16 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
          goto error;
       }
 
-      free(myBufOut);
+      if (NULL != arena) {
+         myBufOut = HgfsArenaStrndup(arena, tempPtr, nameLen);
+         free(tempPtr);
+         if (NULL == myBufOut) {
+            return HGFS_NAME_STATUS_OUT_OF_MEMORY;
+         }
+         tempPtr = myBufOut;
+      } else {
+         free(myBufOut);
+      }
       LOG(4, ("%s: name is \"%s\"\n", __FUNCTION__, tempPtr));
 
       /* Save returned pointers, update buffer length. */
@@ -5290,8 +5736,20 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
          goto error;
       }
 
-      free(myBufOut);
-      myBufOut = convertedMyBufOut;
+      if (NULL != arena) {
+         /* The working buffer stays in the arena until the request is done. */
+         myBufOut = HgfsArenaStrndup(arena, convertedMyBufOut,
+                                     convertedMyBufOutLen);
+         free(convertedMyBufOut);
+         if (NULL == myBufOut) {
+            LOG(4, ("%s: out of memory copying converted name\n",
+                    __FUNCTION__));
+            return HGFS_NAME_STATUS_OUT_OF_MEMORY;
+         }
+      } else {
+         free(myBufOut);
+         myBufOut = convertedMyBufOut;
+      }
       myBufOutLen = convertedMyBufOutLen;
       ASSERT(myBufOut);
    }
@@ -5317,7 +5775,7 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
       }
    }
 
-   {
+   if (NULL == arena) {
       char *p;
 
       /* Trim unused memory */
@@ -5329,10 +5787,10 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
       } else {
          myBufOut = p;
       }
+   }
 
-      if (outLen) {
-         *outLen = myBufOutLen;
-      }
+   if (outLen) {
+      *outLen = myBufOutLen;
    }
 
    LOG(4, ("%s: name is \"%s\"\n", __FUNCTION__, myBufOut));
@@ -5342,7 +5800,9 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    return HGFS_NAME_STATUS_COMPLETE;
 
 error:
-   free(myBufOut);
+   if (NULL == arena) {
+      free(myBufOut);
+   }
 
    return nameStatus;
 }
@@ -5775,6 +6235,7 @@ HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
          LOG(4, ("%s: Could not remove the node from cache.\n", __FUNCTION__));
          return FALSE;
       }
+      Atomic_Inc64(&session->numNodeEvictions);
    } else {
       LOG(4, ("%s: Could not find a node to remove from cache.\n", __FUNCTION__));
       return FALSE;
@@ -6125,38 +6586,52 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
    case HGFS_OP_READ_FAST_V4:
    case HGFS_OP_READ_V3: {
          HgfsReplyReadV3 *reply = replyRead;
-         void *payload;
+         void *payload = NULL;
+         HgfsVmxIov *payloadIov = NULL;
+         uint32 payloadIovCount = 0;
          Bool readUseDataBuffer = replyReadDataSize != 0;
 
          /*
           * The read data size holds the size of the data to read which will be read
           * into the separate data packet buffer. Zero indicates data is read into the
           * same buffer as the reply arguments.
+          *
+          * When the data packet is in guest memory read straight into its
+          * mappings rather than into a bounce buffer which is copied out later.
           */
          if (readUseDataBuffer) {
-            payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
-                                            input->transportSession->channelCbTable);
+            payloadIov = HSPU_GetDataPacketIov(input->packet, BUF_WRITEABLE,
+                                               input->transportSession->channelCbTable,
+                                               &payloadIovCount);
+            if (NULL == payloadIov) {
+               payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
+                                               input->transportSession->channelCbTable);
+            }
          } else {
             payload = &reply->payload[0];
          }
-         if (payload) {
+         if (payloadIov) {
+            status = HgfsPlatformReadFileV(readFd, input->session, offset,
+                                           requiredSize, payloadIov,
+                                           payloadIovCount, &reply->actualSize);
+         } else if (payload) {
             status = HgfsPlatformReadFile(readFd, input->session, offset,
                                           requiredSize, payload,
                                           &reply->actualSize);
-            if (HGFS_ERROR_SUCCESS == status) {
-               reply->reserved = 0;
-               replyPayloadSize = sizeof *reply;
-
-               if (readUseDataBuffer) {
-                  HSPU_SetDataPacketSize(input->packet, reply->actualSize);
-               } else {
-                  replyPayloadSize += reply->actualSize;
-               }
-            }
          } else {
             status = HGFS_ERROR_PROTOCOL;
             LOG(4, ("%s: V3/V4 Failed to get payload -> PROTOCOL_ERROR.\n", __FUNCTION__));
          }
+         if (HGFS_ERROR_SUCCESS == status) {
+            reply->reserved = 0;
+            replyPayloadSize = sizeof *reply;
+
+            if (readUseDataBuffer) {
+               HSPU_SetDataPacketSize(input->packet, reply->actualSize);
+            } else {
+               replyPayloadSize += reply->actualSize;
+            }
+         }
          break;
       }
    case HGFS_OP_READ: {
@@ -6205,6 +6680,8 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
    HgfsWriteFlags flags;
    uint64 offset;
    const void *dataToWrite;
+   HgfsVmxIov *dataToWriteIov = NULL;
+   uint32 dataToWriteIovCount = 0;
    uint32 replyActualSize;
    size_t replyPayloadSize = 0;
    HgfsHandle file;
@@ -6222,17 +6699,29 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
    if (NULL == dataToWrite) {
       /* No inline data to write, get it from the transport shared memory. */
       HSPU_SetDataPacketSize(input->packet, numberBytesToWrite);
-      dataToWrite = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
-                                          input->transportSession->channelCbTable);
-      if (NULL == dataToWrite) {
-         LOG(4, ("%s: Error: Op %d mapping write data buffer\n", __FUNCTION__, input->op));
-         status = HGFS_ERROR_PROTOCOL;
-         goto exit;
+      dataToWriteIov = HSPU_GetDataPacketIov(input->packet, BUF_READABLE,
+                                             input->transportSession->channelCbTable,
+                                             &dataToWriteIovCount);
+      if (NULL == dataToWriteIov) {
+         dataToWrite = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
+                                             input->transportSession->channelCbTable);
+         if (NULL == dataToWrite) {
+            LOG(4, ("%s: Error: Op %d mapping write data buffer\n", __FUNCTION__, input->op));
+            status = HGFS_ERROR_PROTOCOL;
+            goto exit;
+         }
       }
    }
 
-   status = HgfsPlatformWriteFile(file, input->session, offset, numberBytesToWrite,
-                                  flags, dataToWrite, &replyActualSize);
+   if (NULL != dataToWriteIov) {
+      /* Write straight from the guest memory mappings, no bounce buffer. */
+      status = HgfsPlatformWriteFileV(file, input->session, offset, numberBytesToWrite,
+                                      flags, dataToWriteIov, dataToWriteIovCount,
+                                      &replyActualSize);
+   } else {
+      status = HgfsPlatformWriteFile(file, input->session, offset, numberBytesToWrite,
+                                     flags, dataToWrite, &replyActualSize);
+   }
    if (HGFS_ERROR_SUCCESS != status) {
       goto exit;
    }
@@ -6247,6 +6736,102 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCopyFileRange --
+ *
+ *    Handle a copy file range request. The data is copied between the two
+ *    files on the host and never transferred to or from the client.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCopyFileRange(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsInternalStatus status;
+   HgfsHandle srcFile;
+   HgfsHandle dstFile;
+   uint64 srcOffset;
+   uint64 dstOffset;
+   uint64 requiredSize;
+   uint64 actualSize = 0;
+   fileDesc srcFd;
+   fileDesc dstFd;
+   Bool sequentialOpen;
+   size_t replyPayloadSize = 0;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackCopyFileRangeRequest(input->payload, input->payloadSize,
+                                       input->op, &srcFile, &srcOffset,
+                                       &dstFile, &dstOffset, &requiredSize)) {
+      LOG(4, ("%s: Failed to unpack a valid packet -> PROTOCOL_ERROR.\n", __FUNCTION__));
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
+   /* Positional copies make no sense for files opened for sequential access. */
+   if (!HgfsHandleIsSequentialOpen(srcFile, input->session, &sequentialOpen) ||
+       sequentialOpen ||
+       !HgfsHandleIsSequentialOpen(dstFile, input->session, &sequentialOpen) ||
+       sequentialOpen) {
+      LOG(4, ("%s: Error: invalid handles %u %u\n", __FUNCTION__,
+              srcFile, dstFile));
+      status = HGFS_ERROR_INVALID_PARAMETER;
+      goto exit;
+   }
+
+   requiredSize = MIN(requiredSize, HGFS_COPY_FILE_RANGE_MAX);
+
+   /*
+    * Validate the handles by retrieving their descriptors, possibly from the
+    * cache. Retrieving the target may evict the source from the cache, which
+    * closes its descriptor: with a cache too small to hold both, the copy
+    * is refused and the client falls back to reading and writing.
+    */
+   status = HgfsPlatformGetFd(srcFile, input->session, FALSE, &srcFd);
+   if (status != HGFS_ERROR_SUCCESS) {
+      LOG(4, ("%s: Error: source handle %u -> %d.\n", __FUNCTION__,
+              srcFile, status));
+      goto exit;
+   }
+   status = HgfsPlatformGetFd(dstFile, input->session, FALSE, &dstFd);
+   if (status != HGFS_ERROR_SUCCESS) {
+      LOG(4, ("%s: Error: target handle %u -> %d.\n", __FUNCTION__,
+              dstFile, status));
+      goto exit;
+   }
+   if (!HgfsIsCached(srcFile, input->session)) {
+      LOG(4, ("%s: Error: source handle %u evicted.\n", __FUNCTION__, srcFile));
+      status = HGFS_ERROR_NOT_SUPPORTED;
+      goto exit;
+   }
+
+   status = HgfsPlatformCopyFileRange(srcFd, srcOffset, dstFd, dstOffset,
+                                      requiredSize, &actualSize);
+   if (status != HGFS_ERROR_SUCCESS) {
+      goto exit;
+   }
+
+   if (!HgfsPackCopyFileRangeReply(input->packet, input->request, input->op,
+                                   actualSize, &replyPayloadSize,
+                                   input->session)) {
+      status = HGFS_ERROR_INTERNAL;
+   }
+
+exit:
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -6270,6 +6855,7 @@ exit:
  */
 static HgfsInternalStatus
 HgfsServerQueryVolInt(HgfsSessionInfo *session,   // IN: session info
+                      HgfsArena *arena,           // IN/OUT: request arena
                       const char *fileName,       // IN: cpName for the volume
                       size_t fileNameLength,      // IN: cpName length
                       uint32 caseFlags,           // IN: case sensitive/insensitive name
@@ -6293,6 +6879,7 @@ HgfsServerQueryVolInt(HgfsSessionInfo *session,   // IN: session info
                                            fileNameLength,
                                            caseFlags,
                                            &shareInfo,
+                                           arena,
                                            &utf8Name,
                                            &utf8NameLen);
 
@@ -6304,7 +6891,6 @@ HgfsServerQueryVolInt(HgfsSessionInfo *session,   // IN: session info
       LOG(4,("%s: querying path %s\n", __FUNCTION__, utf8Name));
       success = HgfsServerStatFs(utf8Name, utf8NameLen,
                                  &outFreeBytes, &outTotalBytes);
-      free(utf8Name);
       if (!success) {
          LOG(4, ("%s: error getting volume information\n", __FUNCTION__));
          status = HGFS_ERROR_IO;
@@ -6390,6 +6976,7 @@ HgfsServerQueryVolume(HgfsInputParam *input)  // IN: Input params
          status = HGFS_ERROR_INVALID_PARAMETER;
       } else {
          status = HgfsServerQueryVolInt(input->session,
+                                        &input->arena,
                                         fileName,
                                         fileNameLength,
                                         caseFlags,
@@ -6432,6 +7019,7 @@ HgfsServerQueryVolume(HgfsInputParam *input)  // IN: Input params
 
 HgfsInternalStatus
 HgfsSymlinkCreate(HgfsSessionInfo *session, // IN: session info,
+                  HgfsArena *arena,         // IN/OUT: request arena
                   const char *srcFileName,  // IN: symbolic link file name
                   uint32 srcFileNameLength, // IN: symbolic link name length
                   uint32 srcCaseFlags,      // IN: symlink case flags
@@ -6456,6 +7044,7 @@ HgfsSymlinkCreate(HgfsSessionInfo *session, // IN: session info,
                                            srcFileNameLength,
                                            srcCaseFlags,
                                            &shareInfo,
+                                           arena,
                                            &localSymlinkName,
                                            &localSymlinkNameLen);
    if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
@@ -6496,7 +7085,6 @@ HgfsSymlinkCreate(HgfsSessionInfo *session, // IN: session info,
       status = HgfsPlatformSymlinkCreate(localSymlinkName, localTargetName);
    }
 
-   free(localSymlinkName);
    return status;
 }
 
@@ -6548,9 +7136,10 @@ HgfsServerSymlinkCreate(HgfsInputParam *input)  // IN: Input params
          LOG(4, ("%s: Doesn't support file handle.\n", __FUNCTION__));
          status = HGFS_ERROR_INVALID_PARAMETER;
       } else {
-         status = HgfsSymlinkCreate(input->session, srcFileName, srcFileNameLength,
-                                    srcCaseFlags, trgFileName, trgFileNameLength,
-                                    trgCaseFlags);
+         status = HgfsSymlinkCreate(input->session, &input->arena,
+                                    srcFileName, srcFileNameLength,
+                                    srcCaseFlags, trgFileName,
+                                    trgFileNameLength, trgCaseFlags);
          if (HGFS_ERROR_SUCCESS == status) {
             if (!HgfsPackSymlinkCreateReply(input->packet, input->request, input->op,
                                             &replyPayloadSize, input->session)) {
@@ -6601,7 +7190,8 @@ HgfsServerSearchOpen(HgfsInputParam *input)  // IN: Input params
    if (HgfsUnpackSearchOpenRequest(input->payload, input->payloadSize, input->op,
                                    &dirName, &dirNameLength, &caseFlags)) {
       nameStatus = HgfsServerGetLocalNameInfo(dirName, dirNameLength, caseFlags,
-                                              &shareInfo, &baseDir, &baseDirLen);
+                                              &shareInfo, &input->arena,
+                                              &baseDir, &baseDirLen);
       status = HgfsPlatformSearchDir(nameStatus, dirName, dirNameLength, caseFlags,
                                      &shareInfo, baseDir, baseDirLen,
                                      input->session, &search);
@@ -6616,7 +7206,6 @@ HgfsServerSearchOpen(HgfsInputParam *input)  // IN: Input params
    }
 
    HgfsServerCompleteRequest(status, replyPayloadSize, input);
-   free(baseDir);
 }
 
 
@@ -6684,6 +7273,7 @@ HgfsValidateRenameFile(Bool useHandle,            // IN:
                                               cpNameLength,
                                               caseFlags,
                                               shareInfo,
+                                              NULL,
                                               localFileName,
                                               localNameLength);
       if (HGFS_NAME_STATUS_COMPLETE != nameStatus) {
@@ -6884,7 +7474,8 @@ HgfsServerCreateDir(HgfsInputParam *input)  // IN: Input params
    if (HgfsUnpackCreateDirRequest(input->payload, input->payloadSize,
                                   input->op, &info)) {
       nameStatus = HgfsServerGetLocalNameInfo(info.cpName, info.cpNameSize, info.caseFlags,
-                                              &shareInfo, &utf8Name, &utf8NameLen);
+                                              &shareInfo, &input->arena,
+                                              &utf8Name, &utf8NameLen);
       if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
          ASSERT(utf8Name);
 
@@ -6939,7 +7530,6 @@ HgfsServerCreateDir(HgfsInputParam *input)  // IN: Input params
    }
 
    HgfsServerCompleteRequest(status, replyPayloadSize, input);
-   free(utf8Name);
 }
 
 
@@ -6990,7 +7580,9 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
          char *utf8Name = NULL;
          size_t utf8NameLen;
 
-         nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags, &shareInfo,
+         nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize,
+                                                 caseFlags, &shareInfo,
+                                                 &input->arena,
                                                  &utf8Name, &utf8NameLen);
          if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
             /*
@@ -7017,7 +7609,6 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
                LOG(4, ("%s: deleting \"%s\"\n", __FUNCTION__, utf8Name));
                status = HgfsPlatformDeleteFileByName(utf8Name);
             }
-            free(utf8Name);
          } else {
             LOG(4, ("%s: Shared folder does not exist.\n", __FUNCTION__));
             status = HgfsPlatformConvertFromNameStatus(nameStatus);
@@ -7100,7 +7691,9 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
          char *utf8Name = NULL;
          size_t utf8NameLen;
 
-         nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags, &shareInfo,
+         nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize,
+                                                 caseFlags, &shareInfo,
+                                                 &input->arena,
                                                  &utf8Name, &utf8NameLen);
          if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
             ASSERT(utf8Name);
@@ -7123,7 +7716,6 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
                LOG(4, ("%s: removing \"%s\"\n", __FUNCTION__, utf8Name));
                status = HgfsPlatformDeleteDirByName(utf8Name);
             }
-            free(utf8Name);
          } else {
             LOG(4, ("%s: access check failed\n", __FUNCTION__));
             status = HgfsPlatformConvertFromNameStatus(nameStatus);
@@ -7307,7 +7899,8 @@ HgfsServerSetDirWatchByName(HgfsInputParam *input,         // IN: Input params
 
    LOG(8, ("%s: entered\n",__FUNCTION__));
 
-   nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags, &shareInfo,
+   nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags,
+                                           &shareInfo, &input->arena,
                                            &utf8Name, &utf8NameLen);
    if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
       char const *inEnd = cpName + cpNameSize;
@@ -7376,7 +7969,6 @@ HgfsServerSetDirWatchByName(HgfsInputParam *input,         // IN: Input params
       LOG(4, ("%s: file not found.\n", __FUNCTION__));
       status = HgfsPlatformConvertFromNameStatus(nameStatus);
    }
-   free(utf8Name);
    LOG(8, ("%s: exit %u\n",__FUNCTION__, status));
    return status;
 }
@@ -7570,7 +8162,9 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
           * Depending on whether this file/dir is real or virtual, either
           * forge its attributes or look them up in the actual filesystem.
           */
-         nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags, &shareInfo,
+         nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize,
+                                                 caseFlags, &shareInfo,
+                                                 &input->arena,
                                                  &localName, &localNameLen);
          switch (nameStatus) {
          case HGFS_NAME_STATUS_INCOMPLETE_BASE:
@@ -7636,7 +8230,6 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
    }
 
    free(targetName);
-   free(localName);
 
    HgfsServerCompleteRequest(status, replyPayloadSize, input);
 }
@@ -7704,6 +8297,7 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
                                                  cpNameSize,
                                                  caseFlags,
                                                  &shareInfo,
+                                                 &input->arena,
                                                  &utf8Name,
                                                  &utf8NameLen);
          if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
@@ -7737,7 +8331,6 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
                                                     hints,
                                                     useHostTime);
             }
-            free(utf8Name);
          } else {
             LOG(4, ("%s: file not found.\n", __FUNCTION__));
             status = HgfsPlatformConvertFromNameStatus(nameStatus);
@@ -7770,13 +8363,14 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
  *    Appropriate error code otherwise.
  *
  * Side effects:
- *    None
+ *    Sets openInfo->utf8Name, allocated from the request arena.
  *
  *-----------------------------------------------------------------------------
  */
 
 static HgfsInternalStatus
 HgfsServerValidateOpenParameters(HgfsFileOpenInfo *openInfo, // IN/OUT: openfile info
+                                 HgfsArena *arena,           // IN/OUT: request arena
                                  Bool *denyCreatingFile,     // OUT: No new files
                                  int *followSymlinks)        // OUT: Host resolves link
 {
@@ -7793,6 +8387,7 @@ HgfsServerValidateOpenParameters(HgfsFileOpenInfo *openInfo, // IN/OUT: openfile
                                               openInfo->cpNameSize,
                                               openInfo->caseFlags,
                                               &openInfo->shareInfo,
+                                              arena,
                                               &openInfo->utf8Name,
                                               &utf8NameLen);
       if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
@@ -7891,7 +8486,8 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
       int followSymlinks;
       Bool denyCreatingFile;
 
-      status = HgfsServerValidateOpenParameters(&openInfo, &denyCreatingFile,
+      status = HgfsServerValidateOpenParameters(&openInfo, &input->arena,
+                                                &denyCreatingFile,
                                                 &followSymlinks);
       if (HGFS_ERROR_SUCCESS == status) {
          ASSERT(openInfo.utf8Name);
@@ -7948,7 +8544,6 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
          } else {
             status = HGFS_ERROR_PATH_BUSY;
          }
-         free(openInfo.utf8Name);
       }
    } else {
       status = HGFS_ERROR_PROTOCOL;
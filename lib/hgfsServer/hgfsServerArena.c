@@ -0,0 +1,260 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerArena.c --
+ *
+ * Per-request bump allocator used by the hgfs server for scratch memory
+ * whose lifetime ends when the request's reply has been sent.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "hgfsServer.h"
+#include "hgfsServerInt.h"
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+/* All allocations are aligned to this boundary. */
+#define HGFS_ARENA_ALIGN      (sizeof (uint64))
+
+struct HgfsArenaBlock {
+   HgfsArenaBlock *next;
+   uint64 data[1];            /* Start of the allocation, uint64 aligned */
+};
+
+/*
+ * Usage of every arena released so far. Requests run on several threads,
+ * so the counters are atomic.
+ */
+static struct {
+   Atomic_uint64 requests;
+   Atomic_uint64 allocCount;
+   Atomic_uint64 inlineBytes;
+   Atomic_uint64 peakInlineBytes;
+   Atomic_uint64 overflowCount;
+   Atomic_uint64 overflowBytes;
+} gHgfsArenaStats;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsArenaInit --
+ *
+ *    Initializes an arena to hand out memory from the caller's buffer.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsArenaInit(HgfsArena *arena,    // OUT: arena
+              void *buffer,        // IN: inline buffer
+              size_t bufferSize)   // IN: inline buffer size
+{
+   ASSERT(arena);
+   ASSERT(buffer != NULL || bufferSize == 0);
+
+   memset(arena, 0, sizeof *arena);
+   arena->base = buffer;
+   arena->size = bufferSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsArenaAlloc --
+ *
+ *    Allocates memory from the arena. The memory is valid until the arena
+ *    is reset and must not be freed individually.
+ *
+ * Results:
+ *    Pointer to the memory, or NULL if a heap spill allocation failed.
+ *
+ * Side effects:
+ *    May allocate a heap block if the inline buffer is exhausted.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void *
+HgfsArenaAlloc(HgfsArena *arena,   // IN/OUT: arena
+               size_t size)        // IN: bytes to allocate
+{
+   HgfsArenaBlock *block;
+   size_t alignedSize;
+
+   ASSERT(arena);
+
+   alignedSize = (size + HGFS_ARENA_ALIGN - 1) & ~(HGFS_ARENA_ALIGN - 1);
+   if (alignedSize < size) {
+      return NULL;
+   }
+   arena->allocCount++;
+
+   if (alignedSize <= arena->size - arena->used) {
+      void *result = arena->base + arena->used;
+
+      arena->used += alignedSize;
+      if (arena->used > arena->peakUsed) {
+         arena->peakUsed = arena->used;
+      }
+      return result;
+   }
+
+   block = malloc(offsetof(HgfsArenaBlock, data) + alignedSize);
+   if (NULL == block) {
+      LOG(4, ("%s: failed to allocate %"FMTSZ"u bytes\n", __FUNCTION__, size));
+      return NULL;
+   }
+   block->next = arena->overflow;
+   arena->overflow = block;
+   arena->overflowCount++;
+   arena->overflowBytes += alignedSize;
+
+   return block->data;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsArenaStrndup --
+ *
+ *    Copies len bytes of the string into the arena and NUL terminates it.
+ *
+ * Results:
+ *    Pointer to the copy, or NULL on allocation failure.
+ *
+ * Side effects:
+ *    See HgfsArenaAlloc.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+char *
+HgfsArenaStrndup(HgfsArena *arena, // IN/OUT: arena
+                 const char *str,  // IN: string to copy
+                 size_t len)       // IN: string length
+{
+   char *result;
+
+   ASSERT(str);
+
+   result = HgfsArenaAlloc(arena, len + 1);
+   if (NULL != result) {
+      memcpy(result, str, len);
+      result[len] = '\0';
+   }
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsArenaReset --
+ *
+ *    Releases every allocation made from the arena so the inline buffer
+ *    can be reused by the next request, and adds the arena's usage to the
+ *    accumulated statistics.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Frees any heap spill blocks. Updates the arena statistics.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsArenaReset(HgfsArena *arena)   // IN/OUT: arena
+{
+   uint64 peak;
+
+   ASSERT(arena);
+
+   Atomic_Inc64(&gHgfsArenaStats.requests);
+   Atomic_Add64(&gHgfsArenaStats.allocCount, arena->allocCount);
+   Atomic_Add64(&gHgfsArenaStats.inlineBytes, arena->used);
+   Atomic_Add64(&gHgfsArenaStats.overflowCount, arena->overflowCount);
+   Atomic_Add64(&gHgfsArenaStats.overflowBytes, arena->overflowBytes);
+   do {
+      peak = Atomic_Read64(&gHgfsArenaStats.peakInlineBytes);
+   } while (arena->peakUsed > peak &&
+            Atomic_ReadIfEqualWrite64(&gHgfsArenaStats.peakInlineBytes, peak,
+                                      arena->peakUsed) != peak);
+
+   if (NULL != arena->overflow) {
+      LOG(4, ("%s: %u spill allocations, %"FMTSZ"u bytes, "
+              "peak inline %"FMTSZ"u\n", __FUNCTION__, arena->overflowCount,
+              arena->overflowBytes, arena->peakUsed));
+   }
+
+   while (NULL != arena->overflow) {
+      HgfsArenaBlock *block = arena->overflow;
+
+      arena->overflow = block->next;
+      free(block);
+   }
+   arena->used = 0;
+   arena->peakUsed = 0;
+   arena->allocCount = 0;
+   arena->overflowCount = 0;
+   arena->overflowBytes = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsArenaGetStats --
+ *
+ *    Returns the usage of every arena released since the server started.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsArenaGetStats(HgfsArenaStats *stats)  // OUT: accumulated usage
+{
+   ASSERT(stats);
+
+   stats->requests = Atomic_Read64(&gHgfsArenaStats.requests);
+   stats->allocCount = Atomic_Read64(&gHgfsArenaStats.allocCount);
+   stats->inlineBytes = Atomic_Read64(&gHgfsArenaStats.inlineBytes);
+   stats->peakInlineBytes = Atomic_Read64(&gHgfsArenaStats.peakInlineBytes);
+   stats->overflowCount = Atomic_Read64(&gHgfsArenaStats.overflowCount);
+   stats->overflowBytes = Atomic_Read64(&gHgfsArenaStats.overflowBytes);
+}
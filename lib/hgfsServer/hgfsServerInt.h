@@ -111,6 +111,65 @@ typedef struct HgfsShareInfo {
    HgfsSharedFolderHandle handle;
 } HgfsShareInfo;
 
+/*
+ * Read access pattern of an open file as detected from the offsets of the
+ * client's recent reads. Used to give the host OS caching hints.
+ */
+typedef enum {
+   HGFS_ACCESS_PATTERN_UNKNOWN,
+   HGFS_ACCESS_PATTERN_SEQUENTIAL,
+   HGFS_ACCESS_PATTERN_RANDOM,
+} HgfsAccessPattern;
+
+/*
+ * Readahead advice for a read computed from the file's access pattern.
+ */
+typedef struct HgfsReadAdvice {
+   /* Set if the access pattern changed and must be applied to the file. */
+   Bool patternChanged;
+
+   /* Current access pattern of the file. */
+   HgfsAccessPattern pattern;
+
+   /* Region to prefetch ahead of the client, zero length if none. */
+   uint64 readaheadOffset;
+   uint32 readaheadLength;
+} HgfsReadAdvice;
+
+/*
+ * Per-request bump allocator.
+ *
+ * Scratch memory needed only for the lifetime of a single request (local
+ * names, temporary conversion buffers) is carved out of a buffer owned by
+ * the request's input params. Allocations that do not fit spill over into
+ * heap blocks which are released when the arena is reset.
+ */
+typedef struct HgfsArenaBlock HgfsArenaBlock;
+
+typedef struct HgfsArena {
+   char *base;                /* Inline buffer supplied by the owner */
+   size_t size;               /* Size of the inline buffer */
+   size_t used;               /* Bytes handed out from the inline buffer */
+   HgfsArenaBlock *overflow;  /* Heap blocks for allocations that do not fit */
+   size_t peakUsed;           /* High water mark of the inline buffer */
+   uint32 allocCount;         /* Number of allocations */
+   uint32 overflowCount;      /* Number of heap spill allocations */
+   size_t overflowBytes;      /* Bytes allocated from the heap */
+} HgfsArena;
+
+/*
+ * Arena usage accumulated over every request since the server started,
+ * reported by HgfsServer_DumpStats.
+ */
+typedef struct HgfsArenaStats {
+   uint64 requests;           /* Arenas released, one per request */
+   uint64 allocCount;         /* Allocations made from arenas */
+   uint64 inlineBytes;        /* Bytes served from the inline buffers */
+   uint64 peakInlineBytes;    /* Most inline bytes used by one request */
+   uint64 overflowCount;      /* Allocations that spilled to the heap */
+   uint64 overflowBytes;      /* Bytes that spilled to the heap */
+} HgfsArenaStats;
+
 /*
  * This struct represents a file on the local filesystem that has been
  * opened by a remote client. We store the name of the local file and
@@ -173,6 +232,12 @@ typedef struct HgfsFileNode {
 
    /* Parameters associated with the share. */
    HgfsShareInfo shareInfo;
+
+   /* Read access pattern tracking, see HgfsHandleGetReadAdvice. */
+   HgfsAccessPattern accessPattern;
+   int32 sequentialScore;
+   uint64 nextReadOffset;
+   uint64 readaheadEnd;
 } HgfsFileNode;
 
 
@@ -248,6 +313,20 @@ typedef enum {
    HGFS_SESSION_STATE_CLOSED,
 } HgfsSessionInfoState;
 
+/*
+ * Per operation statistics kept by each session. Latencies are counted in
+ * buckets of powers of two microseconds: bucket i holds requests that took
+ * less than 2^(i+1) us, the last bucket holds everything slower.
+ */
+#define HGFS_STATS_LATENCY_BUCKETS 16
+
+typedef struct HgfsOpStats {
+   Atomic_uint64 count;          /* Requests completed. */
+   Atomic_uint64 errors;         /* Requests completed with an error. */
+   Atomic_uint64 totalLatency;   /* Sum of the request latencies in us. */
+   Atomic_uint32 latency[HGFS_STATS_LATENCY_BUCKETS];
+} HgfsOpStats;
+
 typedef struct HgfsSessionInfo {
 
    DblLnkLst_Links links;
@@ -326,6 +405,12 @@ typedef struct HgfsSessionInfo {
 
    uint32 numberOfCapabilities;
 
+   /* Request statistics, indexed by op. */
+   HgfsOpStats opStats[HGFS_OP_MAX];
+
+   /* Open nodes closed to make room in the node cache. */
+   Atomic_uint64 numNodeEvictions;
+
 } HgfsSessionInfo;
 
 /*
@@ -636,6 +721,13 @@ HgfsHandleIsSequentialOpen(HgfsHandle handle,        // IN:  Hgfs file handle
                            HgfsSessionInfo *session, // IN: session info
                            Bool *sequentialOpen);    // OUT: If open was sequential
 
+Bool
+HgfsHandleGetReadAdvice(HgfsHandle handle,         // IN: Hgfs file handle
+                        HgfsSessionInfo *session,  // IN: session info
+                        uint64 offset,             // IN: offset of the read
+                        uint32 requiredSize,       // IN: size of the read
+                        HgfsReadAdvice *advice);   // OUT: readahead advice
+
 Bool
 HgfsHandleIsSharedFolderOpen(HgfsHandle handle,        // IN:  Hgfs file handle
                              HgfsSessionInfo *session, // IN: session info
@@ -756,6 +848,30 @@ HgfsPlatformWriteFile(HgfsHandle file,             // IN: Hgfs file handle
                       const void *payload,         // IN: data to be written
                       uint32 *actualSize);         // OUT: actual length written
 HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc readFile,           // IN: file descriptor
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      HgfsVmxIov *iov,             // OUT: mapped buffers for the data
+                      uint32 iovCount,             // IN: number of mapped buffers
+                      uint32 *actualSize);         // OUT: actual length read
+HgfsInternalStatus
+HgfsPlatformWriteFileV(HgfsHandle file,             // IN: Hgfs file handle
+                       HgfsSessionInfo *session,    // IN: session info
+                       uint64 offset,               // IN: file offset to write to
+                       uint32 requiredSize,         // IN: length of data to write
+                       HgfsWriteFlags flags,        // IN: write flags
+                       HgfsVmxIov *iov,             // IN: mapped buffers of the data
+                       uint32 iovCount,             // IN: number of mapped buffers
+                       uint32 *actualSize);         // OUT: actual length written
+HgfsInternalStatus
+HgfsPlatformCopyFileRange(fileDesc srcFile,            // IN: file descriptor to copy from
+                          uint64 srcOffset,            // IN: offset to copy from
+                          fileDesc dstFile,            // IN: file descriptor to copy to
+                          uint64 dstOffset,            // IN: offset to copy to
+                          uint64 requiredSize,         // IN: length of data to copy
+                          uint64 *actualSize);         // OUT: actual length copied
+HgfsInternalStatus
 HgfsPlatformWriteWin32Stream(HgfsHandle file,           // IN: packet header
                              char *dataToWrite,         // IN: data to write
                              size_t requiredSize,       // IN: data size
@@ -831,6 +947,22 @@ HgfsPlatformValidateOpen(HgfsFileOpenInfo *openInfo, // IN: Open info struct
                          HgfsLocalId *localId,       // OUT: Local unique file ID
                          fileDesc *newHandle);       // OUT: Handle to the file
 
+void
+HgfsArenaInit(HgfsArena *arena,    // OUT: arena
+              void *buffer,        // IN: inline buffer
+              size_t bufferSize);  // IN: inline buffer size
+void *
+HgfsArenaAlloc(HgfsArena *arena,   // IN/OUT: arena
+               size_t size);       // IN: bytes to allocate
+char *
+HgfsArenaStrndup(HgfsArena *arena, // IN/OUT: arena
+                 const char *str,  // IN: string to copy
+                 size_t len);      // IN: string length
+void
+HgfsArenaReset(HgfsArena *arena);  // IN/OUT: arena
+void
+HgfsArenaGetStats(HgfsArenaStats *stats); // OUT: accumulated usage
+
 void *
 HSPU_GetMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                    size_t *metaPacketSize,               // OUT: Size of metaPacket
@@ -845,6 +977,12 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
                       MappingType mappingType,              // IN: Readable/ Writeable ?
                       HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
 
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Readable/ Writeable ?
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount);                    // OUT: mapped iov count
+
 void
 HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
                        size_t dataSize);              // IN: data size
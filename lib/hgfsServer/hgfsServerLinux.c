@@ -39,6 +39,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>  // for utimes(2)
+#include <sys/uio.h>   // for preadv(2)/pwritev(2)
 #include <sys/syscall.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -382,6 +383,22 @@ static HgfsInternalStatus HgfsWriteCheckIORange(off_t offset,
                                                 uint32 bytesToWrite);
 #endif
 
+/* Size of the buffer for copies the kernel cannot do for us. */
+#define HGFS_COPY_BUFFER_SIZE (1024 * 1024)
+static void HgfsReadAdvise(fileDesc file,
+                           HgfsHandle handle,
+                           HgfsSessionInfo *session,
+                           uint64 offset,
+                           uint32 requiredSize);
+#if defined(__linux__)
+static struct iovec *HgfsVmxIovToIovec(HgfsVmxIov *iov,
+                                       uint32 iovCount,
+                                       uint32 requiredSize,
+                                       struct iovec *localVec,
+                                       uint32 localVecCount,
+                                       int *vecCount);
+#endif
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4168,6 +4185,8 @@ HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
       return EBADF;
    }
 
+   HgfsReadAdvise(file, handle, session, offset, requiredSize);
+
 #if defined(__linux__) || defined(__APPLE__)
    /* Read from the file. */
    if (sequentialOpen) {
@@ -4351,6 +4370,500 @@ HgfsPlatformWriteFile(HgfsHandle file,             // IN: Hgfs file handle
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadFileV --
+ *
+ *    Reads data from a file directly into the mapped guest buffers of the
+ *    request's data packet. On Linux this is a single readv/preadv so no
+ *    intermediate contiguous buffer and copy is needed.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc file,               // IN: file descriptor
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      HgfsVmxIov *iov,             // OUT: mapped buffers for the data
+                      uint32 iovCount,             // IN: number of mapped buffers
+                      uint32 *actualSize)          // OUT: actual length read
+{
+   HgfsInternalStatus status = 0;
+#if defined(__linux__)
+   struct iovec localVec[HGFS_LARGE_IO_MAX_PAGES + 1];
+   struct iovec *vec;
+   int vecCount;
+   int error;
+   HgfsHandle handle;
+   Bool sequentialOpen;
+
+   ASSERT(session);
+   ASSERT(iov);
+
+   LOG(4, ("%s: read fh %u, offset %"FMT64"u, count %u, iovs %u\n", __FUNCTION__,
+           file, offset, requiredSize, iovCount));
+
+   if (!HgfsFileDesc2Handle(file, session, &handle)) {
+      LOG(4, ("%s: Could not get file handle\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   HgfsReadAdvise(file, handle, session, offset, requiredSize);
+
+   vec = HgfsVmxIovToIovec(iov, iovCount, requiredSize,
+                           localVec, ARRAYSIZE(localVec), &vecCount);
+
+   /* Read from the file. */
+   if (sequentialOpen) {
+      error = readv(file, vec, vecCount);
+   } else {
+      error = preadv(file, vec, vecCount, offset);
+   }
+
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error reading from file: %s\n", __FUNCTION__,
+              strerror(status)));
+   } else {
+      LOG(4, ("%s: read %d bytes\n", __FUNCTION__, error));
+      *actualSize = error;
+   }
+
+   if (vec != localVec) {
+      free(vec);
+   }
+#else
+   uint32 i;
+   uint32 totalRead = 0;
+
+   /* No portable preadv(2), read into each of the mapped buffers in turn. */
+   for (i = 0; i < iovCount && totalRead < requiredSize; i++) {
+      uint32 chunkSize = MIN(iov[i].len, requiredSize - totalRead);
+      uint32 chunkRead = 0;
+
+      status = HgfsPlatformReadFile(file, session, offset + totalRead,
+                                    chunkSize, iov[i].va, &chunkRead);
+      if (status != 0) {
+         break;
+      }
+      totalRead += chunkRead;
+      if (chunkRead < chunkSize) {
+         break;
+      }
+   }
+
+   if (status == 0 || totalRead != 0) {
+      status = 0;
+      *actualSize = totalRead;
+   }
+#endif
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteFileV --
+ *
+ *    Writes data to a file directly from the mapped guest buffers of the
+ *    request's data packet. On Linux this is a single writev/pwritev so no
+ *    intermediate contiguous buffer and copy is needed.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteFileV(HgfsHandle file,             // IN: Hgfs file handle
+                       HgfsSessionInfo *session,    // IN: session info
+                       uint64 offset,               // IN: file offset to write to
+                       uint32 requiredSize,         // IN: length of data to write
+                       HgfsWriteFlags flags,        // IN: write flags
+                       HgfsVmxIov *iov,             // IN: mapped buffers of the data
+                       uint32 iovCount,             // IN: number of mapped buffers
+                       uint32 *actualSize)          // OUT: actual length written
+{
+   HgfsInternalStatus status = 0;
+#if defined(__linux__)
+   struct iovec localVec[HGFS_LARGE_IO_MAX_PAGES + 1];
+   struct iovec *vec;
+   int vecCount;
+   int fd;
+   int error;
+   Bool sequentialOpen;
+
+   ASSERT(iov);
+
+   LOG(4, ("%s: write fh %u, offset %"FMT64"u, count %u, iovs %u\n",
+           __FUNCTION__, file, offset, requiredSize, iovCount));
+
+   /* Get the file desriptor from the cache */
+   status = HgfsPlatformGetFd(file, session,
+                              ((flags & HGFS_WRITE_APPEND) ? TRUE : FALSE),
+                              &fd);
+
+   if (status != 0) {
+      LOG(4, ("%s: Could not get file descriptor\n", __FUNCTION__));
+      return status;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(file, session, &sequentialOpen)) {
+      LOG(4, ("%s: Could not get sequential open status\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   if (!sequentialOpen) {
+      status = HgfsWriteCheckIORange(offset, requiredSize);
+      if (status != 0) {
+         return status;
+      }
+   }
+
+   vec = HgfsVmxIovToIovec(iov, iovCount, requiredSize,
+                           localVec, ARRAYSIZE(localVec), &vecCount);
+
+   /* Write to the file. */
+   if (sequentialOpen) {
+      error = writev(fd, vec, vecCount);
+   } else {
+      error = pwritev(fd, vec, vecCount, offset);
+   }
+
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
+         strerror(status)));
+   } else {
+      LOG(4, ("%s: wrote %d bytes\n", __FUNCTION__, error));
+      *actualSize = error;
+   }
+
+   if (vec != localVec) {
+      free(vec);
+   }
+#else
+   uint32 i;
+   uint32 totalWritten = 0;
+
+   /* No portable pwritev(2), write each of the mapped buffers in turn. */
+   for (i = 0; i < iovCount && totalWritten < requiredSize; i++) {
+      uint32 chunkSize = MIN(iov[i].len, requiredSize - totalWritten);
+      uint32 chunkWritten = 0;
+
+      status = HgfsPlatformWriteFile(file, session, offset + totalWritten,
+                                     chunkSize, flags, iov[i].va, &chunkWritten);
+      if (status != 0) {
+         break;
+      }
+      totalWritten += chunkWritten;
+      if (chunkWritten < chunkSize) {
+         break;
+      }
+   }
+
+   if (status == 0 || totalWritten != 0) {
+      status = 0;
+      *actualSize = totalWritten;
+   }
+#endif
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReadAdvise --
+ *
+ *    Tell the host OS how the client is reading the file so it can cache
+ *    accordingly: sequential readers get aggressive readahead and a window
+ *    prefetched ahead of their offset, random readers get readahead
+ *    disabled so the page cache is not polluted.
+ *
+ * Results:
+ *    None. Failures only cost performance and are ignored.
+ *
+ * Side effects:
+ *    Host readahead I/O may be started.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsReadAdvise(fileDesc file,               // IN: file descriptor
+               HgfsHandle handle,           // IN: Hgfs file handle
+               HgfsSessionInfo *session,    // IN: session info
+               uint64 offset,               // IN: offset of the read
+               uint32 requiredSize)         // IN: size of the read
+{
+#if defined(__linux__)
+   HgfsReadAdvice advice;
+   int error;
+
+   if (!HgfsHandleGetReadAdvice(handle, session, offset, requiredSize, &advice)) {
+      return;
+   }
+
+   if (advice.patternChanged) {
+      int fadvice;
+
+      switch (advice.pattern) {
+      case HGFS_ACCESS_PATTERN_SEQUENTIAL:
+         fadvice = POSIX_FADV_SEQUENTIAL;
+         break;
+      case HGFS_ACCESS_PATTERN_RANDOM:
+         fadvice = POSIX_FADV_RANDOM;
+         break;
+      default:
+         fadvice = POSIX_FADV_NORMAL;
+         break;
+      }
+
+      error = posix_fadvise(file, 0, 0, fadvice);
+      if (error != 0) {
+         LOG(4, ("%s: fadvise %d failed: %s\n", __FUNCTION__, fadvice,
+                 strerror(error)));
+      }
+   }
+
+   if (advice.readaheadLength != 0) {
+      /* WILLNEED starts asynchronous readahead of the region. */
+      error = posix_fadvise(file, advice.readaheadOffset,
+                            advice.readaheadLength, POSIX_FADV_WILLNEED);
+      if (error != 0) {
+         LOG(4, ("%s: readahead %"FMT64"u, %u failed: %s\n", __FUNCTION__,
+                 advice.readaheadOffset, advice.readaheadLength,
+                 strerror(error)));
+      }
+   }
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformCopyFileRange --
+ *
+ *    Copies data between two files on the host. On Linux copy_file_range(2)
+ *    is used so the kernel (or the filesystem, e.g. by reflinking) does the
+ *    copy without the data passing through user space. Otherwise, or if the
+ *    kernel cannot copy between these files, the data is copied through a
+ *    large buffer.
+ *
+ *    Like copy_file_range(2), overlapping ranges of the same file are
+ *    rejected, as copying them front to back would overwrite source data
+ *    before it is read.
+ *
+ * Results:
+ *    Zero on success.
+ *    EINVAL if the ranges overlap in the same file.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformCopyFileRange(fileDesc srcFile,            // IN: file descriptor to copy from
+                          uint64 srcOffset,            // IN: offset to copy from
+                          fileDesc dstFile,            // IN: file descriptor to copy to
+                          uint64 dstOffset,            // IN: offset to copy to
+                          uint64 requiredSize,         // IN: length of data to copy
+                          uint64 *actualSize)          // OUT: actual length copied
+{
+   HgfsInternalStatus status = 0;
+   uint64 totalCopied = 0;
+   struct stat srcStat;
+   struct stat dstStat;
+   char *buffer;
+
+   LOG(4, ("%s: copy fd %d @ %"FMT64"u to fd %d @ %"FMT64"u, count %"FMT64"u\n",
+           __FUNCTION__, srcFile, srcOffset, dstFile, dstOffset, requiredSize));
+
+#if !defined(sun)
+   status = HgfsWriteCheckIORange(dstOffset, (uint32)MIN(requiredSize, MAX_UINT32));
+   if (status != 0) {
+      return status;
+   }
+#endif
+
+   if (fstat(srcFile, &srcStat) != 0 || fstat(dstFile, &dstStat) != 0) {
+      status = errno;
+      LOG(4, ("%s: error getting file info: %s\n", __FUNCTION__,
+              strerror(status)));
+      return status;
+   }
+
+   if (srcStat.st_dev == dstStat.st_dev && srcStat.st_ino == dstStat.st_ino &&
+       (srcOffset < dstOffset ? dstOffset - srcOffset :
+                                srcOffset - dstOffset) < requiredSize) {
+      LOG(4, ("%s: overlapping ranges in the same file\n", __FUNCTION__));
+      return EINVAL;
+   }
+
+#if defined(__linux__) && defined(SYS_copy_file_range)
+   {
+      loff_t inOffset = srcOffset;
+      loff_t outOffset = dstOffset;
+      long copied;
+
+      copied = syscall(SYS_copy_file_range, srcFile, &inOffset, dstFile,
+                       &outOffset, (size_t)requiredSize, 0);
+      if (copied >= 0) {
+         LOG(4, ("%s: copied %ld bytes\n", __FUNCTION__, copied));
+         *actualSize = copied;
+         return 0;
+      }
+
+      status = errno;
+      if (status != ENOSYS && status != EXDEV &&
+          status != EINVAL && status != EOPNOTSUPP) {
+         LOG(4, ("%s: error copying file range: %s\n", __FUNCTION__,
+                 strerror(status)));
+         return status;
+      }
+
+      /* Not supported by the kernel or across these filesystems. */
+      LOG(4, ("%s: copy_file_range unavailable (%s), copying via buffer\n",
+              __FUNCTION__, strerror(status)));
+      status = 0;
+   }
+#endif
+
+   buffer = malloc(HGFS_COPY_BUFFER_SIZE);
+   if (buffer == NULL) {
+      return ENOMEM;
+   }
+
+   while (totalCopied < requiredSize) {
+      size_t chunkSize = (size_t)MIN(requiredSize - totalCopied,
+                                     HGFS_COPY_BUFFER_SIZE);
+      ssize_t bytesRead;
+      ssize_t bytesWritten = 0;
+
+      bytesRead = pread(srcFile, buffer, chunkSize, srcOffset + totalCopied);
+      if (bytesRead < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         status = errno;
+         break;
+      }
+      if (bytesRead == 0) {
+         /* End of the source file. */
+         break;
+      }
+
+      while (bytesWritten < bytesRead) {
+         ssize_t written = pwrite(dstFile, buffer + bytesWritten,
+                                  bytesRead - bytesWritten,
+                                  dstOffset + totalCopied + bytesWritten);
+         if (written < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            status = errno;
+            break;
+         }
+         bytesWritten += written;
+      }
+
+      totalCopied += bytesWritten;
+      if (status != 0) {
+         break;
+      }
+   }
+
+   free(buffer);
+
+   /* A partial copy is reported as such, the client will retry the rest. */
+   if (status != 0 && totalCopied == 0) {
+      LOG(4, ("%s: error copying file range: %s\n", __FUNCTION__,
+              strerror(status)));
+      return status;
+   }
+
+   LOG(4, ("%s: copied %"FMT64"u bytes\n", __FUNCTION__, totalCopied));
+   *actualSize = totalCopied;
+   return 0;
+}
+
+
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmxIovToIovec --
+ *
+ *    Builds the iovec array for vectored I/O on the mapped guest buffers,
+ *    trimming it to the size of the transfer. The caller supplied array is
+ *    used unless the mappings do not fit in it.
+ *
+ * Results:
+ *    The iovec array to use, the caller must free it if it is not localVec.
+ *
+ * Side effects:
+ *    Memory may be allocated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static struct iovec *
+HgfsVmxIovToIovec(HgfsVmxIov *iov,             // IN: mapped buffers
+                  uint32 iovCount,             // IN: number of mapped buffers
+                  uint32 requiredSize,         // IN: size of the transfer
+                  struct iovec *localVec,      // IN: caller's iovec array
+                  uint32 localVecCount,        // IN: size of caller's array
+                  int *vecCount)               // OUT: iovec entries used
+{
+   struct iovec *vec = localVec;
+   uint32 remainingSize = requiredSize;
+   uint32 i;
+
+   if (iovCount > localVecCount) {
+      vec = Util_SafeMalloc(iovCount * sizeof *vec);
+   }
+
+   for (i = 0; i < iovCount && remainingSize > 0; i++) {
+      ASSERT(iov[i].va != NULL);
+      vec[i].iov_base = iov[i].va;
+      vec[i].iov_len = MIN(iov[i].len, remainingSize);
+      remainingSize -= vec[i].iov_len;
+   }
+
+   *vecCount = i;
+   return vec;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -356,6 +356,79 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetDataPacketIov --
+ *
+ *    Get the data packet of an hgfs packet as an array of guest mappings.
+ *    Unlike HSPU_GetDataPacketBuf no contiguous buffer is ever allocated,
+ *    so the caller can transfer file data directly to or from the mapped
+ *    iovs with scatter-gather I/O and avoid the bounce buffer copy.
+ *    Released by HSPU_PutDataPacketBuf.
+ *
+ * Results:
+ *    Pointer to the first mapped iov of the data packet and the number of
+ *    mapped iovs, or NULL if the data packet cannot be mapped (or is already
+ *    held as a contiguous buffer) and the caller must use
+ *    HSPU_GetDataPacketBuf instead.
+ *
+ * Side effects:
+ *    Guest mappings may be established.
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Writeable/Readable
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount)                     // OUT: mapped iov count
+{
+   HgfsChannelMapVirtAddrFunc mapVa;
+
+   *iovCount = 0;
+
+   if (packet->dataPacket != NULL ||
+       packet->dataPacketMappedIov != 0 ||
+       packet->dataPacketSize == 0 ||
+       chanCb == NULL ||
+       chanCb->putVa == NULL) {
+      return NULL;
+   }
+
+   if (mappingType == BUF_WRITEABLE ||
+       mappingType == BUF_READWRITEABLE) {
+      mapVa = chanCb->getWriteVa;
+   } else {
+      ASSERT(mappingType == BUF_READABLE);
+      mapVa = chanCb->getReadVa;
+   }
+
+   /* Looks like we are in the middle of poweroff. */
+   if (mapVa == NULL) {
+      return NULL;
+   }
+
+   if (!HSPUMapBuf(mapVa,
+                   chanCb->putVa,
+                   packet->dataPacketSize,
+                   packet->dataPacketIovIndex,
+                   packet->iovCount,
+                   packet->iov,
+                   &packet->dataPacketMappedIov)) {
+      /* Guest probably passed us bad physical address */
+      return NULL;
+   }
+
+   LOG(10, ("%s: Hgfs mapped %u data iovs\n", __FUNCTION__,
+            packet->dataPacketMappedIov));
+   packet->dataMappingType = mappingType;
+   *iovCount = packet->dataPacketMappedIov;
+
+   return &packet->iov[packet->dataPacketIovIndex];
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -535,6 +608,15 @@ HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
                       HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
 {
    if (packet->dataPacket == NULL) {
+      if (packet->dataPacketMappedIov != 0 &&
+          chanCb != NULL && chanCb->putVa != NULL) {
+         /* The data was transferred directly through the iov mappings. */
+         LOG(4, ("%s Hgfs Putting Data packet iovs\n", __FUNCTION__));
+         HSPUUnmapBuf(chanCb->putVa,
+                      packet->dataPacketIovIndex,
+                      packet->iov,
+                      &packet->dataPacketMappedIov);
+      }
       return;
    }
 
@@ -123,6 +123,7 @@ static HgfsCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_UNLOCK_BYTE_RANGE_V4,  HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_QUERY_EAS_V4,          HGFS_REQUEST_NOT_SUPPORTED},
    {HGFS_OP_SET_EAS_V4,            HGFS_REQUEST_NOT_SUPPORTED},
+   {HGFS_OP_COPY_FILE_RANGE_V4,    HGFS_REQUEST_POSIX_SUPPORTED},
 };
 
 
@@ -4554,6 +4555,96 @@ HgfsPackWriteReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCopyFileRangeRequest --
+ *
+ *    Unpack hgfs copy file range request to get the source and target files
+ *    and the range to copy.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCopyFileRangeRequest(const void *packet,   // IN: HGFS request
+                               size_t packetSize,    // IN: request packet size
+                               HgfsOp op,            // IN: request type
+                               HgfsHandle *srcFile,  // OUT: Handle to copy from
+                               uint64 *srcOffset,    // OUT: offset to copy from
+                               HgfsHandle *dstFile,  // OUT: Handle to copy to
+                               uint64 *dstOffset,    // OUT: offset to copy to
+                               uint64 *length)       // OUT: length of data to copy
+{
+   const HgfsRequestCopyFileRangeV4 *requestV4 = packet;
+
+   ASSERT(op == HGFS_OP_COPY_FILE_RANGE_V4);
+   LOG(4, ("%s: HGFS_OP_COPY_FILE_RANGE_V4\n", __FUNCTION__));
+
+   if (packetSize < sizeof *requestV4) {
+      LOG(4, ("%s: HGFS packet too small\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   if (requestV4->flags != 0) {
+      LOG(4, ("%s: Unsupported flags 0x%x\n", __FUNCTION__, requestV4->flags));
+      return FALSE;
+   }
+
+   *srcFile = requestV4->srcFile;
+   *srcOffset = requestV4->srcOffset;
+   *dstFile = requestV4->dstFile;
+   *dstOffset = requestV4->dstOffset;
+   *length = requestV4->requiredSize;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackCopyFileRangeReply --
+ *
+ *    Pack hgfs copy file range reply to the HgfsReplyCopyFileRangeV4 structure.
+ *
+ * Results:
+ *    Always TRUE.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackCopyFileRangeReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
+                           const void *packetHeader,     // IN: packet header
+                           HgfsOp op,                    // IN: request type
+                           uint64 actualSize,            // IN: number of bytes copied
+                           size_t *payloadSize,          // OUT: size of packet
+                           HgfsSessionInfo *session)     // IN: Session info
+{
+   HgfsReplyCopyFileRangeV4 *reply;
+
+   ASSERT(op == HGFS_OP_COPY_FILE_RANGE_V4);
+
+   reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply, session);
+   reply->actualSize = actualSize;
+   reply->reserved = 0;
+   *payloadSize = sizeof *reply;
+
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
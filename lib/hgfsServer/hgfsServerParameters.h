@@ -297,6 +297,22 @@ HgfsUnpackWriteRequest(const void *writeRequest,// IN: HGFS write request params
                        HgfsWriteFlags *flags,   // OUT: write flags
                        const void **data);      // OUT: data to be written
 Bool
+HgfsUnpackCopyFileRangeRequest(const void *packet,   // IN: HGFS request
+                               size_t packetSize,    // IN: request packet size
+                               HgfsOp op,            // IN: request type
+                               HgfsHandle *srcFile,  // OUT: Handle to copy from
+                               uint64 *srcOffset,    // OUT: offset to copy from
+                               HgfsHandle *dstFile,  // OUT: Handle to copy to
+                               uint64 *dstOffset,    // OUT: offset to copy to
+                               uint64 *length);      // OUT: length of data to copy
+Bool
+HgfsPackCopyFileRangeReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
+                           const void *packetHeader,     // IN: packet header
+                           HgfsOp op,                    // IN: request type
+                           uint64 actualSize,            // IN: number of bytes copied
+                           size_t *payloadSize,          // OUT: size of packet
+                           HgfsSessionInfo *session);    // IN: Session info
+Bool
 HgfsPackCreateSessionReply(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
                            const void *packetHeader,  // IN: packet header
                            size_t *payloadSize,       // OUT: size of packet
@@ -23,11 +23,18 @@
  *
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "vm_basic_defs.h"
 #include "vm_assert.h"
 #include "vm_atomic.h"
 #include "util.h"
+#include "hostinfo.h"
+#include "userlock.h"
+#include "hgfsTrace.h"
 #if defined(VMTOOLS_USE_GLIB)
 #define G_LOG_DOMAIN "hgfsd"
 #define Debug                 g_debug
@@ -114,6 +121,24 @@ static HgfsServerConfig gHgfsGuestCfgSettings = {
 /* HGFS server info state. Referenced by each separate channel that uses it. */
 static HgfsChannelServerData gHgfsChannelServerInfo = { NULL, {0} };
 
+/*
+ * Request packet capture.
+ *
+ * When enabled, every packet received through HgfsChannelGuest_Receive is
+ * appended to a trace file with its arrival time and the time the server
+ * took to process it, for later offline replay.
+ */
+typedef struct HgfsChannelTrace {
+   FILE                       *file;          /* Trace file, NULL if off. */
+   VmTimeType                 startTime;      /* Capture start, system timer us. */
+   uint64                     records;        /* Packets captured. */
+} HgfsChannelTrace;
+
+static HgfsChannelTrace gHgfsChannelTrace = { NULL, 0, 0 };
+static Atomic_Ptr gHgfsChannelTraceLockStorage;
+/* Set while the trace file is open, read without the lock on receive. */
+static Atomic_uint32 gHgfsChannelTracing = { 0 };
+
 static void HgfsChannelTeardownChannel(HgfsChannelData *channel);
 static void HgfsChannelTeardownServer(HgfsChannelServerData *serverInfo);
 static void HgfsChannelExitChannel(HgfsChannelData *channel);
@@ -680,6 +705,195 @@ HgfsChannelGuest_Exit(HgfsServerMgrData *mgrData) // IN/OUT: connection manager
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsChannelTraceGetLock --
+ *
+ *    Returns the lock serializing writes to the packet trace file.
+ *
+ * Results:
+ *    The lock.
+ *
+ * Side effects:
+ *    Creates the lock on first use.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static MXUserExclLock *
+HgfsChannelTraceGetLock(void)
+{
+   return MXUser_CreateSingletonExclLock(&gHgfsChannelTraceLockStorage,
+                                         "hgfsChannelTraceLock",
+                                         RANK_LEAF);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsChannelTraceRecord --
+ *
+ *    Appends a received request packet to the trace file.
+ *
+ *    A failed write stops the capture so a full disk does not cost
+ *    every following request a failing write.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Writes to the trace file.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+HgfsChannelTraceRecord(VmTimeType receiveTime,  // IN: system timer us at receive
+                       char const *packetIn,    // IN: request packet
+                       size_t packetInSize,     // IN: request packet size
+                       size_t packetOutSize,    // IN: reply packet size
+                       Bool result)             // IN: channel receive result
+{
+   MXUserExclLock *lock = HgfsChannelTraceGetLock();
+   HgfsTraceRecord record;
+   VmTimeType now = Hostinfo_SystemTimerUS();
+
+   record.latency = (uint32)MIN(now - receiveTime, MAX_UINT32);
+   record.packetSize = (uint32)packetInSize;
+   record.replySize = (uint32)packetOutSize;
+   record.result = result;
+
+   MXUser_AcquireExclLock(lock);
+   if (NULL != gHgfsChannelTrace.file) {
+      record.timestamp = receiveTime - gHgfsChannelTrace.startTime;
+      if (fwrite(&record, sizeof record, 1, gHgfsChannelTrace.file) != 1 ||
+          fwrite(packetIn, packetInSize, 1, gHgfsChannelTrace.file) != 1) {
+         Warning("%s: Packet trace write failed, stopping capture after "
+                 "%"FMT64"u packets.\n", __FUNCTION__,
+                 gHgfsChannelTrace.records);
+         fclose(gHgfsChannelTrace.file);
+         gHgfsChannelTrace.file = NULL;
+         Atomic_Write(&gHgfsChannelTracing, 0);
+      } else {
+         gHgfsChannelTrace.records++;
+      }
+   }
+   MXUser_ReleaseExclLock(lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsChannelGuest_StartTrace --
+ *
+ *    Starts capturing received request packets to the named file.
+ *    Any capture already in progress is stopped first.
+ *
+ *    The service runs privileged, so the file must not already exist,
+ *    a symlink is never followed and the trace is readable by the
+ *    owner only: captured packets carry file names and file data.
+ *
+ * Results:
+ *    TRUE if the trace file was created, FALSE otherwise.
+ *
+ * Side effects:
+ *    Creates the trace file.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsChannelGuest_StartTrace(const char *fileName)   // IN: trace file name
+{
+   MXUserExclLock *lock = HgfsChannelTraceGetLock();
+   HgfsTraceFileHeader header;
+   VmTimeType wallTime;
+   FILE *file;
+   int fd;
+
+   ASSERT(NULL != fileName);
+
+   HgfsChannelGuest_StopTrace();
+
+   fd = open(fileName, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+             0600);
+   if (fd < 0) {
+      Warning("%s: Could not create packet trace file %s.\n",
+              __FUNCTION__, fileName);
+      return FALSE;
+   }
+
+   file = fdopen(fd, "wb");
+   if (NULL == file) {
+      Warning("%s: Could not open packet trace file %s.\n",
+              __FUNCTION__, fileName);
+      close(fd);
+      return FALSE;
+   }
+
+   Hostinfo_GetTimeOfDay(&wallTime);
+   memset(&header, 0, sizeof header);
+   header.magic = HGFS_TRACE_MAGIC;
+   header.version = HGFS_TRACE_VERSION;
+   header.headerSize = sizeof header;
+   header.recordSize = sizeof (HgfsTraceRecord);
+   header.startTime = wallTime;
+
+   if (fwrite(&header, sizeof header, 1, file) != 1) {
+      Warning("%s: Could not write packet trace file %s.\n",
+              __FUNCTION__, fileName);
+      fclose(file);
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(lock);
+   gHgfsChannelTrace.startTime = Hostinfo_SystemTimerUS();
+   gHgfsChannelTrace.records = 0;
+   gHgfsChannelTrace.file = file;
+   Atomic_Write(&gHgfsChannelTracing, 1);
+   MXUser_ReleaseExclLock(lock);
+
+   Debug("%s: Capturing HGFS packets to %s.\n", __FUNCTION__, fileName);
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsChannelGuest_StopTrace --
+ *
+ *    Stops any packet capture in progress and closes the trace file.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsChannelGuest_StopTrace(void)
+{
+   MXUserExclLock *lock = HgfsChannelTraceGetLock();
+
+   MXUser_AcquireExclLock(lock);
+   if (NULL != gHgfsChannelTrace.file) {
+      Debug("%s: Captured %"FMT64"u HGFS packets.\n", __FUNCTION__,
+            gHgfsChannelTrace.records);
+      fclose(gHgfsChannelTrace.file);
+      gHgfsChannelTrace.file = NULL;
+      Atomic_Write(&gHgfsChannelTracing, 0);
+   }
+   MXUser_ReleaseExclLock(lock);
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -706,6 +920,7 @@ HgfsChannelGuest_Receive(HgfsServerMgrData *mgrData, // IN/OUT : conn manager
 {
    HgfsChannelData *channel = NULL;
    Bool result = FALSE;
+   VmTimeType receiveTime = 0;
 
    ASSERT(NULL != mgrData);
    ASSERT(NULL != mgrData->connection);
@@ -715,6 +930,14 @@ HgfsChannelGuest_Receive(HgfsServerMgrData *mgrData, // IN/OUT : conn manager
 
    Debug("%s: %s Channel receive request.\n", __FUNCTION__, mgrData->appName);
 
+   /*
+    * Only take the trace lock when capturing. A capture stopped meanwhile
+    * is caught by HgfsChannelTraceRecord.
+    */
+   if (Atomic_Read(&gHgfsChannelTracing) != 0) {
+      receiveTime = Hostinfo_SystemTimerUS();
+   }
+
    if (HgfsChannelIsChannelActive(channel)) {
       result = HgfsChannelReceive(channel,
                                   packetIn,
@@ -723,6 +946,11 @@ HgfsChannelGuest_Receive(HgfsServerMgrData *mgrData, // IN/OUT : conn manager
                                   packetOutSize);
    }
 
+   if (0 != receiveTime) {
+      HgfsChannelTraceRecord(receiveTime, packetIn, packetInSize,
+                             result ? *packetOutSize : 0, result);
+   }
+
    Debug("%s: Channel receive returns %#x.\n", __FUNCTION__, result);
 
    return result;
@@ -59,6 +59,8 @@ Bool HgfsChannelGuest_Receive(HgfsServerMgrData *data,
                               char *packetOut,
                               size_t *packetOutSize);
 uint32 HgfsChannelGuest_InvalidateInactiveSessions(HgfsServerMgrData *data);
+Bool HgfsChannelGuest_StartTrace(const char *fileName);
+void HgfsChannelGuest_StopTrace(void);
 
 #endif /* _HGFSCHANNELGUESTINT_H_ */
 
@@ -173,3 +173,76 @@ HgfsServerManager_Unregister(HgfsServerMgrData *data)         // IN: RpcIn chann
    HgfsServerPolicy_Cleanup();
    memset(&gHgfsServerManagerGuestData, 0, sizeof gHgfsServerManagerGuestData);
 }
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsServerManager_StartTrace --
+ *
+ *    Starts capturing the request packets received by the hgfs server
+ *    to a trace file for offline replay.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    Creates the trace file, which must not already exist.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServerManager_StartTrace(const char *fileName)            // IN: trace file name
+{
+   ASSERT(fileName);
+
+   return HgfsChannelGuest_StartTrace(fileName);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsServerManager_StopTrace --
+ *
+ *    Stops any request packet capture in progress.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerManager_StopTrace(void)
+{
+   HgfsChannelGuest_StopTrace();
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsServerManager_DumpStats --
+ *
+ *    Reports the HGFS server session statistics one line at a time.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerManager_DumpStats(HgfsServerManagerStatsFunc printFunc, // IN: printer
+                            void *clientData)                     // IN: printer data
+{
+   HgfsServer_DumpStats(printFunc, clientData);
+}
@@ -102,6 +102,38 @@
  */
 #define CONFNAME_GUESTINFO_ENABLESTATLOGGING "enable-stat-logging"
 
+/**
+ * Lets users disable the NIC monitor, which sends NIC changes to the host as
+ * soon as the kernel reports them (Linux only). The NIC info is still sent
+ * on every poll.
+ */
+#define CONFNAME_GUESTINFO_DISABLENICMONITOR "disable-nic-monitor"
+
+/**
+ * Define how often the free space of the partitions is updated (in seconds),
+ * when the mount table doesn't change. Partitions are enumerated again only
+ * when mounts change (Linux only).
+ *
+ * @param int   Interval in seconds. Set to 0 to update it on every poll.
+ */
+#define CONFNAME_GUESTINFO_DISKSPACEINTERVAL "disk-space-interval"
+
+/**
+ * Define how many of the processes using the most resources are published in
+ * the guestinfo.topProcesses variable, on every stats interval (Linux only).
+ *
+ * @param int   Number of processes. Set to 0 to disable process sampling.
+ */
+#define CONFNAME_GUESTINFO_TOPPROCESSES "top-processes"
+
+/**
+ * Define how long sampling the processes may take per stats interval (in
+ * milliseconds). Processes not sampled in time are sampled next interval.
+ *
+ * @param int   Budget in milliseconds. Set to 0 for no limit.
+ */
+#define CONFNAME_GUESTINFO_TOPPROCESSESBUDGET "top-processes-budget"
+
 /*
  * END GuestInfo goodies.
  ******************************************************************************
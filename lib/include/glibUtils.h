@@ -33,6 +33,14 @@
 #  include <windows.h>
 #endif
 
+/**
+ * Type of the function that writes several messages to a logger at once. The
+ * messages are already formatted; they're written in the given order.
+ */
+typedef void (*GlibLogBatchFunc)(const gchar **messages,
+                                 guint count,
+                                 gpointer data);
+
 /**
  * @brief Description for a logger.
  *
@@ -50,6 +58,7 @@ typedef struct GlibLogger {
    gboolean          addsTimestamp; /**< Output adds timestamp automatically. */
    GLogFunc          logfn;         /**< The function that writes to the output. */
    GDestroyNotify    dtor;          /**< Destructor. */
+   GlibLogBatchFunc  logbatch;      /**< Writes several messages, may be NULL. */
 } GlibLogger;
 
 
@@ -57,7 +66,8 @@ GlibLogger *
 GlibUtils_CreateFileLogger(const char *path,
                            gboolean append,
                            guint maxSize,
-                           guint maxFiles);
+                           guint maxFiles,
+                           guint maxSpace);
 
 GlibLogger *
 GlibUtils_CreateStdLogger(void);
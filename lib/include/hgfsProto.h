@@ -146,6 +146,7 @@ typedef enum {
    HGFS_OP_UNLOCK_BYTE_RANGE_V4,  /* Release byte range lock. */
    HGFS_OP_QUERY_EAS_V4,          /* Query extended attributes. */
    HGFS_OP_SET_EAS_V4,            /* Add or modify extended attributes. */
+   HGFS_OP_COPY_FILE_RANGE_V4,    /* Copy data between files on the server. */
 
    HGFS_OP_MAX,                   /* Dummy op, must be last in enum */
    HGFS_OP_NEW_HEADER = 0xff,     /* Header op, must be unique, distinguishes packet headers. */
@@ -2699,4 +2700,35 @@ struct HgfsReplyDeleteFileV4 {
 #include "vmware_pack_end.h"
 HgfsReplyDeleteFileV4;
 
+/*
+ * Copy a range of data from one open file to another entirely on the server,
+ * so the data never crosses the transport. Both handles must belong to the
+ * session; the source must be open for reading and the target for writing.
+ * The server may copy less than requested (e.g. at the end of the source
+ * file or to bound the time spent on a request), so clients loop on the
+ * actual size copied. A zero actual size indicates the end of the source.
+ */
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsRequestCopyFileRangeV4 {
+   HgfsHandle srcFile;   /* Opaque file ID of the source file */
+   uint64 srcOffset;     /* Offset in the source file to copy from */
+   HgfsHandle dstFile;   /* Opaque file ID of the target file */
+   uint64 dstOffset;     /* Offset in the target file to copy to */
+   uint64 requiredSize;  /* Number of bytes to copy */
+   uint32 flags;         /* Reserved for future use, must be zero */
+   uint64 reserved;      /* Reserved for future use */
+}
+#include "vmware_pack_end.h"
+HgfsRequestCopyFileRangeV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsReplyCopyFileRangeV4 {
+   uint64 actualSize;    /* Number of bytes copied */
+   uint64 reserved;      /* Reserved for future use */
+}
+#include "vmware_pack_end.h"
+HgfsReplyCopyFileRangeV4;
+
 #endif /* _HGFS_PROTO_H_ */
@@ -205,4 +205,13 @@ void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
 void HgfsServer_Quiesce(Bool freeze);
 
+/*
+ * Function called once per line of statistics output by HgfsServer_DumpStats.
+ */
+typedef void (*HgfsServerStatsPrintFunc)(void *clientData,
+                                         const char *line);
+
+void HgfsServer_DumpStats(HgfsServerStatsPrintFunc printFunc,
+                          void *clientData);
+
 #endif // _HGFS_SERVER_H_
@@ -61,6 +61,13 @@ Bool HgfsServerManager_ProcessPacket(HgfsServerMgrData *mgrData,
                                      char *packetOut,
                                      size_t *packetOutSize);
 uint32 HgfsServerManager_InvalidateInactiveSessions(HgfsServerMgrData *mgrData);
+Bool HgfsServerManager_StartTrace(const char *fileName);
+void HgfsServerManager_StopTrace(void);
+
+/* Same signature as HgfsServerStatsPrintFunc. */
+typedef void (*HgfsServerManagerStatsFunc)(void *clientData, const char *line);
+void HgfsServerManager_DumpStats(HgfsServerManagerStatsFunc printFunc,
+                                 void *clientData);
 #endif
 
 #endif // _HGFS_SERVER_MANAGER_H_
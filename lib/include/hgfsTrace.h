@@ -0,0 +1,64 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _HGFS_TRACE_H_
+# define _HGFS_TRACE_H_
+
+/*
+ * hgfsTrace.h --
+ *
+ *    On disk format of HGFS request packet traces.
+ *
+ *    A trace file is a HgfsTraceFileHeader followed by a sequence of
+ *    records, each a HgfsTraceRecord immediately followed by packetSize
+ *    bytes of the request packet exactly as received by the channel.
+ *    All fields are in host byte order.
+ */
+
+#include "vm_basic_types.h"
+
+#define HGFS_TRACE_MAGIC        0x43525448   /* "HTRC" */
+#define HGFS_TRACE_VERSION_1    1
+#define HGFS_TRACE_VERSION      HGFS_TRACE_VERSION_1
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsTraceFileHeader {
+   uint32 magic;          /* HGFS_TRACE_MAGIC */
+   uint32 version;        /* HGFS_TRACE_VERSION */
+   uint32 headerSize;     /* Size of this header */
+   uint32 recordSize;     /* Size of HgfsTraceRecord */
+   uint64 startTime;      /* Capture start, wall clock microseconds */
+   uint64 reserved;       /* Reserved for future use */
+}
+#include "vmware_pack_end.h"
+HgfsTraceFileHeader;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsTraceRecord {
+   uint64 timestamp;      /* Microseconds since the capture started */
+   uint32 latency;        /* Microseconds the server spent on the request */
+   uint32 packetSize;     /* Size of the request packet that follows */
+   uint32 replySize;      /* Size of the reply sent back */
+   uint32 result;         /* Non zero if the channel processed the packet */
+}
+#include "vmware_pack_end.h"
+HgfsTraceRecord;
+
+#endif // _HGFS_TRACE_H_
@@ -53,12 +53,14 @@
 /*
  * hgfs locks
  */
+#define RANK_hgfsTransportSessions   (RANK_libLockBase + 0x4005)
 #define RANK_hgfsSessionArrayLock    (RANK_libLockBase + 0x4010)
 #define RANK_hgfsSharedFolders       (RANK_libLockBase + 0x4030)
 #define RANK_hgfsNotifyLock          (RANK_libLockBase + 0x4040)
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsInputParamCache     (RANK_libLockBase + 0x4080)
 
 /*
  * vigor (must be < VMDB range and < disklib, see bug 741290)
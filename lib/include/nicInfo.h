@@ -36,6 +36,22 @@ Bool GuestInfo_GetNicInfo(NicInfoV3 **nicInfo);
 void GuestInfo_FreeNicInfo(NicInfoV3 *nicInfo);
 char *GuestInfo_GetPrimaryIP(void);
 
+#if defined(__linux__) && !defined(USERWORLD)
+/*
+ * rtnetlink-based NIC monitor: keeps the NIC info up to date from the
+ * kernel's change notifications.
+ */
+
+typedef struct NicInfoMonitor NicInfoMonitor;
+
+NicInfoMonitor *GuestInfo_NicMonitorOpen(void);
+int GuestInfo_NicMonitorGetFd(const NicInfoMonitor *mon);
+Bool GuestInfo_NicMonitorProcess(NicInfoMonitor *mon, Bool *changed);
+Bool GuestInfo_NicMonitorResync(NicInfoMonitor *mon);
+Bool GuestInfo_NicMonitorGetNicInfo(NicInfoMonitor *mon, NicInfoV3 **nicInfo);
+void GuestInfo_NicMonitorClose(NicInfoMonitor *mon);
+#endif
+
 /*
  * Comparison routines -- handy for caching, unit testing.
  */
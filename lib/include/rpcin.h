@@ -46,6 +46,8 @@ RpcIn *RpcIn_Construct(GMainContext *mainCtx,
 Bool RpcIn_start(RpcIn *in, unsigned int delay,
                  RpcIn_ErrorFunc *errorFunc, void *errorData);
 
+void RpcIn_GetStats(RpcIn *in, RpcInStats *stats);
+
 #else /* } { */
 
 #include "dbllnklst.h"
@@ -45,6 +45,12 @@ G_BEGIN_DECLS
 #define RPCIN_SETRETVALS  RpcChannel_SetRetVals
 #define RPCIN_SETRETVALSF RpcChannel_SetRetValsF
 
+/**
+ * Owner under which RpcChannel_Dispatch() reports the duration of RPC
+ * handlers to the dispatch monitor; see VMTools_SetDispatchMonitor().
+ */
+#define RPCCHANNEL_DISPATCH_OWNER "GuestRPC"
+
 typedef struct _RpcChannel RpcChannel;
 
 /** Data structure passed to RPC callbacks. */
@@ -114,6 +120,34 @@ typedef struct RpcChannelCallback {
    size_t            xdrInSize;
 } RpcChannelCallback;
 
+/**
+ * Wakeup and latency counters of the channel's TCLO receive path. Backdoor
+ * channels poll the host on a timer; vsock channels are woken up by the
+ * host's messages and by the heartbeat.
+ */
+typedef struct RpcInStats {
+   /** Whether the receive path is event driven (vsock) or polling. */
+   gboolean          eventDriven;
+   /** Backdoor only: current poll interval, in milliseconds. */
+   guint             pollInterval;
+   /** Timer and socket wakeups since the channel was started. */
+   guint64           wakeups;
+   /** Wakeups during the last complete minute. */
+   guint64           lastMinuteWakeups;
+   /** Commands dispatched since the channel was started. */
+   guint64           commands;
+   /** Sum of the times from command arrival to handler, in microseconds. */
+   guint64           totalLatency;
+   /** Longest time from command arrival to handler, in microseconds. */
+   guint64           maxLatency;
+   /**
+    * Backdoor only: sum of the poll intervals in effect when commands were
+    * picked up, in microseconds. A command waits on average half the
+    * interval before it is picked up.
+    */
+   guint64           totalPollInterval;
+} RpcInStats;
+
 /**
  * Signature for the callback function called after a channel reset.
  *
@@ -125,6 +159,21 @@ typedef void (*RpcChannelResetCb)(RpcChannel *chan,
                                   gboolean success,
                                   gpointer data);
 
+/**
+ * Signature for the completion callback of RpcChannel_SendAsync.
+ *
+ * @param[in]  status      The status from the remote end (TRUE if the call
+ *                         was successful).
+ * @param[in]  result      Response from the other side, or a description of
+ *                         the error. Only valid during the call.
+ * @param[in]  resultLen   Number of bytes in response.
+ * @param[in]  data        Client data.
+ */
+typedef void (*RpcChannelSendCb)(gboolean status,
+                                 const char *result,
+                                 size_t resultLen,
+                                 gpointer data);
+
 gboolean
 RpcChannel_Start(RpcChannel *chan);
 
@@ -141,6 +190,13 @@ RpcChannel_Send(RpcChannel *chan,
                 char **result,
                 size_t *resultLen);
 
+gboolean
+RpcChannel_SendAsync(RpcChannel *chan,
+                     char const *data,
+                     size_t dataLen,
+                     RpcChannelSendCb cb,
+                     gpointer cbData);
+
 void
 RpcChannel_Free(void *ptr);
 
@@ -201,12 +257,22 @@ RpcChannel_SendOne(char **reply,
                    const char *reqFmt,
                    ...);
 
+void
+RpcChannel_SendOneKeepOpen(void);
+
+void
+RpcChannel_SendOneShutdown(void);
+
 RpcChannel *
 RpcChannel_New(void);
 
 void
 RpcChannel_SetBackdoorOnly(void);
 
+gboolean
+RpcChannel_GetInStats(RpcChannel *chan,
+                      RpcInStats *stats);
+
 G_END_DECLS
 
 /** @} */
@@ -43,6 +43,18 @@
  *      - Valid values: std, outputdebugstring (Win32-only), file, file+ (same as
  *        "file", but appends to existing log file), vmx, syslog.
  *      - Default: "syslog".
+ *    - rateLimit: maximum number of similar messages to log per minute; 0 (the
+ *      default) means no limit. Messages are similar when they have the same
+ *      domain, level and text, ignoring digits. Up to a minute's worth of
+ *      similar messages can be logged in a burst; after that, they're
+ *      suppressed, and the number of suppressed messages is logged about
+ *      once a minute: with the next similar message, or from a timer on the
+ *      default main context, or by VMTools_FlushLogs(), if the messages have
+ *      stopped.
+ *      Fatal errors are never suppressed. Domains that don't set a rate limit
+ *      use the default domain's.
+ *    - rateLimit.<level>: rate limit for the given log level, overriding
+ *      "rateLimit".
  *
  * For file handlers, the following extra configuration information can be
  * provided:
@@ -52,6 +64,16 @@
  *      default, at most 10 backed up log files will be kept. Value should be >= 1.
  *    - maxLogSize: maximum size of each log file, defaults to 10 (MB). A value of
  *      0 disables log rotation.
+ *    - maxOldLogSpace: maximum total size of the rotated log files, in MB. The
+ *      oldest files are deleted to stay under it, but the newest one is always
+ *      kept. Defaults to maxLogSize times maxOldLogFiles.
+ *
+ * When a log file is rotated, it's only renamed while logging is held up; a
+ * separate thread then renumbers the old log files, compresses the newest one
+ * with gzip (adding a ".gz" suffix) when the tools were built with zlib, and
+ * deletes the old files that go over the limits above. Rotated files left
+ * behind by a process that exited before archiving them are archived the next
+ * time the log file is opened.
  *
  * When using syslog on Unix, the following options are available:
  *
@@ -61,10 +83,24 @@
  *      LOG_USER. This option should be defined for the application's default
  *      log domain (it's ignored for all other domains).
  *
+ * Messages for handlers that write to files (and syslog, which may write
+ * synchronously) are queued and written by a dedicated thread, so that the
+ * code logging them doesn't wait for the I/O. The "asyncQueueSize" option
+ * sets how many messages may be waiting to be written (default: 1024);
+ * messages logged while the queue is full are dropped, and the number of
+ * dropped messages is logged afterwards. A value of 0 makes every thread
+ * write its own messages. Fatal errors are always written synchronously,
+ * after all queued messages. Use VMTools_FlushLogs() to wait for the queued
+ * messages to be written.
+ *
  * The "vmx" logger will log all messages to the host; it's not recommended
  * for normal use, since writing to the host log is an expensive operation and
  * can also affect other running applications that need to send messages to the
  * host. Do not use this logger unless explicitly instructed to do so.
+ * Messages for the "vmx" logger are sent by a dedicated thread, batched into
+ * multi-line RPCs over a channel that is kept open; fatal errors are sent
+ * right away. VMTools_GetVMXLogStats() tells how many messages are waiting
+ * and how many were dropped because too many were waiting.
  *
  * Log levels:
  *
@@ -118,6 +154,10 @@
  * unity.handler = file
  * unity.data = /tmp/unity.log
  *
+ * # Logs at most 10 similar warnings a minute for the "guestinfo" domain.
+ * guestinfo.level = message
+ * guestinfo.rateLimit.warning = 10
+ *
  * # Defines the "vmtoolsd" domain, and disable logging for it.
  * vmtoolsd.level = none
  * @endverbatim
@@ -200,6 +240,24 @@
 /** @copydoc vm_critical */
 #define  vm_warning(fmt, ...)    g_warning("%s: " fmt, FUNC, ## __VA_ARGS__)
 
+/** State of the queue of the "vmx" loggers. */
+typedef struct VMToolsVMXLogStats {
+   /** Whether a "vmx" logger is currently configured. */
+   gboolean          active;
+   /** Messages waiting to be sent. */
+   guint             queued;
+   /** Size of the messages waiting to be sent, in bytes. */
+   guint             queuedBytes;
+   /** Messages sent. */
+   guint64           sent;
+   /** RPCs used to send them. */
+   guint64           rpcs;
+   /** Messages dropped because the queue was full. */
+   guint64           dropped;
+} VMToolsVMXLogStats;
+
+struct _RpcChannel;
+
 G_BEGIN_DECLS
 
 void
@@ -208,6 +266,15 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
                       gboolean force,
                       gboolean reset);
 
+void
+VMTools_FlushLogs(void);
+
+void
+VMTools_SetVMXLogChannel(struct _RpcChannel *chan);
+
+gboolean
+VMTools_GetVMXLogStats(VMToolsVMXLogStats *stats);
+
 G_END_DECLS
 
 /** @} */
@@ -54,7 +54,9 @@
 
 
 /**
- * Attaches the given event source to the app context's main loop.
+ * Attaches the given event source to the app context's main loop. The time
+ * spent in the callback is reported to the service's dispatch monitor under
+ * the caller's log domain; see VMTools_SetDispatchMonitor().
  *
  * @param[in]  ctx      The application context.
  * @param[in]  src      Source to attach.
@@ -62,11 +64,10 @@
  * @param[in]  data     Data to provide to the callback.
  * @param[in]  destroy  Destruction notification callback.
  */
-#define VMTOOLSAPP_ATTACH_SOURCE(ctx, src, cb, data, destroy) do {      \
-   GSource *__src = (src);                                              \
-   g_source_set_callback(__src, (GSourceFunc) (cb), (data), (destroy)); \
-   g_source_attach(__src, g_main_loop_get_context((ctx)->mainLoop));    \
-} while (0)
+#define VMTOOLSAPP_ATTACH_SOURCE(ctx, src, cb, data, destroy)            \
+   VMTools_AttachSource(g_main_loop_get_context((ctx)->mainLoop),       \
+                        (src), (GSourceFunc) (cb), (data), (destroy),   \
+                        G_LOG_DOMAIN, #cb)
 
 /**
  * Checks if the Tools service is main (system) service or not.
@@ -219,6 +220,20 @@ ToolsCore_LogState(guint level,
  */
 #define TOOLS_CORE_PROP_CTX "tcs_app_ctx"
 
+/**
+ * @brief Property where the service's startup timeline is stored.
+ *
+ * The value is a string of space-separated "key=time" pairs in microseconds,
+ * e.g. "total=85000us setup=1200us plugin.vmbackup=300us". "total" and "caps"
+ * are measured from process start to the first main loop iteration and to
+ * the capabilities registration; the other keys are the durations of the
+ * startup phases and of each plugin's ToolsOnLoad(). The property is set once
+ * the main loop starts running and updated when the capabilities are
+ * registered. The string is owned by the service and should only be read
+ * from the main loop's thread.
+ */
+#define TOOLS_CORE_PROP_TIMELINE "tcs_startup_timeline"
+
 
 /**
  * This enum lists all API versions that different versions of vmtoolsd support.
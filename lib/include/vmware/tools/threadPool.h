@@ -39,6 +39,14 @@
  * with the lifecycle of the new thread managed by the thread pool so that it
  * is properly notified of service shutdown.
  *
+ * Tasks are queued in one of several priority classes, and idle workers
+ * always pick the oldest task of the most urgent class. Time-critical tasks
+ * (such as the quiesce operations of a backup) may also use worker threads
+ * that are kept in reserve for them, so they are not stuck behind a flood of
+ * long running tasks. To keep a single plugin from using up the whole pool,
+ * the number of tasks from the same plugin that run at the same time is
+ * limited (except for time-critical tasks).
+ *
  * Finally, depending on the configuration, the shared thread pool might not
  * be a thread pool at all: if the configuration has disabled threading, tasks
  * destined to the shared thread pool will be executed on the main service
@@ -54,6 +62,17 @@
 typedef void (*ToolsCorePoolCb)(ToolsAppCtx *ctx,
                                 gpointer data);
 
+/** Priority classes of tasks submitted to the pool, most urgent first. */
+typedef enum {
+   /** Must run as soon as possible; may use the reserved workers. */
+   TOOLS_CORE_POOL_PRIORITY_CRITICAL,
+   /** The default priority. */
+   TOOLS_CORE_POOL_PRIORITY_NORMAL,
+   /** Long running background work; never uses all the workers. */
+   TOOLS_CORE_POOL_PRIORITY_BULK,
+   TOOLS_CORE_POOL_PRIORITY_MAX
+} ToolsCorePoolPriority;
+
 /**
  * @brief Public interface of the shared thread pool.
  *
@@ -74,6 +93,12 @@ typedef struct ToolsCorePool {
                      ToolsCorePoolCb interrupt,
                      gpointer data,
                      GDestroyNotify dtor);
+   guint (*submitPriority)(ToolsAppCtx *ctx,
+                           ToolsCorePoolCb cb,
+                           gpointer data,
+                           GDestroyNotify dtor,
+                           ToolsCorePoolPriority priority,
+                           const gchar *owner);
 } ToolsCorePool;
 
 
@@ -112,6 +137,9 @@ ToolsCorePool_GetPool(ToolsAppCtx *ctx)
  * The task data's destructor will be called after the task finishes executing,
  * or in case the thread pool is destroyed before the task is executed.
  *
+ * The task is queued with normal priority, and counts against the limit of
+ * concurrent tasks of the caller's log domain.
+ *
  * @param[in] ctx    Application context.
  * @param[in] cb     Function to execute the task.
  * @param[in] data   Opaque data for the task.
@@ -130,7 +158,51 @@ ToolsCorePool_SubmitTask(ToolsAppCtx *ctx,
 {
    ToolsCorePool *pool = ToolsCorePool_GetPool(ctx);
    if (pool != NULL) {
-      return pool->submit(ctx, cb, data, dtor);
+      return pool->submitPriority(ctx, cb, data, dtor,
+                                  TOOLS_CORE_POOL_PRIORITY_NORMAL,
+                                  G_LOG_DOMAIN);
+   }
+   return 0;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePool_SubmitPriorityTask --                                    */ /**
+ *
+ * @brief Submits a task with the given priority for execution in the pool.
+ *
+ * Same as ToolsCorePool_SubmitTask(), but lets the caller choose the task's
+ * priority class. Critical tasks are run before any other queued task, may
+ * use the workers reserved for them and are not subject to the limit of
+ * concurrent tasks per plugin; bulk tasks only run when no other task is
+ * waiting, and never occupy all of the pool's workers.
+ *
+ * If the thread pool is disabled, the priority is used to order the tasks
+ * in the main loop.
+ *
+ * @param[in] ctx       Application context.
+ * @param[in] cb        Function to execute the task.
+ * @param[in] data      Opaque data for the task.
+ * @param[in] dtor      Destructor for the task data.
+ * @param[in] priority  Priority class of the task.
+ *
+ * @return An identifier for the task, or 0 on error.
+ *
+ *******************************************************************************
+ */
+
+G_INLINE_FUNC guint
+ToolsCorePool_SubmitPriorityTask(ToolsAppCtx *ctx,
+                                 ToolsCorePoolCb cb,
+                                 gpointer data,
+                                 GDestroyNotify dtor,
+                                 ToolsCorePoolPriority priority)
+{
+   ToolsCorePool *pool = ToolsCorePool_GetPool(ctx);
+   if (pool != NULL) {
+      return pool->submitPriority(ctx, cb, data, dtor, priority,
+                                  G_LOG_DOMAIN);
    }
    return 0;
 }
@@ -147,7 +219,8 @@ ToolsCorePool_SubmitTask(ToolsAppCtx *ctx,
  * (if any) is called.
  *
  * @param[in] ctx    Application context.
- * @param[in] taskId Task ID returned by ToolsCorePool_SubmitTask().
+ * @param[in] taskId Task ID returned by ToolsCorePool_SubmitTask() or
+ *                   ToolsCorePool_SubmitPriorityTask().
  *
  *******************************************************************************
  */
@@ -145,6 +145,48 @@ VMTools_GetLibdir(void);
 GSource *
 VMTools_CreateTimer(gint timeout);
 
+/**
+ * Type of the function that returns the time of a monotonic clock, in
+ * milliseconds. See VMTools_SetMonotonicClock().
+ */
+typedef guint64 (*VMToolsMonotonicClockFn)(void);
+
+guint64
+VMTools_GetMonotonicTime(void);
+
+void
+VMTools_SetMonotonicClock(VMToolsMonotonicClockFn clock);
+
+/**
+ * Type of the function that receives the duration, in microseconds, of main
+ * loop callbacks. See VMTools_SetDispatchMonitor().
+ */
+typedef void (*VMToolsDispatchMonitorCb)(const gchar *owner,
+                                         const gchar *name,
+                                         gint64 duration,
+                                         gpointer data);
+
+void
+VMTools_SetDispatchMonitor(VMToolsDispatchMonitorCb cb,
+                           gpointer data);
+
+gboolean
+VMTools_IsDispatchMonitored(void);
+
+void
+VMTools_ReportDispatch(const gchar *owner,
+                       const gchar *name,
+                       gint64 duration);
+
+guint
+VMTools_AttachSource(GMainContext *ctx,
+                     GSource *src,
+                     GSourceFunc cb,
+                     gpointer data,
+                     GDestroyNotify destroy,
+                     const gchar *owner,
+                     const gchar *name);
+
 void
 VMTools_SetGuestSDKMode(void);
 
@@ -49,6 +49,10 @@ IpAddressEntry *GuestInfoAddIpAddress(GuestNicV3 *nic,                  // IN/OU
 
 char *GuestInfoGetPrimaryIP(void);
 
+#if !defined(USERWORLD)
+Bool GuestInfoGetResolverInfo(NicInfoV3 *nicInfo);
+#endif
+
 #if defined _WIN32
 void GuestInfoDupTypedIpAddress(TypedIpAddress *srcIp,   // IN
                                 TypedIpAddress *destIp);  // OUT
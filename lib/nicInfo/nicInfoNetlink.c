@@ -0,0 +1,1114 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file nicInfoNetlink.c
+ *
+ * rtnetlink(7) backend of the GuestInfo NIC collector (Linux only).
+ *
+ * A NIC monitor keeps a model of the guest's links, addresses and routes. The
+ * model is filled from a dump of the kernel's tables when the monitor is
+ * opened, and is then kept up to date from the change notifications the
+ * kernel sends to the monitor's socket. Building a NicInfoV3 from the model
+ * doesn't need to walk the interfaces or parse /proc, and callers can wait
+ * for the socket to become readable to learn that the NICs may have changed.
+ *
+ * The routes kept are the ones the /proc backend reports: the main IPv4 table
+ * (what /proc/net/route shows), and all IPv6 tables (what /proc/net/ipv6_route
+ * shows). The kernel doesn't send notifications for IPv4 routes that go away
+ * because a link goes down or an address is removed, so the IPv4 routes are
+ * dumped again when that happens.
+ */
+
+#if defined(__linux__) && !defined(USERWORLD)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "vmware.h"
+#include "nicInfoInt.h"
+#include "str.h"
+#include "util.h"
+#include "xdrutil.h"
+
+#ifndef SOL_NETLINK
+#  define SOL_NETLINK 270
+#endif
+
+/** Size of the receive buffer; large enough for any rtnetlink message. */
+#define NICMON_BUFSIZE     (64 * 1024)
+
+/** Socket buffer size requested for the notifications. */
+#define NICMON_RCVBUF      (1024 * 1024)
+
+
+typedef struct NicMonAddr {
+   int         family;
+   guint8      prefixLen;
+   guint8      addr[16];
+} NicMonAddr;
+
+
+typedef struct NicMonLink {
+   int         ifIndex;
+   unsigned    flags;
+   Bool        isEthernet;    /* ARPHRD_ETHER, with a MAC address. */
+   guint8      mac[6];
+   GArray     *addrs;         /* NicMonAddr */
+} NicMonLink;
+
+
+typedef struct NicMonRoute {
+   int         family;
+   guint32     table;
+   guint8      dstLen;
+   guint8      dst[16];
+   Bool        hasGateway;
+   guint8      gateway[16];
+   int         oif;
+   guint32     metric;
+} NicMonRoute;
+
+
+struct NicInfoMonitor {
+   int          fd;           /* Receives the change notifications. */
+   guint32      seq;
+   GHashTable  *links;        /* ifIndex -> NicMonLink */
+   GArray      *routes;       /* NicMonRoute */
+   guint8      *buf;
+   Bool         resync;       /* Notifications were lost. */
+   Bool         resyncRoutes; /* IPv4 routes may have gone away silently. */
+};
+
+
+/*
+ ******************************************************************************
+ * NicMonitorFreeLink --                                                 */ /**
+ *
+ * @brief Frees a link of the model.
+ *
+ * @param[in]  data     The link.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicMonitorFreeLink(gpointer data)
+{
+   NicMonLink *link = data;
+
+   g_array_free(link->addrs, TRUE);
+   g_free(link);
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorParseAttrs --                                               */ /**
+ *
+ * @brief Indexes the attributes of a message by type.
+ *
+ * @param[in]  rta      First attribute.
+ * @param[in]  len      Length of the attributes.
+ * @param[out] tb       Attributes, by type; NULL for missing ones.
+ * @param[in]  max      Highest type of interest.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicMonitorParseAttrs(struct rtattr *rta,
+                     int len,
+                     struct rtattr **tb,
+                     int max)
+{
+   memset(tb, 0, (max + 1) * sizeof *tb);
+   for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+      if (rta->rta_type <= max) {
+         tb[rta->rta_type] = rta;
+      }
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorGetAddr --                                                  */ /**
+ *
+ * @brief Copies an address attribute.
+ *
+ * @param[in]  rta      The attribute, may be NULL.
+ * @param[in]  family   Address family.
+ * @param[out] addr     The address (16 bytes).
+ *
+ * @retval TRUE  The attribute holds an address of the right family.
+ * @retval FALSE Otherwise.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorGetAddr(const struct rtattr *rta,
+                  int family,
+                  guint8 *addr)
+{
+   size_t len = family == AF_INET ? sizeof (struct in_addr) :
+                                    sizeof (struct in6_addr);
+
+   memset(addr, 0, 16);
+   if (rta == NULL || RTA_PAYLOAD(rta) < len) {
+      return FALSE;
+   }
+   memcpy(addr, RTA_DATA(rta), len);
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorDropRoutes --                                               */ /**
+ *
+ * @brief Forgets the routes of a family, or the routes through a link.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[in]  family   Family of the routes to forget, AF_UNSPEC for all.
+ * @param[in]  ifIndex  Link of the routes to forget, 0 for all.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicMonitorDropRoutes(NicInfoMonitor *mon,
+                     int family,
+                     int ifIndex)
+{
+   guint i = 0;
+
+   while (i < mon->routes->len) {
+      NicMonRoute *route = &g_array_index(mon->routes, NicMonRoute, i);
+
+      if ((family == AF_UNSPEC || route->family == family) &&
+          (ifIndex == 0 || route->oif == ifIndex)) {
+         g_array_remove_index(mon->routes, i);
+      } else {
+         i++;
+      }
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorIsEthernet --                                               */ /**
+ *
+ * @brief Tells whether a link is reported as a NIC.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[in]  ifIndex  Index of the link.
+ *
+ * @return TRUE if the link is known and is an Ethernet link.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorIsEthernet(NicInfoMonitor *mon,
+                     int ifIndex)
+{
+   NicMonLink *link = g_hash_table_lookup(mon->links,
+                                          GINT_TO_POINTER(ifIndex));
+   return link != NULL && link->isEthernet;
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorLink --                                                     */ /**
+ *
+ * @brief Applies a RTM_NEWLINK or RTM_DELLINK message to the model.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[in]  nlh      The message.
+ *
+ * @return Whether the NIC info may have changed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorLink(NicInfoMonitor *mon,
+               struct nlmsghdr *nlh)
+{
+   struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+   struct rtattr *tb[IFLA_MAX + 1];
+   gpointer key = GINT_TO_POINTER(ifi->ifi_index);
+   NicMonLink *link;
+   Bool wasEthernet = FALSE;
+   guint8 oldMac[6];
+
+   if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof *ifi)) {
+      return FALSE;
+   }
+
+   link = g_hash_table_lookup(mon->links, key);
+
+   if (nlh->nlmsg_type == RTM_DELLINK) {
+      if (link == NULL) {
+         return FALSE;
+      }
+      wasEthernet = link->isEthernet;
+      g_hash_table_remove(mon->links, key);
+      NicMonitorDropRoutes(mon, AF_UNSPEC, ifi->ifi_index);
+      return wasEthernet;
+   }
+
+   NicMonitorParseAttrs(IFLA_RTA(ifi), IFLA_PAYLOAD(nlh), tb, IFLA_MAX);
+
+   if (link == NULL) {
+      link = g_new0(NicMonLink, 1);
+      link->ifIndex = ifi->ifi_index;
+      link->addrs = g_array_new(FALSE, FALSE, sizeof (NicMonAddr));
+      g_hash_table_insert(mon->links, key, link);
+   } else {
+      wasEthernet = link->isEthernet;
+      if ((link->flags & IFF_UP) && !(ifi->ifi_flags & IFF_UP)) {
+         mon->resyncRoutes = TRUE;
+      }
+   }
+   memcpy(oldMac, link->mac, sizeof oldMac);
+
+   /* Notifications may leave out the address; keep the one we know of. */
+   if (ifi->ifi_type != ARPHRD_ETHER) {
+      link->isEthernet = FALSE;
+   } else if (tb[IFLA_ADDRESS] != NULL) {
+      link->isEthernet = RTA_PAYLOAD(tb[IFLA_ADDRESS]) == sizeof link->mac;
+      if (link->isEthernet) {
+         memcpy(link->mac, RTA_DATA(tb[IFLA_ADDRESS]), sizeof link->mac);
+      }
+   }
+   link->flags = ifi->ifi_flags;
+
+   return link->isEthernet != wasEthernet ||
+          (link->isEthernet &&
+           memcmp(oldMac, link->mac, sizeof oldMac) != 0);
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorAddr --                                                     */ /**
+ *
+ * @brief Applies a RTM_NEWADDR or RTM_DELADDR message to the model.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[in]  nlh      The message.
+ *
+ * @return Whether the NIC info may have changed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorAddr(NicInfoMonitor *mon,
+               struct nlmsghdr *nlh)
+{
+   struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+   struct rtattr *tb[IFA_MAX + 1];
+   NicMonLink *link;
+   NicMonAddr addr;
+   guint i;
+
+   if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof *ifa) ||
+       (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)) {
+      return FALSE;
+   }
+
+   NicMonitorParseAttrs(IFA_RTA(ifa), IFA_PAYLOAD(nlh), tb, IFA_MAX);
+
+   /* For IPv4, IFA_ADDRESS is the peer's address on point-to-point links. */
+   memset(&addr, 0, sizeof addr);
+   addr.family = ifa->ifa_family;
+   addr.prefixLen = ifa->ifa_prefixlen;
+   if (!NicMonitorGetAddr(tb[IFA_LOCAL], addr.family, addr.addr) &&
+       !NicMonitorGetAddr(tb[IFA_ADDRESS], addr.family, addr.addr)) {
+      return FALSE;
+   }
+
+   if (nlh->nlmsg_type == RTM_DELADDR && addr.family == AF_INET) {
+      mon->resyncRoutes = TRUE;
+   }
+
+   link = g_hash_table_lookup(mon->links, GINT_TO_POINTER(ifa->ifa_index));
+   if (link == NULL) {
+      return FALSE;
+   }
+
+   for (i = 0; i < link->addrs->len; i++) {
+      if (memcmp(&g_array_index(link->addrs, NicMonAddr, i), &addr,
+                 sizeof addr) == 0) {
+         break;
+      }
+   }
+
+   if (nlh->nlmsg_type == RTM_NEWADDR) {
+      if (i < link->addrs->len) {
+         return FALSE;
+      }
+      g_array_append_val(link->addrs, addr);
+   } else {
+      if (i == link->addrs->len) {
+         return FALSE;
+      }
+      g_array_remove_index(link->addrs, i);
+   }
+
+   return link->isEthernet;
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorRoute --                                                    */ /**
+ *
+ * @brief Applies a RTM_NEWROUTE or RTM_DELROUTE message to the model.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[in]  nlh      The message.
+ *
+ * @return Whether the NIC info may have changed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorRoute(NicInfoMonitor *mon,
+                struct nlmsghdr *nlh)
+{
+   struct rtmsg *rtm = NLMSG_DATA(nlh);
+   struct rtattr *tb[RTA_MAX + 1];
+   struct rtattr *gateway;
+   NicMonRoute route;
+   Bool changed = FALSE;
+   guint i;
+
+   if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof *rtm) ||
+       (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) ||
+       (rtm->rtm_flags & RTM_F_CLONED)) {
+      return FALSE;
+   }
+
+   NicMonitorParseAttrs(RTM_RTA(rtm), RTM_PAYLOAD(nlh), tb, RTA_MAX);
+
+   memset(&route, 0, sizeof route);
+   route.family = rtm->rtm_family;
+   route.table = rtm->rtm_table;
+   if (tb[RTA_TABLE] != NULL &&
+       RTA_PAYLOAD(tb[RTA_TABLE]) >= sizeof (guint32)) {
+      route.table = *(guint32 *)RTA_DATA(tb[RTA_TABLE]);
+   }
+   if (route.family == AF_INET && route.table != RT_TABLE_MAIN) {
+      return FALSE;
+   }
+
+   route.dstLen = rtm->rtm_dst_len;
+   NicMonitorGetAddr(tb[RTA_DST], route.family, route.dst);
+   if (tb[RTA_PRIORITY] != NULL &&
+       RTA_PAYLOAD(tb[RTA_PRIORITY]) >= sizeof (guint32)) {
+      route.metric = *(guint32 *)RTA_DATA(tb[RTA_PRIORITY]);
+   }
+
+   /* Multipath routes are reported through their first next hop. */
+   gateway = tb[RTA_GATEWAY];
+   if (tb[RTA_OIF] != NULL && RTA_PAYLOAD(tb[RTA_OIF]) >= sizeof (guint32)) {
+      route.oif = *(guint32 *)RTA_DATA(tb[RTA_OIF]);
+   } else if (tb[RTA_MULTIPATH] != NULL &&
+              RTA_PAYLOAD(tb[RTA_MULTIPATH]) >= sizeof (struct rtnexthop)) {
+      struct rtnexthop *nh = RTA_DATA(tb[RTA_MULTIPATH]);
+      struct rtattr *nhtb[RTA_MAX + 1];
+
+      route.oif = nh->rtnh_ifindex;
+      if (nh->rtnh_len > sizeof *nh &&
+          nh->rtnh_len <= RTA_PAYLOAD(tb[RTA_MULTIPATH])) {
+         NicMonitorParseAttrs(RTNH_DATA(nh), nh->rtnh_len - sizeof *nh,
+                              nhtb, RTA_MAX);
+         gateway = nhtb[RTA_GATEWAY];
+      }
+   }
+   route.hasGateway = NicMonitorGetAddr(gateway, route.family, route.gateway);
+
+   /* A replaced route goes away, whatever its next hop was. */
+   if (nlh->nlmsg_type == RTM_NEWROUTE && (nlh->nlmsg_flags & NLM_F_REPLACE)) {
+      i = 0;
+      while (i < mon->routes->len) {
+         NicMonRoute *old = &g_array_index(mon->routes, NicMonRoute, i);
+
+         if (old->family == route.family && old->table == route.table &&
+             old->dstLen == route.dstLen && old->metric == route.metric &&
+             memcmp(old->dst, route.dst, sizeof route.dst) == 0) {
+            changed = changed || NicMonitorIsEthernet(mon, old->oif);
+            g_array_remove_index(mon->routes, i);
+         } else {
+            i++;
+         }
+      }
+   }
+
+   for (i = 0; i < mon->routes->len; i++) {
+      if (memcmp(&g_array_index(mon->routes, NicMonRoute, i), &route,
+                 sizeof route) == 0) {
+         break;
+      }
+   }
+
+   if (nlh->nlmsg_type == RTM_NEWROUTE) {
+      if (i < mon->routes->len) {
+         return changed;
+      }
+      g_array_append_val(mon->routes, route);
+   } else {
+      if (i == mon->routes->len) {
+         return changed;
+      }
+      g_array_remove_index(mon->routes, i);
+   }
+
+   return changed || NicMonitorIsEthernet(mon, route.oif);
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorHandle --                                                   */ /**
+ *
+ * @brief Applies the messages in a buffer to the model.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[in]  len      Length of the data in the monitor's buffer.
+ * @param[in]  seq      Sequence number of the dump being read, 0 for
+ *                      notifications.
+ * @param[out] done     Set when the end of the dump is reached. May be NULL.
+ * @param[out] changed  Set if the NIC info may have changed.
+ *
+ * @retval TRUE  Success.
+ * @retval FALSE The kernel reported an error.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorHandle(NicInfoMonitor *mon,
+                 int len,
+                 guint32 seq,
+                 Bool *done,
+                 Bool *changed)
+{
+   struct nlmsghdr *nlh;
+
+   for (nlh = (struct nlmsghdr *)mon->buf;
+        NLMSG_OK(nlh, len);
+        nlh = NLMSG_NEXT(nlh, len)) {
+      if (seq != 0 && nlh->nlmsg_seq != seq) {
+         continue;
+      }
+
+      switch (nlh->nlmsg_type) {
+      case NLMSG_DONE:
+         if (done != NULL) {
+            *done = TRUE;
+         }
+         return TRUE;
+      case NLMSG_ERROR:
+         return FALSE;
+      case RTM_NEWLINK:
+      case RTM_DELLINK:
+         *changed = NicMonitorLink(mon, nlh) || *changed;
+         break;
+      case RTM_NEWADDR:
+      case RTM_DELADDR:
+         *changed = NicMonitorAddr(mon, nlh) || *changed;
+         break;
+      case RTM_NEWROUTE:
+      case RTM_DELROUTE:
+         *changed = NicMonitorRoute(mon, nlh) || *changed;
+         break;
+      default:
+         break;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorDump --                                                     */ /**
+ *
+ * @brief Dumps one of the kernel's tables into the model.
+ *
+ * A separate socket is used, so that the dump isn't mixed up with the
+ * notifications; notifications about things that are also in the dump are
+ * harmless, since applying them again doesn't change the model.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[in]  type     RTM_GETLINK, RTM_GETADDR or RTM_GETROUTE.
+ * @param[in]  family   Address family to dump.
+ *
+ * @retval TRUE  Success.
+ * @retval FALSE The dump failed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorDump(NicInfoMonitor *mon,
+               int type,
+               int family)
+{
+   struct {
+      struct nlmsghdr nlh;
+      union {
+         struct ifinfomsg ifi;
+         struct ifaddrmsg ifa;
+         struct rtmsg rtm;
+      } u;
+   } req;
+   struct sockaddr_nl kernel;
+   Bool done = FALSE;
+   Bool changed = FALSE;
+   Bool ret = FALSE;
+   int fd;
+
+   fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+   if (fd < 0) {
+      g_debug("%s: socket failed: %d\n", __FUNCTION__, errno);
+      return FALSE;
+   }
+
+   memset(&req, 0, sizeof req);
+   switch (type) {
+   case RTM_GETLINK:
+      req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof req.u.ifi);
+      req.u.ifi.ifi_family = family;
+      break;
+   case RTM_GETADDR:
+      req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof req.u.ifa);
+      req.u.ifa.ifa_family = family;
+      break;
+   default:
+      req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof req.u.rtm);
+      req.u.rtm.rtm_family = family;
+      break;
+   }
+   req.nlh.nlmsg_type = type;
+   req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+   req.nlh.nlmsg_seq = ++mon->seq;
+   if (req.nlh.nlmsg_seq == 0) {
+      req.nlh.nlmsg_seq = ++mon->seq;
+   }
+
+   memset(&kernel, 0, sizeof kernel);
+   kernel.nl_family = AF_NETLINK;
+   if (sendto(fd, &req, req.nlh.nlmsg_len, 0, (struct sockaddr *)&kernel,
+              sizeof kernel) < 0) {
+      g_debug("%s: sendto failed: %d\n", __FUNCTION__, errno);
+      goto exit;
+   }
+
+   while (!done) {
+      struct sockaddr_nl from;
+      socklen_t fromLen = sizeof from;
+      ssize_t len;
+
+      len = recvfrom(fd, mon->buf, NICMON_BUFSIZE, 0,
+                     (struct sockaddr *)&from, &fromLen);
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         g_debug("%s: recvfrom failed: %d\n", __FUNCTION__, errno);
+         goto exit;
+      }
+      if (len == 0) {
+         goto exit;
+      }
+      if (from.nl_pid != 0) {
+         continue;
+      }
+      if (!NicMonitorHandle(mon, (int)len, req.nlh.nlmsg_seq, &done,
+                            &changed)) {
+         g_debug("%s: dump %d/%d failed.\n", __FUNCTION__, type, family);
+         goto exit;
+      }
+   }
+
+   ret = TRUE;
+
+exit:
+   close(fd);
+   return ret;
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorSync --                                                     */ /**
+ *
+ * @brief Rebuilds the model from the kernel's tables.
+ *
+ * @param[in]  mon      The monitor.
+ *
+ * @retval TRUE  Success.
+ * @retval FALSE A dump failed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicMonitorSync(NicInfoMonitor *mon)
+{
+   g_hash_table_remove_all(mon->links);
+   g_array_set_size(mon->routes, 0);
+   mon->resync = FALSE;
+   mon->resyncRoutes = FALSE;
+
+   return NicMonitorDump(mon, RTM_GETLINK, AF_UNSPEC) &&
+          NicMonitorDump(mon, RTM_GETADDR, AF_UNSPEC) &&
+          NicMonitorDump(mon, RTM_GETROUTE, AF_INET) &&
+          NicMonitorDump(mon, RTM_GETROUTE, AF_INET6);
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorToSockaddr --                                               */ /**
+ *
+ * @brief Builds a socket address from an address of the model.
+ *
+ * @param[in]  family   Address family.
+ * @param[in]  addr     The address.
+ * @param[out] ss       The socket address.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicMonitorToSockaddr(int family,
+                     const guint8 *addr,
+                     struct sockaddr_storage *ss)
+{
+   memset(ss, 0, sizeof *ss);
+   if (family == AF_INET) {
+      struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+      sin->sin_family = AF_INET;
+      memcpy(&sin->sin_addr, addr, sizeof sin->sin_addr);
+   } else {
+      struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+      sin6->sin6_family = AF_INET6;
+      memcpy(&sin6->sin6_addr, addr, sizeof sin6->sin6_addr);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorCollectNic --                                               */ /**
+ *
+ * @brief g_hash_table_foreach() callback that collects the indices of the
+ * Ethernet links.
+ *
+ * @param[in]  key      Unused.
+ * @param[in]  value    A link.
+ * @param[out] data     Array of indices.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicMonitorCollectNic(gpointer key,
+                     gpointer value,
+                     gpointer data)
+{
+   NicMonLink *link = value;
+
+   if (link->isEthernet) {
+      g_array_append_val((GArray *)data, link->ifIndex);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonitorCompareIndex --                                             */ /**
+ *
+ * @brief Sorts interface indices.
+ *
+ ******************************************************************************
+ */
+
+static gint
+NicMonitorCompareIndex(gconstpointer a,
+                       gconstpointer b)
+{
+   return *(const int *)a - *(const int *)b;
+}
+
+
+/*
+ * Global functions.
+ */
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonitorOpen --                                           */ /**
+ *
+ * @brief Creates a NIC monitor.
+ *
+ * Subscribes to the kernel's link, address and route notifications, then
+ * dumps the current state.
+ *
+ * @return The monitor, NULL if rtnetlink can't be used.
+ *
+ ******************************************************************************
+ */
+
+NicInfoMonitor *
+GuestInfo_NicMonitorOpen(void)
+{
+   static const int groups[] = {
+      RTNLGRP_LINK,
+      RTNLGRP_IPV4_IFADDR,
+      RTNLGRP_IPV6_IFADDR,
+      RTNLGRP_IPV4_ROUTE,
+      RTNLGRP_IPV6_ROUTE,
+   };
+   NicInfoMonitor *mon;
+   struct sockaddr_nl local;
+   int rcvbuf = NICMON_RCVBUF;
+   size_t i;
+   int fd;
+
+   fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+   if (fd < 0) {
+      g_debug("%s: socket failed: %d\n", __FUNCTION__, errno);
+      return NULL;
+   }
+
+   memset(&local, 0, sizeof local);
+   local.nl_family = AF_NETLINK;
+   if (bind(fd, (struct sockaddr *)&local, sizeof local) < 0) {
+      g_debug("%s: bind failed: %d\n", __FUNCTION__, errno);
+      close(fd);
+      return NULL;
+   }
+
+   /* Subscribe before dumping, so that no change is missed. */
+   for (i = 0; i < ARRAYSIZE(groups); i++) {
+      if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &groups[i],
+                     sizeof groups[i]) < 0) {
+         g_debug("%s: cannot join group %d: %d\n", __FUNCTION__, groups[i],
+                 errno);
+         close(fd);
+         return NULL;
+      }
+   }
+
+   setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+   fcntl(fd, F_SETFD, FD_CLOEXEC);
+   fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+   mon = Util_SafeCalloc(1, sizeof *mon);
+   mon->fd = fd;
+   mon->links = g_hash_table_new_full(NULL, NULL, NULL, NicMonitorFreeLink);
+   mon->routes = g_array_new(FALSE, FALSE, sizeof (NicMonRoute));
+   mon->buf = Util_SafeMalloc(NICMON_BUFSIZE);
+
+   if (!NicMonitorSync(mon)) {
+      GuestInfo_NicMonitorClose(mon);
+      return NULL;
+   }
+
+   return mon;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonitorGetFd --                                          */ /**
+ *
+ * @brief Returns the file descriptor that becomes readable when the NICs
+ * change; call GuestInfo_NicMonitorProcess() then.
+ *
+ * @param[in]  mon      The monitor.
+ *
+ * @return A file descriptor.
+ *
+ ******************************************************************************
+ */
+
+int
+GuestInfo_NicMonitorGetFd(const NicInfoMonitor *mon)
+{
+   return mon->fd;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonitorProcess --                                        */ /**
+ *
+ * @brief Applies the pending notifications to the monitor's model.
+ *
+ * Doesn't block. If notifications were lost because the socket's buffer was
+ * full, the model is rebuilt from scratch.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[out] changed  Whether the NIC info may have changed.
+ *
+ * @retval TRUE  Success.
+ * @retval FALSE The monitor can't be used anymore.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfo_NicMonitorProcess(NicInfoMonitor *mon,
+                            Bool *changed)
+{
+   *changed = FALSE;
+
+   while (TRUE) {
+      struct sockaddr_nl from;
+      socklen_t fromLen = sizeof from;
+      ssize_t len;
+
+      len = recvfrom(mon->fd, mon->buf, NICMON_BUFSIZE, MSG_DONTWAIT,
+                     (struct sockaddr *)&from, &fromLen);
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+         } else if (errno == ENOBUFS) {
+            mon->resync = TRUE;
+            continue;
+         }
+         g_warning("%s: recvfrom failed: %d\n", __FUNCTION__, errno);
+         return FALSE;
+      }
+      if (len == 0) {
+         break;
+      }
+      if (from.nl_pid == 0) {
+         NicMonitorHandle(mon, (int)len, 0, NULL, changed);
+      }
+   }
+
+   if (mon->resync) {
+      g_debug("%s: notifications lost, rebuilding the NIC model.\n",
+              __FUNCTION__);
+      *changed = TRUE;
+      return NicMonitorSync(mon);
+   }
+
+   if (mon->resyncRoutes) {
+      mon->resyncRoutes = FALSE;
+      NicMonitorDropRoutes(mon, AF_INET, 0);
+      *changed = TRUE;
+      return NicMonitorDump(mon, RTM_GETROUTE, AF_INET);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonitorResync --                                         */ /**
+ *
+ * @brief Rebuilds the monitor's model from the kernel's tables.
+ *
+ * The model should never drift from the kernel's state, but the kernel
+ * doesn't send notifications for every change (see the IPv4 routes above);
+ * calling this now and then bounds how long an unexpected drift can last.
+ *
+ * @param[in]  mon      The monitor.
+ *
+ * @retval TRUE  Success.
+ * @retval FALSE The monitor can't be used anymore.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfo_NicMonitorResync(NicInfoMonitor *mon)
+{
+   return NicMonitorSync(mon);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonitorGetNicInfo --                                     */ /**
+ *
+ * @brief Builds the NIC info from the monitor's model.
+ *
+ * The NICs are the Ethernet links, ordered by interface index. The resolver
+ * settings are read like GuestInfo_GetNicInfo() does.
+ *
+ * @param[in]  mon      The monitor.
+ * @param[out] nicInfo  Will point to a newly allocated NicInfoV3.
+ *
+ * @note
+ * Caller is responsible for freeing @a nicInfo with GuestInfo_FreeNicInfo.
+ *
+ * @retval TRUE  Success.  @a nicInfo now points to a populated NicInfoV3.
+ * @retval FALSE Failure.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfo_NicMonitorGetNicInfo(NicInfoMonitor *mon,
+                               NicInfoV3 **nicInfo)
+{
+   GArray *indices = g_array_new(FALSE, FALSE, sizeof (int));
+   GHashTable *positions = g_hash_table_new(NULL, NULL);
+   NicMonLink *link;
+   NicInfoV3 *info;
+   guint i;
+   guint j;
+
+   info = Util_SafeCalloc(1, sizeof *info);
+
+   g_hash_table_foreach(mon->links, NicMonitorCollectNic, indices);
+   g_array_sort(indices, NicMonitorCompareIndex);
+
+   for (i = 0; i < indices->len; i++) {
+      char macAddress[NICINFO_MAC_LEN];
+      GuestNicV3 *nic;
+      int ifIndex = g_array_index(indices, int, i);
+
+      link = g_hash_table_lookup(mon->links, GINT_TO_POINTER(ifIndex));
+      Str_Sprintf(macAddress, sizeof macAddress,
+                  "%02x:%02x:%02x:%02x:%02x:%02x",
+                  link->mac[0], link->mac[1], link->mac[2],
+                  link->mac[3], link->mac[4], link->mac[5]);
+      nic = GuestInfoAddNicEntry(info, macAddress, NULL, NULL);
+      if (nic == NULL) {
+         /* We reached maximum number of NICs we can report to the host. */
+         break;
+      }
+      g_hash_table_insert(positions, GINT_TO_POINTER(link->ifIndex),
+                          GUINT_TO_POINTER(info->nics.nics_len));
+
+      for (j = 0; j < link->addrs->len; j++) {
+         NicMonAddr *addr = &g_array_index(link->addrs, NicMonAddr, j);
+         struct sockaddr_storage ss;
+
+         NicMonitorToSockaddr(addr->family, addr->addr, &ss);
+         GuestInfoAddIpAddress(nic, (struct sockaddr *)&ss, addr->prefixLen,
+                               NULL, NULL);
+      }
+   }
+
+   g_array_free(indices, TRUE);
+
+   if (!GuestInfoGetResolverInfo(info)) {
+      g_hash_table_destroy(positions);
+      GuestInfo_FreeNicInfo(info);
+      return FALSE;
+   }
+
+   for (i = 0; i < mon->routes->len; i++) {
+      NicMonRoute *route = &g_array_index(mon->routes, NicMonRoute, i);
+      gpointer found = g_hash_table_lookup(positions,
+                                           GINT_TO_POINTER(route->oif));
+      guint pos = GPOINTER_TO_UINT(found);
+      struct sockaddr_storage ss;
+      InetCidrRouteEntry *icre;
+
+      if (pos == 0) {
+         continue;
+      }
+
+      /* Check to see if we're going above our limit. See bug 605821. */
+      if (info->routes.routes_len == NICINFO_MAX_ROUTES) {
+         g_message("%s: route limit (%d) reached, skipping overflow.",
+                   __FUNCTION__, NICINFO_MAX_ROUTES);
+         break;
+      }
+
+      icre = XDRUTIL_ARRAYAPPEND(info, routes, 1);
+      ASSERT_MEM_ALLOC(icre);
+
+      NicMonitorToSockaddr(route->family, route->dst, &ss);
+      GuestInfoSockaddrToTypedIpAddress((struct sockaddr *)&ss,
+                                        &icre->inetCidrRouteDest);
+      icre->inetCidrRoutePfxLen = route->dstLen;
+
+      if (route->hasGateway) {
+         TypedIpAddress *ip = Util_SafeCalloc(1, sizeof *ip);
+         NicMonitorToSockaddr(route->family, route->gateway, &ss);
+         GuestInfoSockaddrToTypedIpAddress((struct sockaddr *)&ss, ip);
+         icre->inetCidrRouteNextHop = ip;
+      }
+
+      icre->inetCidrRouteIfIndex = pos - 1;
+      icre->inetCidrRouteMetric = route->metric;
+   }
+
+   g_hash_table_destroy(positions);
+   *nicInfo = info;
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonitorClose --                                          */ /**
+ *
+ * @brief Destroys a NIC monitor.
+ *
+ * @param[in]  mon      The monitor, may be NULL.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_NicMonitorClose(NicInfoMonitor *mon)
+{
+   if (mon != NULL) {
+      close(mon->fd);
+      g_hash_table_destroy(mon->links);
+      g_array_free(mon->routes, TRUE);
+      free(mon->buf);
+      free(mon);
+   }
+}
+
+#endif // if defined(__linux__) && !defined(USERWORLD)
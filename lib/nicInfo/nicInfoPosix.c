@@ -134,13 +134,14 @@
 #ifndef NO_DNET
 static void RecordNetworkAddress(GuestNicV3 *nic, const struct addr *addr);
 static int ReadInterfaceDetails(const struct intf_entry *entry, void *arg);
-static Bool RecordResolverInfo(NicInfoV3 *nicInfo);
-static void RecordResolverNS(DnsConfigInfo *dnsConfigInfo);
 static Bool RecordRoutingInfo(NicInfoV3 *nicInfo);
 #if !defined(__FreeBSD__) && !defined(__APPLE__) && !defined(USERWORLD)
 static int GuestInfoGetIntf(const struct intf_entry *entry, void *arg);
 #endif
 #endif
+#if !defined(USERWORLD)
+static void RecordResolverNS(DnsConfigInfo *dnsConfigInfo);
+#endif
 static char *ValidateConvertAddress(const struct sockaddr *addr);
 
 
@@ -196,7 +197,7 @@ GuestInfoGetNicInfo(NicInfoV3 *nicInfo) // OUT
 
    intf_close(intf);
 
-   if (!RecordResolverInfo(nicInfo)) {
+   if (!GuestInfoGetResolverInfo(nicInfo)) {
       return FALSE;
    }
 
@@ -449,10 +450,13 @@ ReadInterfaceDetails(const struct intf_entry *entry,  // IN: current interface e
    return 0;
 }
 
+#endif // ifndef NO_DNET
+
 
+#if !defined(USERWORLD)
 /*
  ******************************************************************************
- * RecordResolverInfo --                                                 */ /**
+ * GuestInfoGetResolverInfo --                                           */ /**
  *
  * @brief Query resolver(3), mapping settings to DnsConfigInfo.
  *
@@ -464,8 +468,8 @@ ReadInterfaceDetails(const struct intf_entry *entry,  // IN: current interface e
  ******************************************************************************
  */
 
-static Bool
-RecordResolverInfo(NicInfoV3 *nicInfo)  // OUT
+Bool
+GuestInfoGetResolverInfo(NicInfoV3 *nicInfo)  // OUT
 {
    DnsConfigInfo *dnsConfigInfo = NULL;
    char namebuf[DNSINFO_MAX_ADDRLEN + 1];
@@ -620,8 +624,10 @@ RecordResolverNS(DnsConfigInfo *dnsConfigInfo) // IN
    }
 #endif                                  // if !defined RESOLVER_IPV6_GETSERVERS
 }
+#endif // if !defined(USERWORLD)
 
 
+#ifndef NO_DNET
 #ifdef USE_SLASH_PROC
 /*
  ******************************************************************************
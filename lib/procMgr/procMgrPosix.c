@@ -80,6 +80,7 @@
 #include "strutil.h"
 #include "codeset.h"
 #include "unicode.h"
+#include "userlock.h"
 
 #ifdef USERWORLD
 #include <vm_basic_types.h>
@@ -249,6 +250,240 @@ done:
 }
 
 
+/*
+ * State ProcMgr_ListProcesses keeps between calls: /proc, open, and the
+ * names of the users that own processes, most recently used first. The
+ * names are forgotten when the password file changes.
+ */
+
+#define PROCMGR_PASSWD_FILE "/etc/passwd"
+
+typedef struct ProcMgrUidName {
+   uid_t uid;
+   char *name;
+} ProcMgrUidName;
+
+static Atomic_Ptr procMgrListLockStorage;
+static DIR *procMgrProcDir = NULL;
+static ProcMgrUidName procMgrUidCache[64];
+static unsigned int procMgrUidCacheCount = 0;
+static time_t procMgrPasswdMtime = 0;
+static ino_t procMgrPasswdIno = 0;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrListLock --
+ *
+ *      Acquire or release the lock that protects the state kept by
+ *      ProcMgr_ListProcesses between calls.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrListLock(Bool lock) // IN
+{
+   MXUserExclLock *lck = MXUser_CreateSingletonExclLock(&procMgrListLockStorage,
+                                                        "procMgrListLock",
+                                                        RANK_UNRANKED);
+
+   VERIFY(lck != NULL);
+
+   if (lock) {
+      MXUser_AcquireExclLock(lck);
+   } else {
+      MXUser_ReleaseExclLock(lck);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrCheckPasswd --
+ *
+ *      Forget the cached user names if the password file changed since
+ *      they were looked up. Must be called with the list lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May empty the user name cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrCheckPasswd(void)
+{
+   struct stat fileStat;
+   time_t mtime = 0;
+   ino_t ino = 0;
+   unsigned int i;
+
+   if (stat(PROCMGR_PASSWD_FILE, &fileStat) == 0) {
+      mtime = fileStat.st_mtime;
+      ino = fileStat.st_ino;
+   }
+
+   if (mtime == procMgrPasswdMtime && ino == procMgrPasswdIno) {
+      return;
+   }
+
+   for (i = 0; i < procMgrUidCacheCount; i++) {
+      free(procMgrUidCache[i].name);
+   }
+   procMgrUidCacheCount = 0;
+   procMgrPasswdMtime = mtime;
+   procMgrPasswdIno = ino;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrGetOwnerName --
+ *
+ *      Get the name of a user, or the uid as a string if the user has
+ *      no name. Names are looked up once and kept in a small LRU
+ *      cache. Must be called with the list lock held.
+ *
+ * Results:
+ *      The name, to be freed by the caller.
+ *
+ * Side effects:
+ *      Updates the user name cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+ProcMgrGetOwnerName(uid_t uid) // IN
+{
+   ProcMgrUidName entry;
+   unsigned int i;
+
+   for (i = 0; i < procMgrUidCacheCount; i++) {
+      if (procMgrUidCache[i].uid == uid) {
+         break;
+      }
+   }
+
+   if (i < procMgrUidCacheCount) {
+      entry = procMgrUidCache[i];
+   } else {
+      struct passwd pw;
+      struct passwd *ppw = &pw;
+      char buffer[BUFSIZ];
+      int error;
+
+      if ((error = getpwuid_r(uid, &pw, buffer, sizeof buffer, &ppw)) == 0 &&
+          ppw != NULL) {
+         entry.name = Unicode_Alloc(pw.pw_name, STRING_ENCODING_DEFAULT);
+      } else {
+         entry.name = Str_SafeAsprintf(NULL, "%d", (int) uid);
+      }
+      entry.uid = uid;
+
+      if (procMgrUidCacheCount == ARRAYSIZE(procMgrUidCache)) {
+         free(procMgrUidCache[--procMgrUidCacheCount].name);
+      }
+      i = procMgrUidCacheCount++;
+   }
+
+   /*
+    * Move the entry to the front; the least recently used is at the end.
+    */
+   memmove(&procMgrUidCache[1], &procMgrUidCache[0],
+           i * sizeof procMgrUidCache[0]);
+   procMgrUidCache[0] = entry;
+
+   return Util_SafeStrdup(entry.name);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrGetStartTime --
+ *
+ *      Read the start time of a process from its /proc/<pid>/stat file.
+ *
+ * Results:
+ *      TRUE on success, with the start time in clock ticks after boot
+ *      in *startTime.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrGetStartTime(int dirFd,                          // IN: /proc
+                    const char *pid,                    // IN
+                    unsigned long long *startTime)      // OUT
+{
+   char path[64];
+   char buf[1024];
+   char *field;
+   int numRead;
+   int fd;
+   int i;
+
+   if (Str_Snprintf(path, sizeof path, "%s/stat", pid) == -1) {
+      return FALSE;
+   }
+
+   fd = openat(dirFd, path, O_RDONLY);
+   if (-1 == fd) {
+      return FALSE;
+   }
+
+   /*
+    * The start time is the 22nd field, well within the buffer even if
+    * the line is longer.
+    */
+   numRead = read(fd, buf, sizeof buf - 1);
+   close(fd);
+   if (numRead <= 0) {
+      return FALSE;
+   }
+   buf[numRead] = '\0';
+
+   /*
+    * Skip over the process id and name, "123 (bash) S [...]". The name
+    * can contain ')', so look for the last one. Then skip the state.
+    */
+   field = strrchr(buf, ')');
+   if (NULL == field || field[1] == '\0' || field[2] == '\0') {
+      return FALSE;
+   }
+   field += 3;
+
+   for (i = 4; i <= 22; i++) {
+      char *end;
+
+      *startTime = strtoull(field, &end, 10);
+      if (end == field) {
+         return FALSE;
+      }
+      field = end;
+   }
+
+   return TRUE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -258,6 +493,10 @@ done:
  *      enumerate. The strings in the returned structure should be all
  *      UTF-8 encoded, although we do not enforce it right now.
  *
+ *      /proc stays open between calls, and the files of each process
+ *      are opened relative to it. The owner of a process is the owner
+ *      of its files, so it comes from the open cmdline file.
+ *
  * Results:
  *      
  *      A ProcMgrProcInfoArray.
@@ -285,6 +524,8 @@ ProcMgr_ListProcesses(void)
    procInfo.procCmdLine = NULL;
    procInfo.procOwner = NULL;
 
+   ProcMgrListLock(TRUE);
+
    /*
     * Figure out when the system started.  We need this number to
     * compute process start times, which are relative to this number.
@@ -332,30 +573,39 @@ ProcMgr_ListProcesses(void)
 #endif
    } // if (0 == hostStartTime)
 
+   ProcMgrCheckPasswd();
+
    /*
     * Scan /proc for any directory that is all numbers.
     * That represents a process id.
     */
-   dir = opendir("/proc");
-   if (NULL == dir) {
-      Warning("ProcMgr_ListProcesses unable to open /proc\n");
-      goto abort;
+   if (NULL == procMgrProcDir) {
+      int fd = open("/proc", O_RDONLY | O_DIRECTORY);
+
+      if (-1 != fd) {
+         fcntl(fd, F_SETFD, FD_CLOEXEC);
+         procMgrProcDir = fdopendir(fd);
+         if (NULL == procMgrProcDir) {
+            close(fd);
+         }
+      }
+      if (NULL == procMgrProcDir) {
+         Warning("ProcMgr_ListProcesses unable to open /proc\n");
+         goto abort;
+      }
+   } else {
+      rewinddir(procMgrProcDir);
    }
+   dir = procMgrProcDir;
 
    while ((ent = readdir(dir))) {
       struct stat fileStat;
-      char cmdFilePath[1024];
-      int statResult;
+      char cmdFilePath[64];
       int numRead = 0;   /* number of bytes that read() actually read */
       int cmdFd;
       int replaceLoop;
-      struct passwd *pwd;
       char *cmdLineTemp = NULL;
-      char *cmdStatTemp = NULL;
-      size_t strLen = 0;
-      unsigned long long dummy;
       unsigned long long relativeStartTime;
-      char *stringBegin;
       char *cmdNameBegin;
       Bool cmdNameLookup = TRUE;
 
@@ -366,15 +616,15 @@ ProcMgr_ListProcesses(void)
          continue;
       }
 
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/cmdline",
-                   ent->d_name) == -1) {
+      if (Str_Snprintf(cmdFilePath,
+                       sizeof cmdFilePath,
+                       "%s/cmdline",
+                       ent->d_name) == -1) {
          Debug("Giant process id '%s'\n", ent->d_name);
          continue;
       }
       
-      cmdFd = open(cmdFilePath, O_RDONLY);
+      cmdFd = openat(dirfd(dir), cmdFilePath, O_RDONLY);
       if (-1 == cmdFd) {
          /*
           * We may not be able to open the file due to the security reason.
@@ -383,6 +633,16 @@ ProcMgr_ListProcesses(void)
          continue;
       }
 
+      /*
+       * fstat() the file to get the process owner.  We use
+       * fileStat.st_uid later in this code.  If we can't fstat(), ignore
+       * and continue.
+       */
+      if (0 != fstat(cmdFd, &fileStat)) {
+         close(cmdFd);
+         continue;
+      }
+
       /*
        * Read in the command and its arguments.  Arguments are separated
        * by \0, which we convert to ' '.  Then we add a NULL terminator
@@ -440,11 +700,11 @@ ProcMgr_ListProcesses(void)
          cmdFd = -1;
          numRead = 0;
 
-         if (snprintf(cmdFilePath,
-                      sizeof cmdFilePath,
-                      "/proc/%s/status",
-                      ent->d_name) != -1) {
-            cmdFd = open(cmdFilePath, O_RDONLY);
+         if (Str_Snprintf(cmdFilePath,
+                          sizeof cmdFilePath,
+                          "%s/status",
+                          ent->d_name) != -1) {
+            cmdFd = openat(dirfd(dir), cmdFilePath, O_RDONLY);
          }
          if (cmdFd != -1) {
             numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
@@ -485,68 +745,10 @@ ProcMgr_ListProcesses(void)
       }
 
       /*
-       * Get the inode information for this process.  This gives us
-       * the process owner.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-
-      /*
-       * stat() /proc/<pid> to get the owner.  We use fileStat.st_uid
-       * later in this code.  If we can't stat(), ignore and continue.
-       * Maybe we don't have enough permission.
+       * Figure out the process start time from /proc/<pid>/stat, and
+       * compute it in absolute time.
        */
-      statResult = stat(cmdFilePath, &fileStat);
-      if (0 != statResult) {
-         goto next_entry;
-      }
-
-      /*
-       * Figure out the process start time.  Open /proc/<pid>/stat
-       * and read the start time and compute it in absolute time.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/stat",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         goto next_entry;
-      }
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
-      close(cmdFd);
-      if (0 >= numRead) {
-         goto next_entry;
-      }
-      /*
-       * Skip over initial process id and process name.  "123 (bash) [...]".
-       */
-      stringBegin = strchr(cmdStatTemp, ')') + 2;
-
-      numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
-                           "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
-                           "%d %ld %Lu",
-                           (char *) &dummy, (int *) &dummy, (int *) &dummy,
-                           (int *) &dummy, (int *) &dummy,  (int *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (long *) &dummy, (long *) &dummy,
-                           (int *) &dummy, (long *) &dummy,
-                           &relativeStartTime);
-      if (20 != numberFound) {
+      if (!ProcMgrGetStartTime(dirfd(dir), ent->d_name, &relativeStartTime)) {
          goto next_entry;
       }
 
@@ -567,10 +769,7 @@ ProcMgr_ListProcesses(void)
       /*
        * Store the owner of the process.
        */
-      pwd = getpwuid(fileStat.st_uid);
-      procInfo.procOwner = (NULL == pwd)
-                           ? Str_SafeAsprintf(&strLen, "%d", (int) fileStat.st_uid)
-                           : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+      procInfo.procOwner = ProcMgrGetOwnerName(fileStat.st_uid);
 
       /*
        * Store the time that the process started.
@@ -590,8 +789,9 @@ ProcMgr_ListProcesses(void)
       procInfo.procOwner = NULL;
 
 next_entry:
+      free(procInfo.procCmdName);
+      procInfo.procCmdName = NULL;
       free(cmdLineTemp);
-      free(cmdStatTemp);
    } // while readdir
 
    if (0 < ProcMgrProcInfoArray_Count(procList)) {
@@ -599,7 +799,7 @@ next_entry:
    }
 
 abort:
-   closedir(dir);
+   ProcMgrListLock(FALSE);
 
    free(procInfo.procCmdName);
    free(procInfo.procCmdLine);
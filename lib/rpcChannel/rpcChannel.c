@@ -22,7 +22,11 @@
  *    Common functions to all RPC channel implementations.
  */
 
+#include <stdlib.h>
 #include <string.h>
+#if !defined(_WIN32)
+#  include <unistd.h>
+#endif
 #include "vm_assert.h"
 #include "dynxdr.h"
 #include "rpcChannelInt.h"
@@ -31,6 +35,7 @@
 #include "vmxrpc.h"
 #include "xdrutil.h"
 #include "rpcin.h"
+#include "hostinfo.h"
 #include "debug.h"
 
 /** Internal state of a channel. */
@@ -38,6 +43,7 @@ typedef struct RpcChannelInt {
    RpcChannel              impl;
    gchar                  *appName;
    GHashTable             *rpcs;
+   size_t                  maxNameLen;
    GMainContext           *mainCtx;
    GSource                *resetCheck;
    gpointer                appCtx;
@@ -53,6 +59,9 @@ typedef struct RpcChannelInt {
 
 #define LGPFX "RpcChannel: "
 
+/** Command names shorter than this are looked up without allocating. */
+#define RPCCHANNEL_NAME_BUF_SIZE 128
+
 static gboolean
 RpcChannelPing(RpcInData *data);
 
@@ -69,6 +78,34 @@ static gboolean gUseBackdoorOnly = FALSE;
  */
 static gboolean gVSocketFailed = FALSE;
 
+/** Idle time (in us) after which the RpcChannel_SendOne* channel is closed. */
+#define RPCCHANNEL_ONE_IDLE_TIMEOUT  (30 * 1000 * 1000)
+
+/*
+ * Channel shared by RpcChannel_SendOne* callers in this process, so that
+ * programs sending many messages don't open a new channel for each one.
+ * It is only kept open between RpcChannel_SendOneKeepOpen and the matching
+ * RpcChannel_SendOneShutdown. While it is open, a reaper thread closes it
+ * once it has been idle for RPCCHANNEL_ONE_IDLE_TIMEOUT.
+ *
+ * The lock is not held while a message is sent: the sender marks the
+ * channel busy instead, and concurrent senders use a channel of their own.
+ */
+static struct {
+   GStaticMutex   lock;
+   GCond         *cond;            // Signaled when the channel closes or is
+                                   // no longer busy.
+   RpcChannel    *chan;
+   VmTimeType     lastUse;
+   guint          users;           // RpcChannel_SendOneKeepOpen callers.
+   gboolean       busy;            // A message is being sent on chan.
+   gboolean       reaperRunning;
+#if !defined(_WIN32)
+   pid_t          pid;
+   pid_t          reaperPid;       // Threads do not survive fork().
+#endif
+} gSendOne = { G_STATIC_MUTEX_INIT, };
+
 /**
  * Handler for a "ping" message. Does nothing.
  *
@@ -367,24 +404,52 @@ RpcChannel_Create(void)
 gboolean
 RpcChannel_Dispatch(RpcInData *data)
 {
+   char nameBuf[RPCCHANNEL_NAME_BUF_SIZE];
    char *name = NULL;
-   unsigned int index = 0;
-   size_t nameLen;
+   size_t start = 0;
+   size_t nameLen = 0;
    Bool status;
+   VmTimeType dispatchStart = 0;
    RpcChannelCallback *rpc = NULL;
    RpcChannelInt *chan = data->clientData;
 
-   name = StrUtil_GetNextToken(&index, data->args, " ");
-   if (name == NULL) {
+   /*
+    * Find the command name in place. The scan stops one character past the
+    * longest registered name, so that unknown commands are rejected without
+    * copying or hashing them.
+    */
+   while (start < data->argsSize && data->args[start] == ' ') {
+      start++;
+   }
+   while (start + nameLen < data->argsSize &&
+          data->args[start + nameLen] != ' ' &&
+          data->args[start + nameLen] != '\0' &&
+          nameLen <= chan->maxNameLen) {
+      nameLen++;
+   }
+
+   if (nameLen == 0) {
       Debug(LGPFX "Bad command (null) received.\n");
       status = RPCIN_SETRETVALS(data, "Bad command", FALSE);
       goto exit;
    }
 
-   if (chan->rpcs != NULL) {
-      rpc = g_hash_table_lookup(chan->rpcs, name);
+   if (chan->rpcs == NULL || nameLen > chan->maxNameLen) {
+      Debug(LGPFX "Unknown Command '%.*s': Handler not registered.\n",
+            (int) nameLen, data->args + start);
+      status = RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
+      goto exit;
+   }
+
+   if (nameLen < sizeof nameBuf) {
+      name = nameBuf;
+      memcpy(name, data->args + start, nameLen);
+      name[nameLen] = '\0';
+   } else {
+      name = g_strndup(data->args + start, nameLen);
    }
 
+   rpc = g_hash_table_lookup(chan->rpcs, name);
    if (rpc == NULL) {
       Debug(LGPFX "Unknown Command '%s': Handler not registered.\n", name);
       status = RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
@@ -392,24 +457,34 @@ RpcChannel_Dispatch(RpcInData *data)
    }
 
    /* Adjust the RPC arguments. */
-   nameLen = strlen(name);
    data->name = name;
-   data->args = data->args + nameLen;
-   data->argsSize -= nameLen;
+   data->args = data->args + start + nameLen;
+   data->argsSize -= start + nameLen;
    data->appCtx = chan->appCtx;
    data->clientData = rpc->clientData;
 
+   if (VMTools_IsDispatchMonitored()) {
+      dispatchStart = Hostinfo_SystemTimerUS();
+   }
+
    if (rpc->xdrIn != NULL || rpc->xdrOut != NULL) {
       status = RpcChannelXdrWrapper(data, rpc);
    } else {
       status = rpc->callback(data);
    }
 
+   if (dispatchStart != 0) {
+      VMTools_ReportDispatch(RPCCHANNEL_DISPATCH_OWNER, name,
+                             Hostinfo_SystemTimerUS() - dispatchStart);
+   }
+
    ASSERT(data->result != NULL);
 
 exit:
    data->name = NULL;
-   free(name);
+   if (name != nameBuf) {
+      g_free(name);
+   }
    return status;
 }
 
@@ -428,6 +503,8 @@ RpcChannel_Destroy(RpcChannel *chan)
    size_t i;
    RpcChannelInt *cdata = (RpcChannelInt *) chan;
 
+   RpcChannel_ShutdownAsync(chan);
+
    if (cdata->impl.funcs != NULL && cdata->impl.funcs->shutdown != NULL) {
       cdata->impl.funcs->shutdown(chan);
    }
@@ -440,6 +517,7 @@ RpcChannel_Destroy(RpcChannel *chan)
    if (cdata->rpcs != NULL) {
       g_hash_table_destroy(cdata->rpcs);
       cdata->rpcs = NULL;
+      cdata->maxNameLen = 0;
    }
 
    cdata->resetCb = NULL;
@@ -621,6 +699,7 @@ RpcChannel_RegisterCallback(RpcChannel *chan,
       Panic("Trying to overwrite existing RPC registration for %s!\n", rpc->name);
    }
    g_hash_table_insert(cdata->rpcs, (gpointer) rpc->name, rpc);
+   cdata->maxNameLen = MAX(cdata->maxNameLen, strlen(rpc->name));
 }
 
 
@@ -657,6 +736,28 @@ RpcChannel_SetBackdoorOnly(void)
 }
 
 
+/**
+ * Returns the wakeup and latency counters of the channel's TCLO receive path.
+ *
+ * @param[in]  chan     The RPC channel instance.
+ * @param[out] stats    Where to store the counters.
+ *
+ * @return FALSE if the channel does not receive TCLO commands.
+ */
+
+gboolean
+RpcChannel_GetInStats(RpcChannel *chan,
+                      RpcInStats *stats)
+{
+   if (chan == NULL || chan->in == NULL || !chan->inStarted) {
+      return FALSE;
+   }
+
+   RpcIn_GetStats(chan->in, stats);
+   return TRUE;
+}
+
+
 /**
  * Create an RpcChannel instance using a prefered channel implementation,
  * currently this is VSockChannel.
@@ -691,6 +792,8 @@ void
 RpcChannel_Shutdown(RpcChannel *chan)
 {
    if (chan != NULL) {
+      /* The async worker may still need the send lock to drain. */
+      RpcChannel_ShutdownAsync(chan);
       g_static_mutex_free(&chan->outLock);
    }
 
@@ -759,6 +862,10 @@ RpcChannel_Start(RpcChannel *chan)
       gVSocketFailed = TRUE;
    }
 
+   if (ok) {
+      RpcChannel_StartAsync(chan);
+   }
+
    return ok;
 }
 
@@ -777,6 +884,7 @@ RpcChannel_Stop(RpcChannel *chan)
    g_return_if_fail(chan->funcs->stop != NULL);
 
    g_static_mutex_lock(&chan->outLock);
+   RpcChannel_StopAsync(chan);
    chan->funcs->stop(chan);
 
    if (chan->in != NULL) {
@@ -845,16 +953,44 @@ RpcChannel_Send(RpcChannel *chan,
                 size_t *resultLen)
 {
    gboolean ok;
+
+   ASSERT(chan && chan->funcs);
+
+   g_static_mutex_lock(&chan->outLock);
+   ok = RpcChannel_SendLocked(chan, data, dataLen, result, resultLen);
+   g_static_mutex_unlock(&chan->outLock);
+   return ok;
+}
+
+
+/**
+ * Same as RpcChannel_Send, for callers that already hold the channel's send
+ * lock.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  data        Data to send.
+ * @param[in]  dataLen     Number of bytes to send.
+ * @param[out] result      Response from other side (should be freed by
+ *                         calling RpcChannel_Free).
+ * @param[out] resultLen   Number of bytes in response.
+ *
+ * @return The status from the remote end (TRUE if call was successful).
+ */
+
+gboolean
+RpcChannel_SendLocked(RpcChannel *chan,
+                      char const *data,
+                      size_t dataLen,
+                      char **result,
+                      size_t *resultLen)
+{
+   gboolean ok;
    char *res = NULL;
    size_t resLen = 0;
    const RpcChannelFuncs *funcs;
 
    Debug(LGPFX "Sending: %"FMTSZ"u bytes\n", dataLen);
 
-   ASSERT(chan && chan->funcs);
-
-   g_static_mutex_lock(&chan->outLock);
-
    funcs = chan->funcs;
    ASSERT(funcs->send);
 
@@ -885,8 +1021,7 @@ RpcChannel_Send(RpcChannel *chan,
          goto done;
       }
 
-      ok = FALSE;
-      goto exit;
+      return FALSE;
    }
 
 done:
@@ -901,15 +1036,277 @@ done:
       *resultLen = resLen;
    }
 
-exit:
-   g_static_mutex_unlock(&chan->outLock);
    return ok;
 }
 
 
 /**
- * Open/close RpcChannel each time for sending a Rpc message, this is a wrapper
- * for RpcChannel APIs.
+ * Closes the channel shared by RpcChannel_SendOne* callers. Must be called
+ * with the lock held, while the channel isn't busy.
+ */
+
+static void
+RpcChannelSendOneClose(void)
+{
+   RpcChannel *chan = gSendOne.chan;
+
+   if (chan == NULL) {
+      return;
+   }
+   ASSERT(!gSendOne.busy);
+   gSendOne.chan = NULL;
+
+   if (gSendOne.cond != NULL) {
+      g_cond_broadcast(gSendOne.cond);
+   }
+
+#if !defined(_WIN32)
+   if (gSendOne.pid != getpid()) {
+      /*
+       * Inherited across fork(): the channel belongs to the parent, which
+       * is still using it. Stopping it here would close the parent's
+       * backdoor channel on the host, so just forget about it.
+       */
+      Debug(LGPFX "Dropping SendOne channel inherited from %d.\n",
+            (int)gSendOne.pid);
+      return;
+   }
+#endif
+
+   RpcChannel_Stop(chan);
+   RpcChannel_Destroy(chan);
+}
+
+
+/**
+ * Reaper thread for the channel shared by RpcChannel_SendOne* callers.
+ * Closes the channel once it has been idle for RPCCHANNEL_ONE_IDLE_TIMEOUT,
+ * and exits when the channel is closed, for whatever reason.
+ *
+ * @param[in]  data     Unused.
+ *
+ * @return NULL.
+ */
+
+static gpointer
+RpcChannelSendOneReaper(gpointer data)
+{
+   g_static_mutex_lock(&gSendOne.lock);
+   while (gSendOne.chan != NULL) {
+      VmTimeType idle = Hostinfo_SystemTimerUS() - gSendOne.lastUse;
+      GTimeVal deadline;
+
+      if (gSendOne.busy) {
+         /* The sender updates lastUse when it is done. */
+         g_cond_wait(gSendOne.cond, g_static_mutex_get_mutex(&gSendOne.lock));
+         continue;
+      }
+
+      if (idle >= RPCCHANNEL_ONE_IDLE_TIMEOUT) {
+         Debug(LGPFX "SendOne channel idle, closing.\n");
+         RpcChannelSendOneClose();
+         break;
+      }
+
+      g_get_current_time(&deadline);
+      g_time_val_add(&deadline, (glong)(RPCCHANNEL_ONE_IDLE_TIMEOUT - idle));
+      g_cond_timed_wait(gSendOne.cond,
+                        g_static_mutex_get_mutex(&gSendOne.lock),
+                        &deadline);
+   }
+   gSendOne.reaperRunning = FALSE;
+   g_static_mutex_unlock(&gSendOne.lock);
+   return NULL;
+}
+
+
+/**
+ * Starts the reaper thread for the shared SendOne channel, unless it is
+ * already running. Must be called with the lock held. If the thread cannot
+ * be started (e.g. the program did not initialize glib threads), the
+ * channel is only checked for idleness on the next send.
+ */
+
+static void
+RpcChannelSendOneStartReaper(void)
+{
+   GError *err = NULL;
+
+   if (!g_thread_supported()) {
+      return;
+   }
+
+#if !defined(_WIN32)
+   if (gSendOne.reaperPid != getpid()) {
+      gSendOne.reaperRunning = FALSE;
+   }
+#endif
+   if (gSendOne.reaperRunning) {
+      return;
+   }
+
+   if (gSendOne.cond == NULL) {
+      gSendOne.cond = g_cond_new();
+   }
+
+   if (g_thread_create(RpcChannelSendOneReaper, NULL, FALSE, &err) == NULL) {
+      Debug(LGPFX "Failed to start the SendOne reaper: %s\n",
+            err != NULL ? err->message : "unknown error");
+      g_clear_error(&err);
+      return;
+   }
+   gSendOne.reaperRunning = TRUE;
+#if !defined(_WIN32)
+   gSendOne.reaperPid = getpid();
+#endif
+}
+
+
+/**
+ * Returns the channel shared by RpcChannel_SendOne* callers, opening it if
+ * needed. A channel that has been idle for longer than
+ * RPCCHANNEL_ONE_IDLE_TIMEOUT is reopened rather than reused, since the
+ * other end may have dropped it; this only matters when the reaper thread
+ * could not run. Must be called with the lock held.
+ *
+ * @param[out] errMsg      Description of the error on failure.
+ *
+ * @return The channel, or NULL on failure.
+ */
+
+static RpcChannel *
+RpcChannelSendOneGet(const char **errMsg)
+{
+   VmTimeType now = Hostinfo_SystemTimerUS();
+
+   if (gSendOne.chan != NULL) {
+      if (now - gSendOne.lastUse > RPCCHANNEL_ONE_IDLE_TIMEOUT) {
+         Debug(LGPFX "SendOne channel idle, reopening.\n");
+         RpcChannelSendOneClose();
+      }
+   }
+
+   if (gSendOne.chan == NULL) {
+      RpcChannel *chan = RpcChannel_New();
+
+      if (chan == NULL) {
+         *errMsg = "RpcChannel: Unable to create the RpcChannel object";
+         return NULL;
+      }
+      if (!RpcChannel_Start(chan)) {
+         *errMsg = "RpcChannel: Unable to open the communication channel";
+         RpcChannel_Stop(chan);
+         RpcChannel_Destroy(chan);
+         return NULL;
+      }
+
+      gSendOne.chan = chan;
+#if !defined(_WIN32)
+      gSendOne.pid = getpid();
+#endif
+      RpcChannelSendOneStartReaper();
+   }
+
+   gSendOne.lastUse = now;
+   return gSendOne.chan;
+}
+
+
+/**
+ * Keeps a channel open for RpcChannel_SendOne* calls, until the matching
+ * call to RpcChannel_SendOneShutdown, so that sending many messages only
+ * pays the channel setup cost once. Without it, each message opens and
+ * closes a channel of its own. Calls may be nested.
+ */
+
+void
+RpcChannel_SendOneKeepOpen(void)
+{
+   g_static_mutex_lock(&gSendOne.lock);
+   gSendOne.users++;
+   g_static_mutex_unlock(&gSendOne.lock);
+}
+
+
+/**
+ * Ends a call to RpcChannel_SendOneKeepOpen. After the last one, the shared
+ * channel is closed, so that the host side is released right away, and its
+ * reaper thread exits.
+ */
+
+void
+RpcChannel_SendOneShutdown(void)
+{
+   g_static_mutex_lock(&gSendOne.lock);
+   ASSERT(gSendOne.users > 0);
+   if (gSendOne.users > 0) {
+      gSendOne.users--;
+   }
+   /* A busy channel is closed by its sender. */
+   if (gSendOne.users == 0 && !gSendOne.busy) {
+      RpcChannelSendOneClose();
+   }
+   g_static_mutex_unlock(&gSendOne.lock);
+}
+
+
+/**
+ * Sends a message on a channel opened for that message only.
+ *
+ * @param[in]  data        request data
+ * @param[in]  dataLen     data length
+ * @param[out] result      reply, should be freed by calling RpcChannel_Free.
+ * @param[out] resultLen   reply length
+ *
+ * @returns    TRUE on success.
+ */
+
+static gboolean
+RpcChannelSendOneTemp(const char *data,
+                      size_t dataLen,
+                      char **result,
+                      size_t *resultLen)
+{
+   RpcChannel *chan;
+   const char *errMsg = NULL;
+   gboolean status = FALSE;
+
+   chan = RpcChannel_New();
+   if (chan == NULL) {
+      errMsg = "RpcChannel: Unable to create the RpcChannel object";
+   } else if (!RpcChannel_Start(chan)) {
+      errMsg = "RpcChannel: Unable to open the communication channel";
+   } else {
+      /* On failure, we already have the description of the error. */
+      status = RpcChannel_Send(chan, data, dataLen, result, resultLen);
+   }
+
+   if (errMsg != NULL && result != NULL) {
+      *result = Util_SafeStrdup(errMsg);
+      if (resultLen != NULL) {
+         *resultLen = strlen(*result);
+      }
+   }
+
+   if (chan != NULL) {
+      RpcChannel_Stop(chan);
+      RpcChannel_Destroy(chan);
+   }
+
+   return status;
+}
+
+
+/**
+ * Sends a single Rpc message. This is a wrapper for RpcChannel APIs for
+ * callers that don't keep a channel of their own.
+ *
+ * Between RpcChannel_SendOneKeepOpen and RpcChannel_SendOneShutdown, the
+ * message is sent on a channel shared by all callers in the process. That
+ * channel is closed after being idle for a while, or after it fails in a way
+ * that RpcChannel_Send could not recover from, and reopened on the next
+ * send. Otherwise, or while another caller is sending on the shared
+ * channel, a channel is opened for this message only.
  *
  * @param[in]  data        request data
  * @param[in]  dataLen     data length
@@ -925,52 +1322,66 @@ RpcChannel_SendOneRaw(const char *data,
                       char **result,
                       size_t *resultLen)
 {
-   RpcChannel *chan;
+   RpcChannel *chan = NULL;
+   const char *errMsg = NULL;
    gboolean status;
 
-   status = FALSE;
+   g_static_mutex_lock(&gSendOne.lock);
 
-   chan = RpcChannel_New();
-   if (chan == NULL) {
-      if (result != NULL) {
-         *result = Util_SafeStrdup("RpcChannel: Unable to create "
-                                   "the RpcChannel object");
-         if (resultLen != NULL) {
-            *resultLen = strlen(*result);
-         }
+#if !defined(_WIN32)
+   if (gSendOne.chan != NULL && gSendOne.pid != getpid()) {
+      /* Inherited across fork(), maybe in the middle of a send. */
+      gSendOne.busy = FALSE;
+      RpcChannelSendOneClose();
+   }
+#endif
+
+   if (gSendOne.users > 0 && !gSendOne.busy) {
+      chan = RpcChannelSendOneGet(&errMsg);
+      if (chan != NULL) {
+         gSendOne.busy = TRUE;
       }
-      goto sent;
-   } else if (!RpcChannel_Start(chan)) {
+   }
+   g_static_mutex_unlock(&gSendOne.lock);
+
+   if (chan == NULL && errMsg != NULL) {
       if (result != NULL) {
-         *result = Util_SafeStrdup("RpcChannel: Unable to open the "
-                                   "communication channel");
+         *result = Util_SafeStrdup(errMsg);
          if (resultLen != NULL) {
             *resultLen = strlen(*result);
          }
       }
-      goto sent;
-   } else if (!RpcChannel_Send(chan, data, dataLen, result, resultLen)) {
-      /* We already have the description of the error */
-      goto sent;
-   }
+      status = FALSE;
+   } else if (chan == NULL) {
+      status = RpcChannelSendOneTemp(data, dataLen, result, resultLen);
+   } else {
+      status = RpcChannel_Send(chan, data, dataLen, result, resultLen);
 
-   status = TRUE;
+      g_static_mutex_lock(&gSendOne.lock);
+      gSendOne.busy = FALSE;
+      gSendOne.lastUse = Hostinfo_SystemTimerUS();
+      /*
+       * We already have the description of the error. A failed RPC leaves
+       * the channel usable; only drop it if the channel itself went down
+       * and could not be restarted, or if it was released meanwhile.
+       */
+      if ((!status && !chan->outStarted) || gSendOne.users == 0) {
+         RpcChannelSendOneClose();
+      } else if (gSendOne.cond != NULL) {
+         g_cond_broadcast(gSendOne.cond);
+      }
+      g_static_mutex_unlock(&gSendOne.lock);
+   }
 
-sent:
    Debug(LGPFX "Request %s: reqlen=%"FMTSZ"u, replyLen=%"FMTSZ"u\n",
          status ? "OK" : "FAILED", dataLen, resultLen ? *resultLen : 0);
-   if (chan) {
-      RpcChannel_Stop(chan);
-      RpcChannel_Destroy(chan);
-   }
 
    return status;
 }
 
 
 /**
- * Open/close RpcChannel each time for sending a Rpc message, this is a wrapper
- * for RpcChannel APIs.
+ * Formats and sends a single Rpc message using RpcChannel_SendOneRaw.
  *
  * @param[out] reply       reply, should be freed by calling RpcChannel_Free.
  * @param[out] repLen      reply length
@@ -0,0 +1,610 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file rpcChannelAsync.c
+ *
+ *    Asynchronous send support for RPC channels.
+ *
+ *    Requests queued with RpcChannel_SendAsync() are sent by a worker thread
+ *    owned by the channel. If the channel implementation provides the async
+ *    transport functions, the worker keeps up to
+ *    RPCCHANNEL_ASYNC_MAX_OUTSTANDING requests in flight on a connection of
+ *    its own, and matches replies to requests in the order they were sent.
+ *    Otherwise (e.g. the backdoor channel), or if the pipelined connection
+ *    cannot be opened, the worker sends one request at a time through the
+ *    synchronous path. Queuing a request never waits for the channel's send
+ *    lock, which synchronous senders hold for a full round trip.
+ *
+ *    Completion callbacks run in the main context the channel was set up
+ *    with, or in the worker thread if the channel has none.
+ *
+ *    Requests are never sent twice: when the pipelined connection fails, the
+ *    requests waiting for a reply are failed, since the host may already
+ *    have received them. Stopping the channel aborts the connection the same
+ *    way, and holds the queued requests until the channel is started again;
+ *    the worker never restarts a channel its owner stopped. The connection
+ *    is aborted rather than drained, so a host that stops replying cannot
+ *    keep a stop or shutdown waiting.
+ */
+
+#include <string.h>
+
+#include "rpcChannelInt.h"
+#include "util.h"
+#include "debug.h"
+
+#define LGPFX "RpcChanAsync: "
+
+/** Max number of requests waiting to be sent. */
+#define RPCCHANNEL_ASYNC_MAX_QUEUED       1024
+
+/** Guards the creation and destruction of the channels' async state. */
+static GStaticMutex gAsyncLock = G_STATIC_MUTEX_INIT;
+
+typedef struct RpcChannelAsyncReq {
+   char              *data;
+   size_t             dataLen;
+   RpcChannelSendCb   cb;
+   gpointer           cbData;
+   GMainContext      *mainCtx;
+   gboolean           status;
+   char              *result;
+   size_t             resultLen;
+} RpcChannelAsyncReq;
+
+struct RpcChannelAsync {
+   RpcChannel        *chan;
+   GThread           *thread;
+   GMutex            *lock;
+   GCond             *cond;
+   GQueue            *queued;
+   GQueue            *inFlight;      // Only touched by the worker thread.
+   /*
+    * conn and connFuncs are only set by the worker thread, under lock; the
+    * worker may use them without the lock.
+    */
+   gpointer           conn;
+   const RpcChannelFuncs *connFuncs; // Implementation that opened conn.
+   gboolean           reset;         // Close conn, the channel was stopped.
+   gboolean           stopped;       // Hold queued requests until started.
+   gboolean           stop;
+};
+
+
+/**
+ * Frees a request and its results.
+ *
+ * @param[in]  req      The request.
+ */
+
+static void
+RpcChannelAsyncFreeReq(RpcChannelAsyncReq *req)
+{
+   if (req->mainCtx != NULL) {
+      g_main_context_unref(req->mainCtx);
+   }
+   g_free(req->data);
+   g_free(req->result);
+   g_free(req);
+}
+
+
+/**
+ * Idle callback that runs a request's completion callback in the main
+ * context it was submitted from.
+ *
+ * @param[in]  _req     The request.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+RpcChannelAsyncCompleteCb(gpointer _req)
+{
+   RpcChannelAsyncReq *req = _req;
+
+   req->cb(req->status, req->result, req->resultLen, req->cbData);
+   return FALSE;
+}
+
+
+/**
+ * Records the result of a request and hands it to its completion callback.
+ * Takes ownership of the request.
+ *
+ * @param[in]  req         The request.
+ * @param[in]  status      Status of the RPC.
+ * @param[in]  result      Reply, or description of the error (may be NULL).
+ * @param[in]  resultLen   Length of the reply.
+ */
+
+static void
+RpcChannelAsyncComplete(RpcChannelAsyncReq *req,
+                        gboolean status,
+                        const char *result,
+                        size_t resultLen)
+{
+   GSource *src;
+
+   if (req->cb == NULL) {
+      RpcChannelAsyncFreeReq(req);
+      return;
+   }
+
+   req->status = status;
+   if (result != NULL) {
+      req->result = g_malloc(resultLen + 1);
+      memcpy(req->result, result, resultLen);
+      req->result[resultLen] = '\0';
+      req->resultLen = resultLen;
+   }
+
+   if (req->mainCtx == NULL) {
+      RpcChannelAsyncCompleteCb(req);
+      RpcChannelAsyncFreeReq(req);
+      return;
+   }
+
+   src = g_idle_source_new();
+   g_source_set_callback(src, RpcChannelAsyncCompleteCb, req,
+                         (GDestroyNotify) RpcChannelAsyncFreeReq);
+   g_source_attach(src, req->mainCtx);
+   g_source_unref(src);
+}
+
+
+/**
+ * Sends a request using the synchronous channel path and completes it. If
+ * the channel was stopped, the request is put back at the head of the queue
+ * instead, so that sending it doesn't restart the channel.
+ *
+ * @param[in]  async    Async state.
+ * @param[in]  req      The request.
+ */
+
+static void
+RpcChannelAsyncSendSync(struct RpcChannelAsync *async,
+                        RpcChannelAsyncReq *req)
+{
+   RpcChannel *chan = async->chan;
+   char *result = NULL;
+   size_t resultLen = 0;
+   gboolean stopped;
+   gboolean ok = FALSE;
+
+   /* RpcChannel_Stop sets "stopped" with the send lock held. */
+   g_static_mutex_lock(&chan->outLock);
+   g_mutex_lock(async->lock);
+   stopped = async->stopped;
+   if (stopped) {
+      g_queue_push_head(async->queued, req);
+   }
+   g_mutex_unlock(async->lock);
+
+   if (!stopped) {
+      ok = RpcChannel_SendLocked(chan, req->data, req->dataLen,
+                                 &result, &resultLen);
+   }
+   g_static_mutex_unlock(&chan->outLock);
+
+   if (!stopped) {
+      RpcChannelAsyncComplete(req, ok, result, resultLen);
+      RpcChannel_Free(result);
+   }
+}
+
+
+/**
+ * Opens the worker's pipelined connection, if the channel implementation
+ * supports one and the channel isn't stopped. Called by the worker thread
+ * without the lock held.
+ *
+ * @param[in]  async    Async state.
+ */
+
+static void
+RpcChannelAsyncOpenConn(struct RpcChannelAsync *async)
+{
+   const RpcChannelFuncs *funcs;
+   gpointer conn = NULL;
+   gboolean stopped;
+
+   /*
+    * The implementation may change under us (vsock falling back to the
+    * backdoor, under the send lock), so remember which one owns the
+    * connection.
+    */
+   g_static_mutex_lock(&async->chan->outLock);
+   funcs = async->chan->funcs;
+   g_static_mutex_unlock(&async->chan->outLock);
+
+   if (funcs->asyncOpen != NULL) {
+      conn = funcs->asyncOpen(async->chan);
+   }
+
+   if (conn != NULL) {
+      g_mutex_lock(async->lock);
+      stopped = async->stopped;
+      if (!stopped) {
+         async->conn = conn;
+         async->connFuncs = funcs;
+      }
+      g_mutex_unlock(async->lock);
+
+      if (stopped) {
+         /* Stopped while opening: don't send anything on it. */
+         funcs->asyncClose(conn);
+      }
+   }
+}
+
+
+/**
+ * Closes the worker's pipelined connection, if any. Called by the worker
+ * thread without the lock held.
+ *
+ * @param[in]  async    Async state.
+ */
+
+static void
+RpcChannelAsyncCloseConn(struct RpcChannelAsync *async)
+{
+   gpointer conn;
+
+   g_mutex_lock(async->lock);
+   conn = async->conn;
+   async->conn = NULL;
+   g_mutex_unlock(async->lock);
+
+   if (conn != NULL) {
+      async->connFuncs->asyncClose(conn);
+   }
+}
+
+
+/**
+ * Aborts the worker's pipelined connection so that a receive blocked on it
+ * fails. Called with the lock held, from any thread.
+ *
+ * @param[in]  async    Async state.
+ */
+
+static void
+RpcChannelAsyncAbortConn(struct RpcChannelAsync *async)
+{
+   if (async->conn != NULL) {
+      async->connFuncs->asyncAbort(async->conn);
+   }
+}
+
+
+/**
+ * Closes the pipelined connection after it failed or was aborted, and fails
+ * every request still waiting for a reply. They are not resent: the host
+ * may have received them already.
+ *
+ * @param[in]  async    Async state.
+ */
+
+static void
+RpcChannelAsyncConnFailed(struct RpcChannelAsync *async)
+{
+   static const char err[] = "RpcChannel: connection lost";
+   RpcChannelAsyncReq *req;
+
+   Debug(LGPFX "Pipelined connection failed, %u requests outstanding.\n",
+         g_queue_get_length(async->inFlight));
+
+   RpcChannelAsyncCloseConn(async);
+
+   while ((req = g_queue_pop_head(async->inFlight)) != NULL) {
+      RpcChannelAsyncComplete(req, FALSE, err, sizeof err - 1);
+   }
+}
+
+
+/**
+ * Worker thread. Keeps the pipeline full while there are queued requests,
+ * and completes in-flight requests as their replies arrive.
+ *
+ * @param[in]  _async   Async state.
+ *
+ * @return NULL.
+ */
+
+static gpointer
+RpcChannelAsyncThread(gpointer _async)
+{
+   struct RpcChannelAsync *async = _async;
+   RpcChannelAsyncReq *req;
+
+   g_mutex_lock(async->lock);
+   for (;;) {
+      if (async->reset) {
+         /* The channel was stopped: drop the connection, if any. */
+         async->reset = FALSE;
+         g_mutex_unlock(async->lock);
+         if (g_queue_is_empty(async->inFlight)) {
+            RpcChannelAsyncCloseConn(async);
+         } else {
+            RpcChannelAsyncConnFailed(async);
+         }
+         g_mutex_lock(async->lock);
+         continue;
+      }
+
+      if (g_queue_is_empty(async->inFlight)) {
+         if (async->stop) {
+            break;
+         }
+         if (async->stopped || g_queue_is_empty(async->queued)) {
+            g_cond_wait(async->cond, async->lock);
+            continue;
+         }
+      }
+
+      if (!async->stop && !async->stopped &&
+          !g_queue_is_empty(async->queued) &&
+          g_queue_get_length(async->inFlight) <
+             RPCCHANNEL_ASYNC_MAX_OUTSTANDING) {
+         req = g_queue_pop_head(async->queued);
+         g_mutex_unlock(async->lock);
+
+         if (async->conn == NULL) {
+            RpcChannelAsyncOpenConn(async);
+         }
+
+         if (async->conn == NULL) {
+            /*
+             * No pipelining available, or the channel was just stopped; run
+             * the request synchronously, or hold it.
+             */
+            RpcChannelAsyncSendSync(async, req);
+         } else if (async->connFuncs->asyncSend(async->conn, req->data,
+                                                req->dataLen)) {
+            g_queue_push_tail(async->inFlight, req);
+         } else {
+            g_queue_push_tail(async->inFlight, req);
+            RpcChannelAsyncConnFailed(async);
+         }
+
+         g_mutex_lock(async->lock);
+         continue;
+      }
+
+      /* Pipeline is full, or nothing else to send: wait for a reply. */
+      g_mutex_unlock(async->lock);
+      {
+         gboolean status;
+         const char *reply = NULL;
+         size_t replyLen = 0;
+
+         if (async->connFuncs->asyncRecv(async->conn, &status,
+                                         &reply, &replyLen)) {
+            req = g_queue_pop_head(async->inFlight);
+            RpcChannelAsyncComplete(req, status, reply, replyLen);
+         } else {
+            RpcChannelAsyncConnFailed(async);
+         }
+      }
+      g_mutex_lock(async->lock);
+   }
+
+   while ((req = g_queue_pop_head(async->queued)) != NULL) {
+      static const char err[] = "RpcChannel: channel shut down";
+
+      RpcChannelAsyncComplete(req, FALSE, err, sizeof err - 1);
+   }
+   g_mutex_unlock(async->lock);
+
+   RpcChannelAsyncCloseConn(async);
+   return NULL;
+}
+
+
+/**
+ * Queues an RPC to be sent to the host without waiting for the reply.
+ *
+ * Requests are sent in the order they are queued. On channels that support
+ * it, several requests are kept in flight at once on a separate connection,
+ * so callers sending many messages don't pay a full round trip for each.
+ *
+ * The completion callback is called from the main context the channel was
+ * set up with (from a worker thread if there is none). The result passed to
+ * the callback is only valid for the duration of the call. Requests queued
+ * while the channel is stopped are sent once it is started again.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ * @param[in]  data        Data to send.
+ * @param[in]  dataLen     Number of bytes to send.
+ * @param[in]  cb          Completion callback (may be NULL).
+ * @param[in]  cbData      Data for the completion callback.
+ *
+ * @return TRUE if the request was queued; FALSE if the queue is full or the
+ *         worker thread could not be started (the program must have
+ *         initialized glib threads). The callback is not called in that
+ *         case.
+ */
+
+gboolean
+RpcChannel_SendAsync(RpcChannel *chan,
+                     char const *data,
+                     size_t dataLen,
+                     RpcChannelSendCb cb,
+                     gpointer cbData)
+{
+   struct RpcChannelAsync *async;
+   RpcChannelAsyncReq *req;
+   gboolean ret = FALSE;
+
+   ASSERT(chan && chan->funcs);
+
+   g_static_mutex_lock(&gAsyncLock);
+
+   if (chan->async == NULL) {
+      GError *err = NULL;
+
+      if (!g_thread_supported()) {
+         Debug(LGPFX "Threads not initialized, cannot send asynchronously.\n");
+         goto exit;
+      }
+
+      async = g_new0(struct RpcChannelAsync, 1);
+      async->chan = chan;
+      async->lock = g_mutex_new();
+      async->cond = g_cond_new();
+      async->queued = g_queue_new();
+      async->inFlight = g_queue_new();
+      async->thread = g_thread_create(RpcChannelAsyncThread, async, TRUE, &err);
+      if (async->thread == NULL) {
+         Warning(LGPFX "Failed to start async send thread: %s\n",
+                 err != NULL ? err->message : "unknown error");
+         g_clear_error(&err);
+         g_queue_free(async->inFlight);
+         g_queue_free(async->queued);
+         g_cond_free(async->cond);
+         g_mutex_free(async->lock);
+         g_free(async);
+         goto exit;
+      }
+      chan->async = async;
+   }
+   async = chan->async;
+
+   g_mutex_lock(async->lock);
+   if (!async->stop &&
+       g_queue_get_length(async->queued) < RPCCHANNEL_ASYNC_MAX_QUEUED) {
+      req = g_new0(RpcChannelAsyncReq, 1);
+      req->data = g_malloc(dataLen);
+      memcpy(req->data, data, dataLen);
+      req->dataLen = dataLen;
+      req->cb = cb;
+      req->cbData = cbData;
+      if (chan->mainCtx != NULL) {
+         req->mainCtx = g_main_context_ref(chan->mainCtx);
+      }
+      g_queue_push_tail(async->queued, req);
+      g_cond_signal(async->cond);
+      ret = TRUE;
+   } else {
+      Debug(LGPFX "Async send queue is full, dropping %"FMTSZ"u bytes.\n",
+            dataLen);
+   }
+   g_mutex_unlock(async->lock);
+
+exit:
+   g_static_mutex_unlock(&gAsyncLock);
+   return ret;
+}
+
+
+/**
+ * Lets the async send worker send the requests held while the channel was
+ * stopped. Called when the channel is started.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ */
+
+void
+RpcChannel_StartAsync(RpcChannel *chan)
+{
+   struct RpcChannelAsync *async;
+
+   g_static_mutex_lock(&gAsyncLock);
+   async = chan->async;
+   if (async != NULL) {
+      g_mutex_lock(async->lock);
+      async->stopped = FALSE;
+      g_cond_signal(async->cond);
+      g_mutex_unlock(async->lock);
+   }
+   g_static_mutex_unlock(&gAsyncLock);
+}
+
+
+/**
+ * Aborts the async send worker's pipelined connection when the channel is
+ * stopped. Requests waiting for a reply are failed; queued requests are
+ * held until the channel is started again. Called with the channel's send
+ * lock held.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ */
+
+void
+RpcChannel_StopAsync(RpcChannel *chan)
+{
+   struct RpcChannelAsync *async;
+
+   g_static_mutex_lock(&gAsyncLock);
+   async = chan->async;
+   if (async != NULL) {
+      g_mutex_lock(async->lock);
+      async->reset = TRUE;
+      async->stopped = TRUE;
+      RpcChannelAsyncAbortConn(async);
+      g_cond_signal(async->cond);
+      g_mutex_unlock(async->lock);
+   }
+   g_static_mutex_unlock(&gAsyncLock);
+}
+
+
+/**
+ * Stops the channel's async send worker, if running. The pipelined
+ * connection is aborted, so requests still waiting for a reply are failed,
+ * as are requests still queued.
+ *
+ * @param[in]  chan        The RPC channel instance.
+ */
+
+void
+RpcChannel_ShutdownAsync(RpcChannel *chan)
+{
+   struct RpcChannelAsync *async;
+
+   /*
+    * Don't join with gAsyncLock held: the worker may be waiting for the
+    * send lock, held by a sender that is starting the channel.
+    */
+   g_static_mutex_lock(&gAsyncLock);
+   async = chan->async;
+   chan->async = NULL;
+   g_static_mutex_unlock(&gAsyncLock);
+
+   if (async == NULL) {
+      return;
+   }
+
+   g_mutex_lock(async->lock);
+   async->stop = TRUE;
+   RpcChannelAsyncAbortConn(async);
+   g_cond_signal(async->cond);
+   g_mutex_unlock(async->lock);
+
+   g_thread_join(async->thread);
+
+   ASSERT(g_queue_is_empty(async->queued));
+   ASSERT(g_queue_is_empty(async->inFlight));
+   g_queue_free(async->inFlight);
+   g_queue_free(async->queued);
+   g_cond_free(async->cond);
+   g_mutex_free(async->lock);
+   g_free(async);
+}
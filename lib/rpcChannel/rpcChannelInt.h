@@ -30,7 +30,11 @@
 /** Max amount of time (in .01s) that the RpcIn loop will sleep for. */
 #define RPCIN_MAX_DELAY    10
 
+/** Max number of async requests sent but not yet replied to. */
+#define RPCCHANNEL_ASYNC_MAX_OUTSTANDING  8
+
 struct RpcIn;
+struct RpcChannelAsync;
 
 /** a list of interface functions for a channel implementation */
 typedef struct _RpcChannelFuncs{
@@ -44,6 +48,18 @@ typedef struct _RpcChannelFuncs{
    RpcChannelType (*getType)(RpcChannel *chan);
    void (*onStartErr)(RpcChannel *);
    gboolean (*stopRpcOut)(RpcChannel *);
+   /*
+    * Optional pipelined transport used by RpcChannel_SendAsync: a separate
+    * connection on which several requests may be sent before reading their
+    * replies, which must come back in order. asyncAbort may be called
+    * from another thread and must make a blocked asyncRecv fail.
+    */
+   gpointer (*asyncOpen)(RpcChannel *);
+   gboolean (*asyncSend)(gpointer conn, char const *data, size_t dataLen);
+   gboolean (*asyncRecv)(gpointer conn, gboolean *status,
+                         const char **reply, size_t *replyLen);
+   void (*asyncAbort)(gpointer conn);
+   void (*asyncClose)(gpointer conn);
 } RpcChannelFuncs;
 
 /** Defines the interface between the application and the RPC channel. */
@@ -57,6 +73,7 @@ struct _RpcChannel {
    struct RpcIn              *in;
    gboolean                  inStarted;
    gboolean                  outStarted;
+   struct RpcChannelAsync    *async;
 };
 
 void
@@ -66,6 +83,18 @@ RpcChannel *VSockChannel_New(void);
 RpcChannel *BackdoorChannel_New(void);
 gboolean
 BackdoorChannel_Fallback(RpcChannel *chan);
+gboolean
+RpcChannel_SendLocked(RpcChannel *chan,
+                      char const *data,
+                      size_t dataLen,
+                      char **result,
+                      size_t *resultLen);
+void
+RpcChannel_StartAsync(RpcChannel *chan);
+void
+RpcChannel_StopAsync(RpcChannel *chan);
+void
+RpcChannel_ShutdownAsync(RpcChannel *chan);
 
 #endif /* _RPCCHANNELINT_H_ */
 
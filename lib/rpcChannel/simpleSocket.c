@@ -150,6 +150,42 @@ Socket_Close(SOCKET sock)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Socket_Shutdown --
+ *
+ *      Shuts down both directions of a socket without closing it, e.g. to
+ *      make a receive blocked in another thread fail.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Socket_Shutdown(SOCKET sock)
+{
+   int res;
+
+#if defined(_WIN32)
+   res = shutdown(sock, SD_BOTH);
+#else
+   res = shutdown(sock, SHUT_RDWR);
+#endif
+
+   if (res == SOCKET_ERROR) {
+      int err = SocketGetLastError();
+      Debug(LGPFX "Error in shutting down socket %d: %d[%s]\n",
+            sock, err, Err_Errno2String(err));
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -69,6 +69,7 @@ typedef int SOCKET;
 #define PRIVILEGED_PORT_MIN    1
 
 void Socket_Close(SOCKET sock);
+void Socket_Shutdown(SOCKET sock);
 SOCKET Socket_ConnectVMCI(unsigned int cid,
                           unsigned int port,
                           gboolean isPriv,
@@ -221,18 +221,13 @@ VSockOutStop(VSockOut *out)    // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * VSockOutSend --
- *
- *    Make VMware synchronously execute a TCLO command
+ * VSockOutSendRequest --
  *
- *    Unlike the other send varieties, VSockOutSend requires that the
- *    caller pass non-NULL reply and repLen arguments.
+ *    Send a TCLO command without waiting for its result.
  *
  * Result
- *    TRUE on success. 'reply' contains the result of the rpc
- *    FALSE on error. 'reply' will contain a description of the error
- *
- *    In both cases, the caller should not free the reply.
+ *    TRUE on success.
+ *    FALSE on error. 'reply' will contain a description of the error.
  *
  * Side-effects
  *    None
@@ -241,25 +236,56 @@ VSockOutStop(VSockOut *out)    // IN
  */
 
 static gboolean
-VSockOutSend(VSockOut *out,        // IN
-             const char *request,  // IN
-             size_t reqLen,        // IN
-             const char **reply,   // OUT
-             size_t *repLen)       // OUT
+VSockOutSendRequest(VSockOut *out,        // IN
+                    const char *request,  // IN
+                    size_t reqLen,        // IN
+                    const char **reply)   // OUT
 {
    ASSERT(out);
    ASSERT(out->fd != INVALID_SOCKET);
 
-   *reply = NULL;
-   *repLen = 0;
-
    Debug(LGPFX "Sending request for conn %d,  reqLen=%d\n",
          out->fd, (int)reqLen);
 
    if (!Socket_SendPacket(out->fd, request, reqLen)) {
       *reply = "VSockOut: Unable to send data for the RPCI command";
-      goto error;
+      return FALSE;
    }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockOutRecvReply --
+ *
+ *    Receive the result of the oldest TCLO command sent on the connection.
+ *
+ * Result
+ *    TRUE if a well formed result was received; 'status' is the status of
+ *    the rpc and 'reply' its result.
+ *    FALSE on error. 'reply' will contain a description of the error.
+ *
+ *    In both cases, the caller should not free the reply. It is valid until
+ *    the next reply is received on the connection.
+ *
+ * Side-effects
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockOutRecvReply(VSockOut *out,        // IN
+                  gboolean *status,     // OUT
+                  const char **reply,   // OUT
+                  size_t *repLen)       // OUT
+{
+   ASSERT(out);
+   ASSERT(out->fd != INVALID_SOCKET);
+
+   *status = FALSE;
 
    free(out->payload);
    out->payload = NULL;
@@ -276,12 +302,13 @@ VSockOutSend(VSockOut *out,        // IN
       goto error;
    }
 
+   *status = out->payload[0] == '1';
    *reply = out->payload + 2;
    *repLen = out->payloadLen - 2;
 
    Debug("VSockOut: recved %d bytes for conn %d\n", out->payloadLen, out->fd);
 
-   return out->payload[0] == '1';
+   return TRUE;
 
 error:
    *repLen = strlen(*reply);
@@ -289,6 +316,49 @@ error:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockOutSend --
+ *
+ *    Make VMware synchronously execute a TCLO command
+ *
+ *    Unlike the other send varieties, VSockOutSend requires that the
+ *    caller pass non-NULL reply and repLen arguments.
+ *
+ * Result
+ *    TRUE on success. 'reply' contains the result of the rpc
+ *    FALSE on error. 'reply' will contain a description of the error
+ *
+ *    In both cases, the caller should not free the reply.
+ *
+ * Side-effects
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockOutSend(VSockOut *out,        // IN
+             const char *request,  // IN
+             size_t reqLen,        // IN
+             const char **reply,   // OUT
+             size_t *repLen)       // OUT
+{
+   gboolean status;
+
+   *reply = NULL;
+   *repLen = 0;
+
+   if (!VSockOutSendRequest(out, request, reqLen, reply)) {
+      *repLen = strlen(*reply);
+      return FALSE;
+   }
+
+   return VSockOutRecvReply(out, &status, reply, repLen) && status;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -529,6 +599,150 @@ VSockChannelStopRpcOut(RpcChannel *chan)
 
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelAsyncOpen --
+ *
+ *      Opens a separate vsocket connection for pipelined async sends.
+ *
+ * Result:
+ *      The connection, or NULL on failure.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+VSockChannelAsyncOpen(RpcChannel *chan)    // IN
+{
+   VSockOut *out = VSockOutConstruct();
+
+   if (out != NULL && !VSockOutStart(out)) {
+      VSockOutDestruct(out);
+      out = NULL;
+   }
+   return out;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelAsyncSend --
+ *
+ *      Sends a request on a pipelined connection.
+ *
+ * Result:
+ *      TRUE on success.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockChannelAsyncSend(gpointer conn,       // IN
+                      char const *data,    // IN
+                      size_t dataLen)      // IN
+{
+   const char *err;
+
+   if (!VSockOutSendRequest(conn, data, dataLen, &err)) {
+      Debug(LGPFX "%s\n", err);
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelAsyncRecv --
+ *
+ *      Receives the reply to the oldest request sent on a pipelined
+ *      connection.
+ *
+ * Result:
+ *      TRUE if a reply was received, FALSE if the connection failed.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VSockChannelAsyncRecv(gpointer conn,          // IN
+                      gboolean *status,       // OUT
+                      const char **reply,     // OUT
+                      size_t *replyLen)       // OUT
+{
+   if (!VSockOutRecvReply(conn, status, reply, replyLen)) {
+      Debug(LGPFX "%s\n", *reply);
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelAsyncAbort --
+ *
+ *      Shuts a pipelined connection down so that a receive blocked on it,
+ *      in another thread, returns an error. The socket stays open until
+ *      VSockChannelAsyncClose.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VSockChannelAsyncAbort(gpointer conn)    // IN
+{
+   VSockOut *out = conn;
+
+   if (out->fd != INVALID_SOCKET) {
+      Socket_Shutdown(out->fd);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VSockChannelAsyncClose --
+ *
+ *      Closes a pipelined connection.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VSockChannelAsyncClose(gpointer conn)    // IN
+{
+   VSockOutStop(conn);
+   VSockOutDestruct(conn);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -560,7 +774,12 @@ VSockChannel_New(void)
       VSockChannelShutdown,
       VSockChannelGetType,
       VSockChannelOnStartErr,
-      VSockChannelStopRpcOut
+      VSockChannelStopRpcOut,
+      VSockChannelAsyncOpen,
+      VSockChannelAsyncSend,
+      VSockChannelAsyncRecv,
+      VSockChannelAsyncAbort,
+      VSockChannelAsyncClose
    };
 
    chan = RpcChannel_Create();
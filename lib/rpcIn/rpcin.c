@@ -79,9 +79,11 @@
 #include "rpcin.h"
 #include "util.h"
 #include "system.h"
+#include "hostinfo.h"
 
 #if !defined(VMTOOLS_USE_GLIB)
 #include "eventManager.h"
+#include "hashTable.h"
 
 /* Which event queue should RPC events be added to? */
 static DblLnkLst_Links *gTimerEventQueue;
@@ -90,20 +92,32 @@ static DblLnkLst_Links *gTimerEventQueue;
  * The RpcIn object
  */
 
-/* The list of TCLO command callbacks we support */
-typedef struct RpcInCallbackList {
+/* Initial number of buckets of the TCLO command table (a power of 2) */
+#define RPCIN_CALLBACK_BUCKETS   64
+
+/* Command names shorter than this are looked up without allocating */
+#define RPCIN_NAME_BUF_SIZE      128
+
+/* A TCLO command callback we support, keyed by name in RpcIn.callbacks */
+typedef struct RpcInCallbackEntry {
    const char *name;
    size_t length; /* Length of name so we don't have to strlen a lot */
    RpcIn_Callback callback;
-   struct RpcInCallbackList *next;
    void *clientData;
-} RpcInCallbackList;
+} RpcInCallbackEntry;
 
 #endif /* VMTOOLS_USE_GLIB */
 
 #if defined(VMTOOLS_USE_VSOCKET)
 
 #define RPCIN_HEARTBEAT_INTERVAL              1000             /* 1 second */
+/*
+ * A channel that fell back to the backdoor retries vsock after this long,
+ * in us, doubling the wait after every failed retry and giving up after
+ * RPCIN_VSOCK_MAX_RETRIES (about an hour in total).
+ */
+#define RPCIN_VSOCK_RETRY_INTERVAL            (60 * 1000000)   /* 1 minute */
+#define RPCIN_VSOCK_MAX_RETRIES               6
 #define RPCIN_MIN_SEND_BUF_SIZE               (64 * 1024)
 #define RPCIN_MIN_RECV_BUF_SIZE               (64 * 1024)
 
@@ -139,13 +153,29 @@ struct RpcIn {
    RpcIn_Callback dispatch;
    gpointer clientData;
 #else
-   RpcInCallbackList *callbacks;
+   HashTable *callbacks;   /* Name -> RpcInCallbackEntry */
+   size_t maxNameLen;      /* Longest registered command name */
    Event *nextEvent;
 #endif
 
 #if defined(VMTOOLS_USE_VSOCKET)
    ConnInfo *conn;
    GSource *heartbeatSrc;
+   VmTimeType lastVsockAttempt;  /* When vsock was last tried, in us */
+   VmTimeType vsockRetryInterval;  /* Current vsock retry backoff, in us */
+   unsigned int vsockRetries;    /* vsock retries since the last connection */
+#endif
+
+#if defined(VMTOOLS_USE_GLIB)
+   /*
+    * Receive path instrumentation. cmdArrival and cmdPollInterval describe
+    * the command about to be dispatched by RpcInExecRpc.
+    */
+   RpcInStats stats;
+   VmTimeType statsMinuteStart;
+   uint64 statsMinuteWakeups;
+   VmTimeType cmdArrival;
+   unsigned int cmdPollInterval;
 #endif
 
    Message_Channel *channel;
@@ -189,6 +219,66 @@ static Bool RpcInExecRpc(RpcIn *in,            // IN
                          const char **errmsg); // OUT
 static Bool RpcInOpenChannel(RpcIn *in, Bool useBackdoorOnly);
 
+#if defined(VMTOOLS_USE_GLIB)
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInRollStatsWindow --
+ *
+ *      Closes the current one minute wakeup window if it has elapsed.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInRollStatsWindow(RpcIn *in,          // IN
+                     VmTimeType now)     // IN
+{
+   VmTimeType elapsed = now - in->statsMinuteStart;
+
+   if (elapsed >= 60 * 1000000) {
+      /* A window with no wakeup at all leaves nothing to report. */
+      in->stats.lastMinuteWakeups = elapsed < 2 * 60 * 1000000 ?
+                                    in->statsMinuteWakeups : 0;
+      in->statsMinuteWakeups = 0;
+      in->statsMinuteStart = now;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInCountWakeup --
+ *
+ *      Accounts one timer or socket wakeup of the receive path.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInCountWakeup(RpcIn *in)     // IN
+{
+   RpcInRollStatsWindow(in, Hostinfo_SystemTimerUS());
+   in->stats.wakeups++;
+   in->statsMinuteWakeups++;
+}
+
+#endif /* VMTOOLS_USE_GLIB */
+
 /*
  * The following functions are only needed in the non-glib version of the
  * library. The glib version of the library only deals with the transport
@@ -253,12 +343,38 @@ RpcIn_Construct(DblLnkLst_Links *eventQueue)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInFreeCallback --
+ *
+ *      Frees a callback entry when it is removed from the command table.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInFreeCallback(void *clientData) // IN
+{
+   RpcInCallbackEntry *p = clientData;
+
+   free((void *) p->name);
+   free(p);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * RpcInLookupCallback --
  *
- *      Lookup a callback struct in our list.
+ *      Lookup a callback struct in our table.
  *
  * Results:
  *      The callback if found
@@ -270,22 +386,21 @@ RpcIn_Construct(DblLnkLst_Links *eventQueue)
  *-----------------------------------------------------------------------------
  */
 
-static RpcInCallbackList *
+static RpcInCallbackEntry *
 RpcInLookupCallback(RpcIn *in,        // IN
                     const char *name) // IN
 {
-   RpcInCallbackList *p;
+   void *p = NULL;
 
    ASSERT(in);
    ASSERT(name);
 
-   for (p = in->callbacks; p; p = p->next) {
-      if (strcmp(name, p->name) == 0) {
-         return p;
-      }
+   if (in->callbacks == NULL ||
+       !HashTable_Lookup(in->callbacks, name, &p)) {
+      return NULL;
    }
 
-   return NULL;
+   return p;
 }
 
 
@@ -316,7 +431,7 @@ RpcIn_RegisterCallback(RpcIn *in,               // IN
                        RpcIn_Callback cb,       // IN
                        void *clientData)        // IN
 {
-   RpcInCallbackList *p;
+   RpcInCallbackEntry *p;
 
    Debug("RpcIn: Registering callback '%s'\n", name);
 
@@ -325,17 +440,23 @@ RpcIn_RegisterCallback(RpcIn *in,               // IN
    ASSERT(cb);
    ASSERT(RpcInLookupCallback(in, name) == NULL); // not there yet
 
-   p = (RpcInCallbackList *) malloc(sizeof(RpcInCallbackList));
+   if (in->callbacks == NULL) {
+      in->callbacks = HashTable_Alloc(RPCIN_CALLBACK_BUCKETS,
+                                      HASH_STRING_KEY | HASH_FLAG_COPYKEY,
+                                      RpcInFreeCallback);
+   }
+
+   p = (RpcInCallbackEntry *) malloc(sizeof(RpcInCallbackEntry));
    ASSERT_NOT_IMPLEMENTED(p);
 
    p->length = strlen(name);
    p->name = strdup(name);
    p->callback = cb;
    p->clientData = clientData;
+   ASSERT_NOT_IMPLEMENTED(p->name);
 
-   p->next = in->callbacks;
-
-   in->callbacks = p;
+   HashTable_Insert(in->callbacks, p->name, p);
+   in->maxNameLen = MAX(in->maxNameLen, p->length);
 }
 
 
@@ -359,29 +480,20 @@ void
 RpcIn_UnregisterCallback(RpcIn *in,               // IN
                          const char *name)        // IN
 {
-   RpcInCallbackList *cur, *prev;
+   Bool removed;
 
    ASSERT(in);
    ASSERT(name);
 
    Debug("RpcIn: Unregistering callback '%s'\n", name);
 
-   for (cur = in->callbacks, prev = NULL; cur && strcmp(cur->name, name);
-        prev = cur, cur = cur->next);
-
    /*
     * If we called UnregisterCallback on a name that doesn't exist, we
     * have a problem.
     */
-   ASSERT(cur != NULL);
-
-   if (prev == NULL) {
-      in->callbacks = cur->next;
-   } else {
-      prev->next = cur->next;
-   }
-   free((void *)cur->name);
-   free(cur);
+   ASSERT(in->callbacks != NULL);
+   removed = HashTable_Delete(in->callbacks, name);
+   ASSERT(removed);
 }
 
 
@@ -469,13 +581,9 @@ RpcIn_Destruct(RpcIn *in) // IN
 #endif
 
 #if !defined(VMTOOLS_USE_GLIB)
-   while (in->callbacks) {
-      RpcInCallbackList *p;
-
-      p = in->callbacks->next;
-      free((void *) in->callbacks->name);
-      free(in->callbacks);
-      in->callbacks = p;
+   if (in->callbacks != NULL) {
+      HashTable_Free(in->callbacks);
+      in->callbacks = NULL;
    }
 
    gTimerEventQueue = NULL;
@@ -771,6 +879,7 @@ RpcInHeartbeatCallback(void *clientData)      // IN
 {
    RpcIn *in = (RpcIn *)clientData;
    ASSERT(in);
+   RpcInCountWakeup(in);
    if (in->conn) {
       ASSERT(!in->mustSend);
       ASSERT(in->last_result == NULL);
@@ -914,6 +1023,8 @@ RpcInConnRecvedCb(void *buf,            // IN
 
    if (buf == &conn->packetLen) {
       /* We just received the packet header*/
+      conn->timestamp = Hostinfo_SystemTimerUS();
+      RpcInCountWakeup(conn->in);
       conn->packetLen = ntohl(conn->packetLen);
       Debug("RpcIn:: Got packet length %d from conn %d.\n",
             conn->packetLen, AsyncSocket_GetFd(conn->asock));
@@ -936,6 +1047,8 @@ RpcInConnRecvedCb(void *buf,            // IN
       Debug("RpcIn: Got msg from conn %d: [%s]\n",
             AsyncSocket_GetFd(conn->asock), payload);
 
+      conn->in->cmdArrival = conn->timestamp;
+      conn->in->cmdPollInterval = 0;
       if (RpcInExecRpc(conn->in, payload, payloadLen, &errmsg)) {
          conn->in->mustSend = TRUE;
          if (RpcInSend(conn->in, 0)) {
@@ -1114,6 +1227,8 @@ RpcInConnectDone(AsyncSocket *asock,   // IN
    }
 
    conn->connected = TRUE;
+   in->vsockRetries = 0;
+   in->vsockRetryInterval = RPCIN_VSOCK_RETRY_INTERVAL;
    RpcInConnRecvHeader(conn);
    return;
 
@@ -1313,32 +1428,61 @@ RpcInExecRpc(RpcIn *in,            // IN
 
 #if defined(VMTOOLS_USE_GLIB)
    RpcInData data = { NULL, reply, repLen, NULL, 0, FALSE, NULL, in->clientData };
+   VmTimeType latency = Hostinfo_SystemTimerUS() - in->cmdArrival;
+
+   in->stats.commands++;
+   in->stats.totalLatency += latency;
+   in->stats.maxLatency = MAX(in->stats.maxLatency, (uint64) latency);
+   in->stats.totalPollInterval += (uint64) in->cmdPollInterval * 1000;
 
    status = in->dispatch(&data);
    result = data.result;
    resultLen = data.resultLen;
    freeResult = data.freeResult;
 #else
-   char *cmd;
-   unsigned int index = 0;
-   RpcInCallbackList *cb = NULL;
+   char cmdBuf[RPCIN_NAME_BUF_SIZE];
+   char *cmd = NULL;
+   size_t start = 0;
+   size_t cmdLen = 0;
+   RpcInCallbackEntry *cb = NULL;
 
-   cmd = StrUtil_GetNextToken(&index, reply, " ");
-   if (cmd != NULL) {
-      cb = RpcInLookupCallback(in, cmd);
+   /*
+    * Find the command name in place. Names longer than any registered
+    * command cannot match, so they are rejected without a lookup.
+    */
+   while (start < repLen && reply[start] == ' ') {
+      start++;
+   }
+   while (start + cmdLen < repLen && reply[start + cmdLen] != ' ' &&
+          reply[start + cmdLen] != '\0' && cmdLen <= in->maxNameLen) {
+      cmdLen++;
+   }
+
+   if (cmdLen > 0) {
+      if (cmdLen <= in->maxNameLen) {
+         cmd = cmdLen < sizeof cmdBuf ? cmdBuf : malloc(cmdLen + 1);
+         ASSERT_NOT_IMPLEMENTED(cmd);
+         memcpy(cmd, reply + start, cmdLen);
+         cmd[cmdLen] = '\0';
+         cb = RpcInLookupCallback(in, cmd);
+      }
       if (cb) {
          result = NULL;
          status = cb->callback((char const **) &result, &resultLen, cb->name,
-                               reply + cb->length, repLen - cb->length,
+                               reply + start + cb->length,
+                               repLen - start - cb->length,
                                cb->clientData);
          ASSERT(result);
       } else {
-         Debug("RpcIn: Unknown Command '%s': No matching callback\n", cmd);
+         Debug("RpcIn: Unknown Command '%.*s': No matching callback\n",
+               (int) cmdLen, reply + start);
          status = FALSE;
          result = "Unknown Command";
          resultLen = strlen(result);
       }
-      free(cmd);
+      if (cmd != cmdBuf) {
+         free(cmd);
+      }
    } else {
       Debug("RpcIn: Bad command (null) received\n");
       status = FALSE;
@@ -1525,6 +1669,9 @@ RpcInLoop(void *clientData) // IN
 #if defined(VMTOOLS_USE_GLIB)
    unsigned int current;
 #endif
+#if defined(VMTOOLS_USE_VSOCKET)
+   Bool retryVsock = FALSE;
+#endif
 
    in = (RpcIn *)clientData;
    ASSERT(in);
@@ -1534,6 +1681,7 @@ RpcInLoop(void *clientData) // IN
 
 #if defined(VMTOOLS_USE_GLIB)
    current = in->delay;
+   RpcInCountWakeup(in);
 #else
    /*
     * The event has fired: it is no longer valid. Note that this is
@@ -1570,6 +1718,10 @@ RpcInLoop(void *clientData) // IN
    if (repLen) {
       char *s = ByteDump(reply, repLen);
       Debug("RpcIn: received %d bytes, content:\"%s\"\n", (int) repLen, s);
+#if defined(VMTOOLS_USE_GLIB)
+      in->cmdArrival = Hostinfo_SystemTimerUS();
+      in->cmdPollInterval = current * 10;
+#endif
       if (!RpcInExecRpc(in, reply, repLen, &errmsg)) {
          goto error;
       }
@@ -1594,9 +1746,50 @@ RpcInLoop(void *clientData) // IN
       ASSERT(in->last_resultLen == 0);
 
       RpcInUpdateDelayTime(in);
+
+#if defined(VMTOOLS_USE_VSOCKET)
+      /*
+       * Polling is only the fallback for when vsock could not be used, e.g.
+       * because the vsock transport was not loaded yet when the channel
+       * started. While idle, try to go back to vsock with an exponential
+       * backoff; retrying closes the backdoor channel until the connect
+       * completes or fails, so a host without vsock is left alone after a
+       * few attempts.
+       */
+      retryVsock = in->vsockRetries < RPCIN_VSOCK_MAX_RETRIES &&
+                   Hostinfo_SystemTimerUS() - in->lastVsockAttempt >=
+                   in->vsockRetryInterval;
+#endif
    }
 
    ASSERT(in->mustSend == FALSE);
+
+#if defined(VMTOOLS_USE_VSOCKET)
+   if (retryVsock && !in->shouldStop) {
+      in->vsockRetries++;
+      in->vsockRetryInterval *= 2;
+      Debug("RpcIn: retrying vsocket connection (attempt %u of %u).\n",
+            in->vsockRetries, RPCIN_VSOCK_MAX_RETRIES);
+
+      /* There is no pending result: just close the backdoor channel. */
+      if (Message_Close(in->channel) == FALSE) {
+         Debug("RpcIn: couldn't close channel\n");
+      }
+      in->channel = NULL;
+
+      /* Returning FALSE below destroys the current timer. */
+      g_source_unref(in->nextEvent);
+      in->nextEvent = NULL;
+      resched = TRUE;
+
+      if (!RpcInOpenChannel(in, FALSE)) {
+         errmsg = "RpcIn: Unable to reopen the channel";
+         goto error;
+      }
+      goto exit;
+   }
+#endif
+
    in->mustSend = TRUE;
 
    if (!in->shouldStop) {
@@ -1702,6 +1895,8 @@ RpcInOpenChannel(RpcIn *in,                 // IN
          break;
       }
 
+      in->lastVsockAttempt = Hostinfo_SystemTimerUS();
+
       if (first) {
          first = FALSE;
          res = AsyncSocket_Init();
@@ -1814,6 +2009,16 @@ RpcIn_start(RpcIn *in,                    // IN
    in->errorFunc = errorFunc;
    in->errorData = errorData;
 
+#if defined(VMTOOLS_USE_GLIB)
+   memset(&in->stats, 0, sizeof in->stats);
+   in->statsMinuteStart = Hostinfo_SystemTimerUS();
+   in->statsMinuteWakeups = 0;
+#endif
+#if defined(VMTOOLS_USE_VSOCKET)
+   in->vsockRetries = 0;
+   in->vsockRetryInterval = RPCIN_VSOCK_RETRY_INTERVAL;
+#endif
+
    /* No initial result */
    ASSERT(in->last_result == NULL);
    ASSERT(in->last_resultLen == 0);
@@ -1833,6 +2038,41 @@ RpcIn_start(RpcIn *in,                    // IN
 }
 
 
+
+#if defined(VMTOOLS_USE_GLIB)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcIn_GetStats --
+ *
+ *    Returns the wakeup and latency counters of the receive path.
+ *
+ * Result
+ *    None
+ *
+ * Side-effects
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RpcIn_GetStats(RpcIn *in,              // IN
+               RpcInStats *stats)      // OUT
+{
+   ASSERT(in);
+   ASSERT(stats);
+
+   RpcInRollStatsWindow(in, Hostinfo_SystemTimerUS());
+   *stats = in->stats;
+   stats->eventDriven = FALSE;
+#if defined(VMTOOLS_USE_VSOCKET)
+   stats->eventDriven = in->conn != NULL && in->conn->connected;
+#endif
+   stats->pollInterval = stats->eventDriven ? 0 : in->delay * 10;
+}
+#endif
+
 #if !defined(VMTOOLS_USE_GLIB)
 /*
  *-----------------------------------------------------------------------------
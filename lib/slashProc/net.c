@@ -20,6 +20,11 @@
  * @file net.c
  *
  *	Parses assorted /proc/net nodes.
+ *
+ *	Each node is read into a single buffer, which is then tokenized in
+ *	place, in one pass.  The parsers accept exactly the lines that the
+ *	regular expressions in their comments match, and reject the whole
+ *	node otherwise.
  */
 
 
@@ -51,21 +56,31 @@
 
 
 /**
- * @brief Evaluate an expression with a regular expression match.
- *
- * Convenience wrapper to fetch a regular expression match result, evaluate
- * it as an argument in some expression, and then free it.
- *
- * @param[in] matchInfo  GMatchInfo RE context.
- * @param[in] matchIndex Match index.
- * @param[in] expr       Expression to evaluate.  Must contain @c MATCH as
- *                       placeholder where matched value will be inserted.
+ * Initial size of the buffer a node is read into.  Doubled as needed.
+ */
+#define SLASHPROC_BUF_SIZE      16384
+
+
+/**
+ * Number of fields of a @c /proc/net/route line.
+ */
+#define SLASHPROC_ROUTE_FIELDS  11
+
+
+/**
+ * Number of interface names whose index is remembered while parsing
+ * @c /proc/net/ipv6_route.
+ */
+#define SLASHPROC_IFCACHE_SIZE  8
+
+
+/**
+ * Interface name to index cache entry.
  */
-#define MATCHEXPR(matchInfo, matchIndex, expr) do {                     \
-   gchar *MATCH = g_match_info_fetch(matchInfo, matchIndex);            \
-   expr;                                                                \
-   g_free(MATCH);                                                       \
-} while(0)
+typedef struct SlashProcIfCache {
+   char name[IFNAMSIZ];
+   unsigned int index;
+} SlashProcIfCache;
 
 
 /**
@@ -96,11 +111,23 @@ static const char *pathToNetRoute6 = PROC_NET_ROUTE6;
  * Private function prototypes.
  */
 
-static void Ip6StringToIn6Addr(const char *ip6String,
-                               struct in6_addr *in6_addr);
-static guint64 MatchToGuint64(const GMatchInfo *matchInfo,
-                              const gint matchIndex,
-                              gint base);
+static gchar *ReadNode(int fd);
+static gchar *NextLine(gchar **cursor);
+static gboolean IsWord(const gchar *start, const gchar *end);
+static gboolean IsDecimal(const gchar *start, const gchar *end);
+static gboolean IsHex(const gchar *str, gsize len);
+static guint32 HexToGuint32(const gchar *str, gsize len);
+static gchar *SkipSpace(const gchar *str);
+static gchar *SkipToken(const gchar *str);
+static guint SplitFields(gchar *line, gchar **fields, guint maxFields);
+static gboolean ParseSnmpPair(GHashTable *table, gchar *keyLine,
+                              gchar *valLine);
+static gboolean ParseSnmp6Line(GHashTable *table, gchar *line);
+static gboolean ParseRouteHeader(gchar *line);
+static gboolean ParseRouteLine(gchar *line, struct rtentry *entry);
+static gboolean ParseRoute6Line(gchar *line, struct in6_rtmsg *entry,
+                                SlashProcIfCache *ifCache, guint *ifNext);
+static void HexToIn6Addr(const gchar *str, struct in6_addr *in6_addr);
 
 
 /*
@@ -108,7 +135,6 @@ static guint64 MatchToGuint64(const GMatchInfo *matchInfo,
  */
 
 
-#ifdef VMX86_DEVEL
 /*
  ******************************************************************************
  * SlashProcNetSetPathSnmp --                                           */ /**
@@ -181,7 +207,6 @@ SlashProcNetSetPathRoute6(const char *newPathToNetRoute6)
 {
    pathToNetRoute6 = newPathToNetRoute6 ? newPathToNetRoute6 : PROC_NET_ROUTE6;
 }
-#endif // ifdef VMX86_DEVEL
 
 
 /*
@@ -204,11 +229,9 @@ SlashProcNetSetPathRoute6(const char *newPathToNetRoute6)
  *
  * @note        Caller should free the returned @c GHashTable with
  *              @c g_hash_table_destroy.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GHashTable.
  * @todo        Provide a case-insensitive key comparison function.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  *
  ******************************************************************************
  */
@@ -217,31 +240,22 @@ GHashTable *
 SlashProcNet_GetSnmp(void)
 {
    GHashTable *myHashTable = NULL;
-   GIOChannel *myChannel = NULL;
-   GIOStatus keyIoStatus = G_IO_STATUS_ERROR;
-   GIOStatus valIoStatus = G_IO_STATUS_ERROR;
-   gchar *myKeyLine = NULL;
-   gchar *myValLine = NULL;
+   gchar *myBuffer;
+   gchar *myCursor;
+   gchar *myKeyLine;
+   gchar *myValLine;
    Bool parseError = FALSE;
    int fd = -1;
 
-   static GRegex *myKeyRegex = NULL;
-   static GRegex *myValRegex = NULL;
-
-   if (myKeyRegex == NULL) {
-      myKeyRegex = g_regex_new("^(\\w+): (\\w+ )*(\\w+)$", G_REGEX_OPTIMIZE,
-                               0, NULL);
-      myValRegex = g_regex_new("^(\\w+): (-?\\d+ )*(-?\\d+)$", G_REGEX_OPTIMIZE,
-                               0, NULL);
-      ASSERT(myKeyRegex);
-      ASSERT(myValRegex);
-   }
-
    if ((fd = g_open(pathToNetSnmp, O_RDONLY)) == -1) {
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   myBuffer = ReadNode(fd);
+   close(fd);
+   if (myBuffer == NULL) {
+      return NULL;
+   }
 
    myHashTable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
@@ -252,103 +266,15 @@ SlashProcNet_GetSnmp(void)
     * pfx0: val0 val1 val2 ... valN
     * ...
     * pfxN: ...
+    *
+    * A trailing unpaired line is ignored.
     */
 
-   while ((keyIoStatus = g_io_channel_read_line(myChannel, &myKeyLine, NULL, NULL,
-                                                NULL)) == G_IO_STATUS_NORMAL &&
-          (valIoStatus = g_io_channel_read_line(myChannel, &myValLine, NULL, NULL,
-                                                NULL)) == G_IO_STATUS_NORMAL) {
-
-      GMatchInfo *keyMatchInfo = NULL;
-      GMatchInfo *valMatchInfo = NULL;
-
-      gchar **myKeys = NULL;
-      gchar **myVals = NULL;
-
-      gchar **myKey = NULL;
-      gchar **myVal = NULL;
-
-      gchar *keyPrefix = NULL;
-      gchar *valPrefix = NULL;
-
-      /*
-       * Per format above, we expect a pair of lines with a matching prefix.
-       */
-      {
-         if (!g_regex_match(myKeyRegex, myKeyLine, 0, &keyMatchInfo) ||
-             !g_regex_match(myValRegex, myValLine, 0, &valMatchInfo)) {
-            parseError = TRUE;
-            goto badIteration;
-         }
-
-         keyPrefix = g_match_info_fetch(keyMatchInfo, 1);
-         valPrefix = g_match_info_fetch(valMatchInfo, 1);
-
-         ASSERT(keyPrefix);
-         ASSERT(valPrefix);
-
-         if (strcmp(keyPrefix, valPrefix)) {
-            parseError = TRUE;
-            goto badIteration;
-         }
-      }
-
-      myKeys = g_strsplit(myKeyLine, " ", 0);
-      myVals = g_strsplit(myValLine, " ", 0);
-
-      /*
-       * Iterate over the columns, combining the column keys with the prefix
-       * to form the new key name.  (I.e., "Ip: InDiscards" => "IpInDiscards".)
-       */
-      for (myKey = &myKeys[1], myVal = &myVals[1];
-           *myKey && *myVal;
-           myKey++, myVal++) {
-         gchar *hashKey;
-         guint64 *myIntVal = NULL;
-
-         hashKey = g_strjoin(NULL, keyPrefix, *myKey, NULL);
-         g_strstrip(hashKey);
-
-         /*
-          * By virtue of having matched the above regex, this conversion
-          * must hold.
-          */
-         myIntVal = g_new(guint64, 1);
-         *myIntVal = g_ascii_strtoull(*myVal, NULL, 10);
-
-         /*
-          * If our input contains duplicate keys, which I really don't see
-          * happening, the latter value overrides the former.
-          *
-          * NB: myHashTable claims ownership of hashKey.
-          */
-         g_hash_table_insert(myHashTable, hashKey, myIntVal);
-      }
-
-      /*
-       * Make sure the column counts matched.  If we succeeded, both pointers
-       * should now be NULL.
-       */
-      if (*myKey || *myVal) {
+   myCursor = myBuffer;
+   while ((myKeyLine = NextLine(&myCursor)) != NULL &&
+          (myValLine = NextLine(&myCursor)) != NULL) {
+      if (!ParseSnmpPair(myHashTable, myKeyLine, myValLine)) {
          parseError = TRUE;
-      }
-
-badIteration:
-      g_match_info_free(keyMatchInfo);
-      g_match_info_free(valMatchInfo);
-
-      g_free(keyPrefix);
-      g_free(valPrefix);
-
-      g_strfreev(myKeys);
-      g_strfreev(myVals);
-
-      g_free(myKeyLine);
-      g_free(myValLine);
-      myKeyLine = NULL;
-      myValLine = NULL;
-
-      if (parseError) {
          break;
       }
    }
@@ -356,25 +282,14 @@ badIteration:
    /*
     * Error conditions:
     *    Hash table empty:      Unable to parse any input.
-    *    myKeyLine != NULL:     Failed to read "key" and "value" lines during
-    *                           same loop iteration.
-    *    parseError == TRUE:    See loop body above.
+    *    parseError == TRUE:    See ParseSnmpPair.
     */
-   if (keyIoStatus == G_IO_STATUS_ERROR ||
-       valIoStatus == G_IO_STATUS_ERROR ||
-       g_hash_table_size(myHashTable) == 0 ||
-       parseError) {
+   if (g_hash_table_size(myHashTable) == 0 || parseError) {
       g_hash_table_destroy(myHashTable);
       myHashTable = NULL;
    }
 
-   g_free(myKeyLine);
-   g_free(myValLine);
-   myKeyLine = NULL;
-   myValLine = NULL;
-
-   close(fd);
-   g_io_channel_unref(myChannel);
+   g_free(myBuffer);
 
    return myHashTable;
 }
@@ -395,11 +310,9 @@ badIteration:
  *
  * @note        Caller should free the returned @c GHashTable with
  *              @c g_hash_table_destroy.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GHashTable.
  * @todo        Provide a case-insensitive key comparison function.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  *
  ******************************************************************************
  */
@@ -408,25 +321,21 @@ GHashTable *
 SlashProcNet_GetSnmp6(void)
 {
    GHashTable *myHashTable = NULL;
-   GIOChannel *myChannel = NULL;
-   GIOStatus ioStatus;
-   gchar *myInputLine = NULL;
+   gchar *myBuffer;
+   gchar *myCursor;
+   gchar *myInputLine;
    Bool parseError = FALSE;
    int fd = -1;
 
-   static GRegex *myRegex = NULL;
-
-   if (myRegex == NULL) {
-      myRegex = g_regex_new("^(\\w+)\\s+(-?\\d+)\\s*$", G_REGEX_OPTIMIZE,
-                            0, NULL);
-      ASSERT(myRegex);
-   }
-
    if ((fd = g_open(pathToNetSnmp6, O_RDONLY)) == -1) {
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   myBuffer = ReadNode(fd);
+   close(fd);
+   if (myBuffer == NULL) {
+      return NULL;
+   }
 
    myHashTable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
@@ -439,53 +348,20 @@ SlashProcNet_GetSnmp6(void)
     * keyN                              valueN
     */
 
-   while ((ioStatus = g_io_channel_read_line(myChannel, &myInputLine, NULL,
-                                             NULL, NULL)) == G_IO_STATUS_NORMAL) {
-      GMatchInfo *matchInfo = NULL;
-
-      if (g_regex_match(myRegex, myInputLine, 0, &matchInfo)) {
-         gchar *myKey = NULL;
-         gchar *myVal = NULL;
-         guint64 *myIntVal = NULL;
-
-         myKey = g_match_info_fetch(matchInfo, 1);
-         myVal = g_match_info_fetch(matchInfo, 2);
-
-         /*
-          * By virtue of having matched the above regex, this conversion
-          * must hold.
-          */
-         myIntVal = g_new(guint64, 1);
-         *myIntVal = g_ascii_strtoull(myVal, NULL, 10);
-
-         /*
-          * The hash table will take ownership of myKey and myIntVal.  We're
-          * still responsible for myVal.
-          */
-         g_hash_table_insert(myHashTable, myKey, myIntVal);
-         g_free(myVal);
-      } else {
+   myCursor = myBuffer;
+   while ((myInputLine = NextLine(&myCursor)) != NULL) {
+      if (!ParseSnmp6Line(myHashTable, myInputLine)) {
          parseError = TRUE;
-      }
-
-      g_match_info_free(matchInfo);
-      g_free(myInputLine);
-      myInputLine = NULL;
-
-      if (parseError) {
          break;
       }
    }
 
-   if (ioStatus == G_IO_STATUS_ERROR ||
-       g_hash_table_size(myHashTable) == 0 ||
-       parseError) {
+   if (g_hash_table_size(myHashTable) == 0 || parseError) {
       g_hash_table_destroy(myHashTable);
       myHashTable = NULL;
    }
 
-   close(fd);
-   g_io_channel_unref(myChannel);
+   g_free(myBuffer);
 
    return myHashTable;
 }
@@ -512,10 +388,8 @@ SlashProcNet_GetSnmp6(void)
  *
  * @note        Caller is responsible for freeing the @c GPtrArray with
  *              SlashProcNet_FreeRoute.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GPtrArray.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  * @todo        Consider rewriting, integrating with libdnet.
  *
  ******************************************************************************
@@ -524,30 +398,14 @@ SlashProcNet_GetSnmp6(void)
 GPtrArray *
 SlashProcNet_GetRoute(void)
 {
-   GIOChannel *myChannel = NULL;
-   GIOStatus myIoStatus;
    GPtrArray *myArray = NULL;
-   gchar *myLine = NULL;
+   gchar *myBuffer;
+   gchar *myCursor;
+   gchar *myLine;
    int fd = -1;
 
-   static GRegex *myFieldsRE = NULL;
-   static GRegex *myValuesRE = NULL;
-
-   if (myFieldsRE == NULL) {
-      myFieldsRE = g_regex_new("^Iface\\s+Destination\\s+Gateway\\s+Flags\\s+"
-                               "RefCnt\\s+Use\\s+Metric\\s+Mask\\s+MTU\\s+"
-                               "Window\\s+IRTT\\s*$", 0, 0, NULL);
-      myValuesRE = g_regex_new("^(\\S+)\\s+([[:xdigit:]]{8})\\s+"
-                               "([[:xdigit:]]{8})\\s+([[:xdigit:]]{4})\\s+"
-                               "\\d+\\s+\\d+\\s+(\\d+)\\s+"
-                               "([[:xdigit:]]{8})\\s+(\\d+)\\s+\\d+\\s+(\\d+)\\s*$",
-                               0, 0, NULL);
-      ASSERT(myFieldsRE);
-      ASSERT(myValuesRE);
-   }
-
    /*
-    * 1.  Open pathToNetRoute, associate it with a GIOChannel.
+    * 1.  Read pathToNetRoute.
     */
 
    if ((fd = g_open(pathToNetRoute, O_RDONLY)) == -1) {
@@ -556,7 +414,11 @@ SlashProcNet_GetRoute(void)
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   myBuffer = ReadNode(fd);
+   close(fd);
+   if (myBuffer == NULL) {
+      return NULL;
+   }
 
    /*
     * 2.  Sanity check the header, making sure it matches what we expect.
@@ -564,86 +426,33 @@ SlashProcNet_GetRoute(void)
     *     anyway.)
     */
 
-   myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL, NULL);
-   if (myIoStatus != G_IO_STATUS_NORMAL ||
-       g_regex_match(myFieldsRE, myLine, 0, NULL) == FALSE) {
+   myCursor = myBuffer;
+   myLine = NextLine(&myCursor);
+   if (myLine == NULL || !ParseRouteHeader(myLine)) {
       goto out;
    }
 
-   g_free(myLine);
-   myLine = NULL;
-
    myArray = g_ptr_array_new();
 
    /*
-    * 3.  For each line...
+    * 3.  For each line, allocate a new rtentry and add it to the array before
+    *     filling it in.  This simplifies the cleanup code path.
     */
 
-   while ((myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL,
-                                               NULL)) == G_IO_STATUS_NORMAL) {
-      GMatchInfo *myMatchInfo = NULL;
-      struct rtentry *myEntry = NULL;
-      struct sockaddr_in *sin = NULL;
-      Bool parseError = FALSE;
-
-      /*
-       * 3a. Validate with regex.
-       */
-      if (!g_regex_match(myValuesRE, myLine, 0, &myMatchInfo)) {
-         parseError = TRUE;
-         goto badIteration;
-      }
+   while ((myLine = NextLine(&myCursor)) != NULL) {
+      struct rtentry *myEntry = g_new0(struct rtentry, 1);
 
-      /*
-       * 3b. Allocate new rtentry, add to array.  This simplifies the cleanup
-       *     code path.
-       */
-      myEntry = g_new0(struct rtentry, 1);
       g_ptr_array_add(myArray, myEntry);
 
-      /*
-       * 3c. Copy contents to new struct rtentry.
-       */
-      myEntry->rt_dev = g_match_info_fetch(myMatchInfo, 1);
-
-      sin = (struct sockaddr_in *)&myEntry->rt_dst;
-      sin->sin_family = AF_INET;
-      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 2, 16);
-
-      sin = (struct sockaddr_in *)&myEntry->rt_gateway;
-      sin->sin_family = AF_INET;
-      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 3, 16);
-
-      sin = (struct sockaddr_in *)&myEntry->rt_genmask;
-      sin->sin_family = AF_INET;
-      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 6, 16);
-
-      myEntry->rt_flags = MatchToGuint64(myMatchInfo, 4, 16);
-      myEntry->rt_metric = MatchToGuint64(myMatchInfo, 5, 10);
-      myEntry->rt_mtu = MatchToGuint64(myMatchInfo, 7, 10);
-      myEntry->rt_irtt = MatchToGuint64(myMatchInfo, 8, 10);
-
-badIteration:
-      g_free(myLine);
-      myLine = NULL;
-
-      g_match_info_free(myMatchInfo);
-      myMatchInfo = NULL;
-
-      if (parseError) {
+      if (!ParseRouteLine(myLine, myEntry)) {
+         SlashProcNet_FreeRoute(myArray);
+         myArray = NULL;
          break;
       }
    }
 
-   if (myArray && myIoStatus != G_IO_STATUS_EOF) {
-      SlashProcNet_FreeRoute(myArray);
-      myArray = NULL;
-   }
-
 out:
-   g_free(myLine);
-   close(fd);
-   g_io_channel_unref(myChannel);
+   g_free(myBuffer);
 
    return myArray;
 }
@@ -672,7 +481,6 @@ SlashProcNet_FreeRoute(GPtrArray *routeArray)
 
    for (i = 0; i < routeArray->len; i++) {
       struct rtentry *myEntry = g_ptr_array_index(routeArray, i);
-      ASSERT(myEntry->rt_dev);
       g_free(myEntry->rt_dev);
       g_free(myEntry);
    }
@@ -702,10 +510,8 @@ SlashProcNet_FreeRoute(GPtrArray *routeArray)
  *
  * @note        Caller is responsible for freeing the @c GPtrArray with
  *              SlashProcNet_FreeRoute6.
- * @note        This routine creates persistent GLib GRegexs.
  *
  * @return      On failure, NULL.  On success, a valid @c GPtrArray.
- * @todo        Consider init/cleanup routines to not "leak" GRegexs.
  * @todo        Consider rewriting, integrating with libdnet.
  *
  ******************************************************************************
@@ -714,85 +520,43 @@ SlashProcNet_FreeRoute(GPtrArray *routeArray)
 GPtrArray *
 SlashProcNet_GetRoute6(void)
 {
-   GIOChannel *myChannel = NULL;
-   GIOStatus myIoStatus;
+   SlashProcIfCache ifCache[SLASHPROC_IFCACHE_SIZE];
+   guint ifNext = 0;
    GPtrArray *myArray = NULL;
-   gchar *myLine = NULL;
-   Bool parseError = FALSE;
+   gchar *myBuffer;
+   gchar *myCursor;
+   gchar *myLine;
    int fd = -1;
 
-   static GRegex *myValuesRE = NULL;
-
-   if (myValuesRE == NULL) {
-      myValuesRE = g_regex_new("^([[:xdigit:]]{32}) ([[:xdigit:]]{2}) "
-                                "([[:xdigit:]]{32}) ([[:xdigit:]]{2}) "
-                                "([[:xdigit:]]{32}) ([[:xdigit:]]{8}) "
-                                "[[:xdigit:]]{8} [[:xdigit:]]{8} "
-                                "([[:xdigit:]]{8})\\s+(\\S+)\\s*$", 0, 0,
-                                NULL);
-      ASSERT(myValuesRE);
-   }
-
-   /*
-    * 1.  Open pathToNetRoute6, associate it with a GIOChannel.
-    */
-
    if ((fd = g_open(pathToNetRoute6, O_RDONLY)) == -1) {
-      Warning("%s: open(%s): %s\n", __func__, pathToNetRoute,
+      Warning("%s: open(%s): %s\n", __func__, pathToNetRoute6,
               g_strerror(errno));
       return NULL;
    }
 
-   myChannel = g_io_channel_unix_new(fd);
+   myBuffer = ReadNode(fd);
+   close(fd);
+   if (myBuffer == NULL) {
+      return NULL;
+   }
 
+   memset(ifCache, 0, sizeof ifCache);
    myArray = g_ptr_array_new();
 
-   while ((myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL,
-                                               NULL)) == G_IO_STATUS_NORMAL) {
-      struct in6_rtmsg *myEntry = NULL;
-      GMatchInfo *myMatchInfo = NULL;
-
-      if (!g_regex_match(myValuesRE, myLine, 0, &myMatchInfo)) {
-         parseError = TRUE;
-         goto badIteration;
-      }
+   myCursor = myBuffer;
+   while ((myLine = NextLine(&myCursor)) != NULL) {
+      struct in6_rtmsg *myEntry = g_new0(struct in6_rtmsg, 1);
 
-      myEntry = g_new0(struct in6_rtmsg, 1);
       g_ptr_array_add(myArray, myEntry);
 
-      MATCHEXPR(myMatchInfo, 1, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_dst));
-      MATCHEXPR(myMatchInfo, 3, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_src));
-      MATCHEXPR(myMatchInfo, 5, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_gateway));
-
-      myEntry->rtmsg_dst_len = MatchToGuint64(myMatchInfo, 2, 16);
-      myEntry->rtmsg_src_len = MatchToGuint64(myMatchInfo, 4, 16);
-      myEntry->rtmsg_metric = MatchToGuint64(myMatchInfo, 6, 16);
-      myEntry->rtmsg_flags = MatchToGuint64(myMatchInfo, 7, 16);
-
-      MATCHEXPR(myMatchInfo, 8, myEntry->rtmsg_ifindex = if_nametoindex(MATCH));
-
-badIteration:
-      g_free(myLine);
-      myLine = NULL;
-
-      g_match_info_free(myMatchInfo);
-      myMatchInfo = NULL;
-
-      if (parseError) {
+      if (!ParseRoute6Line(myLine, myEntry, ifCache, &ifNext)) {
+         SlashProcNet_FreeRoute6(myArray);
+         myArray = NULL;
          break;
       }
    }
 
-   if (myArray && myIoStatus != G_IO_STATUS_EOF) {
-      SlashProcNet_FreeRoute6(myArray);
-      myArray = NULL;
-   }
-
-   g_free(myLine);
-   myLine = NULL;
-
-   close(fd);
-   g_io_channel_unref(myChannel);
+   g_free(myBuffer);
 
    return myArray;
 }
@@ -820,7 +584,7 @@ SlashProcNet_FreeRoute6(GPtrArray *routeArray)
    }
 
    for (i = 0; i < routeArray->len; i++) {
-      struct rtentry *myEntry = g_ptr_array_index(routeArray, i);
+      struct in6_rtmsg *myEntry = g_ptr_array_index(routeArray, i);
       g_free(myEntry);
    }
 
@@ -835,53 +599,645 @@ SlashProcNet_FreeRoute6(GPtrArray *routeArray)
 
 /*
  ******************************************************************************
- * Ip6StringToIn6Addr --                                                */ /**
+ * ReadNode --                                                          */ /**
  *
- * @brief Parses a @c /proc/net/ipv6_route hexadecimal IPv6 address and
- *        records it in a <tt>struct in6_addr</tt>.
+ * @brief Reads a @c /proc node into a single NUL-terminated buffer.
  *
- * @param[in]   ip6String       Source string.
- * @param[out]  in6_addr        Output struct.
+ * @c /proc nodes don't report their size, so the buffer starts at
+ * @ref SLASHPROC_BUF_SIZE and is doubled until the whole node fits.
+ *
+ * @param[in]   fd              Open file descriptor.
+ *
+ * @return      On failure, NULL.  On success, the contents.  Caller should
+ *              free them with @c g_free.
  *
  ******************************************************************************
  */
 
-static void
-Ip6StringToIn6Addr(const char *ip6String,
-                   struct in6_addr *in6_addr)
+static gchar *
+ReadNode(int fd)
 {
-   unsigned int i;
+   gsize size = SLASHPROC_BUF_SIZE;
+   gsize used = 0;
+   gchar *buf = g_malloc(size);
 
-   ASSERT(strlen(ip6String) == 32);
+   for (;;) {
+      ssize_t nRead;
 
-   for (i = 0; i < 16; i++) {
-      int nmatched;
-      nmatched = sscanf(&ip6String[2 * i], "%2hhx", &in6_addr->s6_addr[i]);
-      ASSERT(nmatched == 1);
+      /* Always leave room for the NUL. */
+      if (size - used < 2) {
+         size *= 2;
+         buf = g_realloc(buf, size);
+      }
+
+      nRead = read(fd, buf + used, size - used - 1);
+      if (nRead < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         g_free(buf);
+         return NULL;
+      }
+      if (nRead == 0) {
+         break;
+      }
+      used += nRead;
+   }
+
+   buf[used] = '\0';
+   return buf;
+}
+
+
+/*
+ ******************************************************************************
+ * NextLine --                                                          */ /**
+ *
+ * @brief Returns the next line of a buffer read by ReadNode, with its
+ *        newline replaced by a NUL.
+ *
+ * @param[in,out] cursor        Start of the line.  Updated to point at the
+ *                              next line.
+ *
+ * @return      The line, or NULL at the end of the buffer.
+ *
+ ******************************************************************************
+ */
+
+static gchar *
+NextLine(gchar **cursor)
+{
+   gchar *line = *cursor;
+   gchar *newline;
+
+   if (*line == '\0') {
+      return NULL;
+   }
+
+   newline = strchr(line, '\n');
+   if (newline != NULL) {
+      *newline = '\0';
+      *cursor = newline + 1;
+   } else {
+      *cursor = line + strlen(line);
+   }
+
+   return line;
+}
+
+
+/*
+ ******************************************************************************
+ * IsWord --                                                            */ /**
+ *
+ * @brief Tells whether a string matches <tt>\\w+</tt>.
+ *
+ * @param[in]   start           First character.
+ * @param[in]   end             Character past the last one.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+IsWord(const gchar *start,
+       const gchar *end)
+{
+   const gchar *p;
+
+   for (p = start; p < end; p++) {
+      if (!g_ascii_isalnum(*p) && *p != '_') {
+         return FALSE;
+      }
+   }
+
+   return end > start;
+}
+
+
+/*
+ ******************************************************************************
+ * IsDecimal --                                                         */ /**
+ *
+ * @brief Tells whether a string matches <tt>\\d+</tt>.
+ *
+ * @sa IsWord
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+IsDecimal(const gchar *start,
+          const gchar *end)
+{
+   const gchar *p;
+
+   for (p = start; p < end; p++) {
+      if (!g_ascii_isdigit(*p)) {
+         return FALSE;
+      }
+   }
+
+   return end > start;
+}
+
+
+/*
+ ******************************************************************************
+ * IsHex --                                                             */ /**
+ *
+ * @brief Tells whether a string starts with @a len hexadecimal digits.
+ *
+ * @param[in]   str             The string.
+ * @param[in]   len             Number of digits.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+IsHex(const gchar *str,
+      gsize len)
+{
+   gsize i;
+
+   for (i = 0; i < len; i++) {
+      if (!g_ascii_isxdigit(str[i])) {
+         return FALSE;
+      }
    }
+
+   return TRUE;
 }
 
 
 /*
  ******************************************************************************
- * MatchToGuint64 --                                                    */ /**
+ * HexToGuint32 --                                                      */ /**
  *
- * @brief Wrapper around @c g_ascii_strtoull and @c g_match_info_fetch.
+ * @brief Converts @a len (at most 8) hexadecimal digits, checked by IsHex.
  *
- * @param[in]   matchInfo       Source regular expression match context.
- * @param[in]   matchIndex      Match number to fetch.
- * @param[in]   base            Base represented by matched string.
- *                              (See @c g_ascii_strtoull docs.)
+ * @param[in]   str             The digits.
+ * @param[in]   len             Number of digits.
  *
  ******************************************************************************
  */
 
-static guint64
-MatchToGuint64(const GMatchInfo *matchInfo,
-               const gint matchIndex,
-               gint base)
+static guint32
+HexToGuint32(const gchar *str,
+             gsize len)
 {
-   guint64 retval;
-   MATCHEXPR(matchInfo, matchIndex, retval = g_ascii_strtoull(MATCH, NULL, base));
-   return retval;
+   guint32 value = 0;
+   gsize i;
+
+   ASSERT(len <= 8);
+
+   for (i = 0; i < len; i++) {
+      value = (value << 4) | g_ascii_xdigit_value(str[i]);
+   }
+
+   return value;
+}
+
+
+/*
+ ******************************************************************************
+ * SkipSpace --                                                         */ /**
+ *
+ * @brief Returns the first character of a string that doesn't match
+ *        <tt>\\s</tt>.
+ *
+ ******************************************************************************
+ */
+
+static gchar *
+SkipSpace(const gchar *str)
+{
+   while (g_ascii_isspace(*str)) {
+      str++;
+   }
+
+   return (gchar *)str;
+}
+
+
+/*
+ ******************************************************************************
+ * SkipToken --                                                         */ /**
+ *
+ * @brief Returns the first character of a string that matches <tt>\\s</tt>,
+ *        or its NUL.
+ *
+ ******************************************************************************
+ */
+
+static gchar *
+SkipToken(const gchar *str)
+{
+   while (*str != '\0' && !g_ascii_isspace(*str)) {
+      str++;
+   }
+
+   return (gchar *)str;
+}
+
+
+/*
+ ******************************************************************************
+ * SplitFields --                                                       */ /**
+ *
+ * @brief Splits a line in place into its whitespace-separated fields.
+ *
+ * @param[in]   line            The line.  Must not start with whitespace.
+ * @param[out]  fields          NUL-terminated fields.
+ * @param[in]   maxFields       Size of @a fields.
+ *
+ * @return      Number of fields found, maxFields + 1 if there are more.
+ *
+ ******************************************************************************
+ */
+
+static guint
+SplitFields(gchar *line,
+            gchar **fields,
+            guint maxFields)
+{
+   guint n = 0;
+   gchar *p = line;
+
+   while (*p != '\0') {
+      gchar *end = SkipToken(p);
+
+      if (n == maxFields) {
+         return maxFields + 1;
+      }
+      fields[n++] = p;
+
+      p = SkipSpace(end);
+      *end = '\0';
+   }
+
+   return n;
+}
+
+
+/*
+ ******************************************************************************
+ * ParseSnmpPair --                                                     */ /**
+ *
+ * @brief Parses a pair of @c /proc/net/snmp lines into @a table.
+ *
+ * The key line must match <tt>^(\\w+): (\\w+ )*(\\w+)$</tt>, the value line
+ * <tt>^(\\w+): (-?\\d+ )*(-?\\d+)$</tt>, and both must have the same prefix
+ * and number of columns.  Each column's key is combined with the prefix to
+ * form the hash key (i.e., "Ip: InDiscards" => "IpInDiscards").
+ *
+ * @param[in]   table           Table to add the values to.
+ * @param[in]   keyLine         Key line.
+ * @param[in]   valLine         Value line.
+ *
+ * @return      TRUE if the lines were valid.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ParseSnmpPair(GHashTable *table,
+              gchar *keyLine,
+              gchar *valLine)
+{
+   gchar *keyPrefixEnd = strchr(keyLine, ':');
+   gchar *valPrefixEnd = strchr(valLine, ':');
+   gsize prefixLen;
+   gchar *key;
+   gchar *val;
+
+   if (keyPrefixEnd == NULL || valPrefixEnd == NULL ||
+       !IsWord(keyLine, keyPrefixEnd) ||
+       keyPrefixEnd - keyLine != valPrefixEnd - valLine ||
+       strncmp(keyLine, valLine, keyPrefixEnd - keyLine) != 0 ||
+       keyPrefixEnd[1] != ' ' || valPrefixEnd[1] != ' ') {
+      return FALSE;
+   }
+
+   prefixLen = keyPrefixEnd - keyLine;
+   key = keyPrefixEnd + 2;
+   val = valPrefixEnd + 2;
+
+   for (;;) {
+      gchar *keyEnd = key + strcspn(key, " ");
+      gchar *valEnd = val + strcspn(val, " ");
+      gchar *digits = (*val == '-') ? val + 1 : val;
+      gchar *hashKey;
+      guint64 *myIntVal;
+
+      if (!IsWord(key, keyEnd) || !IsDecimal(digits, valEnd)) {
+         return FALSE;
+      }
+
+      hashKey = g_malloc(prefixLen + (keyEnd - key) + 1);
+      memcpy(hashKey, keyLine, prefixLen);
+      memcpy(hashKey + prefixLen, key, keyEnd - key);
+      hashKey[prefixLen + (keyEnd - key)] = '\0';
+
+      /* Same conversion, including negative values and overflows, as ever. */
+      myIntVal = g_new(guint64, 1);
+      *myIntVal = g_ascii_strtoull(val, NULL, 10);
+
+      /*
+       * If our input contains duplicate keys, which I really don't see
+       * happening, the latter value overrides the former.
+       *
+       * NB: table claims ownership of hashKey.
+       */
+      g_hash_table_insert(table, hashKey, myIntVal);
+
+      if (*keyEnd == '\0' && *valEnd == '\0') {
+         return TRUE;
+      }
+
+      /* Make sure the column counts match. */
+      if (*keyEnd == '\0' || *valEnd == '\0') {
+         return FALSE;
+      }
+
+      key = keyEnd + 1;
+      val = valEnd + 1;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * ParseSnmp6Line --                                                    */ /**
+ *
+ * @brief Parses a @c /proc/net/snmp6 line into @a table.
+ *
+ * The line must match <tt>^(\\w+)\\s+(-?\\d+)\\s*$</tt>.
+ *
+ * @param[in]   table           Table to add the value to.
+ * @param[in]   line            The line.
+ *
+ * @return      TRUE if the line was valid.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ParseSnmp6Line(GHashTable *table,
+               gchar *line)
+{
+   gchar *keyEnd = SkipToken(line);
+   gchar *val = SkipSpace(keyEnd);
+   gchar *valEnd = SkipToken(val);
+   gchar *digits = (*val == '-') ? val + 1 : val;
+   guint64 *myIntVal;
+
+   if (!IsWord(line, keyEnd) || val == keyEnd ||
+       !IsDecimal(digits, valEnd) || *SkipSpace(valEnd) != '\0') {
+      return FALSE;
+   }
+
+   myIntVal = g_new(guint64, 1);
+   *myIntVal = g_ascii_strtoull(val, NULL, 10);
+
+   /* The hash table will take ownership of the key and myIntVal. */
+   g_hash_table_insert(table, g_strndup(line, keyEnd - line), myIntVal);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ParseRouteHeader --                                                  */ /**
+ *
+ * @brief Checks the header of @c /proc/net/route.
+ *
+ * The line must match <tt>^Iface\\s+Destination\\s+Gateway\\s+Flags\\s+
+ * RefCnt\\s+Use\\s+Metric\\s+Mask\\s+MTU\\s+Window\\s+IRTT\\s*$</tt>.
+ *
+ * @param[in]   line            The line.  Split in place.
+ *
+ * @return      TRUE if the header is the expected one.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ParseRouteHeader(gchar *line)
+{
+   static const char *names[SLASHPROC_ROUTE_FIELDS] = {
+      "Iface", "Destination", "Gateway", "Flags", "RefCnt", "Use", "Metric",
+      "Mask", "MTU", "Window", "IRTT"
+   };
+   gchar *fields[SLASHPROC_ROUTE_FIELDS];
+   guint i;
+
+   if (g_ascii_isspace(*line) ||
+       SplitFields(line, fields, ARRAYSIZE(fields)) != ARRAYSIZE(fields)) {
+      return FALSE;
+   }
+
+   for (i = 0; i < ARRAYSIZE(fields); i++) {
+      if (strcmp(fields[i], names[i]) != 0) {
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ParseRouteLine --                                                    */ /**
+ *
+ * @brief Parses a @c /proc/net/route line into a <tt>struct rtentry</tt>.
+ *
+ * The line must match <tt>^(\\S+)\\s+([[:xdigit:]]{8})\\s+([[:xdigit:]]{8})
+ * \\s+([[:xdigit:]]{4})\\s+\\d+\\s+\\d+\\s+(\\d+)\\s+([[:xdigit:]]{8})\\s+
+ * (\\d+)\\s+\\d+\\s+(\\d+)\\s*$</tt>.
+ *
+ * @param[in]   line            The line.  Split in place.
+ * @param[out]  entry           Zeroed entry to fill in.
+ *
+ * @return      TRUE if the line was valid.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ParseRouteLine(gchar *line,
+               struct rtentry *entry)
+{
+   enum {
+      IFACE, DESTINATION, GATEWAY, FLAGS, REFCNT, USE, METRIC, MASK, MTU,
+      WINDOW, IRTT
+   };
+   gchar *fields[SLASHPROC_ROUTE_FIELDS];
+   struct sockaddr_in *sin;
+
+   if (g_ascii_isspace(*line) ||
+       SplitFields(line, fields, ARRAYSIZE(fields)) != ARRAYSIZE(fields)) {
+      return FALSE;
+   }
+
+#define FIELD_IS_HEX(i, n) (strlen(fields[i]) == (n) && IsHex(fields[i], (n)))
+#define FIELD_IS_DEC(i)    IsDecimal(fields[i], fields[i] + strlen(fields[i]))
+
+   if (!FIELD_IS_HEX(DESTINATION, 8) || !FIELD_IS_HEX(GATEWAY, 8) ||
+       !FIELD_IS_HEX(FLAGS, 4) || !FIELD_IS_DEC(REFCNT) ||
+       !FIELD_IS_DEC(USE) || !FIELD_IS_DEC(METRIC) ||
+       !FIELD_IS_HEX(MASK, 8) || !FIELD_IS_DEC(MTU) ||
+       !FIELD_IS_DEC(WINDOW) || !FIELD_IS_DEC(IRTT)) {
+      return FALSE;
+   }
+
+#undef FIELD_IS_HEX
+#undef FIELD_IS_DEC
+
+   /* GRegex only matches valid UTF-8. */
+   if (!g_utf8_validate(fields[IFACE], -1, NULL)) {
+      return FALSE;
+   }
+
+   entry->rt_dev = g_strdup(fields[IFACE]);
+
+   sin = (struct sockaddr_in *)&entry->rt_dst;
+   sin->sin_family = AF_INET;
+   sin->sin_addr.s_addr = HexToGuint32(fields[DESTINATION], 8);
+
+   sin = (struct sockaddr_in *)&entry->rt_gateway;
+   sin->sin_family = AF_INET;
+   sin->sin_addr.s_addr = HexToGuint32(fields[GATEWAY], 8);
+
+   sin = (struct sockaddr_in *)&entry->rt_genmask;
+   sin->sin_family = AF_INET;
+   sin->sin_addr.s_addr = HexToGuint32(fields[MASK], 8);
+
+   entry->rt_flags = HexToGuint32(fields[FLAGS], 4);
+   entry->rt_metric = g_ascii_strtoull(fields[METRIC], NULL, 10);
+   entry->rt_mtu = g_ascii_strtoull(fields[MTU], NULL, 10);
+   entry->rt_irtt = g_ascii_strtoull(fields[IRTT], NULL, 10);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ParseRoute6Line --                                                   */ /**
+ *
+ * @brief Parses a @c /proc/net/ipv6_route line into a
+ *        <tt>struct in6_rtmsg</tt>.
+ *
+ * The line must match <tt>^([[:xdigit:]]{32}) ([[:xdigit:]]{2})
+ * ([[:xdigit:]]{32}) ([[:xdigit:]]{2}) ([[:xdigit:]]{32})
+ * ([[:xdigit:]]{8}) [[:xdigit:]]{8} [[:xdigit:]]{8} ([[:xdigit:]]{8})\\s+
+ * (\\S+)\\s*$</tt>.
+ *
+ * The interface names' indices are looked up through a small cache, as the
+ * same few names make up the whole table.
+ *
+ * @param[in]     line          The line.  Split in place.
+ * @param[out]    entry         Zeroed entry to fill in.
+ * @param[in,out] ifCache       Interface name to index cache.
+ * @param[in,out] ifNext        Next cache entry to replace.
+ *
+ * @return      TRUE if the line was valid.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ParseRoute6Line(gchar *line,
+                struct in6_rtmsg *entry,
+                SlashProcIfCache *ifCache,
+                guint *ifNext)
+{
+   /* Widths of the fixed fields, each followed by a space but the last. */
+   static const gsize widths[] = { 32, 2, 32, 2, 32, 8, 8, 8, 8 };
+   const gchar *fields[ARRAYSIZE(widths)];
+   gchar *p = line;
+   gchar *dev;
+   gchar *devEnd;
+   gsize devLen;
+   guint i;
+
+   for (i = 0; i < ARRAYSIZE(widths); i++) {
+      if (!IsHex(p, widths[i]) ||
+          (i < ARRAYSIZE(widths) - 1 && p[widths[i]] != ' ')) {
+         return FALSE;
+      }
+      fields[i] = p;
+      p += widths[i] + 1;
+   }
+
+   /* p is one past the last field, which must be followed by \s+. */
+   p--;
+   dev = SkipSpace(p);
+   devEnd = SkipToken(dev);
+   if (dev == p || devEnd == dev || *SkipSpace(devEnd) != '\0') {
+      return FALSE;
+   }
+   *devEnd = '\0';
+   devLen = devEnd - dev;
+
+   /* GRegex only matches valid UTF-8. */
+   if (!g_utf8_validate(dev, devLen, NULL)) {
+      return FALSE;
+   }
+
+   HexToIn6Addr(fields[0], &entry->rtmsg_dst);
+   HexToIn6Addr(fields[2], &entry->rtmsg_src);
+   HexToIn6Addr(fields[4], &entry->rtmsg_gateway);
+
+   entry->rtmsg_dst_len = HexToGuint32(fields[1], 2);
+   entry->rtmsg_src_len = HexToGuint32(fields[3], 2);
+   entry->rtmsg_metric = HexToGuint32(fields[5], 8);
+   entry->rtmsg_flags = HexToGuint32(fields[8], 8);
+
+   if (devLen >= sizeof ifCache->name) {
+      entry->rtmsg_ifindex = if_nametoindex(dev);
+      return TRUE;
+   }
+
+   for (i = 0; i < SLASHPROC_IFCACHE_SIZE; i++) {
+      if (strcmp(ifCache[i].name, dev) == 0) {
+         entry->rtmsg_ifindex = ifCache[i].index;
+         return TRUE;
+      }
+   }
+
+   entry->rtmsg_ifindex = if_nametoindex(dev);
+
+   i = (*ifNext)++ % SLASHPROC_IFCACHE_SIZE;
+   memcpy(ifCache[i].name, dev, devLen + 1);
+   ifCache[i].index = entry->rtmsg_ifindex;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * HexToIn6Addr --                                                      */ /**
+ *
+ * @brief Converts a @c /proc/net/ipv6_route hexadecimal IPv6 address,
+ *        checked by IsHex, to a <tt>struct in6_addr</tt>.
+ *
+ * @param[in]   str             Source string.
+ * @param[out]  in6_addr        Output struct.
+ *
+ ******************************************************************************
+ */
+
+static void
+HexToIn6Addr(const gchar *str,
+             struct in6_addr *in6_addr)
+{
+   unsigned int i;
+
+   for (i = 0; i < 16; i++) {
+      in6_addr->s6_addr[i] = HexToGuint32(&str[2 * i], 2);
+   }
 }
@@ -28,12 +28,14 @@
 #define INCLUDE_ALLOW_USERLEVEL
 #include "includeCheck.h"
 
-#ifdef VMX86_DEVEL
+/*
+ * Path overrides, used by the tests to parse captured nodes.
+ */
+
 EXTERN void SlashProcNetSetPathSnmp(const char *newPathToNetSnmp);
 EXTERN void SlashProcNetSetPathSnmp6(const char *newPathToNetSnmp6);
 EXTERN void SlashProcNetSetPathRoute(const char *newPathToNetRoute);
 EXTERN void SlashProcNetSetPathRoute6(const char *newPathToNetRoute6);
-#endif // ifdef VMX86_DEVEL
 
 #endif // ifndef _SLASHPROCNETINT_H_
 
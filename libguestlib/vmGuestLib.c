@@ -249,7 +249,8 @@ VMGuestLibCheckArgs(VMGuestLibHandle handle, // IN
  *      VMGuestLibError
  *
  * Side effects:
- *      Resources are allocated.
+ *      Resources are allocated. The RPC channel used for the library's
+ *      requests is kept open until the handle is closed.
  *
  *-----------------------------------------------------------------------------
  */
@@ -274,6 +275,8 @@ VMGuestLib_OpenHandle(VMGuestLibHandle *handle) // OUT
       return VMGUESTLIB_ERROR_MEMORY;
    }
 
+   RpcChannel_SendOneKeepOpen();
+
    *handle = (VMGuestLibHandle)data;
    return VMGUESTLIB_ERROR_SUCCESS;
 }
@@ -292,7 +295,8 @@ VMGuestLib_OpenHandle(VMGuestLibHandle *handle) // OUT
  *      VMGuestLibError
  *
  * Side effects:
- *      None
+ *      Once the last handle is closed, the RPC channel kept open for
+ *      the library's requests is closed.
  *
  *-----------------------------------------------------------------------------
  */
@@ -323,6 +327,8 @@ VMGuestLib_CloseHandle(VMGuestLibHandle handle) // IN
    HANDLE_DATA(handle) = NULL;
    free(handle);
 
+   RpcChannel_SendOneShutdown();
+
    return VMGUESTLIB_ERROR_SUCCESS;
 }
 
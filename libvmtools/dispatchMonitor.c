@@ -0,0 +1,224 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file dispatchMonitor.c
+ *
+ * Lets the application measure how long main loop callbacks take. Sources
+ * attached with VMTOOLSAPP_ATTACH_SOURCE() go through VMTools_AttachSource(),
+ * which tracks the dispatch of the source so that, when a monitor has been
+ * installed with VMTools_SetDispatchMonitor(), the duration of every call is
+ * reported to it along with the owner (the log domain of the code that
+ * attached the source) and the name of the callback. Other dispatchers, such
+ * as the GuestRPC channel, report their callbacks with
+ * VMTools_ReportDispatch().
+ *
+ * The monitor is expected to be installed once, before the main loop runs,
+ * and callbacks are expected to be dispatched from the main loop's thread.
+ */
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "vmware/tools/utils.h"
+
+/*
+ * Callback data of a monitored source. Unlike g_source_set_callback(), the
+ * callback is set through g_source_set_callback_indirect(), so that the
+ * source's "get" function is called right before the source is dispatched
+ * and "unref" right after, whatever the signature of the callback is.
+ */
+typedef struct DispatchMonitorSource {
+   gint              refCount;
+   GSourceFunc       cb;
+   gpointer          data;
+   GDestroyNotify    destroy;
+   const gchar      *owner;
+   const gchar      *name;
+   VmTimeType        start;
+} DispatchMonitorSource;
+
+static VMToolsDispatchMonitorCb gMonitor;
+static gpointer gMonitorData;
+
+
+/**
+ * Takes a reference on the callback data.
+ *
+ * @param[in]  data     The callback data.
+ */
+
+static void
+DispatchMonitorRef(gpointer data)
+{
+   DispatchMonitorSource *wrap = data;
+
+   g_atomic_int_inc(&wrap->refCount);
+}
+
+
+/**
+ * Drops a reference on the callback data. If the source was being dispatched,
+ * reports how long the callback took; frees the data when the last reference
+ * goes away.
+ *
+ * @param[in]  data     The callback data.
+ */
+
+static void
+DispatchMonitorUnref(gpointer data)
+{
+   DispatchMonitorSource *wrap = data;
+
+   if (wrap->start != 0) {
+      VMTools_ReportDispatch(wrap->owner, wrap->name,
+                             Hostinfo_SystemTimerUS() - wrap->start);
+      wrap->start = 0;
+   }
+
+   if (g_atomic_int_dec_and_test(&wrap->refCount)) {
+      if (wrap->destroy != NULL) {
+         wrap->destroy(wrap->data);
+      }
+      g_free(wrap);
+   }
+}
+
+
+/**
+ * Returns the callback and its data. glib calls this right before dispatching
+ * the source, so this is where the callback's timing starts.
+ *
+ * @param[in]  data     The callback data.
+ * @param[in]  src      Unused.
+ * @param[out] func     Where to store the callback.
+ * @param[out] cbData   Where to store the callback's data.
+ */
+
+static void
+DispatchMonitorGet(gpointer data,
+                   GSource *src,
+                   GSourceFunc *func,
+                   gpointer *cbData)
+{
+   DispatchMonitorSource *wrap = data;
+
+   if (gMonitor != NULL) {
+      wrap->start = Hostinfo_SystemTimerUS();
+   }
+   *func = wrap->cb;
+   *cbData = wrap->data;
+}
+
+
+static GSourceCallbackFuncs gDispatchMonitorFuncs = {
+   DispatchMonitorRef,
+   DispatchMonitorUnref,
+   DispatchMonitorGet,
+};
+
+
+/**
+ * Installs the function that receives the duration of main loop callbacks.
+ * Pass NULL to remove it.
+ *
+ * @param[in]  cb       The monitor callback, or NULL.
+ * @param[in]  data     Data to provide to the callback.
+ */
+
+void
+VMTools_SetDispatchMonitor(VMToolsDispatchMonitorCb cb,
+                           gpointer data)
+{
+   gMonitor = cb;
+   gMonitorData = data;
+}
+
+
+/**
+ * Returns whether a dispatch monitor is installed. Dispatchers that time their
+ * own callbacks can use this to avoid reading the clock when nobody is
+ * listening.
+ *
+ * @return Whether a monitor is installed.
+ */
+
+gboolean
+VMTools_IsDispatchMonitored(void)
+{
+   return gMonitor != NULL;
+}
+
+
+/**
+ * Reports the duration of a main loop callback to the installed monitor, if
+ * any.
+ *
+ * @param[in]  owner    Who registered the callback, may be NULL.
+ * @param[in]  name     Name of the callback.
+ * @param[in]  duration How long the callback took, in microseconds.
+ */
+
+void
+VMTools_ReportDispatch(const gchar *owner,
+                       const gchar *name,
+                       gint64 duration)
+{
+   if (gMonitor != NULL) {
+      gMonitor(owner, name, duration, gMonitorData);
+   }
+}
+
+
+/**
+ * Sets the callback of a source and attaches it to the given context. When a
+ * dispatch monitor is installed, the time spent in the callback is reported
+ * to it. This is what VMTOOLSAPP_ATTACH_SOURCE() uses; the owner and name
+ * strings must outlive the source.
+ *
+ * @param[in]  ctx      Context where to attach the source.
+ * @param[in]  src      The source.
+ * @param[in]  cb       The source callback.
+ * @param[in]  data     Data to provide to the callback.
+ * @param[in]  destroy  Destruction notification callback.
+ * @param[in]  owner    Who registered the callback, may be NULL.
+ * @param[in]  name     Name of the callback.
+ *
+ * @return The source ID.
+ */
+
+guint
+VMTools_AttachSource(GMainContext *ctx,
+                     GSource *src,
+                     GSourceFunc cb,
+                     gpointer data,
+                     GDestroyNotify destroy,
+                     const gchar *owner,
+                     const gchar *name)
+{
+   DispatchMonitorSource *wrap = g_malloc0(sizeof *wrap);
+
+   wrap->refCount = 1;
+   wrap->cb = cb;
+   wrap->data = data;
+   wrap->destroy = destroy;
+   wrap->owner = owner;
+   wrap->name = name;
+
+   g_source_set_callback_indirect(src, wrap, &gDispatchMonitorFuncs);
+   return g_source_attach(src, ctx);
+}
@@ -19,7 +19,9 @@
 /**
  * @file monotonicTimer.c
  *
- * A GSource that implements a timer backed by a monotonic time source.
+ * A GSource that implements a timer backed by a monotonic time source, and
+ * the monotonic clock used by the library. Tests can replace the clock with
+ * VMTools_SetMonotonicClock() to control the passing of time.
  */
 
 #include <limits.h>
@@ -33,6 +35,8 @@ typedef struct MTimerSource {
    uint64      last;
 } MTimerSource;
 
+static VMToolsMonotonicClockFn gClock = NULL;
+
 
 /*
  *******************************************************************************
@@ -61,7 +65,7 @@ MTimerSourcePrepare(GSource *src,
       *timeout = 0;
       return TRUE;
    } else {
-         uint64 now = System_GetTimeMonotonic() * 10;
+         uint64 now = VMTools_GetMonotonicTime();
          uint64 diff;
 
          ASSERT(now >= timer->last);
@@ -181,11 +185,56 @@ VMTools_CreateTimer(gint timeout)
    ASSERT(timeout >= 0);
 
    ret = (MTimerSource *) g_source_new(&srcFuncs, sizeof *ret);
-   ret->last = System_GetTimeMonotonic() * 10;
+   ret->last = VMTools_GetMonotonicTime();
    ret->timeout = timeout;
 
    return &ret->src;
 }
 
+
+/*
+ *******************************************************************************
+ * VMTools_GetMonotonicTime --                                            */ /**
+ *
+ * @brief Returns the time of the library's monotonic clock.
+ *
+ * This is the clock used by the timers created with VMTools_CreateTimer(). It
+ * is not affected by changes in the system time.
+ *
+ * @return The time, in milliseconds, since an arbitrary point in the past.
+ *
+ *******************************************************************************
+ */
+
+guint64
+VMTools_GetMonotonicTime(void)
+{
+   VMToolsMonotonicClockFn clock = gClock;
+
+   return (clock != NULL) ? clock() : System_GetTimeMonotonic() * 10;
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_SetMonotonicClock --                                           */ /**
+ *
+ * @brief Replaces the library's monotonic clock.
+ *
+ * Meant for tests, which can use a fake clock to check time dependent code
+ * without waiting. The clock must never go backwards, and should be replaced
+ * before any timer is created.
+ *
+ * @param[in] clock     The new clock, or NULL to use the system's clock.
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_SetMonotonicClock(VMToolsMonotonicClockFn clock)
+{
+   gClock = clock;
+}
+
 /** @}  */
 
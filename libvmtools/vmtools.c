@@ -114,6 +114,7 @@ VMToolsDllFini(void)
 #if defined(_WIN32)
    NetUtil_FreeIpHlpApiDll();
 #endif
+   VMToolsLogQueueFlush();
    VMToolsMsgCleanup();
 }
 
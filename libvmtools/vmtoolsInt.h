@@ -40,9 +40,55 @@ VMToolsMsgCleanup(void);
  * Logging.                                                                   *
  * ************************************************************************** */
 
+/** Maximum size of the messages sent in a single VMX logger RPC. */
+#define VMXLOGGER_RPC_SIZE       (16 * 1024)
+
+/**
+ * How long the oldest message queued by the VMX logger may wait to be sent,
+ * in ms of VMTools_GetMonotonicTime().
+ */
+#define VMXLOGGER_FLUSH_DELAY    50
+
 GlibLogger *
 VMToolsCreateVMXLogger(void);
 
+void
+VMToolsVMXLoggerFlush(void);
+
+/** Logs the summary of the suppressed messages of a domain and level. */
+typedef void (*VMToolsLogLimitReportFn)(const gchar *domain,
+                                        GLogLevelFlags level,
+                                        const gchar *summary);
+
+gboolean
+VMToolsLogLimitCheck(const gchar *domain,
+                     GLogLevelFlags level,
+                     guint rate,
+                     const gchar *message,
+                     VMToolsLogLimitReportFn report);
+
+void
+VMToolsLogLimitFlush(gboolean all,
+                     VMToolsLogLimitReportFn report);
+
+/** Writes, and frees, entries taken from the log queue. */
+typedef void (*VMToolsLogQueueWriteFn)(gpointer *entries,
+                                       guint count);
+
+void
+VMToolsLogQueueConfig(guint size,
+                      VMToolsLogQueueWriteFn writeFn);
+
+gboolean
+VMToolsLogQueuePush(gpointer entry,
+                    gboolean *dropped);
+
+void
+VMToolsLogQueueFlush(void);
+
+void
+VMToolsLogQueueStop(void);
+
 /* ************************************************************************** *
  * Miscelaneous.                                                              *
  * ************************************************************************** */
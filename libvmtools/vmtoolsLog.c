@@ -32,8 +32,11 @@
  */
 
 #include "vmtoolsInt.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <glib/gstdio.h>
 #if defined(G_PLATFORM_WIN32)
 #  include <windows.h>
@@ -52,7 +55,6 @@
 #  include "win32u.h"
 #endif
 #include "str.h"
-#include "system.h"
 #include "vmware/tools/log.h"
 
 #define LOGGING_GROUP         "logging"
@@ -66,6 +68,25 @@
  */
 #define DEFAULT_MAX_CACHE_ENTRIES      (4*1024)
 
+/*
+ * Default max number of log messages waiting for the writer thread. Beyond
+ * that, new messages are dropped.
+ */
+#define DEFAULT_ASYNC_QUEUE_SIZE       (1024)
+
+/*
+ * Size of the message buffer embedded in a log entry. Longer messages are
+ * allocated separately. Kept small since up to DEFAULT_MAX_CACHE_ENTRIES
+ * entries are held while log I/O is suspended.
+ */
+#define LOG_ENTRY_BUF_SIZE             (256)
+
+/* Max number of free log entries kept around for reuse. */
+#define LOG_ENTRY_POOL_MAX             (256)
+
+/* Number of glib log levels, from G_LOG_LEVEL_ERROR to G_LOG_LEVEL_DEBUG. */
+#define LOG_LEVEL_COUNT                (6)
+
 /** The default handler to use if none is specified by the config data. */
 #define DEFAULT_HANDLER "file+"
 
@@ -133,20 +154,35 @@ typedef struct LogHandler {
    gboolean       needsFileIO;
    gboolean       isSysLog;
    gchar         *confData;
+   /** Similar messages allowed per minute, per level; 0 means no limit. */
+   guint          rateLimit[LOG_LEVEL_COUNT];
 } LogHandler;
 
 
 /**
- * Structure for caching a log message
+ * Structure for caching a log message. Entries are recycled through a pool,
+ * and the formatted message is stored in the entry itself unless it's too
+ * long, so that logging a message doesn't need to allocate memory.
  */
 typedef struct LogEntry {
-   gchar           *domain;
+   const gchar     *domain;
    gchar           *msg;
    LogHandler      *handler;
    GLogLevelFlags   level;
+   struct LogEntry *next;
+   gchar            buf[LOG_ENTRY_BUF_SIZE];
 } LogEntry;
 
 
+/**
+ * Per-thread cache of the formatted timestamp, updated once per second.
+ */
+typedef struct LogTimeCache {
+   glong            sec;
+   gchar            prefix[64];
+} LogTimeCache;
+
+
 static gchar *gLogDomain = NULL;
 static GPtrArray *gCachedLogs = NULL;
 static guint gDroppedLogCount = 0;
@@ -163,6 +199,10 @@ static gboolean gLogInitialized = FALSE;
 static GStaticRecMutex gLogStateMutex = G_STATIC_REC_MUTEX_INIT;
 static gboolean gLoggingStopped = FALSE;
 static gboolean gLogIOSuspended = FALSE;
+static GStaticMutex gEntryPoolLock = G_STATIC_MUTEX_INIT;
+static LogEntry *gEntryPool = NULL;
+static guint gEntryPoolSize = 0;
+static GStaticPrivate gTimeCache = G_STATIC_PRIVATE_INIT;
 
 /* Internal functions. */
 
@@ -176,6 +216,9 @@ VMToolsLogPanic(void)
 {
    gPanicCount++;
 
+   /* Make sure the messages logged before the error make it to the log. */
+   VMToolsLogQueueFlush();
+
    /*
     * Probably, flush the cached logs here. It is not
     * critial though because we will have the cached
@@ -236,19 +279,112 @@ VMToolsAsprintf(gchar **string,
 }
 
 
+/**
+ * Checks whether a string only contains ASCII characters.
+ *
+ * @param[in] str    The string.
+ *
+ * @return Whether the string is ASCII.
+ */
+
+static gboolean
+VMToolsIsAscii(const gchar *str)
+{
+   for (; *str != '\0'; str++) {
+      if ((guchar) *str >= 0x80) {
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+
+/**
+ * Writes the current local time to the given buffer, in the same format as
+ * System_GetTimeAsString() (e.g. "Oct 05 18:03:24.948"). The part of the
+ * string that changes once a second is cached per thread, so that it's only
+ * formatted again when the second changes.
+ *
+ * @param[out] buf         Where to write the time.
+ * @param[in]  bufSize     Size of the buffer.
+ *
+ * @return Whether the time could be determined.
+ */
+
+static gboolean
+VMToolsLogGetTime(gchar *buf,
+                  gsize bufSize)
+{
+   GTimeVal now;
+   LogTimeCache *cache = g_static_private_get(&gTimeCache);
+
+   if (cache == NULL) {
+      cache = g_new0(LogTimeCache, 1);
+      cache->sec = -1;
+      g_static_private_set(&gTimeCache, cache, g_free);
+   }
+
+   g_get_current_time(&now);
+
+   if (now.tv_sec != cache->sec) {
+      time_t sec = now.tv_sec;
+      struct tm tm;
+      gsize len;
+
+#if defined(_WIN32)
+      if (localtime_s(&tm, &sec) != 0) {
+         return FALSE;
+      }
+#else
+      if (localtime_r(&sec, &tm) == NULL) {
+         return FALSE;
+      }
+#endif
+
+      len = strftime(cache->prefix, sizeof cache->prefix, "%b %d %H:%M:%S",
+                     &tm);
+      if (len == 0) {
+         return FALSE;
+      }
+
+      /* Like System_GetTimeAsString(), convert from the locale's encoding. */
+      if (!VMToolsIsAscii(cache->prefix)) {
+         gchar *utf8 = g_locale_to_utf8(cache->prefix, len, NULL, NULL, NULL);
+
+         if (utf8 == NULL) {
+            return FALSE;
+         }
+         g_strlcpy(cache->prefix, utf8, sizeof cache->prefix);
+         g_free(utf8);
+      }
+
+      cache->sec = now.tv_sec;
+   }
+
+   g_snprintf(buf, bufSize, "%s.%03d", cache->prefix,
+              (int) (now.tv_usec / 1000));
+   return TRUE;
+}
+
+
 /**
  * Creates a formatted message to be logged. The format of the message will be:
  *
  *    [timestamp] [domain] [level] Log message
  *
+ * The message is written to the given buffer if it fits; otherwise, a new
+ * buffer is allocated for it.
+ *
  * @param[in] message      User log message.
  * @param[in] domain       Log domain.
  * @param[in] level        Log level.
  * @param[in] data         Log handler data.
  * @param[in] cached       If the message will be cached.
+ * @param[in] buf          Buffer where to write the message.
+ * @param[in] bufSize      Size of the buffer.
  *
- * @return Formatted log message according to the log domain's config.
- *         Should be g_free()'d.
+ * @return Formatted log message according to the log domain's config: either
+ *         @a buf, or a buffer that should be g_free()'d.
  */
 
 static gchar *
@@ -256,14 +392,18 @@ VMToolsLogFormat(const gchar *message,
                  const gchar *domain,
                  GLogLevelFlags level,
                  LogHandler *data,
-                 gboolean cached)
+                 gboolean cached,
+                 gchar *buf,
+                 gsize bufSize)
 {
-   char *msg = NULL;
+   char *msg = buf;
    const char *slevel;
-   size_t len = 0;
+   const char *fmt;
+   const char *tstamp = NULL;
+   gint len;
    gboolean shared = TRUE;
    gboolean addsTimestamp = TRUE;
-   char *tstamp;
+   char timeBuf[80];
 
    if (domain == NULL) {
       domain = gLogDomain;
@@ -311,40 +451,39 @@ VMToolsLogFormat(const gchar *message,
       addsTimestamp = data->logger->addsTimestamp;
    }
 
-   tstamp = System_GetTimeAsString();
+   if (!addsTimestamp || cached) {
+      tstamp = VMToolsLogGetTime(timeBuf, sizeof timeBuf) ? timeBuf : "no time";
+   }
 
+   /*
+    * All formats take the same arguments, in the same order; the ones that
+    * don't show the timestamp or the application's domain print them as
+    * empty strings.
+    */
    if (!addsTimestamp) {
-      if (shared) {
-         len = VMToolsAsprintf(&msg, "[%s] [%8s] [%s:%s] %s\n",
-                               (tstamp != NULL) ? tstamp : "no time",
-                               slevel, gLogDomain, domain, message);
-      } else {
-         len = VMToolsAsprintf(&msg, "[%s] [%8s] [%s] %s\n",
-                               (tstamp != NULL) ? tstamp : "no time",
-                               slevel, domain, message);
-      }
+      fmt = shared ? "[%s] [%8s] [%s:%s] %s\n" : "[%s] [%8s] [%s%s] %s\n";
+   } else if (cached) {
+      fmt = shared ? "[cached at %s] [%8s] [%s:%s] %s\n"
+                   : "[cached at %s] [%8s] [%s%s] %s\n";
    } else {
-      if (cached) {
-         if (shared) {
-            len = VMToolsAsprintf(&msg, "[cached at %s] [%8s] [%s:%s] %s\n",
-                                  (tstamp != NULL) ? tstamp : "no time",
-                                  slevel, gLogDomain, domain, message);
-         } else {
-            len = VMToolsAsprintf(&msg, "[cached at %s] [%8s] [%s] %s\n",
-                                  (tstamp != NULL) ? tstamp : "no time",
-                                  slevel, domain, message);
-         }
-      } else {
-         if (shared) {
-            len = VMToolsAsprintf(&msg, "[%8s] [%s:%s] %s\n",
-                                  slevel, gLogDomain, domain, message);
-         } else {
-            len = VMToolsAsprintf(&msg, "[%8s] [%s] %s\n", slevel, domain, message);
-         }
-      }
+      fmt = shared ? "%s[%8s] [%s:%s] %s\n" : "%s[%8s] [%s%s] %s\n";
+      tstamp = "";
    }
 
-   free(tstamp);
+   len = g_snprintf(buf, bufSize, fmt, tstamp, slevel,
+                    shared ? gLogDomain : "", domain, message);
+   if (len >= 0 && (gsize) len >= bufSize) {
+      msg = g_malloc(len + 1);
+      g_snprintf(msg, len + 1, fmt, tstamp, slevel,
+                 shared ? gLogDomain : "", domain, message);
+   }
+
+   if (len <= 0) {
+      /*
+       * Formatting error?
+       */
+      VMToolsLogPanic();
+   }
 
    /*
     * The log messages from glib itself (and probably other libraries based
@@ -352,23 +491,57 @@ VMToolsLogFormat(const gchar *message,
     * we detect whether the original message already had a new line, and
     * remove it, to avoid having two newlines when printing our log messages.
     */
-   if (msg != NULL && msg[len - 2] == '\n') {
+   if (len >= 2 && msg[len - 2] == '\n') {
       msg[len - 1] = '\0';
    }
 
-   if (!msg) {
-      /*
-       * Memory allocation failure?
-       */
-      VMToolsLogPanic();
+   return msg;
+}
+
+
+/**
+ * Returns a log entry, reusing a free one from the pool if available.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] handler   Log handler.
+ *
+ * @return A log entry, without a message.
+ */
+
+static LogEntry *
+VMToolsAllocLogEntry(const gchar *domain,
+                     GLogLevelFlags level,
+                     LogHandler *handler)
+{
+   LogEntry *entry;
+
+   g_static_mutex_lock(&gEntryPoolLock);
+   entry = gEntryPool;
+   if (entry != NULL) {
+      gEntryPool = entry->next;
+      gEntryPoolSize--;
    }
+   g_static_mutex_unlock(&gEntryPoolLock);
 
-   return msg;
+   if (entry == NULL) {
+      entry = g_malloc(sizeof *entry);
+   }
+
+   /* Domain names are interned, so they don't need to be copied per entry. */
+   entry->domain = domain != NULL ? g_intern_string(domain) : NULL;
+   entry->msg = NULL;
+   entry->handler = handler;
+   entry->level = level;
+   entry->next = NULL;
+
+   return entry;
 }
 
 
 /**
- * Function to free a cached LogEntry.
+ * Function to free a cached LogEntry. The entry goes back to the pool,
+ * unless the pool is full.
  *
  * @param[in] data    Log entry to be freed.
  */
@@ -378,8 +551,20 @@ VMToolsFreeLogEntry(gpointer data)
 {
    LogEntry *entry = data;
 
-   g_free(entry->domain);
-   g_free(entry->msg);
+   if (entry->msg != entry->buf) {
+      g_free(entry->msg);
+   }
+   entry->msg = NULL;
+
+   g_static_mutex_lock(&gEntryPoolLock);
+   if (gEntryPoolSize < LOG_ENTRY_POOL_MAX) {
+      entry->next = gEntryPool;
+      gEntryPool = entry;
+      gEntryPoolSize++;
+      entry = NULL;
+   }
+   g_static_mutex_unlock(&gEntryPoolLock);
+
    g_free(entry);
 }
 
@@ -422,94 +607,242 @@ VMToolsLogMsg(gpointer _data, gpointer userData)
 
 
 /**
- * Log handler function that does the common processing of log messages,
- * and delegates the actual printing of the message to the given handler.
+ * Writes and frees log entries taken from the log queue. Consecutive entries
+ * for the same logger are written with a single call when the logger
+ * supports it.
  *
- * @param[in] domain    Log domain.
- * @param[in] level     Log level.
- * @param[in] message   Message to log.
- * @param[in] _data     LogHandler pointer.
+ * @param[in] entries   LogEntry pointers.
+ * @param[in] count     Number of entries.
  */
 
 static void
-VMToolsLog(const gchar *domain,
-           GLogLevelFlags level,
-           const gchar *message,
-           gpointer _data)
+VMToolsLogWriteQueued(gpointer *entries,
+                      guint count)
 {
-   LogHandler *data = _data;
+   const gchar **messages = g_newa(const gchar *, count);
+   guint i = 0;
 
-   if (SHOULD_LOG(level, data)) {
-      LogEntry *entry;
+   while (i < count) {
+      LogEntry *entry = entries[i];
+      GlibLogger *logger = entry->handler->logger;
+      guint n;
 
-      data = data->inherited ? gDefaultData : data;
+      if (logger == NULL || logger->logbatch == NULL) {
+         VMToolsLogMsg(entry, NULL);
+         i++;
+         continue;
+      }
 
-      entry = g_malloc0(sizeof(LogEntry));
-      if (entry) {
-         entry->domain = domain ? g_strdup(domain) : NULL;
-         if (domain && !entry->domain) {
-            VMToolsLogPanic();
+      for (n = 0; i + n < count; n++) {
+         LogEntry *next = entries[i + n];
+         if (next->handler->logger != logger) {
+            break;
          }
-         entry->handler = data;
-         entry->level = level;
+         messages[n] = next->msg;
       }
 
-      if (gLogIOSuspended && data->needsFileIO) {
-         if (gMaxCacheEntries == 0) {
-            /* No way to log at this point, drop it */
-            VMToolsFreeLogEntry(entry);
-            gDroppedLogCount++;
-            goto exit;
-         }
+      logger->logbatch(messages, n, logger);
+
+      for (; n > 0; n--, i++) {
+         VMToolsFreeLogEntry(entries[i]);
+      }
+   }
+}
+
+
+/**
+ * Writes a formatted log entry. Entries for handlers that do file I/O are
+ * queued for the writer thread; others, and fatal errors, are written right
+ * away. Frees the entry.
+ *
+ * @param[in] entry     The log entry.
+ */
+
+static void
+VMToolsLogWrite(LogEntry *entry)
+{
+   if (IS_FATAL(entry->level)) {
+      VMToolsLogQueueFlush();
+   } else if (entry->handler->needsFileIO) {
+      gboolean dropped;
+
+      if (VMToolsLogQueuePush(entry, &dropped)) {
+         return;
+      }
+      if (dropped) {
+         VMToolsFreeLogEntry(entry);
+         return;
+      }
+   }
+
+   VMToolsLogMsg(entry, NULL);
+}
+
+
+/**
+ * Returns the index of a log level, for per-level settings.
+ *
+ * @param[in] level     Log level.
+ *
+ * @return The index, or -1 if @a level is not a single glib log level.
+ */
+
+static gint
+VMToolsLogLevelIndex(GLogLevelFlags level)
+{
+   gint bit = g_bit_nth_lsf(level & G_LOG_LEVEL_MASK, -1);
+
+   return (bit >= 2 && bit < 2 + LOG_LEVEL_COUNT) ? bit - 2 : -1;
+}
 
-         entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE);
+
+/**
+ * Formats a message and hands it to the given handler, or caches it if log
+ * I/O is suspended.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] message   Message to log.
+ * @param[in] data      LogHandler pointer.
+ */
+
+static void
+VMToolsLogOne(const gchar *domain,
+              GLogLevelFlags level,
+              const gchar *message,
+              LogHandler *data)
+{
+   LogEntry *entry = VMToolsAllocLogEntry(domain, level, data);
+
+   if (gLogIOSuspended && data->needsFileIO) {
+      if (gMaxCacheEntries == 0) {
+         /* No way to log at this point, drop it */
+         VMToolsFreeLogEntry(entry);
+         gDroppedLogCount++;
+         return;
+      }
+
+      entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE,
+                                    entry->buf, sizeof entry->buf);
+
+      /*
+       * Cache the log message
+       */
+      if (!gCachedLogs) {
 
          /*
-          * Cache the log message
+          * If gMaxCacheEntries > 1K, start with 1/4th size
+          * to avoid frequent allocations
           */
+         gCachedLogs = g_ptr_array_sized_new(gMaxCacheEntries < 1024 ?
+                                             gMaxCacheEntries :
+                                             gMaxCacheEntries/4);
          if (!gCachedLogs) {
-
-            /*
-             * If gMaxCacheEntries > 1K, start with 1/4th size
-             * to avoid frequent allocations
-             */
-            gCachedLogs = g_ptr_array_sized_new(gMaxCacheEntries < 1024 ?
-                                                gMaxCacheEntries :
-                                                gMaxCacheEntries/4);
-            if (!gCachedLogs) {
-               VMToolsLogPanic();
-            }
-
-            /*
-             * Some builds use glib version 2.16.4 which does not
-             * support g_ptr_array_set_free_func function
-             */
+            VMToolsLogPanic();
          }
 
          /*
-          * We don't expect logging to be suspended for a long time,
-          * so we can avoid putting a cap on cache size. However, we
-          * still have a default cap of 4K messages, just to be safe.
+          * Some builds use glib version 2.16.4 which does not
+          * support g_ptr_array_set_free_func function
           */
-         if (gCachedLogs->len < gMaxCacheEntries) {
-            g_ptr_array_add(gCachedLogs, entry);
-         } else {
-            /*
-             * Cache is full, drop the oldest log message. This is not
-             * very efficient but we don't expect this to be a common
-             * case anyway.
-             */
-            LogEntry *oldest = g_ptr_array_remove_index(gCachedLogs, 0);
-            VMToolsFreeLogEntry(oldest);
-            gDroppedLogCount++;
+      }
+
+      /*
+       * We don't expect logging to be suspended for a long time,
+       * so we can avoid putting a cap on cache size. However, we
+       * still have a default cap of 4K messages, just to be safe.
+       */
+      if (gCachedLogs->len < gMaxCacheEntries) {
+         g_ptr_array_add(gCachedLogs, entry);
+      } else {
+         /*
+          * Cache is full, drop the oldest log message. This is not
+          * very efficient but we don't expect this to be a common
+          * case anyway.
+          */
+         LogEntry *oldest = g_ptr_array_remove_index(gCachedLogs, 0);
+         VMToolsFreeLogEntry(oldest);
+         gDroppedLogCount++;
+
+         g_ptr_array_add(gCachedLogs, entry);
+      }
+
+   } else {
+      entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE,
+                                    entry->buf, sizeof entry->buf);
+      VMToolsLogWrite(entry);
+   }
+}
+
 
-            g_ptr_array_add(gCachedLogs, entry);
+/**
+ * Logs a summary of the messages suppressed by the rate limiter, with the
+ * handler of the domain they were logged to.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] summary   The summary.
+ */
+
+static void
+VMToolsLogLimitReport(const gchar *domain,
+                      GLogLevelFlags level,
+                      const gchar *summary)
+{
+   LogHandler *data = gDefaultData;
+
+   if (domain != NULL && gDomains != NULL) {
+      guint i;
+      for (i = 0; i < gDomains->len; i++) {
+         LogHandler *handler = g_ptr_array_index(gDomains, i);
+         if (strcmp(handler->domain, domain) == 0) {
+            data = handler;
+            break;
          }
+      }
+   }
 
-      } else {
-         entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
-         VMToolsLogMsg(entry, NULL);
+   if (data != NULL && SHOULD_LOG(level, data)) {
+      VMToolsLogOne(domain, level, summary,
+                    data->inherited ? gDefaultData : data);
+   }
+}
+
+
+/**
+ * Log handler function that does the common processing of log messages,
+ * and delegates the actual printing of the message to the given handler.
+ * Messages of domains with a rate limit go through the rate limiter first.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] message   Message to log.
+ * @param[in] _data     LogHandler pointer.
+ */
+
+static void
+VMToolsLog(const gchar *domain,
+           GLogLevelFlags level,
+           const gchar *message,
+           gpointer _data)
+{
+   LogHandler *data = _data;
+
+   if (SHOULD_LOG(level, data)) {
+      gint idx = VMToolsLogLevelIndex(level);
+      guint rate = (IS_FATAL(level) || idx < 0) ? 0 : data->rateLimit[idx];
+
+      data = data->inherited ? gDefaultData : data;
+
+      if (rate > 0) {
+         domain = g_intern_string(domain);
+         if (!VMToolsLogLimitCheck(domain, level, rate, message,
+                                   VMToolsLogLimitReport)) {
+            goto exit;
+         }
       }
+
+      VMToolsLogOne(domain, level, message, data);
    }
 
 exit:
@@ -635,6 +968,7 @@ VMToolsGetLogHandler(const gchar *handler,
       gboolean append = strcmp(handler, "file+") == 0;
       guint maxSize;
       guint maxFiles;
+      gint maxSpace;
       GError *err = NULL;
 
       /* Use the same type name for both. */
@@ -657,7 +991,18 @@ VMToolsGetLogHandler(const gchar *handler,
             maxFiles = 10;
          }
 
-         glogger = GlibUtils_CreateFileLogger(path, append, maxSize, maxFiles);
+         g_snprintf(key, sizeof key, "%s.maxOldLogSpace", domain);
+         maxSpace = g_key_file_get_integer(cfg, LOGGING_GROUP, key, &err);
+         if (err != NULL || maxSpace < 0) {
+            if (err == NULL) {
+               g_warning("Invalid value for %s: %d.", key, maxSpace);
+            }
+            g_clear_error(&err);
+            maxSpace = 0; /* maxSize times maxFiles. */
+         }
+
+         glogger = GlibUtils_CreateFileLogger(path, append, maxSize, maxFiles,
+                                              (guint) maxSpace);
          needsFileIO = TRUE;
       } else {
          g_warning("Missing path for domain '%s'.", domain);
@@ -713,6 +1058,54 @@ VMToolsGetLogHandler(const gchar *handler,
 }
 
 
+/**
+ * Reads the rate limits of a log domain. The "<domain>.rateLimit.<level>" key
+ * sets the limit for a level, and "<domain>.rateLimit" the limit for all the
+ * levels that don't have their own. Domains that set neither use the limits
+ * of the default domain.
+ *
+ * @param[in]  cfg      Config dictionary.
+ * @param[in]  domain   Log domain.
+ * @param[out] limits   Similar messages allowed per minute, per level.
+ */
+
+static void
+VMToolsGetRateLimits(GKeyFile *cfg,
+                     const gchar *domain,
+                     guint *limits)
+{
+   static const gchar *levels[LOG_LEVEL_COUNT] = {
+      "error", "critical", "warning", "message", "info", "debug"
+   };
+   const gchar *domains[] = { domain, gLogDomain };
+   gchar key[MAX_DOMAIN_LEN + 64];
+   guint i;
+
+   for (i = 0; i < LOG_LEVEL_COUNT; i++) {
+      guint d;
+
+      limits[i] = 0;
+      for (d = 0; d < ARRAYSIZE(domains); d++) {
+         GError *err = NULL;
+         gint rate;
+
+         g_snprintf(key, sizeof key, "%s.rateLimit.%s", domains[d], levels[i]);
+         rate = g_key_file_get_integer(cfg, LOGGING_GROUP, key, &err);
+         if (err != NULL) {
+            g_clear_error(&err);
+            g_snprintf(key, sizeof key, "%s.rateLimit", domains[d]);
+            rate = g_key_file_get_integer(cfg, LOGGING_GROUP, key, &err);
+         }
+         if (err == NULL) {
+            limits[i] = MAX(rate, 0);
+            break;
+         }
+         g_clear_error(&err);
+      }
+   }
+}
+
+
 /**
  * Configures the given log domain based on the data provided in the given
  * dictionary. If the log domain being configured doesn't match the default, and
@@ -854,6 +1247,8 @@ VMToolsConfigLogDomain(const gchar *domain,
       data->confData = g_strdup(confData);
    }
 
+   VMToolsGetRateLimits(cfg, domain, data->rateLimit);
+
    if (isDefault) {
       gDefaultData = data;
       g_log_set_default_handler(VMToolsLog, gDefaultData);
@@ -893,25 +1288,34 @@ VMToolsResetLogging(gboolean hard)
    gLogEnabled = FALSE;
    g_log_set_default_handler(g_log_default_handler, NULL);
 
+   if (gDomains != NULL) {
+      guint i;
+      for (i = 0; i < gDomains->len; i++) {
+         LogHandler *data = g_ptr_array_index(gDomains, i);
+         g_log_remove_handler(data->domain, data->handlerId);
+         data->handlerId = 0;
+      }
+   }
+
+   /*
+    * Queued messages refer to the handlers. Now that no new message can reach
+    * them, write the queued ones out before the handlers are freed.
+    */
+   VMToolsLogQueueFlush();
+
    CLEAR_LOG_HANDLER(gErrorData);
    CLEAR_LOG_HANDLER(gErrorSyslog);
    gErrorData = NULL;
    gErrorSyslog = NULL;
 
-   if (gDomains != NULL) {
+   if (gDomains != NULL && hard) {
       guint i;
       for (i = 0; i < gDomains->len; i++) {
          LogHandler *data = g_ptr_array_index(gDomains, i);
-         g_log_remove_handler(data->domain, data->handlerId);
-         data->handlerId = 0;
-         if (hard) {
-            CLEAR_LOG_HANDLER(data);
-         }
-      }
-      if (hard) {
-         g_ptr_array_free(gDomains, TRUE);
-         gDomains = NULL;
+         CLEAR_LOG_HANDLER(data);
       }
+      g_ptr_array_free(gDomains, TRUE);
+      gDomains = NULL;
    }
 
    if (hard) {
@@ -982,6 +1386,7 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
    GPtrArray *oldDomains = NULL;
    LogHandler *oldDefault = NULL;
    GError *err = NULL;
+   gint queueSize;
 
    g_return_if_fail(defaultDomain != NULL);
 
@@ -989,6 +1394,9 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
       cfg = g_key_file_new();
    }
 
+   /* The handlers may go away: report what the rate limiter suppressed. */
+   VMToolsLogLimitFlush(TRUE, VMToolsLogLimitReport);
+
    /*
     * If not resetting the logging system, keep the old domains around. After
     * we're done loading the new configuration, we'll go through the old domains
@@ -1083,6 +1491,15 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
       g_message("Log caching is disabled.");
    }
 
+   queueSize = g_key_file_get_integer(cfg, LOGGING_GROUP,
+                                      "asyncQueueSize", &err);
+   if (err != NULL || queueSize < 0) {
+      /* A value '0' makes every thread write its own messages. */
+      queueSize = DEFAULT_ASYNC_QUEUE_SIZE;
+      g_clear_error(&err);
+   }
+   VMToolsLogQueueConfig((guint) queueSize, VMToolsLogWriteQueued);
+
    if (g_key_file_has_key(cfg, LOGGING_GROUP, "enableCoreDump", NULL)) {
       gEnableCoreDump = g_key_file_get_boolean(cfg, LOGGING_GROUP,
                                                "enableCoreDump", NULL);
@@ -1200,11 +1617,21 @@ VMToolsLogWrapper(GLogLevelFlags level,
    VMTools_ReleaseLogStateLock();
 
    if (gPanicCount == 0) {
-      char *msg = Str_Vasprintf(NULL, fmt, args);
-      if (msg != NULL) {
-         g_log(gLogDomain, level, "%s", msg);
-         free(msg);
+      /* Most messages fit in a stack buffer; allocate only for long ones. */
+      char buf[512];
+      va_list argsCopy;
+
+      va_copy(argsCopy, args);
+      if (Str_Vsnprintf(buf, sizeof buf, fmt, argsCopy) >= 0) {
+         g_log(gLogDomain, level, "%s", buf);
+      } else {
+         char *msg = Str_Vasprintf(NULL, fmt, args);
+         if (msg != NULL) {
+            g_log(gLogDomain, level, "%s", msg);
+            free(msg);
+         }
       }
+      va_end(argsCopy);
    } else {
       /* Try to avoid malloc() since we're aborting. */
       gchar msg[256];
@@ -1268,6 +1695,27 @@ void
 VMTools_SuspendLogIO()
 {
    gLogIOSuspended = TRUE;
+
+   /*
+    * Messages logged from now on are cached; write the ones already queued
+    * before the I/O is really suspended.
+    */
+   VMToolsLogQueueFlush();
+}
+
+
+/**
+ * Logs the summaries of rate limited messages that are due, then waits until
+ * all the log messages queued for the writer thread have been written, and
+ * the ones queued for the VMX have been sent.
+ */
+
+void
+VMTools_FlushLogs(void)
+{
+   VMToolsLogLimitFlush(FALSE, VMToolsLogLimitReport);
+   VMToolsLogQueueFlush();
+   VMToolsVMXLoggerFlush();
 }
 
 
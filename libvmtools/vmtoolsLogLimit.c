@@ -0,0 +1,398 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file vmtoolsLogLimit.c
+ *
+ * Rate limiting of repeated log messages. Messages are grouped by domain,
+ * level and "shape": the message text with digits left out, which stands for
+ * the format string that glib doesn't pass to the log handlers. Each group
+ * has a token bucket that holds up to a minute's worth of messages at the
+ * configured rate, and is refilled continuously. Messages logged while the
+ * bucket is empty are suppressed and counted. The count is reported in a
+ * summary message once LOGLIMIT_SUMMARY_INTERVAL has passed since the first
+ * suppressed message, so a message that keeps being logged too often is
+ * summarized periodically. The summary comes with the next message of the
+ * group, or, if the group goes quiet, from a timer on the default main
+ * context, from VMToolsLogLimitFlush(), or when the group is forgotten.
+ *
+ * The groups live in a small fixed-size table, so that checking a message
+ * never allocates memory; when the table is full, the least recently used
+ * group is forgotten. Time comes from VMTools_GetMonotonicTime(), so tests
+ * can use a fake clock.
+ */
+
+#include <string.h>
+
+#include "vmtoolsInt.h"
+
+/** Number of message groups tracked. Must be a power of 2. */
+#define LOGLIMIT_SLOTS              (256)
+
+/** How many slots are looked at to find a message's group. */
+#define LOGLIMIT_PROBES             (8)
+
+/** Time in which a bucket is refilled at the configured rate, in ms. */
+#define LOGLIMIT_PERIOD             (60 * 1000)
+
+/** How often to report messages that keep being suppressed, in ms. */
+#define LOGLIMIT_SUMMARY_INTERVAL   (60 * 1000)
+
+/** How often the timer looks for summaries due, while there are some. */
+#define LOGLIMIT_SWEEP_INTERVAL     (15 * 1000)
+
+/** How much of a suppressed message is quoted in its summary. */
+#define LOGLIMIT_SAMPLE_LEN         (120)
+
+/** Size of a summary message. */
+#define LOGLIMIT_SUMMARY_SIZE       (256)
+
+typedef struct LogLimitGroup {
+   guint32           hash;
+   GLogLevelFlags    level;
+   const gchar      *domain;
+   /* Tokens, in 1/LOGLIMIT_PERIOD of a message. */
+   guint64           tokens;
+   guint64           lastRefill;
+   guint64           lastUsed;
+   guint             suppressed;
+   guint64           suppressedSince;
+   /* First suppressed message, quoted in the summary. */
+   gchar             sample[LOGLIMIT_SAMPLE_LEN + sizeof "..."];
+} LogLimitGroup;
+
+static LogLimitGroup gGroups[LOGLIMIT_SLOTS];
+static GStaticMutex gLimitLock = G_STATIC_MUTEX_INIT;
+
+/* Number of groups with suppressed messages not reported yet. */
+static guint gPending = 0;
+
+/* Reports the summaries of quiet groups; only exists while some are pending. */
+static GSource *gSweepTimer = NULL;
+static VMToolsLogLimitReportFn gSweepReport = NULL;
+
+
+/**
+ * Hashes the domain, level and shape of a message (FNV-1a).
+ *
+ * @param[in]  domain      Log domain, may be NULL.
+ * @param[in]  level       Log level.
+ * @param[in]  message     The message.
+ *
+ * @return The hash; never 0, which marks free slots.
+ */
+
+static guint32
+VMToolsLogLimitHash(const gchar *domain,
+                    GLogLevelFlags level,
+                    const gchar *message)
+{
+   guint32 hash = 2166136261U ^ (guint32) level;
+   const guchar *p;
+
+   for (p = (const guchar *) (domain != NULL ? domain : ""); *p != '\0'; p++) {
+      hash = (hash ^ *p) * 16777619U;
+   }
+   hash = (hash ^ '\0') * 16777619U;
+
+   for (p = (const guchar *) message; *p != '\0'; p++) {
+      if (!g_ascii_isdigit(*p)) {
+         hash = (hash ^ *p) * 16777619U;
+      }
+   }
+
+   return hash != 0 ? hash : 1;
+}
+
+
+/**
+ * Finds the group of a message, or the slot where to start tracking it.
+ * Must be called with the lock held.
+ *
+ * @param[in]  hash        The message's hash.
+ * @param[in]  domain      Log domain, may be NULL.
+ * @param[in]  level       Log level.
+ * @param[out] found       Whether the group was already tracked.
+ *
+ * @return The group's slot.
+ */
+
+static LogLimitGroup *
+VMToolsLogLimitFind(guint32 hash,
+                    const gchar *domain,
+                    GLogLevelFlags level,
+                    gboolean *found)
+{
+   LogLimitGroup *victim = NULL;
+   guint i;
+
+   for (i = 0; i < LOGLIMIT_PROBES; i++) {
+      LogLimitGroup *group = &gGroups[(hash + i) & (LOGLIMIT_SLOTS - 1)];
+
+      if (group->hash == hash && group->level == level &&
+          g_strcmp0(group->domain, domain) == 0) {
+         *found = TRUE;
+         return group;
+      }
+      if (group->hash == 0) {
+         victim = group;
+         break;
+      }
+      if (victim == NULL || group->lastUsed < victim->lastUsed) {
+         victim = group;
+      }
+   }
+
+   *found = FALSE;
+   return victim;
+}
+
+
+/**
+ * Counts a suppressed message. The first one of a series is kept as the
+ * sample quoted in the summary. Must be called with the lock held.
+ *
+ * @param[in]  group       The group.
+ * @param[in]  now         Current time.
+ * @param[in]  message     The suppressed message.
+ */
+
+static void
+VMToolsLogLimitSuppress(LogLimitGroup *group,
+                        guint64 now,
+                        const gchar *message)
+{
+   if (group->suppressed++ == 0) {
+      gsize len = strcspn(message, "\n");
+
+      g_snprintf(group->sample, sizeof group->sample, "%.*s%s",
+                 (int) MIN(len, LOGLIMIT_SAMPLE_LEN), message,
+                 len > LOGLIMIT_SAMPLE_LEN ? "..." : "");
+      group->suppressedSince = now;
+      gPending++;
+   }
+}
+
+
+/**
+ * Writes the summary of the suppressed messages of a group, and resets the
+ * group's count. Must be called with the lock held.
+ *
+ * @param[in]  group       The group.
+ * @param[in]  now         Current time.
+ * @param[out] summary     Where to write the summary.
+ * @param[in]  size        Size of @a summary.
+ */
+
+static void
+VMToolsLogLimitSummary(LogLimitGroup *group,
+                       guint64 now,
+                       gchar *summary,
+                       gsize size)
+{
+   g_snprintf(summary, size,
+              "%u similar messages suppressed in the last %u seconds: %s\n",
+              group->suppressed,
+              (guint) ((MAX(now, group->suppressedSince) -
+                        group->suppressedSince + 999) / 1000),
+              group->sample);
+   group->suppressed = 0;
+   group->suppressedSince = 0;
+   gPending--;
+}
+
+
+/**
+ * Timer callback: reports the summaries that are due.
+ *
+ * @param[in]  data        Unused.
+ *
+ * @return Whether summaries are still pending.
+ */
+
+static gboolean
+VMToolsLogLimitSweep(gpointer data)
+{
+   VMToolsLogLimitReportFn report;
+   gboolean pending;
+
+   g_static_mutex_lock(&gLimitLock);
+   report = gSweepReport;
+   g_static_mutex_unlock(&gLimitLock);
+
+   VMToolsLogLimitFlush(FALSE, report);
+
+   g_static_mutex_lock(&gLimitLock);
+   pending = gPending > 0;
+   if (!pending) {
+      gSweepTimer = NULL;
+   }
+   g_static_mutex_unlock(&gLimitLock);
+
+   return pending;
+}
+
+
+/**
+ * Starts the timer that reports the summaries of groups that go quiet, if
+ * it's not running. Must be called with the lock held.
+ *
+ * @param[in]  report      Function that logs the summaries.
+ */
+
+static void
+VMToolsLogLimitStartSweep(VMToolsLogLimitReportFn report)
+{
+   gSweepReport = report;
+   if (gSweepTimer == NULL) {
+      gSweepTimer = VMTools_CreateTimer(LOGLIMIT_SWEEP_INTERVAL);
+      g_source_set_callback(gSweepTimer, VMToolsLogLimitSweep, NULL, NULL);
+      g_source_attach(gSweepTimer, NULL);
+      g_source_unref(gSweepTimer);
+   }
+}
+
+
+/**
+ * Decides whether a message should be logged, given the rate at which
+ * similar messages may be logged.
+ *
+ * Summaries of suppressed messages are passed to @a report, without the lock
+ * held, before this function returns: the summary of the message's own
+ * group when it's due, and that of the group forgotten to make room for the
+ * message's, if it had suppressed messages.
+ *
+ * @param[in]  domain      Log domain, may be NULL. The string must stay valid
+ *                         for as long as the library is in use.
+ * @param[in]  level       Log level.
+ * @param[in]  rate        Number of similar messages allowed per minute.
+ * @param[in]  message     The message.
+ * @param[in]  report      Function that logs the summaries.
+ *
+ * @return Whether to log the message.
+ */
+
+gboolean
+VMToolsLogLimitCheck(const gchar *domain,
+                     GLogLevelFlags level,
+                     guint rate,
+                     const gchar *message,
+                     VMToolsLogLimitReportFn report)
+{
+   guint64 now = VMTools_GetMonotonicTime();
+   guint64 capacity = (guint64) rate * LOGLIMIT_PERIOD;
+   gchar summary[LOGLIMIT_SUMMARY_SIZE];
+   gchar evicted[LOGLIMIT_SUMMARY_SIZE];
+   const gchar *evictedDomain = NULL;
+   GLogLevelFlags evictedLevel = 0;
+   guint32 hash;
+   LogLimitGroup *group;
+   gboolean found;
+   gboolean allowed;
+
+   summary[0] = '\0';
+   evicted[0] = '\0';
+   level &= G_LOG_LEVEL_MASK;
+   hash = VMToolsLogLimitHash(domain, level, message);
+
+   g_static_mutex_lock(&gLimitLock);
+
+   group = VMToolsLogLimitFind(hash, domain, level, &found);
+   if (!found) {
+      if (group->suppressed > 0) {
+         /* The group is forgotten: don't lose its count. */
+         evictedDomain = group->domain;
+         evictedLevel = group->level;
+         VMToolsLogLimitSummary(group, now, evicted, sizeof evicted);
+      }
+      group->hash = hash;
+      group->level = level;
+      group->domain = domain;
+      group->tokens = capacity;
+      group->lastRefill = now;
+      group->suppressed = 0;
+      group->suppressedSince = 0;
+   } else if (now > group->lastRefill) {
+      /* rate tokens per LOGLIMIT_PERIOD is rate units per ms. */
+      group->tokens += (now - group->lastRefill) * rate;
+      group->lastRefill = now;
+   }
+   group->tokens = MIN(group->tokens, capacity);
+   group->lastUsed = now;
+
+   allowed = group->tokens >= LOGLIMIT_PERIOD;
+   if (allowed) {
+      group->tokens -= LOGLIMIT_PERIOD;
+   } else {
+      VMToolsLogLimitSuppress(group, now, message);
+      VMToolsLogLimitStartSweep(report);
+   }
+
+   if (group->suppressed > 0 &&
+       now >= group->suppressedSince + LOGLIMIT_SUMMARY_INTERVAL) {
+      VMToolsLogLimitSummary(group, now, summary, sizeof summary);
+   }
+
+   g_static_mutex_unlock(&gLimitLock);
+
+   if (evicted[0] != '\0') {
+      report(evictedDomain, evictedLevel, evicted);
+   }
+   if (summary[0] != '\0') {
+      report(domain, level, summary);
+   }
+
+   return allowed;
+}
+
+
+/**
+ * Reports the summaries of suppressed messages without waiting for more
+ * messages of their groups.
+ *
+ * @param[in]  all         Whether to report all the suppressed messages, or
+ *                         only the summaries that are due.
+ * @param[in]  report      Function that logs the summaries.
+ */
+
+void
+VMToolsLogLimitFlush(gboolean all,
+                     VMToolsLogLimitReportFn report)
+{
+   guint64 now = VMTools_GetMonotonicTime();
+   guint i;
+
+   g_static_mutex_lock(&gLimitLock);
+   for (i = 0; i < LOGLIMIT_SLOTS && gPending > 0; i++) {
+      LogLimitGroup *group = &gGroups[i];
+
+      if (group->suppressed > 0 &&
+          (all || now >= group->suppressedSince + LOGLIMIT_SUMMARY_INTERVAL)) {
+         gchar summary[LOGLIMIT_SUMMARY_SIZE];
+         const gchar *domain = group->domain;
+         GLogLevelFlags level = group->level;
+
+         VMToolsLogLimitSummary(group, now, summary, sizeof summary);
+
+         g_static_mutex_unlock(&gLimitLock);
+         report(domain, level, summary);
+         g_static_mutex_lock(&gLimitLock);
+      }
+   }
+   g_static_mutex_unlock(&gLimitLock);
+}
@@ -0,0 +1,467 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file vmtoolsLogQueue.c
+ *
+ * A bounded queue used to hand log messages to a dedicated writer thread, so
+ * that threads that log don't wait for the log I/O to finish.
+ *
+ * The queue is a ring of slots, each with a sequence number that tells whether
+ * the slot is free for the producer that claimed its position, or holds an
+ * entry ready for the consumer. Producers claim positions with an atomic
+ * compare-and-swap and never block: when the ring is full, the entry is
+ * dropped and counted. There's a single consumer at a time: the writer thread,
+ * or a thread flushing the queue, which holds the consumer lock while
+ * draining. The writer only sleeps when the queue is empty, and producers
+ * only take the wake up lock when the writer is sleeping.
+ *
+ * The writer thread is started the first time something is queued, if glib's
+ * thread support is initialized; otherwise, the queue isn't used and entries
+ * are written synchronously by the caller. Since the thread doesn't survive a
+ * fork(), the queue is flushed before forking, and the child starts its own
+ * writer thread when it needs one.
+ */
+
+#include "vmtoolsInt.h"
+#if !defined(_WIN32)
+#  include <pthread.h>
+#endif
+
+/** Maximum number of entries handed to the write callback at once. */
+#define LOGQUEUE_BATCH_SIZE     64
+
+typedef struct LogQueueSlot {
+   volatile gint     seq;
+   gpointer          entry;
+} LogQueueSlot;
+
+typedef struct LogQueue {
+   LogQueueSlot           *slots;
+   guint                   size;
+   volatile gint           head;
+   guint                   tail;
+   volatile gint           dropped;
+   volatile gint           sleeping;
+   gboolean                stop;
+   VMToolsLogQueueWriteFn  writeFn;
+   GThread                *thread;
+   GCond                  *cond;
+} LogQueue;
+
+static LogQueue gQueue;
+
+/* Serializes the consumers: the writer thread and whoever flushes the queue. */
+static GStaticMutex gConsumerLock = G_STATIC_MUTEX_INIT;
+
+/* Protects the writer's sleep, and the queue's configuration. */
+static GStaticMutex gWakeLock = G_STATIC_MUTEX_INIT;
+
+
+/**
+ * Returns whether there's an entry ready for the consumer.
+ *
+ * @return Whether the queue has an entry ready to be written.
+ */
+
+static gboolean
+VMToolsLogQueueHasEntries(void)
+{
+   LogQueueSlot *slot = &gQueue.slots[gQueue.tail % gQueue.size];
+
+   return g_atomic_int_get(&slot->seq) == (gint) (gQueue.tail + 1);
+}
+
+
+/**
+ * Writes all the entries currently in the queue. Must be called with the
+ * consumer lock held.
+ *
+ * @return Number of entries written.
+ */
+
+static guint
+VMToolsLogQueueDrain(void)
+{
+   guint total = 0;
+   guint count;
+
+   if (gQueue.slots == NULL) {
+      return 0;
+   }
+
+   do {
+      gpointer entries[LOGQUEUE_BATCH_SIZE];
+
+      for (count = 0; count < ARRAYSIZE(entries); count++) {
+         LogQueueSlot *slot = &gQueue.slots[gQueue.tail % gQueue.size];
+
+         if (g_atomic_int_get(&slot->seq) != (gint) (gQueue.tail + 1)) {
+            break;
+         }
+         entries[count] = slot->entry;
+         slot->entry = NULL;
+
+         /* Hands the slot back to the producer that wraps around to it. */
+         g_atomic_int_set(&slot->seq, (gint) (gQueue.tail + gQueue.size));
+         gQueue.tail++;
+      }
+
+      if (count > 0) {
+         gQueue.writeFn(entries, count);
+         total += count;
+      }
+   } while (count == LOGQUEUE_BATCH_SIZE);
+
+   return total;
+}
+
+
+/**
+ * Reports, and resets, the number of entries dropped because the queue was
+ * full. The report is itself logged, so it's queued like any other message.
+ */
+
+static void
+VMToolsLogQueueReportDrops(void)
+{
+   gint dropped;
+
+   do {
+      dropped = g_atomic_int_get(&gQueue.dropped);
+   } while (dropped > 0 &&
+            !g_atomic_int_compare_and_exchange(&gQueue.dropped, dropped, 0));
+
+   if (dropped > 0) {
+      g_warning("Dropped %d log messages because the log queue was full.",
+                dropped);
+   }
+}
+
+
+/**
+ * Writer thread: writes the queued entries in batches, and sleeps while the
+ * queue is empty.
+ *
+ * @param[in]  data     Unused.
+ *
+ * @return NULL.
+ */
+
+static gpointer
+VMToolsLogQueueWriter(gpointer data)
+{
+   while (TRUE) {
+      gboolean stop;
+      guint written;
+
+      g_static_mutex_lock(&gConsumerLock);
+      written = VMToolsLogQueueDrain();
+      g_static_mutex_unlock(&gConsumerLock);
+
+      if (written > 0) {
+         VMToolsLogQueueReportDrops();
+         continue;
+      }
+
+      g_static_mutex_lock(&gWakeLock);
+      g_atomic_int_set(&gQueue.sleeping, 1);
+      stop = gQueue.stop;
+      if (!stop && !VMToolsLogQueueHasEntries()) {
+         /*
+          * No timeout: a producer that publishes an entry after the check
+          * above sees the flag and signals under the lock, and stopping
+          * signals too, so an idle service doesn't wake up for nothing.
+          */
+         g_cond_wait(gQueue.cond, g_static_mutex_get_mutex(&gWakeLock));
+         stop = gQueue.stop;
+      }
+      g_atomic_int_set(&gQueue.sleeping, 0);
+      g_static_mutex_unlock(&gWakeLock);
+
+      if (stop) {
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Starts the writer thread. Must be called with the wake up lock held.
+ *
+ * @return Whether the writer thread is running.
+ */
+
+static gboolean
+VMToolsLogQueueStartWriter(void)
+{
+   GError *err = NULL;
+
+   if (!g_thread_supported()) {
+      return FALSE;
+   }
+
+   if (gQueue.cond == NULL) {
+      gQueue.cond = g_cond_new();
+   }
+
+   gQueue.stop = FALSE;
+   gQueue.thread = g_thread_create(VMToolsLogQueueWriter, NULL, TRUE, &err);
+   if (gQueue.thread == NULL) {
+      /* Can't log here: we're in the middle of logging. */
+      g_clear_error(&err);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+#if !defined(_WIN32)
+
+/**
+ * fork() handlers. Before forking, writes all pending entries, and keeps other
+ * threads from consuming the queue until the fork is done. The child, which
+ * doesn't have a writer thread, starts one the next time it logs.
+ */
+
+static void
+VMToolsLogQueueForkPrepare(void)
+{
+   g_static_mutex_lock(&gWakeLock);
+   g_static_mutex_lock(&gConsumerLock);
+   VMToolsLogQueueDrain();
+}
+
+
+static void
+VMToolsLogQueueForkParent(void)
+{
+   g_static_mutex_unlock(&gConsumerLock);
+   g_static_mutex_unlock(&gWakeLock);
+}
+
+
+static void
+VMToolsLogQueueForkChild(void)
+{
+   gQueue.thread = NULL;
+   gQueue.sleeping = 0;
+   gQueue.cond = NULL;
+   g_static_mutex_unlock(&gConsumerLock);
+   g_static_mutex_unlock(&gWakeLock);
+}
+
+#endif
+
+
+/**
+ * Configures the log queue. If the size changes, entries queued with the old
+ * configuration are written and the writer thread is stopped; it's started
+ * again the next time something is queued. Like the rest of the logging
+ * configuration, this must not race with other threads logging.
+ *
+ * @param[in]  size     Maximum number of queued entries. 0 disables the queue.
+ * @param[in]  writeFn  Callback that writes and frees queued entries.
+ */
+
+void
+VMToolsLogQueueConfig(guint size,
+                      VMToolsLogQueueWriteFn writeFn)
+{
+#if !defined(_WIN32)
+   static gboolean atforkRegistered = FALSE;
+
+   if (!atforkRegistered) {
+      pthread_atfork(VMToolsLogQueueForkPrepare,
+                     VMToolsLogQueueForkParent,
+                     VMToolsLogQueueForkChild);
+      atforkRegistered = TRUE;
+   }
+#endif
+
+   /*
+    * Positions wrap around at G_MAXUINT, so the size must be a power of 2 for
+    * the slot indices to wrap around with them.
+    */
+   if (size > 0) {
+      size = 1 << g_bit_storage(size - 1);
+   }
+
+   if (size == gQueue.size && writeFn == gQueue.writeFn) {
+      return;
+   }
+
+   VMToolsLogQueueStop();
+
+   g_static_mutex_lock(&gWakeLock);
+   g_static_mutex_lock(&gConsumerLock);
+
+   if (size > 0) {
+      guint i;
+
+      gQueue.slots = g_new0(LogQueueSlot, size);
+      for (i = 0; i < size; i++) {
+         gQueue.slots[i].seq = i;
+      }
+   }
+   gQueue.size = size;
+   gQueue.head = 0;
+   gQueue.tail = 0;
+   gQueue.writeFn = writeFn;
+
+   g_static_mutex_unlock(&gConsumerLock);
+   g_static_mutex_unlock(&gWakeLock);
+}
+
+
+/**
+ * Queues an entry to be written by the writer thread. Never blocks on the
+ * log I/O.
+ *
+ * @param[in]  entry    The entry. On success, the queue owns it.
+ * @param[out] dropped  Set to whether the entry should be dropped.
+ *
+ * @return TRUE if the entry was queued. FALSE if the queue is not in use,
+ *         in which case the caller should write the entry itself, or if the
+ *         queue is full, in which case the caller should drop the entry
+ *         (see @a dropped).
+ */
+
+gboolean
+VMToolsLogQueuePush(gpointer entry,
+                    gboolean *dropped)
+{
+   LogQueueSlot *slot;
+   gint pos;
+
+   *dropped = FALSE;
+
+   if (gQueue.slots == NULL) {
+      return FALSE;
+   }
+
+   if (gQueue.thread == NULL) {
+      gboolean running;
+
+      g_static_mutex_lock(&gWakeLock);
+      running = gQueue.thread != NULL || VMToolsLogQueueStartWriter();
+      g_static_mutex_unlock(&gWakeLock);
+      if (!running) {
+         return FALSE;
+      }
+   }
+
+   pos = g_atomic_int_get(&gQueue.head);
+   while (TRUE) {
+      gint diff;
+
+      slot = &gQueue.slots[(guint) pos % gQueue.size];
+      diff = (gint) ((guint) g_atomic_int_get(&slot->seq) - (guint) pos);
+      if (diff == 0) {
+         if (g_atomic_int_compare_and_exchange(&gQueue.head, pos,
+                                               (gint) ((guint) pos + 1))) {
+            break;
+         }
+      } else if (diff < 0) {
+         /* The consumer hasn't freed this slot yet: the queue is full. */
+         g_atomic_int_inc(&gQueue.dropped);
+         *dropped = TRUE;
+         return FALSE;
+      }
+      pos = g_atomic_int_get(&gQueue.head);
+   }
+
+   slot->entry = entry;
+   g_atomic_int_set(&slot->seq, (gint) ((guint) pos + 1));
+
+   if (g_atomic_int_get(&gQueue.sleeping)) {
+      g_static_mutex_lock(&gWakeLock);
+      if (gQueue.cond != NULL) {
+         g_cond_signal(gQueue.cond);
+      }
+      g_static_mutex_unlock(&gWakeLock);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Writes all queued entries on the calling thread. Used when the queued
+ * messages must hit the log before going on: before a fatal error aborts the
+ * process, before log I/O is suspended, and when the configuration changes.
+ */
+
+void
+VMToolsLogQueueFlush(void)
+{
+   if (gQueue.slots == NULL) {
+      return;
+   }
+
+   /*
+    * Don't wait for the consumer lock if it's the writer thread itself that
+    * needs the flush (e.g., a write error turned into a fatal error); since
+    * it's the only consumer, it can just go ahead.
+    */
+   if (gQueue.thread != NULL && gQueue.thread == g_thread_self()) {
+      VMToolsLogQueueDrain();
+   } else {
+      g_static_mutex_lock(&gConsumerLock);
+      VMToolsLogQueueDrain();
+      g_static_mutex_unlock(&gConsumerLock);
+   }
+}
+
+
+/**
+ * Stops the writer thread, and writes and frees any entries still queued.
+ */
+
+void
+VMToolsLogQueueStop(void)
+{
+   GThread *thread;
+
+   g_static_mutex_lock(&gWakeLock);
+   thread = gQueue.thread;
+   gQueue.stop = TRUE;
+   if (gQueue.cond != NULL) {
+      g_cond_signal(gQueue.cond);
+   }
+   g_static_mutex_unlock(&gWakeLock);
+
+   if (thread != NULL && thread != g_thread_self()) {
+      g_thread_join(thread);
+   }
+
+   g_static_mutex_lock(&gWakeLock);
+   g_static_mutex_lock(&gConsumerLock);
+   VMToolsLogQueueDrain();
+   gQueue.thread = NULL;
+   g_free(gQueue.slots);
+   gQueue.slots = NULL;
+   gQueue.size = 0;
+   g_static_mutex_unlock(&gConsumerLock);
+   g_static_mutex_unlock(&gWakeLock);
+
+   VMToolsLogQueueReportDrops();
+}
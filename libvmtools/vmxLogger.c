@@ -20,33 +20,460 @@
  * @file vmxLogger.c
  *
  * A logger that writes the logs to the VMX log file.
+ *
+ * All VMX loggers in the process share one outgoing queue and one RpcChannel,
+ * which is kept open instead of being opened and closed for every message.
+ * Logging a message only appends it to the queue; a flusher thread sends the
+ * queued messages to the VMX, several at a time, as multi-line "log" RPCs of
+ * at most VMXLOGGER_RPC_SIZE bytes. The thread sends as soon as a full RPC is
+ * queued, and otherwise waits up to VMXLOGGER_FLUSH_DELAY after the oldest
+ * queued message so that bursts of messages are coalesced. When more than
+ * VMXLOGGER_MAX_QUEUED bytes are waiting, new messages are dropped; the number
+ * of dropped messages is sent to the VMX with the next batch.
+ *
+ * Without glib thread support, and for fatal errors, the queue is sent right
+ * away by the thread that logs.
  */
 
+#include <string.h>
+
 #include "vmtoolsInt.h"
 #include "vmware/tools/guestrpc.h"
+#include "vmware/tools/log.h"
+#if !defined(_WIN32)
+#  include <pthread.h>
+#endif
+
+/** Maximum number of bytes waiting to be sent. */
+#define VMXLOGGER_MAX_QUEUED     (256 * 1024)
+
+/** How long the flusher sleeps before checking the queue again, in us. */
+#define VMXLOGGER_IDLE_WAKEUP    (G_USEC_PER_SEC)
+
+#define VMXLOGGER_RPC_CMD        "log "
 
 typedef struct VMXLoggerData {
    GlibLogger     handler;
-   RpcChannel    *chan;
 } VMXLoggerData;
 
+typedef struct VMXLogSink {
+   guint          refCount;
+   /* Protected by gQueueLock. */
+   GString       *queue;
+   guint          queuedMsgs;
+   guint64        oldest;
+   guint          dropped;
+   gboolean       stop;
+   GThread       *thread;
+   GCond         *cond;
+   /* Protected by gSendLock. */
+   GString       *rpc;
+   RpcChannel    *chan;
+   gboolean       chanStarted;
+   RpcChannel    *appChan;
+   /* Statistics, protected by gQueueLock. */
+   guint64        sent;
+   guint64        rpcs;
+   guint64        totalDropped;
+} VMXLogSink;
+
+static VMXLogSink gSink;
+
+/*
+ * Lock order: gSendLock, then gQueueLock. gSendLock is held while sending, so
+ * that batches taken from the queue are sent in order.
+ */
+static GStaticMutex gSendLock = G_STATIC_MUTEX_INIT;
+static GStaticMutex gQueueLock = G_STATIC_MUTEX_INIT;
+
+/* Set on the flusher thread, whose own messages (from RpcChannel) are dropped. */
+static GStaticPrivate gIsFlusher = G_STATIC_PRIVATE_INIT;
+
 
 /*
  *******************************************************************************
- * VMXLoggerLog --                                                        */ /**
+ * VMXLoggerNextChunk --                                                  */ /**
+ *
+ * Returns how much of the given messages fit in one RPC. Chunks end at a line
+ * boundary; a line longer than an RPC is sent by itself.
+ *
+ * @param[in] data      Queued messages.
+ * @param[in] len       Length of @a data.
+ *
+ * @return Length of the first chunk of @a data.
+ *
+ *******************************************************************************
+ */
+
+static gsize
+VMXLoggerNextChunk(const gchar *data,
+                   gsize len)
+{
+   const gchar *nl;
+   gsize i;
+
+   if (len <= VMXLOGGER_RPC_SIZE) {
+      return len;
+   }
+
+   for (i = VMXLOGGER_RPC_SIZE; i > 0; i--) {
+      if (data[i - 1] == '\n') {
+         return i;
+      }
+   }
+
+   nl = memchr(data + VMXLOGGER_RPC_SIZE, '\n', len - VMXLOGGER_RPC_SIZE);
+   return nl != NULL ? (gsize) (nl - data) + 1 : len;
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerSendRpc --                                                    */ /**
+ *
+ * Sends one RPC to the VMX, on the application's channel if one was provided,
+ * or on the logger's own channel otherwise. The logger's channel is opened the
+ * first time it's needed, and is closed on error so that it's opened again for
+ * the next RPC. Must be called with the send lock held.
+ *
+ * @param[in] data      The RPC.
+ * @param[in] len       Length of the RPC.
+ *
+ * @return Whether the RPC was sent.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+VMXLoggerSendRpc(const gchar *data,
+                 gsize len)
+{
+   if (gSink.appChan != NULL) {
+      return RpcChannel_Send(gSink.appChan, data, len, NULL, NULL);
+   }
+
+   if (gSink.chan == NULL) {
+      gSink.chan = RpcChannel_New();
+      if (gSink.chan == NULL) {
+         return FALSE;
+      }
+   }
+
+   if (!gSink.chanStarted) {
+      if (!RpcChannel_Start(gSink.chan)) {
+         RpcChannel_Stop(gSink.chan);
+         return FALSE;
+      }
+      gSink.chanStarted = TRUE;
+   }
+
+   if (!RpcChannel_Send(gSink.chan, data, len, NULL, NULL)) {
+      RpcChannel_Stop(gSink.chan);
+      gSink.chanStarted = FALSE;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerSend --                                                       */ /**
+ *
+ * Takes messages from the queue and sends them to the VMX. Unless @a all is
+ * set, only full RPCs are sent and the rest stays queued. Must be called with
+ * the send lock held; the queue lock is taken while the queue is read.
+ *
+ * @param[in] all       Whether to send all the queued messages.
+ *
+ *******************************************************************************
+ */
+
+static void
+VMXLoggerSend(gboolean all)
+{
+   GString *rpc = gSink.rpc;
+   gsize taken = 0;
+   guint dropped;
+   guint rpcs = 0;
+   guint msgs = 0;
+
+   if (rpc == NULL) {
+      rpc = gSink.rpc = g_string_sized_new(VMXLOGGER_RPC_SIZE +
+                                           sizeof VMXLOGGER_RPC_CMD + 128);
+   }
+
+   g_static_mutex_lock(&gQueueLock);
+   dropped = gSink.dropped;
+   gSink.dropped = 0;
+
+   while (taken < gSink.queue->len) {
+      const gchar *chunk = gSink.queue->str + taken;
+      gsize left = gSink.queue->len - taken;
+      gsize len;
+      const gchar *p;
+
+      if (!all && left < VMXLOGGER_RPC_SIZE) {
+         break;
+      }
+      len = VMXLoggerNextChunk(chunk, left);
+
+      g_string_truncate(rpc, 0);
+      g_string_append(rpc, VMXLOGGER_RPC_CMD);
+      if (dropped > 0) {
+         g_string_append_printf(rpc, "Dropped %u log messages because the "
+                                "VMX log queue was full.\n", dropped);
+         dropped = 0;
+      }
+      g_string_append_len(rpc, chunk, len);
+      taken += len;
+
+      for (p = chunk; (p = memchr(p, '\n', chunk + len - p)) != NULL; p++) {
+         msgs++;
+      }
+
+      /*
+       * The queue is only appended to while the lock is released, so the
+       * part already taken stays where it is.
+       */
+      g_static_mutex_unlock(&gQueueLock);
+      VMXLoggerSendRpc(rpc->str, rpc->len);
+      rpcs++;
+      g_static_mutex_lock(&gQueueLock);
+   }
+
+   if (dropped > 0) {
+      /* Nothing was sent: report the drops with the next batch. */
+      gSink.dropped += dropped;
+   }
+
+   g_string_erase(gSink.queue, 0, taken);
+   gSink.queuedMsgs -= MIN(msgs, gSink.queuedMsgs);
+   if (gSink.queue->len == 0) {
+      gSink.oldest = 0;
+   }
+   gSink.sent += msgs;
+   gSink.rpcs += rpcs;
+   g_static_mutex_unlock(&gQueueLock);
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerFlushSync --                                                  */ /**
+ *
+ * Sends all the queued messages on the calling thread. Logging is disabled
+ * while sending, to avoid nested logging inside of RpcChannel (see bug
+ * 1069390); this may be called from inside a log handler.
+ *
+ *******************************************************************************
+ */
+
+static void
+VMXLoggerFlushSync(void)
+{
+   g_static_mutex_lock(&gSendLock);
+   if (gSink.queue != NULL) {
+      VMTools_AcquireLogStateLock();
+      VMTools_StopLogging();
+      VMXLoggerSend(TRUE);
+      VMTools_RestartLogging();
+      VMTools_ReleaseLogStateLock();
+   }
+   g_static_mutex_unlock(&gSendLock);
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerFlusher --                                                    */ /**
  *
- * Logs a message to the VMX using RpcChannel.
+ * Flusher thread: sends full RPCs as soon as they're queued, and whatever is
+ * queued once the oldest message has waited for VMXLOGGER_FLUSH_DELAY.
  *
- * The logger uses its own RpcChannel, opening and closing the channel for each
- * log message sent. This is not optimal, especially if the application already
- * has an RpcChannel instantiated; this could be fixed by providing a way for
- * the application to provide its own RpcChannel to the logging code, if it uses
- * one, so that this logger can re-use it.
+ * @param[in] data      Unused.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+VMXLoggerFlusher(gpointer data)
+{
+   g_static_private_set(&gIsFlusher, GINT_TO_POINTER(1), NULL);
+
+   while (TRUE) {
+      gboolean stop;
+      gboolean all;
+      GTimeVal timeout;
+
+      g_static_mutex_lock(&gQueueLock);
+      if (!gSink.stop && gSink.queue->len == 0) {
+         g_get_current_time(&timeout);
+         g_time_val_add(&timeout, VMXLOGGER_IDLE_WAKEUP);
+         g_cond_timed_wait(gSink.cond, g_static_mutex_get_mutex(&gQueueLock),
+                           &timeout);
+      }
+
+      if (!gSink.stop && gSink.queue->len > 0 &&
+          gSink.queue->len < VMXLOGGER_RPC_SIZE) {
+         gint64 wait = (gint64) (gSink.oldest + VMXLOGGER_FLUSH_DELAY -
+                                 VMTools_GetMonotonicTime());
+
+         if (wait > 0) {
+            g_get_current_time(&timeout);
+            g_time_val_add(&timeout, (glong) wait * 1000);
+            g_cond_timed_wait(gSink.cond,
+                              g_static_mutex_get_mutex(&gQueueLock),
+                              &timeout);
+         }
+      }
+
+      stop = gSink.stop;
+      all = stop || (gSink.oldest != 0 &&
+                     VMTools_GetMonotonicTime() - gSink.oldest >=
+                     VMXLOGGER_FLUSH_DELAY);
+      g_static_mutex_unlock(&gQueueLock);
+
+      g_static_mutex_lock(&gSendLock);
+      VMXLoggerSend(all);
+      g_static_mutex_unlock(&gSendLock);
+
+      if (stop) {
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerStartFlusher --                                               */ /**
+ *
+ * Starts the flusher thread. Must be called with the queue lock held.
+ *
+ * @return Whether the flusher thread is running.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+VMXLoggerStartFlusher(void)
+{
+   GError *err = NULL;
+
+   if (!g_thread_supported()) {
+      return FALSE;
+   }
+
+   if (gSink.cond == NULL) {
+      gSink.cond = g_cond_new();
+   }
+
+   gSink.stop = FALSE;
+   gSink.thread = g_thread_create(VMXLoggerFlusher, NULL, TRUE, &err);
+   if (gSink.thread == NULL) {
+      /* Can't log here: we're in the middle of logging. */
+      g_clear_error(&err);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerStopFlusher --                                                */ /**
+ *
+ * Stops the flusher thread, after it has sent all the queued messages.
+ *
+ *******************************************************************************
+ */
+
+static void
+VMXLoggerStopFlusher(void)
+{
+   GThread *thread;
+
+   g_static_mutex_lock(&gQueueLock);
+   thread = gSink.thread;
+   gSink.thread = NULL;
+   if (thread != NULL) {
+      gSink.stop = TRUE;
+      g_cond_signal(gSink.cond);
+   }
+   g_static_mutex_unlock(&gQueueLock);
+
+   if (thread != NULL) {
+      g_thread_join(thread);
+   }
+}
+
+
+#if !defined(_WIN32)
+
+/*
+ *******************************************************************************
+ * VMXLoggerForkPrepare --                                                */ /**
+ *
+ * fork() handlers. Before forking, keeps other threads from sending or
+ * queueing until the fork is done. The child, which doesn't have a flusher
+ * thread, starts one the next time it logs. It also forgets the messages
+ * queued by the parent, which the parent sends, and the logger's channel,
+ * which belongs to the parent: stopping it would close the parent's channel
+ * on the host.
+ *
+ *******************************************************************************
+ */
+
+static void
+VMXLoggerForkPrepare(void)
+{
+   g_static_mutex_lock(&gSendLock);
+   g_static_mutex_lock(&gQueueLock);
+}
+
+
+static void
+VMXLoggerForkParent(void)
+{
+   g_static_mutex_unlock(&gQueueLock);
+   g_static_mutex_unlock(&gSendLock);
+}
+
+
+static void
+VMXLoggerForkChild(void)
+{
+   gSink.thread = NULL;
+   gSink.cond = NULL;
+   g_string_truncate(gSink.queue, 0);
+   gSink.queuedMsgs = 0;
+   gSink.oldest = 0;
+   gSink.chan = NULL;
+   gSink.chanStarted = FALSE;
+   g_static_mutex_unlock(&gQueueLock);
+   g_static_mutex_unlock(&gSendLock);
+}
+
+#endif
+
+
+/*
+ *******************************************************************************
+ * VMXLoggerLog --                                                        */ /**
+ *
+ * Queues a message to be sent to the VMX.
  *
  * @param[in] domain    Unused.
  * @param[in] level     Log level.
  * @param[in] message   Message to log.
- * @param[in] data      VMX logger data.
+ * @param[in] data      Unused.
  *
  *******************************************************************************
  */
@@ -57,28 +484,41 @@ VMXLoggerLog(const gchar *domain,
              const gchar *message,
              gpointer data)
 {
-   VMXLoggerData *logger = data;
-
-   VMTools_AcquireLogStateLock();
-   /*
-    * To avoid nested logging inside of RpcChannel, we need to disable logging
-    * here. See bug 1069390.
-    */
+   gsize len = strlen(message);
+   gboolean sync = FALSE;
 
-   VMTools_StopLogging();
+   if (g_static_private_get(&gIsFlusher) != NULL) {
+      /* Logged by RpcChannel while sending. */
+      return;
+   }
 
-   if (RpcChannel_Start(logger->chan)) {
-      gchar *msg;
-      gint cnt = VMToolsAsprintf(&msg, "log %s", message);
+   g_static_mutex_lock(&gQueueLock);
+   if (gSink.queue->len + len > VMXLOGGER_MAX_QUEUED) {
+      gSink.dropped++;
+      gSink.totalDropped++;
+      g_static_mutex_unlock(&gQueueLock);
+      return;
+   }
 
-      RpcChannel_Send(logger->chan, msg, cnt, NULL, NULL);
+   if (gSink.queue->len == 0) {
+      gSink.oldest = VMTools_GetMonotonicTime();
+   }
+   g_string_append_len(gSink.queue, message, len);
+   gSink.queuedMsgs++;
 
-      g_free(msg);
-      RpcChannel_Stop(logger->chan);
+   if (gSink.thread == NULL && !VMXLoggerStartFlusher()) {
+      sync = TRUE;
+   } else if (gSink.queue->len == len ||
+              (gSink.queue->len >= VMXLOGGER_RPC_SIZE &&
+               gSink.queue->len - len < VMXLOGGER_RPC_SIZE)) {
+      /* Starts the flush timer, or sends a full RPC right away. */
+      g_cond_signal(gSink.cond);
    }
+   g_static_mutex_unlock(&gQueueLock);
 
-   VMTools_RestartLogging();
-   VMTools_ReleaseLogStateLock();
+   if (sync || (level & (G_LOG_LEVEL_ERROR | G_LOG_FLAG_FATAL)) != 0) {
+      VMXLoggerFlushSync();
+   }
 }
 
 
@@ -86,7 +526,9 @@ VMXLoggerLog(const gchar *domain,
  *******************************************************************************
  * VMXLoggerDestroy --                                                    */ /**
  *
- * Cleans up the internal state of a VMX logger.
+ * Cleans up the internal state of a VMX logger. When the last VMX logger goes
+ * away, the queued messages are sent, and the flusher thread and the logger's
+ * channel are stopped.
  *
  * @param[in] data   VMX logger data.
  *
@@ -97,11 +539,52 @@ static void
 VMXLoggerDestroy(gpointer data)
 {
    VMXLoggerData *logger = data;
-   RpcChannel_Destroy(logger->chan);
+   gboolean last;
+
+   g_static_mutex_lock(&gQueueLock);
+   last = --gSink.refCount == 0;
+   g_static_mutex_unlock(&gQueueLock);
+
+   if (last) {
+      VMXLoggerStopFlusher();
+      VMXLoggerFlushSync();
+
+      g_static_mutex_lock(&gSendLock);
+      if (gSink.chan != NULL) {
+         if (gSink.chanStarted) {
+            RpcChannel_Stop(gSink.chan);
+         }
+         RpcChannel_Destroy(gSink.chan);
+         gSink.chan = NULL;
+         gSink.chanStarted = FALSE;
+      }
+      if (gSink.rpc != NULL) {
+         g_string_free(gSink.rpc, TRUE);
+         gSink.rpc = NULL;
+      }
+      g_static_mutex_unlock(&gSendLock);
+   }
+
    g_free(logger);
 }
 
 
+/*
+ *******************************************************************************
+ * VMToolsVMXLoggerFlush --                                               */ /**
+ *
+ * Sends all the messages queued for the VMX on the calling thread.
+ *
+ *******************************************************************************
+ */
+
+void
+VMToolsVMXLoggerFlush(void)
+{
+   VMXLoggerFlushSync();
+}
+
+
 /*
  *******************************************************************************
  * VMToolsCreateVMXLogger --                                              */ /**
@@ -117,11 +600,91 @@ GlibLogger *
 VMToolsCreateVMXLogger(void)
 {
    VMXLoggerData *data = g_new0(VMXLoggerData, 1);
+#if !defined(_WIN32)
+   static gboolean atforkRegistered = FALSE;
+
+   if (!atforkRegistered) {
+      pthread_atfork(VMXLoggerForkPrepare,
+                     VMXLoggerForkParent,
+                     VMXLoggerForkChild);
+      atforkRegistered = TRUE;
+   }
+#endif
+
    data->handler.logfn = VMXLoggerLog;
    data->handler.addsTimestamp = TRUE;
    data->handler.shared = TRUE;
    data->handler.dtor = VMXLoggerDestroy;
-   data->chan = RpcChannel_New();
+
+   g_static_mutex_lock(&gQueueLock);
+   if (gSink.queue == NULL) {
+      gSink.queue = g_string_sized_new(VMXLOGGER_RPC_SIZE);
+   }
+   gSink.refCount++;
+   g_static_mutex_unlock(&gQueueLock);
+
    return &data->handler;
 }
 
+
+/*
+ *******************************************************************************
+ * VMTools_SetVMXLogChannel --                                            */ /**
+ *
+ * Makes the VMX loggers send their messages on the given channel, instead of
+ * opening a channel of their own. The messages are sent from the VMX loggers'
+ * flusher thread, so the application must not stop or reset the channel
+ * while it's in use; queued messages are sent before this function returns,
+ * so call it with NULL before destroying the channel.
+ *
+ * @param[in] chan      An RpcChannel that has been started, or NULL to go back
+ *                      to the loggers' own channel.
+ *
+ *******************************************************************************
+ */
+
+void
+VMTools_SetVMXLogChannel(RpcChannel *chan)
+{
+   VMXLoggerFlushSync();
+
+   g_static_mutex_lock(&gSendLock);
+   gSink.appChan = chan;
+   g_static_mutex_unlock(&gSendLock);
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_GetVMXLogStats --                                              */ /**
+ *
+ * Returns the state of the VMX loggers' queue.
+ *
+ * @param[out] stats    Where to store the statistics.
+ *
+ * @return FALSE if no VMX logger was ever configured.
+ *
+ *******************************************************************************
+ */
+
+gboolean
+VMTools_GetVMXLogStats(VMToolsVMXLogStats *stats)
+{
+   gboolean ret = FALSE;
+
+   memset(stats, 0, sizeof *stats);
+
+   g_static_mutex_lock(&gQueueLock);
+   if (gSink.queue != NULL) {
+      stats->active = gSink.refCount > 0;
+      stats->queued = gSink.queuedMsgs;
+      stats->queuedBytes = (guint) gSink.queue->len;
+      stats->sent = gSink.sent;
+      stats->rpcs = gSink.rpcs;
+      stats->dropped = gSink.totalDropped;
+      ret = TRUE;
+   }
+   g_static_mutex_unlock(&gQueueLock);
+
+   return ret;
+}
@@ -20,11 +20,182 @@
  * @file diskInfoPosix.c
  *
  * Contains POSIX-specific bits of gettting disk information.
+ *
+ * On Linux, enumerating the partitions (reading the mount table and checking
+ * every mount's device) is only done when the mount table changes, which the
+ * kernel signals with POLLPRI on /proc/self/mountinfo. In between, the space
+ * of the known partitions is refreshed with a statfs() each, at most once per
+ * the configured interval.
  */
 
+#include <string.h>
+
+#if defined(__linux__)
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <sys/poll.h>
+#   include <unistd.h>
+#endif
+
 #include "util.h"
 #include "vmware.h"
 #include "guestInfoInt.h"
+#include "str.h"
+#include "wiper.h"
+#include "vmware/tools/utils.h"
+
+#if defined(__linux__)
+
+#define MOUNTINFO_FILE "/proc/self/mountinfo"
+
+static int gMountInfoFd = -1;
+
+/** The partitions found by the last enumeration, with their last space. */
+static GuestDiskInfo *gPartitions = NULL;
+
+/** When the space of gPartitions was last updated, in ms. */
+static guint64 gSpaceUpdated = 0;
+
+#endif
+
+/** How often to update the free space of the partitions, in seconds. */
+static guint gSpaceInterval = 0;
+
+
+#if defined(__linux__)
+
+/*
+ ******************************************************************************
+ * GuestInfoMountsChanged --                                             */ /**
+ *
+ * Checks whether the mount table changed since the last call. The first call
+ * opens /proc/self/mountinfo, which stays open to be polled.
+ *
+ * @return TRUE if the mount table changed, or if it can't be told.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoMountsChanged(void)
+{
+   struct pollfd pfd;
+
+   if (gMountInfoFd == -1) {
+      gMountInfoFd = open(MOUNTINFO_FILE, O_RDONLY);
+      if (gMountInfoFd == -1) {
+         g_debug("Cannot open " MOUNTINFO_FILE ": %s\n", strerror(errno));
+      } else {
+         fcntl(gMountInfoFd, F_SETFD, FD_CLOEXEC);
+      }
+      return TRUE;
+   }
+
+   pfd.fd = gMountInfoFd;
+   pfd.events = POLLPRI;
+   pfd.revents = 0;
+
+   if (poll(&pfd, 1, 0) == -1) {
+      return TRUE;
+   }
+
+   return (pfd.revents & (POLLPRI | POLLERR)) != 0;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoUpdateSpace --                                               */ /**
+ *
+ * Updates the free and total space of known partitions.
+ *
+ * @param[in,out] di    The partitions.
+ *
+ * @return TRUE on success, FALSE if a partition can't be queried.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GuestInfoUpdateSpace(GuestDiskInfo *di)
+{
+   WiperPartition part;
+   unsigned int i;
+
+   memset(&part, 0, sizeof part);
+
+   for (i = 0; i < di->numEntries; i++) {
+      PPartitionEntry entry = &di->partitionList[i];
+      uint64 freeBytes;
+      uint64 totalBytes;
+      unsigned char *error;
+
+      Str_Strcpy((char *) part.mountPoint, entry->name, sizeof part.mountPoint);
+      error = WiperSinglePartition_GetSpace(&part, &freeBytes, &totalBytes);
+      if (*error != '\0') {
+         g_debug("Could not get space for partition %s: %s\n",
+                 entry->name, error);
+         return FALSE;
+      }
+
+      entry->freeBytes = freeBytes;
+      entry->totalBytes = totalBytes;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoCopyDiskInfo --                                              */ /**
+ *
+ * Copies disk info.
+ *
+ * @param[in] di    The disk info to copy.
+ *
+ * @return The copy. Free with GuestInfo_FreeDiskInfo.
+ *
+ ******************************************************************************
+ */
+
+static GuestDiskInfo *
+GuestInfoCopyDiskInfo(const GuestDiskInfo *di)
+{
+   GuestDiskInfo *copy = Util_SafeCalloc(1, sizeof *copy);
+
+   copy->numEntries = di->numEntries;
+   if (di->numEntries > 0) {
+      copy->partitionList = Util_SafeMalloc(di->numEntries *
+                                            sizeof *di->partitionList);
+      memcpy(copy->partitionList, di->partitionList,
+             di->numEntries * sizeof *di->partitionList);
+   }
+
+   return copy;
+}
+
+#endif // if defined(__linux__)
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_SetDiskSpaceInterval --                                     */ /**
+ *
+ * Sets how often the free space of the partitions is updated, when the mount
+ * table doesn't change.
+ *
+ * @param[in] interval  Interval in seconds; 0 updates it on every call to
+ *                      GuestInfo_GetDiskInfo.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_SetDiskSpaceInterval(guint interval)
+{
+   gSpaceInterval = interval;
+}
 
 
 /*
@@ -42,5 +213,54 @@
 GuestDiskInfo *
 GuestInfo_GetDiskInfo(void)
 {
+#if defined(__linux__)
+   guint64 now = VMTools_GetMonotonicTime();
+   Bool changed = GuestInfoMountsChanged();
+
+   if (!changed && gPartitions != NULL) {
+      if (now - gSpaceUpdated < (guint64) gSpaceInterval * 1000) {
+         return GuestInfoCopyDiskInfo(gPartitions);
+      }
+      if (GuestInfoUpdateSpace(gPartitions)) {
+         gSpaceUpdated = now;
+         return GuestInfoCopyDiskInfo(gPartitions);
+      }
+   }
+
+   g_debug("Enumerating partitions.\n");
+
+   GuestInfo_FreeDiskInfo(gPartitions);
+   gPartitions = GuestInfoGetDiskInfoWiper();
+   if (gPartitions == NULL) {
+      return NULL;
+   }
+   gSpaceUpdated = now;
+
+   return GuestInfoCopyDiskInfo(gPartitions);
+#else
    return GuestInfoGetDiskInfoWiper();
+#endif
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_StopDiskInfoMonitor --                                      */ /**
+ *
+ * Stops watching the mount table, and forgets the known partitions.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_StopDiskInfoMonitor(void)
+{
+#if defined(__linux__)
+   if (gMountInfoFd != -1) {
+      close(gMountInfoFd);
+      gMountInfoFd = -1;
+   }
+   GuestInfo_FreeDiskInfo(gPartitions);
+   gPartitions = NULL;
+#endif
 }
@@ -55,6 +55,11 @@ extern int guestInfoPollInterval;
 Bool
 GuestInfo_PerfMon(DynBuf *stats);
 
+#if !defined(_WIN32)
+void
+GuestInfo_PerfMonShutdown(void);
+#endif
+
 #if defined(_WIN32)
 void
 GuestInfo_SetStatLogging(Bool isEnabled);
@@ -66,8 +71,45 @@ GuestInfoGetDiskInfoWiper(void);
 GuestDiskInfo *
 GuestInfo_GetDiskInfo(void);
 
+#if !defined(_WIN32)
+void
+GuestInfo_SetDiskSpaceInterval(guint interval);
+
+void
+GuestInfo_StopDiskInfoMonitor(void);
+#endif
+
 void
 GuestInfo_FreeDiskInfo(GuestDiskInfo *di);
 
+#if defined(__linux__)
+/*
+ * Per-process resource sampler, see procSamplerLinux.c.
+ */
+
+typedef struct GuestInfoProcUsage {
+   int pid;
+   char name[16];          /* Blanks and ';' are replaced with '_'. */
+   double cpu;             /* Percent of one CPU. */
+   uint64 rss;             /* Resident set size, in KiB. */
+   double readRate;        /* Bytes read from storage per second. */
+   double writeRate;       /* Bytes written to storage per second. */
+} GuestInfoProcUsage;
+
+typedef struct GuestInfoProcSampler GuestInfoProcSampler;
+
+GuestInfoProcSampler *
+GuestInfo_ProcSamplerOpen(const char *procDir);
+
+guint
+GuestInfo_ProcSamplerSample(GuestInfoProcSampler *sampler,
+                            guint budget,
+                            GuestInfoProcUsage *top,
+                            guint count);
+
+void
+GuestInfo_ProcSamplerClose(GuestInfoProcSampler *sampler);
+#endif
+
 #endif /* _GUESTINFOINT_H_ */
 
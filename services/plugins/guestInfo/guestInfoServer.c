@@ -84,6 +84,43 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 
 #define GUESTINFO_DEFAULT_DELIMITER ' '
 
+/**
+ * How long to wait for more NIC changes before sending the NIC info, in ms.
+ */
+#define GUESTINFO_NIC_CHANGE_DELAY 500
+
+/**
+ * How many polls use the NIC monitor's model before it is rebuilt from the
+ * kernel's tables: 10 polls are 5 minutes at the default poll interval.
+ */
+#define GUESTINFO_NIC_RESYNC_POLLS 10
+
+/**
+ * Default interval for updating the free space of the partitions: 0, on
+ * every guestInfo poll.
+ */
+#define GUESTINFO_DISKSPACE_INTERVAL 0
+
+/**
+ * Default number of top processes to publish: 0, process sampling is off.
+ */
+#define GUESTINFO_TOPPROCESSES 0
+
+/**
+ * Most top processes that can be published.
+ */
+#define GUESTINFO_TOPPROCESSES_MAX 100
+
+/**
+ * Default time budget for sampling the processes, in ms.
+ */
+#define GUESTINFO_TOPPROCESSES_BUDGET 200
+
+/**
+ * Guest variable the top processes are published in.
+ */
+#define GUESTINFO_TOPPROCESSES_VAR "guestinfo.topProcesses"
+
 /*
  * Define what guest info types and nic info versions could be sent
  * to update nic info at VMX. The order defines a sequence of fallback
@@ -135,6 +172,25 @@ static GSource *gatherInfoTimeoutSource = NULL;
  */
 static GSource *gatherStatsTimeoutSource = NULL;
 
+#if defined(__linux__) && !defined(USERWORLD)
+/**
+ * NIC monitor, and the sources that watch it and send the NIC info after a
+ * change.
+ */
+static NicInfoMonitor *gNicMonitor = NULL;
+static GSource *gNicMonitorSource = NULL;
+static GSource *gNicChangeSource = NULL;
+static guint gNicPolls = 0;
+
+/**
+ * Process sampler, how many top processes it publishes, and how long it may
+ * take, in ms.
+ */
+static GuestInfoProcSampler *gProcSampler = NULL;
+static guint gTopProcesses = GUESTINFO_TOPPROCESSES;
+static guint gTopProcessesBudget = GUESTINFO_TOPPROCESSES_BUDGET;
+#endif
+
 /* Local cache of the guest information that was last sent to vmx. */
 static GuestInfoCache gInfoCache;
 
@@ -163,6 +219,10 @@ static Bool DiskInfoChanged(const GuestDiskInfo *diskInfo);
 static void GuestInfoClearCache(void);
 static GuestNicList *NicInfoV3ToV2(const NicInfoV3 *infoV3);
 static void TweakGatherLoops(ToolsAppCtx *ctx, gboolean enable);
+static void GuestInfoUpdateNicInfo(ToolsAppCtx *ctx);
+#if defined(__linux__) && !defined(USERWORLD)
+static void StopNicMonitor(void);
+#endif
 
 
 /*
@@ -274,7 +334,6 @@ GuestInfoGather(gpointer data)
    gboolean disableQueryDiskInfo;
    GuestDiskInfo *diskInfo = NULL;
 #endif
-   NicInfoV3 *nicInfo = NULL;
    ToolsAppCtx *ctx = data;
 
    g_debug("Entered guest info gather.\n");
@@ -335,8 +394,59 @@ GuestInfoGather(gpointer data)
       g_warning("Failed to update VMDB.\n");
    }
 
-   /* Get NIC information. */
-   if (!GuestInfo_GetNicInfo(&nicInfo)) {
+#if defined(__linux__) && !defined(USERWORLD)
+   /*
+    * The NIC monitor sends the NIC info when it changes, so this poll is only
+    * a safety net for it. Every few polls, the model is rebuilt so that a
+    * missed change doesn't stick.
+    */
+   if (gNicMonitor != NULL && ++gNicPolls >= GUESTINFO_NIC_RESYNC_POLLS) {
+      gNicPolls = 0;
+      if (!GuestInfo_NicMonitorResync(gNicMonitor)) {
+         g_warning("NIC monitor failed, falling back to polling.\n");
+         StopNicMonitor();
+      }
+   }
+#endif
+
+   GuestInfoUpdateNicInfo(ctx);
+
+   /* Send the uptime to VMX so that it can detect soft resets. */
+   SendUptime(ctx);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoUpdateNicInfo --                                             */ /**
+ *
+ * Collects the NIC information and updates the VMX if it has changed. The
+ * information comes from the NIC monitor when there is one.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoUpdateNicInfo(ToolsAppCtx *ctx)
+{
+   NicInfoV3 *nicInfo = NULL;
+   Bool success;
+
+#if defined(__linux__) && !defined(USERWORLD)
+   if (gNicMonitor != NULL) {
+      success = GuestInfo_NicMonitorGetNicInfo(gNicMonitor, &nicInfo);
+   } else {
+      success = GuestInfo_GetNicInfo(&nicInfo);
+   }
+#else
+   success = GuestInfo_GetNicInfo(&nicInfo);
+#endif
+
+   if (!success) {
       g_warning("Failed to get nic info.\n");
       /*
        * Return an empty nic info.
@@ -358,12 +468,50 @@ GuestInfoGather(gpointer data)
       g_warning("Failed to update VMDB.\n");
       GuestInfo_FreeNicInfo(nicInfo);
    }
+}
 
-   /* Send the uptime to VMX so that it can detect soft resets. */
-   SendUptime(ctx);
 
-   return TRUE;
+#if defined(__linux__) && !defined(USERWORLD)
+/*
+ ******************************************************************************
+ * GuestInfoSendTopProcesses --                                          */ /**
+ *
+ * Samples the processes, and publishes the ones using the most resources in
+ * the GUESTINFO_TOPPROCESSES_VAR guest variable. The value has a record per
+ * process, highest first, separated by ';'. A record is "pid name cpu rss
+ * read write": the CPU usage in percent of a CPU, the resident set size in
+ * KiB, and the storage read and write rates in bytes per second.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoSendTopProcesses(ToolsAppCtx *ctx)
+{
+   GuestInfoProcUsage *top = g_new(GuestInfoProcUsage, gTopProcesses);
+   GString *msg = g_string_new("info-set " GUESTINFO_TOPPROCESSES_VAR " ");
+   guint found;
+   guint i;
+
+   found = GuestInfo_ProcSamplerSample(gProcSampler, gTopProcessesBudget, top,
+                                       gTopProcesses);
+   for (i = 0; i < found; i++) {
+      g_string_append_printf(msg, "%s%d %s %.1f %"FMT64"u %.0f %.0f",
+                             i > 0 ? ";" : "", top[i].pid, top[i].name,
+                             top[i].cpu, top[i].rss, top[i].readRate,
+                             top[i].writeRate);
+   }
+
+   if (!RpcChannel_Send(ctx->rpc, msg->str, msg->len + 1, NULL, NULL)) {
+      g_warning("Failed to send the top processes.\n");
+   }
+
+   g_string_free(msg, TRUE);
+   g_free(top);
 }
+#endif
 
 
 /*
@@ -417,6 +565,12 @@ GuestInfoStatsGather(gpointer data)
    DynBuf_Destroy(&stats);
 #endif
 
+#if defined(__linux__) && !defined(USERWORLD)
+   if (gProcSampler != NULL) {
+      GuestInfoSendTopProcesses(ctx);
+   }
+#endif
+
    return TRUE;
 }
 
@@ -1340,6 +1494,290 @@ TweakGatherLoop(ToolsAppCtx *ctx,
 }
 
 
+#if defined(__linux__) && !defined(USERWORLD)
+/*
+ ******************************************************************************
+ * GuestInfoNicChanged --                                                */ /**
+ *
+ * Sends the NIC info to the VMX once the NICs have settled after a change.
+ *
+ * @param[in]  data     The application context.
+ *
+ * @return FALSE, the source is one-shot.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestInfoNicChanged(gpointer data)
+{
+   ToolsAppCtx *ctx = data;
+
+   gNicChangeSource = NULL;
+   g_debug("NICs changed, updating nic info.\n");
+   GuestInfoUpdateNicInfo(ctx);
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * StopNicMonitor --                                                     */ /**
+ *
+ * Destroys the NIC monitor and its sources, if they exist.
+ *
+ ******************************************************************************
+ */
+
+static void
+StopNicMonitor(void)
+{
+   if (gNicChangeSource != NULL) {
+      g_source_destroy(gNicChangeSource);
+      gNicChangeSource = NULL;
+   }
+
+   if (gNicMonitorSource != NULL) {
+      g_source_destroy(gNicMonitorSource);
+      gNicMonitorSource = NULL;
+   }
+
+   GuestInfo_NicMonitorClose(gNicMonitor);
+   gNicMonitor = NULL;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoNicMonitorCb --                                              */ /**
+ *
+ * Handles the NIC monitor's notifications. Bursts of changes (an interface
+ * coming up gets an address and routes in quick succession) are coalesced by
+ * waiting GUESTINFO_NIC_CHANGE_DELAY before sending the NIC info.
+ *
+ * If the monitor fails, it is destroyed and the NIC info is only sent by
+ * the poll loop from then on.
+ *
+ * @param[in]  chan     Unused.
+ * @param[in]  cond     Unused.
+ * @param[in]  data     The application context.
+ *
+ * @return Whether to keep watching the monitor.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestInfoNicMonitorCb(GIOChannel *chan,
+                      GIOCondition cond,
+                      gpointer data)
+{
+   ToolsAppCtx *ctx = data;
+   Bool changed;
+
+   if (!GuestInfo_NicMonitorProcess(gNicMonitor, &changed)) {
+      g_warning("NIC monitor failed, falling back to polling.\n");
+      /* Returning FALSE destroys the source. */
+      gNicMonitorSource = NULL;
+      StopNicMonitor();
+      return FALSE;
+   }
+
+   if (changed && gNicChangeSource == NULL) {
+      gNicChangeSource = g_timeout_source_new(GUESTINFO_NIC_CHANGE_DELAY);
+      VMTOOLSAPP_ATTACH_SOURCE(ctx, gNicChangeSource, GuestInfoNicChanged,
+                               ctx, NULL);
+      g_source_unref(gNicChangeSource);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TweakNicMonitor --                                                    */ /**
+ *
+ * @brief Starts or stops the NIC monitor.
+ *
+ * @param[in]  ctx      The app context.
+ * @param[in]  enable   Whether to enable the monitor.
+ *
+ * @sa CONFNAME_GUESTINFO_DISABLENICMONITOR
+ *
+ ******************************************************************************
+ */
+
+static void
+TweakNicMonitor(ToolsAppCtx *ctx,
+                gboolean enable)
+{
+   GIOChannel *chan;
+
+   if (enable) {
+      enable = !g_key_file_get_boolean(ctx->config, CONFGROUPNAME_GUESTINFO,
+                                       CONFNAME_GUESTINFO_DISABLENICMONITOR,
+                                       NULL);
+   }
+
+   if (!enable) {
+      if (gNicMonitor != NULL) {
+         StopNicMonitor();
+         g_info("NIC monitor disabled.\n");
+      }
+      return;
+   }
+
+   if (gNicMonitor != NULL) {
+      return;
+   }
+
+   gNicMonitor = GuestInfo_NicMonitorOpen();
+   if (gNicMonitor == NULL) {
+      g_info("NIC monitor not available, relying on polling.\n");
+      return;
+   }
+
+   chan = g_io_channel_unix_new(GuestInfo_NicMonitorGetFd(gNicMonitor));
+   g_io_channel_set_encoding(chan, NULL, NULL);
+   g_io_channel_set_buffered(chan, FALSE);
+
+   gNicMonitorSource = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+   g_io_channel_unref(chan);
+
+   VMTOOLSAPP_ATTACH_SOURCE(ctx, gNicMonitorSource, GuestInfoNicMonitorCb,
+                            ctx, NULL);
+   g_source_unref(gNicMonitorSource);
+
+   g_info("NIC monitor enabled.\n");
+}
+#endif
+
+
+#if !defined(_WIN32) && !defined(USERWORLD)
+/*
+ ******************************************************************************
+ * GuestInfoConfigGetUInt --                                             */ /**
+ *
+ * @brief Reads a non-negative integer from the guestinfo config group.
+ *
+ * @param[in]  ctx         The app context.
+ * @param[in]  key         The config key.
+ * @param[in]  defValue    The value to use if the key is missing or invalid.
+ *
+ * @return The value.
+ *
+ ******************************************************************************
+ */
+
+static guint
+GuestInfoConfigGetUInt(ToolsAppCtx *ctx,
+                       const gchar *key,
+                       guint defValue)
+{
+   GError *gError = NULL;
+   gint value;
+
+   if (!g_key_file_has_key(ctx->config, CONFGROUPNAME_GUESTINFO, key, NULL)) {
+      return defValue;
+   }
+
+   value = g_key_file_get_integer(ctx->config, CONFGROUPNAME_GUESTINFO, key,
+                                  &gError);
+   if (value < 0 || gError) {
+      g_warning("Invalid %s.%s value. Using default %u.\n",
+                CONFGROUPNAME_GUESTINFO, key, defValue);
+      value = defValue;
+   }
+
+   g_clear_error(&gError);
+   return value;
+}
+
+
+/*
+ ******************************************************************************
+ * TweakDiskSpaceInterval --                                             */ /**
+ *
+ * @brief Sets how often the free space of the partitions is updated.
+ *
+ * @param[in]  ctx      The app context.
+ *
+ * @sa CONFNAME_GUESTINFO_DISKSPACEINTERVAL
+ *
+ ******************************************************************************
+ */
+
+static void
+TweakDiskSpaceInterval(ToolsAppCtx *ctx)
+{
+   GuestInfo_SetDiskSpaceInterval(
+      GuestInfoConfigGetUInt(ctx, CONFNAME_GUESTINFO_DISKSPACEINTERVAL,
+                             GUESTINFO_DISKSPACE_INTERVAL));
+}
+#endif
+
+
+#if defined(__linux__) && !defined(USERWORLD)
+/*
+ ******************************************************************************
+ * TweakTopProcesses --                                                  */ /**
+ *
+ * @brief Creates or destroys the process sampler, and sets how many top
+ * processes it publishes.
+ *
+ * The sampler runs with the stats gather loop, so it is only enabled along
+ * with perfmon.
+ *
+ * @param[in]  ctx      The app context.
+ * @param[in]  enable   Whether perfmon is enabled.
+ *
+ * @sa CONFNAME_GUESTINFO_TOPPROCESSES
+ * @sa CONFNAME_GUESTINFO_TOPPROCESSESBUDGET
+ *
+ ******************************************************************************
+ */
+
+static void
+TweakTopProcesses(ToolsAppCtx *ctx,
+                  gboolean enable)
+{
+   guint count = 0;
+
+   if (enable) {
+      count = GuestInfoConfigGetUInt(ctx, CONFNAME_GUESTINFO_TOPPROCESSES,
+                                     GUESTINFO_TOPPROCESSES);
+      gTopProcessesBudget =
+         GuestInfoConfigGetUInt(ctx, CONFNAME_GUESTINFO_TOPPROCESSESBUDGET,
+                                GUESTINFO_TOPPROCESSES_BUDGET);
+   }
+
+   if (count > GUESTINFO_TOPPROCESSES_MAX) {
+      g_warning("%s.%s value too large. Using %u.\n", CONFGROUPNAME_GUESTINFO,
+                CONFNAME_GUESTINFO_TOPPROCESSES, GUESTINFO_TOPPROCESSES_MAX);
+      count = GUESTINFO_TOPPROCESSES_MAX;
+   }
+   gTopProcesses = count;
+
+   if (count == 0) {
+      if (gProcSampler != NULL) {
+         GuestInfo_ProcSamplerClose(gProcSampler);
+         gProcSampler = NULL;
+         g_info("Process sampling disabled.\n");
+      }
+      return;
+   }
+
+   if (gProcSampler == NULL) {
+      gProcSampler = GuestInfo_ProcSamplerOpen("/proc");
+      if (gProcSampler != NULL) {
+         g_info("Process sampling enabled.\n");
+      }
+   }
+}
+#endif
+
+
 /*
  ******************************************************************************
  * TweakGatherLoops --                                                   */ /**
@@ -1354,6 +1792,9 @@ TweakGatherLoop(ToolsAppCtx *ctx,
  *
  * @sa CONFNAME_GUESTINFO_POLLINTERVAL
  * @sa CONFNAME_GUESTINFO_STATSINTERVAL
+ * @sa CONFNAME_GUESTINFO_DISABLENICMONITOR
+ * @sa CONFNAME_GUESTINFO_DISKSPACEINTERVAL
+ * @sa CONFNAME_GUESTINFO_TOPPROCESSES
  *
  ******************************************************************************
  */
@@ -1400,6 +1841,15 @@ TweakGatherLoops(ToolsAppCtx *ctx,
                    GuestInfoGather,
                    &guestInfoPollInterval,
                    &gatherInfoTimeoutSource);
+
+#if defined(__linux__) && !defined(USERWORLD)
+   TweakNicMonitor(ctx, enable);
+   TweakTopProcesses(ctx, perfmonEnabled);
+#endif
+
+#if !defined(_WIN32) && !defined(USERWORLD)
+   TweakDiskSpaceInterval(ctx);
+#endif
 }
 
 
@@ -1486,6 +1936,17 @@ GuestInfoServerShutdown(gpointer src,
       gatherStatsTimeoutSource = NULL;
    }
 
+#if defined(__linux__) && !defined(USERWORLD)
+   StopNicMonitor();
+   GuestInfo_ProcSamplerClose(gProcSampler);
+   gProcSampler = NULL;
+   GuestInfo_PerfMonShutdown();
+#endif
+
+#if !defined(_WIN32) && !defined(USERWORLD)
+   GuestInfo_StopDiskInfoMonitor();
+#endif
+
 #ifdef _WIN32
    GuestInfo_StatProviderShutdown();
    NetUtil_FreeIpHlpApiDll();
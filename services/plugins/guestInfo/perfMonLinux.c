@@ -16,6 +16,8 @@
  *
  *********************************************************/
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -25,22 +27,31 @@
 
 #include "vm_basic_defs.h"
 #include "vmware.h"
-#include "strutil.h"
 #include "debug.h"
 #include "guestInfoInt.h"
 #include "guestStats.h"
 #include "posix.h"
 #include "hashTable.h"
 
+#ifndef O_CLOEXEC
+#   define O_CLOEXEC 0
+#endif
+
 #define GUEST_INFO_PREALLOC_SIZE 4096
+#define GUEST_INFO_READ_BUF_SIZE 16384
 #define INT_AS_HASHKEY(x) ((const void *)(uintptr_t)(x))
 
-#define STAT_FILE        "/proc/stat"
-#define VMSTAT_FILE      "/proc/vmstat"
-#define UPTIME_FILE      "/proc/uptime"
-#define MEMINFO_FILE     "/proc/meminfo"
-#define ZONEINFO_FILE    "/proc/zoneinfo"
-#define SWAPPINESS_FILE  "/proc/sys/vm/swappiness"
+/* Overridden by the benchmark, to read recorded snapshots. */
+#ifndef GUEST_INFO_PROC_DIR
+#define GUEST_INFO_PROC_DIR "/proc"
+#endif
+
+#define STAT_FILE        GUEST_INFO_PROC_DIR "/stat"
+#define VMSTAT_FILE      GUEST_INFO_PROC_DIR "/vmstat"
+#define UPTIME_FILE      GUEST_INFO_PROC_DIR "/uptime"
+#define MEMINFO_FILE     GUEST_INFO_PROC_DIR "/meminfo"
+#define ZONEINFO_FILE    GUEST_INFO_PROC_DIR "/zoneinfo"
+#define SWAPPINESS_FILE  GUEST_INFO_PROC_DIR "/sys/vm/swappiness"
 
 
 /*
@@ -98,11 +109,52 @@ typedef struct {
    GuestInfoQuery  *query;
 } GuestInfoStat;
 
+/*
+ * The files stats are read from. They are opened on first use and kept open;
+ * each collection re-reads them from the start.
+ */
+
+typedef struct {
+   const char      *path;
+   Bool             nameHasColon;  // Field names end with ':'
+   int              fd;
+} GuestInfoProcFile;
+
+static GuestInfoProcFile guestInfoProcFiles[] = {
+   { MEMINFO_FILE,  TRUE,  -1 },
+   { VMSTAT_FILE,   FALSE, -1 },
+   { STAT_FILE,     FALSE, -1 },
+   { ZONEINFO_FILE, FALSE, -1 },
+   { UPTIME_FILE,   FALSE, -1 },
+};
+
+#define N_PROC_FILES  ARRAYSIZE(guestInfoProcFiles)
+#define UPTIME_INDEX  (N_PROC_FILES - 1)
+
+static char *guestInfoReadBuf = NULL;
+static size_t guestInfoReadBufSize = 0;
+
 typedef struct {
-   HashTable       *exactMatches;
+   const char      *key;
+   size_t           keyLen;
+   GuestInfoStat   *stat;
+} GuestInfoKey;
 
-   uint32           numRegExps;
-   GuestInfoStat  **regExps;
+/*
+ * The stats of a file: the exact matches, sorted by name, followed by the
+ * "regExps" (prefix matches) in table order.
+ */
+
+typedef struct {
+   GuestInfoKey    *keys;
+   uint32           numKeys;
+   GuestInfoKey    *prefixes;
+   uint32           numPrefixes;
+} GuestInfoKeyTable;
+
+typedef struct {
+   GuestInfoKey      *keys;
+   GuestInfoKeyTable  tables[N_PROC_FILES];
 
    uint32           numStats;
    GuestInfoStat   *stats;
@@ -113,46 +165,110 @@ typedef struct {
    double           timeStamp;
 } GuestInfoCollector;
 
+/* The collections of the last two GuestInfo_PerfMon calls. */
+static GuestInfoCollector *guestInfoCurrent = NULL;
+static GuestInfoCollector *guestInfoPrevious = NULL;
+
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoGetUpTime --
+ * GuestInfoReadProcFile --
  *
- *      What time is it?
+ *      Reads a proc file from the start, opening it if it isn't open yet.
+ *      The file stays open for the next collections.
+ *
+ *      The kernel generates as much of a proc file as fits in a read, so
+ *      a short read means the end of the file; a single pread() gets all of
+ *      it once the buffer is large enough.
  *
  * Results:
- *      TRUE   Success! *now is populated
- *      FALSE  Failure! *now remains unchanged
+ *      The NUL-terminated contents, in a buffer shared by all files and
+ *      valid until the next read, or NULL on failure.
  *
  * Side effects:
- *      None.
+ *      Closes the file on read errors, so it is reopened next time.
  *
  *----------------------------------------------------------------------
  */
 
-static Bool
-GuestInfoGetUpTime(double *now)  // OUT:
+static char *
+GuestInfoReadProcFile(GuestInfoProcFile *file)  // IN/OUT:
 {
-   char line[512];
-   Bool result = FALSE;
-   FILE *fp = Posix_Fopen(UPTIME_FILE, "r");
+   size_t used = 0;
 
-   if (fp == NULL) {
-      return result;
+   if (file->fd == -1) {
+      file->fd = Posix_Open(file->path, O_RDONLY | O_CLOEXEC);
+      if (file->fd == -1) {
+         g_warning("%s: Error opening %s.\n", __FUNCTION__, file->path);
+         return NULL;
+      }
    }
 
-   if (fgets(line, sizeof line, fp) != NULL) {
-      double idle;
+   for (;;) {
+      size_t room;
+      ssize_t n;
+
+      if (guestInfoReadBufSize - used < 2) {
+         size_t size = MAX(GUEST_INFO_READ_BUF_SIZE, 2 * guestInfoReadBufSize);
+         char *buf = realloc(guestInfoReadBuf, size);
+
+         if (buf == NULL) {
+            return NULL;
+         }
+         guestInfoReadBuf = buf;
+         guestInfoReadBufSize = size;
+      }
+
+      room = guestInfoReadBufSize - used - 1;
+      n = pread(file->fd, guestInfoReadBuf + used, room, used);
+      if (n == -1 && errno == EINTR) {
+         continue;
+      }
+      if (n == -1) {
+         g_warning("%s: Error reading %s: %s.\n", __FUNCTION__, file->path,
+                   strerror(errno));
+         close(file->fd);
+         file->fd = -1;
+         return NULL;
+      }
 
-      if (sscanf(line, "%lf %lf", now, &idle) == 2) {
-         result = TRUE;
+      used += n;
+      if ((size_t) n < room) {
+         break;
       }
    }
 
-   fclose(fp);
+   guestInfoReadBuf[used] = '\0';
 
-   return result;
+   return guestInfoReadBuf;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoGetUpTime --
+ *
+ *      What time is it?
+ *
+ * Results:
+ *      TRUE   Success! *now is populated
+ *      FALSE  Failure! *now remains unchanged
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoGetUpTime(double *now)  // OUT:
+{
+   double idle;
+   const char *data = GuestInfoReadProcFile(&guestInfoProcFiles[UPTIME_INDEX]);
+
+   return (data != NULL) && (sscanf(data, "%lf %lf", now, &idle) == 2);
 }
 
 
@@ -173,39 +289,35 @@ GuestInfoGetUpTime(double *now)  // OUT:
  */
 
 static void
-GuestInfoStoreStat(const char *pathName,  // IN: file stat is in
-                   GuestInfoStat *stat,   // IN/OUT: stat
+GuestInfoStoreStat(GuestInfoStat *stat,   // IN/OUT: stat
                    uint64 value)          // IN: value to be added to stat
 {
    ASSERT(stat);
    ASSERT(stat->query);
 
-   // TODO: consider supporting regexp here.
-   if (strcmp(stat->query->sourceFile, pathName) == 0) {
-      switch (stat->err) {
-      case 0:
-         ASSERT(stat->count != 0);
+   switch (stat->err) {
+   case 0:
+      ASSERT(stat->count != 0);
 
-         if (((stat->count + 1) < stat->count) ||
-             ((stat->value + value) < stat->value)) {
-            stat->err = EOVERFLOW;
-         } else {
-            stat->count++;
-            stat->value += value;
-         }
-         break;
+      if (((stat->count + 1) < stat->count) ||
+          ((stat->value + value) < stat->value)) {
+         stat->err = EOVERFLOW;
+      } else {
+         stat->count++;
+         stat->value += value;
+      }
+      break;
 
-      case ENOENT:
-         ASSERT(stat->count == 0);
+   case ENOENT:
+      ASSERT(stat->count == 0);
 
-         stat->err = 0;
-         stat->count = 1;
-         stat->value = value;
-         break;
+      stat->err = 0;
+      stat->count = 1;
+      stat->value = value;
+      break;
 
-      default:  // Some sort of error - sorry, thank you for playing...
-         break;
-      }
+   default:  // Some sort of error - sorry, thank you for playing...
+      break;
    }
 }
 
@@ -213,16 +325,12 @@ GuestInfoStoreStat(const char *pathName,  // IN: file stat is in
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoCollectStat --
- *
- *      Collect a stat.
+ * GuestInfoCompareKeys --
  *
- *      NOTE: Exact match data cannot be used in a regExp. This is a
- *            performance choice. We can discuss this when we have full
- *            programmability.
+ *      qsort() comparator for the exact match keys.
  *
  * Results:
- *      None.
+ *      <0, 0 or >0, as strcmp().
  *
  * Side effects:
  *      None.
@@ -230,42 +338,29 @@ GuestInfoStoreStat(const char *pathName,  // IN: file stat is in
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoCollectStat(const char *pathName,           // IN:
-                     GuestInfoCollector *collector,  // IN/OUT:
-                     const char *fieldName,          // IN:
-                     uint64 value)                   // IN:
+static int
+GuestInfoCompareKeys(const void *a,  // IN:
+                     const void *b)  // IN:
 {
-   GuestInfoStat *stat = NULL;
-
-   if (!HashTable_Lookup(collector->exactMatches, fieldName, (void **) &stat)) {
-      uint32 i;
-
-      for (i = 0; i < collector->numRegExps; i++) {
-         GuestInfoStat *thisOne = collector->regExps[i];
-
-         if (StrUtil_StartsWith(fieldName, thisOne->query->locatorString)) {
-            stat = thisOne;
-         }
-      }
-   }
-
-   if (stat != NULL) {
-      GuestInfoStoreStat(pathName, stat, value);
-   }
+   return strcmp(((const GuestInfoKey *) a)->key,
+                 ((const GuestInfoKey *) b)->key);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoReadProcMemInfoData --
+ * GuestInfoFindStat --
+ *
+ *      Finds the stat a field of a file goes to: a binary search of the
+ *      exact matches, then the prefix matches.
  *
- *      Reads /proc/meminfo to contribute to a collection.
+ *      NOTE: Exact match data cannot be used in a regExp. This is a
+ *            performance choice. We can discuss this when we have full
+ *            programmability.
  *
  * Results:
- *      TRUE   Success!
- *      FALSE  Failure!
+ *      The stat, or NULL if the field isn't collected.
  *
  * Side effects:
  *      None.
@@ -273,45 +368,44 @@ GuestInfoCollectStat(const char *pathName,           // IN:
  *----------------------------------------------------------------------
  */
 
-static Bool
-GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
+static GuestInfoStat *
+GuestInfoFindStat(const GuestInfoKeyTable *table,  // IN:
+                  const char *fieldName,           // IN: not NUL-terminated
+                  size_t nameLen)                  // IN:
 {
-   char line[512];
-   FILE *fp = Posix_Fopen(MEMINFO_FILE, "r");
-
-   if (fp == NULL) {
-      g_warning("%s: Error opening " MEMINFO_FILE ".\n", __FUNCTION__);
-      return FALSE;
-   }
+   GuestInfoStat *stat = NULL;
+   uint32 lo = 0;
+   uint32 hi = table->numKeys;
+   uint32 i;
 
-   while (fgets(line, sizeof line, fp) == line) {
-      char *p;
-      uint64 value = 0;
-      char *fieldName = strtok(line, " \t");
-      char *fieldData = strtok(NULL, " \t");
+   while (lo < hi) {
+      uint32 mid = lo + (hi - lo) / 2;
+      const GuestInfoKey *key = &table->keys[mid];
+      int cmp = memcmp(fieldName, key->key, MIN(nameLen, key->keyLen));
 
-      if (fieldName == NULL) {
-         continue;
+      if (cmp == 0) {
+         cmp = (nameLen > key->keyLen) - (nameLen < key->keyLen);
       }
-
-      p = strrchr(fieldName, ':');
-      if (p == NULL) {
-         continue;
+      if (cmp == 0) {
+         return key->stat;
+      }
+      if (cmp < 0) {
+         hi = mid;
       } else {
-        *p = '\0';
+         lo = mid + 1;
       }
+   }
 
-      if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
-         continue;
-      }
+   for (i = 0; i < table->numPrefixes; i++) {
+      const GuestInfoKey *key = &table->prefixes[i];
 
-      GuestInfoCollectStat(MEMINFO_FILE, collector, fieldName, value);
+      if ((key->keyLen <= nameLen) &&
+          (memcmp(fieldName, key->key, key->keyLen) == 0)) {
+         stat = key->stat;
+      }
    }
 
-   fclose(fp);
-
-   return TRUE;
+   return stat;
 }
 
 
@@ -320,7 +414,9 @@ GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
  *
  * GuestInfoProcData --
  *
- *      Reads a "stat file" and contribute to the collection.
+ *      Reads a "stat file" and contribute to the collection. Each line is
+ *      a field name and a value, separated by blanks; the names of
+ *      /proc/meminfo end with a colon.
  *
  * Results:
  *      TRUE   Success!
@@ -333,36 +429,60 @@ GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
  */
 
 static Bool
-GuestInfoProcData(const char *pathName,           // IN: path name
-                  GuestInfoCollector *collector)  // IN:
+GuestInfoProcData(GuestInfoCollector *collector,  // IN:
+                  uint32 fileIndex)               // IN:
 {
-   char line[4096];
-   FILE *fp = Posix_Fopen(pathName, "r");
+   GuestInfoProcFile *file = &guestInfoProcFiles[fileIndex];
+   const GuestInfoKeyTable *table = &collector->tables[fileIndex];
+   char *line = GuestInfoReadProcFile(file);
 
-   if (fp == NULL) {
-      g_warning("%s: Error opening %s.\n", __FUNCTION__, pathName);
+   if (line == NULL) {
       return FALSE;
    }
 
-   while (fgets(line, sizeof line, fp) != NULL) {
-      uint64 value = 0;
-      char *fieldName = strtok(line, " \t");
-      char *fieldData = strtok(NULL, " \t");
+   while (*line != '\0') {
+      char *fieldName;
+      char *fieldData;
+      char *end;
+      size_t nameLen;
+      uint64 value;
+      GuestInfoStat *stat;
+
+      fieldName = line + strspn(line, " \t");
+      nameLen = strcspn(fieldName, " \t\n");
+      fieldData = fieldName + nameLen;
+      fieldData += strspn(fieldData, " \t");
+
+      line = fieldData + strcspn(fieldData, "\n");
+      if (*line == '\n') {
+         line++;
+      }
+
+      if (file->nameHasColon) {
+         while (nameLen > 0 && fieldName[nameLen - 1] != ':') {
+            nameLen--;
+         }
+         if (nameLen == 0) {
+            continue;
+         }
+         nameLen--;
+      }
 
-      if (fieldName == NULL) {
+      if (nameLen == 0 || *fieldData == '\n' || *fieldData == '\0') {
          continue;
       }
 
-      if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
+      value = strtoull(fieldData, &end, 10);
+      if (end == fieldData) {
          continue;
       }
 
-      GuestInfoCollectStat(pathName, collector, fieldName, value);
+      stat = GuestInfoFindStat(table, fieldName, nameLen);
+      if (stat != NULL) {
+         GuestInfoStoreStat(stat, value);
+      }
    }
 
-   fclose(fp);
-
    return TRUE;
 }
 
@@ -477,10 +597,9 @@ GuestInfoCollect(GuestInfoCollector *collector)  // IN:
    }
 
    /* Collect new values */
-   GuestInfoProcMemInfoData(collector);
-   GuestInfoProcData(VMSTAT_FILE, collector);
-   GuestInfoProcData(STAT_FILE, collector);
-   GuestInfoProcData(ZONEINFO_FILE, collector);
+   for (i = 0; i < UPTIME_INDEX; i++) {
+      GuestInfoProcData(collector, i);
+   }
    GuestInfoDeriveSwapData(collector);
 
    collector->timeData = GuestInfoGetUpTime(&collector->timeStamp);
@@ -1008,9 +1127,8 @@ static void
 GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
 {
    if (collector != NULL) {
-      HashTable_Free(collector->exactMatches);
       HashTable_Free(collector->reportMap);
-      free(collector->regExps);
+      free(collector->keys);
       free(collector->stats);
       free(collector);
    }
@@ -1039,7 +1157,8 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
                             uint32 numQueries)        // IN:
 {
    uint32 i;
-   uint32 regExp = 0;
+   uint32 f;
+   uint32 numKeys = 0;
    GuestInfoCollector *collector = calloc(1, sizeof *collector);
 
    if (collector == NULL) {
@@ -1048,31 +1167,17 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
 
    collector->reportMap = HashTable_Alloc(256, HASH_INT_KEY, NULL);
 
-   collector->exactMatches = HashTable_Alloc(256,
-                                           HASH_STRING_KEY | HASH_FLAG_COPYKEY,
-                                             NULL);
-
-   collector->numRegExps = 0;
-   for (i = 0; i < numQueries; i++) {
-      if (queries[i].isRegExp && queries[i].collect) {
-         collector->numRegExps++;
-      }
-   }
-
    collector->numStats = numQueries;
    collector->stats = calloc(numQueries, sizeof *collector->stats);
-   collector->regExps = calloc(collector->numRegExps, sizeof(GuestInfoStat *));
+   collector->keys = calloc(numQueries, sizeof *collector->keys);
 
-   if ((collector->exactMatches == NULL) ||
-       (collector->reportMap == NULL) ||
-       ((collector->numRegExps != 0) && (collector->regExps == NULL)) ||
-       ((collector->numStats != 0) && (collector->stats == NULL))) {
+   if ((collector->reportMap == NULL) ||
+       ((collector->numStats != 0) &&
+        ((collector->stats == NULL) || (collector->keys == NULL)))) {
       GuestInfoDestroyCollector(collector);
       return NULL;
    }
 
-   regExp = 0;
-
    for (i = 0; i < numQueries; i++) {
       GuestInfoQuery *query = &queries[i];
       GuestInfoStat *stat = &collector->stats[i];
@@ -1085,22 +1190,57 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
          continue;
       }
 
-      if (query->isRegExp) {
-         ASSERT(query->locatorString);
-
-         collector->regExps[regExp++] = stat;
-      } else {
-         if (query->locatorString != NULL) {
-            HashTable_Insert(collector->exactMatches, query->locatorString,
-                              stat);
-         }
-      }
+      ASSERT(!query->isRegExp || query->locatorString);
 
       /* The report lookup */
       HashTable_Insert(collector->reportMap, INT_AS_HASHKEY(query->reportID),
                        stat);
    }
 
+   /*
+    * The lookup tables of the files: for each file, its exact matches
+    * sorted by name, then its prefix matches.
+    */
+
+   for (f = 0; f < N_PROC_FILES; f++) {
+      GuestInfoKeyTable *table = &collector->tables[f];
+      uint32 pass;
+
+      for (pass = 0; pass < 2; pass++) {
+         Bool prefix = (pass == 1);
+         GuestInfoKey *first = &collector->keys[numKeys];
+         uint32 count = 0;
+
+         for (i = 0; i < numQueries; i++) {
+            GuestInfoQuery *query = &queries[i];
+            GuestInfoKey *key;
+
+            if (!query->collect ||
+                (query->locatorString == NULL) ||
+                (query->sourceFile == NULL) ||
+                (strcmp(query->sourceFile, guestInfoProcFiles[f].path) != 0) ||
+                (query->isRegExp != prefix)) {
+               continue;
+            }
+
+            key = &first[count++];
+            key->key = query->locatorString;
+            key->keyLen = strlen(query->locatorString);
+            key->stat = &collector->stats[i];
+         }
+
+         numKeys += count;
+         if (prefix) {
+            table->prefixes = first;
+            table->numPrefixes = count;
+         } else {
+            qsort(first, count, sizeof *first, GuestInfoCompareKeys);
+            table->keys = first;
+            table->numKeys = count;
+         }
+      }
+   }
+
    return collector;
 }
 
@@ -1126,8 +1266,8 @@ Bool
 GuestInfo_PerfMon(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
 {
    GuestInfoCollector *temp;
-   static GuestInfoCollector *current = NULL;
-   static GuestInfoCollector *previous = NULL;
+   GuestInfoCollector *current = guestInfoCurrent;
+   GuestInfoCollector *previous = guestInfoPrevious;
 
    ASSERT(statBuf && DynBuf_GetSize(statBuf) == 0);
 
@@ -1148,9 +1288,9 @@ GuestInfo_PerfMon(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
    if ((current == NULL) ||
        (previous == NULL)) {
       GuestInfoDestroyCollector(current);
-      current = NULL;
+      guestInfoCurrent = NULL;
       GuestInfoDestroyCollector(previous);
-      previous = NULL;
+      guestInfoPrevious = NULL;
       return FALSE;
    }
 
@@ -1162,9 +1302,49 @@ GuestInfo_PerfMon(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
 
    /* Switch the collections for next time. */
    temp = current;
-   current = previous;
-   previous = temp;
+   guestInfoCurrent = previous;
+   guestInfoPrevious = temp;
 
    return TRUE;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfo_PerfMonShutdown --
+ *
+ *      Releases what GuestInfo_PerfMon keeps between collections: the
+ *      open proc files, the read buffer and the collections.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The next GuestInfo_PerfMon call starts over, as the first one did.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+GuestInfo_PerfMonShutdown(void)
+{
+   size_t i;
+
+   for (i = 0; i < N_PROC_FILES; i++) {
+      if (guestInfoProcFiles[i].fd != -1) {
+         close(guestInfoProcFiles[i].fd);
+         guestInfoProcFiles[i].fd = -1;
+      }
+   }
+
+   free(guestInfoReadBuf);
+   guestInfoReadBuf = NULL;
+   guestInfoReadBufSize = 0;
+
+   GuestInfoDestroyCollector(guestInfoCurrent);
+   guestInfoCurrent = NULL;
+   GuestInfoDestroyCollector(guestInfoPrevious);
+   guestInfoPrevious = NULL;
+}
+
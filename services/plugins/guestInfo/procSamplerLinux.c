@@ -0,0 +1,601 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file procSamplerLinux.c
+ *
+ * Per-process resource sampler, used to find the processes that use the most
+ * CPU, memory and storage bandwidth.
+ *
+ * The sampler keeps /proc open, and reads each process's stat and io files
+ * relative to it. It remembers the previous sample of every process, keyed
+ * by pid, so that CPU time and IO counters can be turned into rates. A pid
+ * that comes back with a different start time belongs to a new process, and
+ * starts over.
+ *
+ * A sample can be given a time budget. When it runs out, the scan stops, and
+ * the next sample continues the pass, skipping the processes the pass has
+ * already sampled. Every sample ranks all the processes, using the usage
+ * each one had at its last sample. Processes are forgotten when they can't
+ * be read anymore, or when a complete pass over /proc doesn't find them.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "guestInfoInt.h"
+#include "vmware/tools/utils.h"
+
+#ifndef O_CLOEXEC
+#   define O_CLOEXEC 0
+#endif
+
+/** How many processes are sampled between checks of the time budget. */
+#define PROC_SAMPLER_CHECK_INTERVAL 64
+
+/** Room for a process's stat or io file. */
+#define PROC_SAMPLER_BUF_SIZE 1024
+
+/** The last sample of a process. */
+typedef struct ProcSamplerEntry {
+   uint64 startTime;       /* In ticks after boot; tells reused pids apart. */
+   uint64 cpuTicks;        /* User and system time. */
+   uint64 readBytes;
+   uint64 writeBytes;
+   guint64 sampleTime;     /* Monotonic time of the sample, in ms. */
+   guint generation;       /* The sampler's generation when last seen. */
+   Bool hasUsage;          /* Whether usage was computed. */
+   GuestInfoProcUsage usage;  /* Usage between the last two samples. */
+} ProcSamplerEntry;
+
+struct GuestInfoProcSampler {
+   DIR *dir;
+   GHashTable *procs;      /* pid -> ProcSamplerEntry. */
+   guint generation;       /* Incremented by every sample. */
+   guint passStart;        /* The generation the current pass started in. */
+   long ticksPerSec;
+   long pageKiB;
+};
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerParsePid --                                                */ /**
+ *
+ * Parses the name of a /proc entry as a pid.
+ *
+ * @param[in]  name     The entry's name.
+ *
+ * @return The pid, 0 if the entry isn't a process.
+ *
+ ******************************************************************************
+ */
+
+static int
+ProcSamplerParsePid(const char *name)
+{
+   int pid = 0;
+
+   do {
+      if (*name < '0' || *name > '9' || pid > (G_MAXINT - 9) / 10) {
+         return 0;
+      }
+      pid = pid * 10 + (*name - '0');
+   } while (*++name != '\0');
+
+   return pid;
+}
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerReadFile --                                                */ /**
+ *
+ * Reads a small /proc file, relative to the sampler's /proc directory.
+ * procfs returns these files in one read.
+ *
+ * @param[in]  sampler  The sampler.
+ * @param[in]  path     The file's path, relative to /proc.
+ * @param[out] buf      Where to read the file; NUL terminated.
+ * @param[in]  size     Size of @a buf.
+ *
+ * @return Whether the file could be read.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+ProcSamplerReadFile(GuestInfoProcSampler *sampler,
+                    const char *path,
+                    char *buf,
+                    size_t size)
+{
+   ssize_t n;
+   int fd;
+
+   fd = openat(dirfd(sampler->dir), path, O_RDONLY | O_CLOEXEC);
+   if (fd == -1) {
+      return FALSE;
+   }
+
+   do {
+      n = read(fd, buf, size - 1);
+   } while (n == -1 && errno == EINTR);
+   close(fd);
+
+   if (n <= 0) {
+      return FALSE;
+   }
+
+   buf[n] = '\0';
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerParseStat --                                               */ /**
+ *
+ * Parses a process's stat file.
+ *
+ * @param[in]  buf         The file's contents.
+ * @param[out] name        The process's name, with blanks and ';' replaced.
+ * @param[in]  nameSize    Size of @a name.
+ * @param[out] startTime   When the process started, in ticks after boot.
+ * @param[out] cpuTicks    The process's user and system time, in ticks.
+ * @param[out] rssPages    The process's resident set size, in pages.
+ *
+ * @return Whether the file could be parsed.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+ProcSamplerParseStat(const char *buf,
+                     char *name,
+                     size_t nameSize,
+                     uint64 *startTime,
+                     uint64 *cpuTicks,
+                     uint64 *rssPages)
+{
+   const char *nameStart = strchr(buf, '(');
+   const char *nameEnd = strrchr(buf, ')');
+   const char *p;
+   size_t len;
+   size_t i;
+   int field;
+
+   if (nameStart == NULL || nameEnd == NULL || nameEnd < nameStart ||
+       nameEnd[1] == '\0' || nameEnd[2] == '\0') {
+      return FALSE;
+   }
+
+   /* The name can contain anything, even ')'; the last ')' ends it. */
+   len = MIN(nameEnd - nameStart - 1, nameSize - 1);
+   for (i = 0; i < len; i++) {
+      char c = nameStart[1 + i];
+
+      name[i] = (c <= ' ' || c == ';' || c == 0x7f) ? '_' : c;
+   }
+   name[len] = '\0';
+
+   /* Field 3 is the state, then come numbers; see proc(5). */
+   *cpuTicks = 0;
+   p = nameEnd + 3;
+   for (field = 4; field <= 24; field++) {
+      char *end;
+      uint64 value = strtoull(p, &end, 10);
+
+      if (end == p) {
+         return FALSE;
+      }
+      p = end;
+
+      switch (field) {
+      case 14:    /* utime */
+      case 15:    /* stime */
+         *cpuTicks += value;
+         break;
+      case 22:
+         *startTime = value;
+         break;
+      case 24:
+         *rssPages = value;
+         break;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerParseIo --                                                 */ /**
+ *
+ * Parses a process's io file.
+ *
+ * @param[in]  buf         The file's contents.
+ * @param[out] readBytes   Bytes the process read from storage.
+ * @param[out] writeBytes  Bytes the process wrote to storage.
+ *
+ ******************************************************************************
+ */
+
+static void
+ProcSamplerParseIo(const char *buf,
+                   uint64 *readBytes,
+                   uint64 *writeBytes)
+{
+   const char *p;
+
+   p = strstr(buf, "\nread_bytes: ");
+   if (p != NULL) {
+      *readBytes = strtoull(p + sizeof "\nread_bytes: " - 1, NULL, 10);
+   }
+
+   p = strstr(buf, "\nwrite_bytes: ");
+   if (p != NULL) {
+      *writeBytes = strtoull(p + sizeof "\nwrite_bytes: " - 1, NULL, 10);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerSampleProc --                                              */ /**
+ *
+ * Samples a process, and stores its usage since its previous sample in its
+ * entry. The entry is created if the process has none, and removed if the
+ * process went away.
+ *
+ * @param[in]  sampler  The sampler.
+ * @param[in]  pid      The process.
+ * @param[in]  entry    The process's last sample, NULL if there is none.
+ * @param[in]  now      The time of the sample, in ms.
+ *
+ ******************************************************************************
+ */
+
+static void
+ProcSamplerSampleProc(GuestInfoProcSampler *sampler,
+                      int pid,
+                      ProcSamplerEntry *entry,
+                      guint64 now)
+{
+   char path[32];
+   char buf[PROC_SAMPLER_BUF_SIZE];
+   char name[sizeof entry->usage.name];
+   uint64 startTime;
+   uint64 cpuTicks;
+   uint64 rssPages;
+   uint64 readBytes = 0;
+   uint64 writeBytes = 0;
+   Bool hasUsage;
+
+   g_snprintf(path, sizeof path, "%d/stat", pid);
+   if (!ProcSamplerReadFile(sampler, path, buf, sizeof buf) ||
+       !ProcSamplerParseStat(buf, name, sizeof name,
+                             &startTime, &cpuTicks, &rssPages)) {
+      if (entry != NULL) {
+         g_hash_table_remove(sampler->procs, GINT_TO_POINTER(pid));
+      }
+      return;
+   }
+
+   /* Only root can read the io file of other users' processes. */
+   g_snprintf(path, sizeof path, "%d/io", pid);
+   if (ProcSamplerReadFile(sampler, path, buf, sizeof buf)) {
+      ProcSamplerParseIo(buf, &readBytes, &writeBytes);
+   }
+
+   if (entry == NULL) {
+      entry = g_new0(ProcSamplerEntry, 1);
+      g_hash_table_insert(sampler->procs, GINT_TO_POINTER(pid), entry);
+      hasUsage = FALSE;
+   } else {
+      hasUsage = entry->startTime == startTime;
+   }
+   entry->generation = sampler->generation;
+
+   if (hasUsage) {
+      double elapsed = now - entry->sampleTime;
+
+      if (elapsed == 0) {
+         /* Keep the older sample, to have something to compare to later. */
+         return;
+      }
+
+      entry->usage.cpu = cpuTicks < entry->cpuTicks ? 0 :
+                         (cpuTicks - entry->cpuTicks) * 100000.0 /
+                         (sampler->ticksPerSec * elapsed);
+      entry->usage.readRate = readBytes < entry->readBytes ? 0 :
+                              (readBytes - entry->readBytes) * 1000.0 /
+                              elapsed;
+      entry->usage.writeRate = writeBytes < entry->writeBytes ? 0 :
+                               (writeBytes - entry->writeBytes) * 1000.0 /
+                               elapsed;
+   }
+
+   entry->hasUsage = hasUsage;
+   entry->usage.pid = pid;
+   entry->usage.rss = rssPages * sampler->pageKiB;
+   g_strlcpy(entry->usage.name, name, sizeof entry->usage.name);
+   entry->startTime = startTime;
+   entry->cpuTicks = cpuTicks;
+   entry->readBytes = readBytes;
+   entry->writeBytes = writeBytes;
+   entry->sampleTime = now;
+}
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerCompare --                                                 */ /**
+ *
+ * Ranks two processes by CPU usage, then storage bandwidth, then memory.
+ *
+ * @param[in]  a     A process's usage.
+ * @param[in]  b     Another process's usage.
+ *
+ * @return Whether @a a ranks above @a b.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+ProcSamplerCompare(const GuestInfoProcUsage *a,
+                   const GuestInfoProcUsage *b)
+{
+   double ioA = a->readRate + a->writeRate;
+   double ioB = b->readRate + b->writeRate;
+
+   if (a->cpu != b->cpu) {
+      return a->cpu > b->cpu;
+   }
+   if (ioA != ioB) {
+      return ioA > ioB;
+   }
+   if (a->rss != b->rss) {
+      return a->rss > b->rss;
+   }
+   return a->pid < b->pid;
+}
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerIsStale --                                                 */ /**
+ *
+ * GHRFunc that tells whether a process wasn't seen by the current pass.
+ *
+ * @param[in]  key      Unused.
+ * @param[in]  value    The process's entry.
+ * @param[in]  data     The sampler.
+ *
+ * @return Whether to remove the entry.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ProcSamplerIsStale(gpointer key,
+                   gpointer value,
+                   gpointer data)
+{
+   const ProcSamplerEntry *entry = value;
+   const GuestInfoProcSampler *sampler = data;
+
+   return entry->generation < sampler->passStart;
+}
+
+
+/*
+ ******************************************************************************
+ * ProcSamplerRank --                                                    */ /**
+ *
+ * Finds the processes that used the most, among those whose usage is known.
+ *
+ * @param[in]  sampler  The sampler.
+ * @param[out] top      Where to store the top processes, highest first.
+ * @param[in]  count    Size of @a top.
+ *
+ * @return How many processes were stored in @a top.
+ *
+ ******************************************************************************
+ */
+
+static guint
+ProcSamplerRank(GuestInfoProcSampler *sampler,
+                GuestInfoProcUsage *top,
+                guint count)
+{
+   GHashTableIter iter;
+   gpointer value;
+   guint found = 0;
+
+   g_hash_table_iter_init(&iter, sampler->procs);
+   while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      const ProcSamplerEntry *entry = value;
+      guint i;
+
+      if (!entry->hasUsage) {
+         continue;
+      }
+
+      /* Insertion into the top list, which is short. */
+      for (i = found;
+           i > 0 && ProcSamplerCompare(&entry->usage, &top[i - 1]);
+           i--) {
+         if (i < count) {
+            top[i] = top[i - 1];
+         }
+      }
+      if (i < count) {
+         top[i] = entry->usage;
+         found = MIN(found + 1, count);
+      }
+   }
+
+   return found;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_ProcSamplerOpen --                                          */ /**
+ *
+ * @brief Creates a process sampler.
+ *
+ * @param[in]  procDir  Where procfs is mounted; tests can use a fake one.
+ *
+ * @return The sampler, NULL if @a procDir can't be opened.
+ *
+ ******************************************************************************
+ */
+
+GuestInfoProcSampler *
+GuestInfo_ProcSamplerOpen(const char *procDir)
+{
+   GuestInfoProcSampler *sampler;
+   DIR *dir;
+   int fd;
+
+   fd = open(procDir, O_RDONLY | O_DIRECTORY);
+   if (fd == -1) {
+      g_warning("%s: Error opening %s: %s.\n", __FUNCTION__, procDir,
+                strerror(errno));
+      return NULL;
+   }
+   fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+   dir = fdopendir(fd);
+   if (dir == NULL) {
+      g_warning("%s: Error reading %s: %s.\n", __FUNCTION__, procDir,
+                strerror(errno));
+      close(fd);
+      return NULL;
+   }
+
+   sampler = g_new0(GuestInfoProcSampler, 1);
+   sampler->dir = dir;
+   sampler->procs = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+   sampler->passStart = 1;
+   sampler->ticksPerSec = sysconf(_SC_CLK_TCK);
+   sampler->pageKiB = sysconf(_SC_PAGESIZE) / 1024;
+   if (sampler->ticksPerSec <= 0) {
+      sampler->ticksPerSec = 100;
+   }
+
+   return sampler;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_ProcSamplerSample --                                        */ /**
+ *
+ * @brief Samples the processes, and finds the ones that used the most.
+ *
+ * Processes are ranked by their usage between their last two samples, so
+ * that those an earlier call of the pass sampled are ranked too. When the
+ * budget runs out before all processes are sampled, the next call continues
+ * the pass with the processes this one didn't get to.
+ *
+ * @param[in]  sampler  The sampler.
+ * @param[in]  budget   How long the scan may take, in ms; 0 for no limit.
+ * @param[out] top      Where to store the top processes, highest first.
+ * @param[in]  count    Size of @a top.
+ *
+ * @return How many processes were stored in @a top.
+ *
+ ******************************************************************************
+ */
+
+guint
+GuestInfo_ProcSamplerSample(GuestInfoProcSampler *sampler,
+                            guint budget,
+                            GuestInfoProcUsage *top,
+                            guint count)
+{
+   guint64 start = VMTools_GetMonotonicTime();
+   struct dirent *dent;
+   guint scanned = 0;
+
+   sampler->generation++;
+   rewinddir(sampler->dir);
+
+   while ((dent = readdir(sampler->dir)) != NULL) {
+      ProcSamplerEntry *entry;
+      int pid = ProcSamplerParsePid(dent->d_name);
+
+      if (pid == 0) {
+         continue;
+      }
+
+      entry = g_hash_table_lookup(sampler->procs, GINT_TO_POINTER(pid));
+      if (entry != NULL && entry->generation >= sampler->passStart) {
+         /* Sampled by an earlier call of this pass. */
+         continue;
+      }
+
+      if (budget > 0 && scanned > 0 &&
+          scanned % PROC_SAMPLER_CHECK_INTERVAL == 0 &&
+          VMTools_GetMonotonicTime() - start >= budget) {
+         g_debug("%s: Out of time after %u processes.\n", __FUNCTION__,
+                 scanned);
+         return ProcSamplerRank(sampler, top, count);
+      }
+      scanned++;
+
+      ProcSamplerSampleProc(sampler, pid, entry, start);
+   }
+
+   /* The pass is complete: forget the processes that are gone. */
+   g_hash_table_foreach_remove(sampler->procs, ProcSamplerIsStale, sampler);
+   sampler->passStart = sampler->generation + 1;
+
+   return ProcSamplerRank(sampler, top, count);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_ProcSamplerClose --                                         */ /**
+ *
+ * @brief Destroys a process sampler.
+ *
+ * @param[in]  sampler  The sampler, may be NULL.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_ProcSamplerClose(GuestInfoProcSampler *sampler)
+{
+   if (sampler != NULL) {
+      closedir(sampler->dir);
+      g_hash_table_destroy(sampler->procs);
+      g_free(sampler);
+   }
+}
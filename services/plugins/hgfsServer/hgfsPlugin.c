@@ -23,6 +23,7 @@
  */
 
 #include <string.h>
+#include <unistd.h>
 
 #define G_LOG_DOMAIN "hgfsd"
 
@@ -36,6 +37,10 @@
 #include "vmware/tools/utils.h"
 
 
+/* Guest RPC returning the per session HGFS server statistics. */
+#define HGFS_STATS_CMD "hgfs.stats"
+
+
 #if !defined(__APPLE__)
 #include "vm_version.h"
 #include "embed_version.h"
@@ -58,11 +63,77 @@ HgfsServerShutdown(gpointer src,
                    ToolsPluginData *plugin)
 {
    HgfsServerMgrData *mgrData = plugin->_private;
+   HgfsServerManager_StopTrace();
    HgfsServerManager_Unregister(mgrData);
    g_free(mgrData);
 }
 
 
+/**
+ * Prints one line of HGFS server statistics in the state dump.
+ *
+ * @param[in]  clientData  Unused.
+ * @param[in]  line        Statistics line.
+ */
+
+static void
+HgfsServerLogStatsLine(void *clientData,
+                       const char *line)
+{
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "%s\n", line);
+}
+
+
+/**
+ * Appends one line of HGFS server statistics to an RPC reply.
+ *
+ * @param[in]  clientData  The GString holding the reply.
+ * @param[in]  line        Statistics line.
+ */
+
+static void
+HgfsServerAppendStatsLine(void *clientData,
+                          const char *line)
+{
+   g_string_append_printf(clientData, "%s\n", line);
+}
+
+
+/**
+ * Logs the per session HGFS server statistics when vmtoolsd dumps its state.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      Unused.
+ * @param[in]  data     Unused.
+ */
+
+static void
+HgfsServerDumpState(gpointer src,
+                    ToolsAppCtx *ctx,
+                    gpointer data)
+{
+   HgfsServerManager_DumpStats(HgfsServerLogStatsLine, NULL);
+}
+
+
+/**
+ * Returns the per session HGFS server statistics to the caller.
+ *
+ * @param[in]  data  RPC request data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+HgfsServerRpcStats(RpcInData *data)
+{
+   GString *stats = g_string_new(NULL);
+
+   HgfsServerManager_DumpStats(HgfsServerAppendStatsLine, stats);
+   return RpcChannel_SetRetValsF(data, g_string_free(stats, FALSE), TRUE);
+}
+
+
 /**
  * Handles hgfs requests.
  *
@@ -161,6 +232,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       NULL
    };
    HgfsServerMgrData *mgrData;
+   gchar *traceFile;
+   gchar *traceName;
 
    if (!TOOLS_IS_MAIN_SERVICE(ctx) && !TOOLS_IS_USER_SERVICE(ctx)) {
       g_info("Unknown container '%s', not loading HGFS plugin.", ctx->name);
@@ -179,12 +252,37 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       return NULL;
    }
 
+   /*
+    * Optionally capture the request packets for offline replay, e.g.
+    *
+    *    [hgfsServer]
+    *    traceFile=/var/tmp/hgfs.trace
+    *
+    * Both services read that key, so the service name and process id are
+    * appended to the file name, e.g. /var/tmp/hgfs.trace.vmsvc.1234. The
+    * file must not already exist.
+    */
+   traceFile = (ctx->config != NULL) ?
+               g_key_file_get_string(ctx->config, "hgfsServer", "traceFile", NULL) :
+               NULL;
+   if (traceFile != NULL && *traceFile != '\0') {
+      traceName = g_strdup_printf("%s.%s.%d", traceFile, ctx->name,
+                                  (int)getpid());
+      if (!HgfsServerManager_StartTrace(traceName)) {
+         g_warning("Could not start HGFS packet capture to %s.\n", traceName);
+      }
+      g_free(traceName);
+   }
+   g_free(traceFile);
+
    {
       RpcChannelCallback rpcs[] = {
-         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 }
+         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 },
+         { HGFS_STATS_CMD, HgfsServerRpcStats, NULL, NULL, NULL, 0 }
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, HgfsServerCapReg, &regData },
+         { TOOLS_CORE_SIG_DUMP_STATE, HgfsServerDumpState, NULL },
          { TOOLS_CORE_SIG_SHUTDOWN, HgfsServerShutdown, &regData }
       };
       ToolsAppReg regs[] = {
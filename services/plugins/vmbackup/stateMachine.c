@@ -644,12 +644,16 @@ VmBackupEnableSyncWait(void)
     * seen slowness in performing open() on NFS mount points.
     * So, we need to run freeze operation in a separate thread
     * and track it with an extra state in the state machine.
+    *
+    * The VMX times out the quiesce operation, so the task must not wait
+    * behind other work queued in the shared thread pool.
     */
    gBackupState->freezeStatus = VMBACKUP_FREEZE_PENDING;
-   if (!ToolsCorePool_SubmitTask(gBackupState->ctx,
-                                 gBackupState->provider->start,
-                                 gBackupState,
-                                 NULL)) {
+   if (!ToolsCorePool_SubmitPriorityTask(gBackupState->ctx,
+                                         gBackupState->provider->start,
+                                         gBackupState,
+                                         NULL,
+                                         TOOLS_CORE_POOL_PRIORITY_CRITICAL)) {
       g_warning("Failed to submit backup start task.");
 #endif
       g_signal_emit_by_name(gBackupState->ctx->serviceObj,
@@ -0,0 +1,534 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file dispatchStats.c
+ *
+ * Keeps track of how long the callbacks run by the service's main loop take,
+ * so that a plugin that blocks the loop can be identified. Three kinds of
+ * callbacks are measured:
+ *
+ *    - event sources attached with VMTOOLSAPP_ATTACH_SOURCE(), reported by
+ *      libvmtools under the log domain of the code that attached them;
+ *    - GuestRPC handlers, reported by RpcChannel_Dispatch() and attributed
+ *      to the plugin that registered them;
+ *    - plugin signal handlers, through a meta marshaller set on the closures
+ *      connected by the plugin manager.
+ *
+ * Callbacks that take longer than a threshold are logged, and the state dump
+ * shows a duration histogram per plugin and per callback. A timer also
+ * measures how late the main loop is to run it ("lag"), which covers time
+ * spent in callbacks that are not instrumented.
+ *
+ * The following keys in the service's config group control the behavior:
+ *
+ *    mainloop.slowCallbackThreshold   Duration, in milliseconds, above which
+ *                                     a callback is logged. 0 disables it.
+ *    mainloop.lagCheckInterval        How often, in seconds, to measure the
+ *                                     main loop lag. 0, the default, disables
+ *                                     it, so that an idle service doesn't
+ *                                     wake up just to take the measurement.
+ */
+
+#include <string.h>
+#include "vmware.h"
+#include "hostinfo.h"
+#include "toolsCoreInt.h"
+#include "vmware/tools/log.h"
+#include "vmware/tools/utils.h"
+
+#define DISPATCH_DEFAULT_THRESHOLD     500
+#define DISPATCH_DEFAULT_LAG_INTERVAL  0
+#define DISPATCH_UNKNOWN_OWNER         "unknown"
+#define DISPATCH_CORE_OWNER            "vmtoolsd"
+#define DISPATCH_HIST_BUCKETS          6
+
+/** Upper bounds, in microseconds, of all but the last histogram bucket. */
+static const VmTimeType gBucketLimits[DISPATCH_HIST_BUCKETS - 1] = {
+   1000, 10000, 100000, 1000000, 10000000
+};
+
+static const char *gBucketNames[DISPATCH_HIST_BUCKETS] = {
+   "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s"
+};
+
+/** Duration statistics of a callback, or of all callbacks of an owner. */
+typedef struct DispatchStat {
+   guint64     count;
+   VmTimeType  total;
+   VmTimeType  max;
+   guint64     hist[DISPATCH_HIST_BUCKETS];
+} DispatchStat;
+
+/** Statistics of the callbacks of one plugin (or other owner). */
+typedef struct DispatchOwner {
+   DispatchStat   all;
+   GHashTable    *callbacks;
+} DispatchOwner;
+
+/** Marshal data of the closures of monitored signal handlers. */
+typedef struct DispatchClosure {
+   const gchar   *owner;
+   gchar         *name;
+} DispatchClosure;
+
+static struct {
+   GStaticMutex   lock;
+   GHashTable    *owners;
+   GHashTable    *rpcOwners;
+   DispatchStat   lag;
+   VmTimeType     threshold;
+   guint          lagInterval;
+   GSource       *lagTimer;
+   VmTimeType     lastCheck;
+   GMainContext  *mainCtx;
+} gDispatch = { G_STATIC_MUTEX_INIT };
+
+
+/**
+ * Adds a sample to a set of statistics.
+ *
+ * @param[in]  stat     The statistics.
+ * @param[in]  duration The sample, in microseconds.
+ */
+
+static void
+ToolsCoreDispatchAdd(DispatchStat *stat,
+                     VmTimeType duration)
+{
+   guint i;
+
+   for (i = 0; i < ARRAYSIZE(gBucketLimits); i++) {
+      if (duration < gBucketLimits[i]) {
+         break;
+      }
+   }
+   stat->hist[i]++;
+   stat->count++;
+   stat->total += duration;
+   stat->max = MAX(stat->max, duration);
+}
+
+
+/**
+ * Formats a set of statistics for the state dump.
+ *
+ * @param[in]  stat     The statistics.
+ *
+ * @return The formatted string, to be freed with g_free().
+ */
+
+static gchar *
+ToolsCoreDispatchFormat(const DispatchStat *stat)
+{
+   GString *str = g_string_new(NULL);
+   guint i;
+
+   g_string_append_printf(str, "%"FMT64"u calls, avg %"FMT64"d us, "
+                          "max %"FMT64"d us,", stat->count,
+                          stat->count > 0 ? stat->total / stat->count : 0,
+                          stat->max);
+   for (i = 0; i < DISPATCH_HIST_BUCKETS; i++) {
+      if (stat->hist[i] > 0) {
+         g_string_append_printf(str, " %s:%"FMT64"u",
+                                gBucketNames[i], stat->hist[i]);
+      }
+   }
+   return g_string_free(str, FALSE);
+}
+
+
+/**
+ * Frees the data of an owner.
+ *
+ * @param[in]  data     The owner data.
+ */
+
+static void
+ToolsCoreDispatchFreeOwner(gpointer data)
+{
+   DispatchOwner *owner = data;
+
+   g_hash_table_destroy(owner->callbacks);
+   g_free(owner);
+}
+
+
+/**
+ * Records the duration of a main loop callback, and logs it if it's over the
+ * configured threshold. This is the dispatch monitor installed in libvmtools,
+ * and is also called directly for the signal handlers.
+ *
+ * @param[in]  ownerName   Who registered the callback, may be NULL.
+ * @param[in]  name        Name of the callback.
+ * @param[in]  duration    Duration of the callback, in microseconds.
+ * @param[in]  data        Unused.
+ */
+
+static void
+ToolsCoreDispatchRecord(const gchar *ownerName,
+                        const gchar *name,
+                        gint64 duration,
+                        gpointer data)
+{
+   gchar rpcName[128];
+   DispatchOwner *owner;
+   DispatchStat *stat;
+   gboolean slow = FALSE;
+
+   g_static_mutex_lock(&gDispatch.lock);
+
+   if (gDispatch.owners == NULL) {
+      goto exit;
+   }
+
+   /* RPC handlers are reported by the channel; find which plugin owns them. */
+   if (ownerName != NULL && strcmp(ownerName, RPCCHANNEL_DISPATCH_OWNER) == 0) {
+      ownerName = g_hash_table_lookup(gDispatch.rpcOwners, name);
+      if (ownerName == NULL) {
+         ownerName = DISPATCH_CORE_OWNER;
+      }
+      g_snprintf(rpcName, sizeof rpcName, "rpc:%s", name);
+      name = rpcName;
+   } else if (ownerName == NULL) {
+      ownerName = DISPATCH_UNKNOWN_OWNER;
+   }
+
+   owner = g_hash_table_lookup(gDispatch.owners, ownerName);
+   if (owner == NULL) {
+      owner = g_malloc0(sizeof *owner);
+      owner->callbacks = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, g_free);
+      g_hash_table_insert(gDispatch.owners, g_strdup(ownerName), owner);
+   }
+
+   stat = g_hash_table_lookup(owner->callbacks, name);
+   if (stat == NULL) {
+      stat = g_malloc0(sizeof *stat);
+      g_hash_table_insert(owner->callbacks, g_strdup(name), stat);
+   }
+
+   ToolsCoreDispatchAdd(stat, duration);
+   ToolsCoreDispatchAdd(&owner->all, duration);
+
+   slow = gDispatch.threshold > 0 && duration >= gDispatch.threshold;
+
+exit:
+   g_static_mutex_unlock(&gDispatch.lock);
+
+   if (slow) {
+      g_message("Slow main loop callback: %s (%s) took %"FMT64"d ms.\n",
+                name, ownerName, duration / 1000);
+   }
+}
+
+
+/**
+ * Timer callback that measures how late the main loop is to run it.
+ *
+ * @param[in]  data     Unused.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+ToolsCoreDispatchLagCb(gpointer data)
+{
+   VmTimeType now = Hostinfo_SystemTimerUS();
+   VmTimeType lag;
+
+   lag = now - gDispatch.lastCheck -
+         (VmTimeType) gDispatch.lagInterval * 1000000;
+   lag = MAX(lag, 0);
+   gDispatch.lastCheck = now;
+
+   g_static_mutex_lock(&gDispatch.lock);
+   ToolsCoreDispatchAdd(&gDispatch.lag, lag);
+   g_static_mutex_unlock(&gDispatch.lock);
+
+   if (gDispatch.threshold > 0 && lag >= gDispatch.threshold) {
+      g_message("Main loop was blocked for %"FMT64"d ms.\n", lag / 1000);
+   }
+   return TRUE;
+}
+
+
+/**
+ * Meta marshaller of monitored signal handlers. Calls the handler and records
+ * how long it took.
+ *
+ * @param[in]  closure     The handler's closure.
+ * @param[out] returnValue Return value of the signal.
+ * @param[in]  nParams     Number of parameters.
+ * @param[in]  params      Signal parameters.
+ * @param[in]  hint        Invocation hint.
+ * @param[in]  marshalData The DispatchClosure data.
+ */
+
+static void
+ToolsCoreDispatchMarshal(GClosure *closure,
+                         GValue *returnValue,
+                         guint nParams,
+                         const GValue *params,
+                         gpointer hint,
+                         gpointer marshalData)
+{
+   DispatchClosure *dc = marshalData;
+   VmTimeType start = Hostinfo_SystemTimerUS();
+
+   closure->marshal(closure, returnValue, nParams, params, hint, NULL);
+   ToolsCoreDispatchRecord(dc->owner, dc->name,
+                           Hostinfo_SystemTimerUS() - start, NULL);
+}
+
+
+/**
+ * Frees the marshal data of a monitored signal handler.
+ *
+ * @param[in]  data     The DispatchClosure data.
+ * @param[in]  closure  Unused.
+ */
+
+static void
+ToolsCoreDispatchFreeClosure(gpointer data,
+                             GClosure *closure)
+{
+   DispatchClosure *dc = data;
+
+   g_free(dc->name);
+   g_free(dc);
+}
+
+
+/**
+ * (Re-)reads the configuration of the callback monitor.
+ *
+ * @param[in]  ctx      The application context.
+ */
+
+void
+ToolsCoreDispatch_LoadConfig(ToolsAppCtx *ctx)
+{
+   GError *err = NULL;
+   gint threshold;
+   gint interval;
+
+   threshold = g_key_file_get_integer(ctx->config, ctx->name,
+                                      "mainloop.slowCallbackThreshold", &err);
+   if (err != NULL) {
+      threshold = DISPATCH_DEFAULT_THRESHOLD;
+      g_clear_error(&err);
+   }
+   gDispatch.threshold = (VmTimeType) MAX(threshold, 0) * 1000;
+
+   interval = g_key_file_get_integer(ctx->config, ctx->name,
+                                     "mainloop.lagCheckInterval", &err);
+   if (err != NULL) {
+      interval = DISPATCH_DEFAULT_LAG_INTERVAL;
+      g_clear_error(&err);
+   }
+   interval = MAX(interval, 0);
+
+   if (interval != gDispatch.lagInterval || gDispatch.lagTimer == NULL) {
+      if (gDispatch.lagTimer != NULL) {
+         g_source_destroy(gDispatch.lagTimer);
+         g_source_unref(gDispatch.lagTimer);
+         gDispatch.lagTimer = NULL;
+      }
+      gDispatch.lagInterval = interval;
+      if (interval > 0) {
+         gDispatch.lastCheck = Hostinfo_SystemTimerUS();
+         gDispatch.lagTimer = g_timeout_source_new(interval * 1000);
+         g_source_set_callback(gDispatch.lagTimer, ToolsCoreDispatchLagCb,
+                               NULL, NULL);
+         g_source_attach(gDispatch.lagTimer, gDispatch.mainCtx);
+      }
+   }
+}
+
+
+/**
+ * Starts monitoring the main loop callbacks.
+ *
+ * @param[in]  ctx      The application context.
+ */
+
+void
+ToolsCoreDispatch_Init(ToolsAppCtx *ctx)
+{
+   gDispatch.owners = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                            ToolsCoreDispatchFreeOwner);
+   gDispatch.rpcOwners = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, NULL);
+   gDispatch.mainCtx = g_main_loop_get_context(ctx->mainLoop);
+   ToolsCoreDispatch_LoadConfig(ctx);
+   VMTools_SetDispatchMonitor(ToolsCoreDispatchRecord, NULL);
+}
+
+
+/**
+ * Records which plugin registered an RPC, so that the time spent in the RPC
+ * handler is accounted to that plugin.
+ *
+ * @param[in]  rpc      Name of the RPC.
+ * @param[in]  owner    Name of the plugin. Must outlive the service.
+ */
+
+void
+ToolsCoreDispatch_SetRpcOwner(const gchar *rpc,
+                              const gchar *owner)
+{
+   g_static_mutex_lock(&gDispatch.lock);
+   if (gDispatch.rpcOwners != NULL) {
+      g_hash_table_insert(gDispatch.rpcOwners, g_strdup(rpc), (gpointer) owner);
+   }
+   g_static_mutex_unlock(&gDispatch.lock);
+}
+
+
+/**
+ * Measures the duration of a signal handler. Must be called after the closure
+ * has been connected, so that it already has the signal's marshaller.
+ *
+ * @param[in]  closure  The handler's closure.
+ * @param[in]  owner    Name of the plugin. Must outlive the closure.
+ * @param[in]  signame  Name of the signal.
+ */
+
+void
+ToolsCoreDispatch_MonitorClosure(GClosure *closure,
+                                 const gchar *owner,
+                                 const gchar *signame)
+{
+   DispatchClosure *dc;
+
+   if (closure->marshal == NULL) {
+      return;
+   }
+
+   dc = g_malloc(sizeof *dc);
+   dc->owner = owner;
+   dc->name = g_strdup_printf("signal:%s", signame);
+   g_closure_add_finalize_notifier(closure, dc, ToolsCoreDispatchFreeClosure);
+   g_closure_set_meta_marshal(closure, dc, ToolsCoreDispatchMarshal);
+}
+
+
+/**
+ * Logs the statistics of one callback. Callback for g_hash_table_foreach().
+ *
+ * @param[in]  key      Name of the callback.
+ * @param[in]  value    The callback's statistics.
+ * @param[in]  data     Unused.
+ */
+
+static void
+ToolsCoreDispatchDumpCallback(gpointer key,
+                              gpointer value,
+                              gpointer data)
+{
+   gchar *str = ToolsCoreDispatchFormat(value);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "%s: %s\n",
+                      (const gchar *) key, str);
+   g_free(str);
+}
+
+
+/**
+ * Logs the statistics of one owner and of its callbacks. Callback for
+ * g_hash_table_foreach().
+ *
+ * @param[in]  key      Name of the owner.
+ * @param[in]  value    The owner's data.
+ * @param[in]  data     Unused.
+ */
+
+static void
+ToolsCoreDispatchDumpOwner(gpointer key,
+                           gpointer value,
+                           gpointer data)
+{
+   DispatchOwner *owner = value;
+   gchar *str = ToolsCoreDispatchFormat(&owner->all);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Main loop callbacks of %s: %s\n",
+                      (const gchar *) key, str);
+   g_free(str);
+   g_hash_table_foreach(owner->callbacks, ToolsCoreDispatchDumpCallback, NULL);
+}
+
+
+/**
+ * Logs the main loop lag and the callback statistics of each owner.
+ */
+
+void
+ToolsCoreDispatch_DumpState(void)
+{
+   gchar *str;
+
+   g_static_mutex_lock(&gDispatch.lock);
+
+   if (gDispatch.owners == NULL) {
+      goto exit;
+   }
+
+   if (gDispatch.lagTimer != NULL) {
+      str = ToolsCoreDispatchFormat(&gDispatch.lag);
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "Main loop lag (checked every %u s): %s\n",
+                         gDispatch.lagInterval, str);
+      g_free(str);
+   }
+
+   g_hash_table_foreach(gDispatch.owners, ToolsCoreDispatchDumpOwner, NULL);
+
+exit:
+   g_static_mutex_unlock(&gDispatch.lock);
+}
+
+
+/**
+ * Stops monitoring the main loop callbacks and frees the statistics.
+ */
+
+void
+ToolsCoreDispatch_Shutdown(void)
+{
+   VMTools_SetDispatchMonitor(NULL, NULL);
+
+   if (gDispatch.lagTimer != NULL) {
+      g_source_destroy(gDispatch.lagTimer);
+      g_source_unref(gDispatch.lagTimer);
+      gDispatch.lagTimer = NULL;
+   }
+
+   g_static_mutex_lock(&gDispatch.lock);
+   if (gDispatch.owners != NULL) {
+      g_hash_table_destroy(gDispatch.owners);
+      g_hash_table_destroy(gDispatch.rpcOwners);
+      gDispatch.owners = NULL;
+      gDispatch.rpcOwners = NULL;
+   }
+   memset(&gDispatch.lag, 0, sizeof gDispatch.lag);
+   gDispatch.lagInterval = 0;
+   gDispatch.mainCtx = NULL;
+   g_static_mutex_unlock(&gDispatch.lock);
+}
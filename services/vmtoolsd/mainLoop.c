@@ -32,6 +32,7 @@
 #include "toolsCoreInt.h"
 #include "conf.h"
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "serviceObj.h"
 #include "system.h"
 #include "util.h"
@@ -58,6 +59,7 @@
 static void
 ToolsCoreCleanup(ToolsServiceState *state)
 {
+   ToolsCoreDispatch_Shutdown();
    ToolsCorePool_Shutdown(&state->ctx);
    ToolsCore_UnloadPlugins(state);
    if (state->ctx.rpc != NULL) {
@@ -83,7 +85,10 @@ ToolsCoreCleanup(ToolsServiceState *state)
 #endif
 
    g_object_set(state->ctx.serviceObj, TOOLS_CORE_PROP_CTX, NULL, NULL);
+   g_object_set(state->ctx.serviceObj, TOOLS_CORE_PROP_TIMELINE, NULL, NULL);
    g_object_unref(state->ctx.serviceObj);
+   g_free(state->timeline);
+   state->timeline = NULL;
    state->ctx.serviceObj = NULL;
    state->ctx.config = NULL;
    state->ctx.mainLoop = NULL;
@@ -170,6 +175,27 @@ ToolsCoreIOFreezeCb(gpointer src,
 }
 
 
+/**
+ * Idle callback that runs on the first iteration of the main loop. Closes the
+ * startup timeline and logs it.
+ *
+ * @param[in]  clientData  Service state.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+ToolsCoreStartupDoneCb(gpointer clientData)
+{
+   ToolsServiceState *state = clientData;
+
+   ToolsCore_PhaseEnd(state, TOOLS_PHASE_MAINLOOP);
+   ToolsCore_PublishTimeline(state);
+   g_message("Startup timeline: %s\n", state->timeline);
+   return FALSE;
+}
+
+
 /*
  ******************************************************************************
  * ToolsCoreRunLoop --                                                  */ /**
@@ -186,21 +212,27 @@ ToolsCoreIOFreezeCb(gpointer src,
 static int
 ToolsCoreRunLoop(ToolsServiceState *state)
 {
+   ToolsCore_PhaseBegin(state, TOOLS_PHASE_RPC_INIT);
    if (!ToolsCore_InitRpc(state)) {
       return 1;
    }
+   ToolsCore_PhaseEnd(state, TOOLS_PHASE_RPC_INIT);
 
    /*
     * Start the RPC channel if it's been created. The channel may be NULL if this is
     * not running in the context of a VM.
     */
+   ToolsCore_PhaseBegin(state, TOOLS_PHASE_RPC_START);
    if (state->ctx.rpc && !RpcChannel_Start(state->ctx.rpc)) {
       return 1;
    }
+   ToolsCore_PhaseEnd(state, TOOLS_PHASE_RPC_START);
 
+   ToolsCore_PhaseBegin(state, TOOLS_PHASE_PLUGINS_LOAD);
    if (!ToolsCore_LoadPlugins(state)) {
       return 1;
    }
+   ToolsCore_PhaseEnd(state, TOOLS_PHASE_PLUGINS_LOAD);
 
    /*
     * The following criteria needs to hold for the main loop to be run:
@@ -216,7 +248,9 @@ ToolsCoreRunLoop(ToolsServiceState *state)
        (state->ctx.isVMware ||
         ToolsCore_GetTcloName(state) == NULL ||
         state->debugPlugin != NULL)) {
+      ToolsCore_PhaseBegin(state, TOOLS_PHASE_PLUGINS_REGISTER);
       ToolsCore_RegisterPlugins(state);
+      ToolsCore_PhaseEnd(state, TOOLS_PHASE_PLUGINS_REGISTER);
 
       /*
        * Listen for the I/O freeze signal. We have to disable the config file
@@ -235,6 +269,9 @@ ToolsCoreRunLoop(ToolsServiceState *state)
                                              ToolsCoreConfFileCb,
                                              state);
 
+      ToolsCore_PhaseBegin(state, TOOLS_PHASE_MAINLOOP);
+      g_idle_add(ToolsCoreStartupDoneCb, state);
+
 #if defined(__APPLE__)
       ToolsCore_CFRunLoop(state);
 #else
@@ -259,6 +296,7 @@ void
 ToolsCore_DumpState(ToolsServiceState *state)
 {
    guint i;
+   VMToolsVMXLogStats logStats;
    const char *providerStates[] = {
       "idle",
       "active",
@@ -294,6 +332,55 @@ ToolsCore_DumpState(ToolsServiceState *state)
       }
    }
 
+   if (state->ctx.rpc != NULL) {
+      RpcInStats stats;
+
+      if (RpcChannel_GetInStats(state->ctx.rpc, &stats)) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                            "TCLO receive path: %s\n",
+                            stats.eventDriven ? "event driven (vsock)"
+                                              : "polling (backdoor)");
+         if (!stats.eventDriven) {
+            ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                               "TCLO poll interval: %u ms\n",
+                               stats.pollInterval);
+         }
+         ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                            "TCLO wakeups: %"FMT64"u total, %"FMT64"u in "
+                            "the last minute\n",
+                            stats.wakeups, stats.lastMinuteWakeups);
+         if (stats.commands > 0) {
+            ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                               "TCLO commands: %"FMT64"u, arrival to handler "
+                               "avg %"FMT64"u us, max %"FMT64"u us, "
+                               "avg poll wait %"FMT64"u us\n",
+                               stats.commands,
+                               stats.totalLatency / stats.commands,
+                               stats.maxLatency,
+                               stats.totalPollInterval / 2 / stats.commands);
+         }
+      }
+   }
+
+   if (VMTools_GetVMXLogStats(&logStats) && logStats.active) {
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "VMX log: %u messages (%u bytes) queued, "
+                         "%"FMT64"u sent in %"FMT64"u RPCs, "
+                         "%"FMT64"u dropped\n",
+                         logStats.queued, logStats.queuedBytes,
+                         logStats.sent, logStats.rpcs, logStats.dropped);
+   }
+
+   if (state->timeline != NULL) {
+      gchar *timeline = ToolsCore_FormatTimeline(state);
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "Startup timeline: %s\n",
+                         timeline);
+      g_free(timeline);
+   }
+
+   ToolsCorePool_DumpState();
+   ToolsCoreDispatch_DumpState();
    ToolsCore_DumpPluginInfo(state);
 
    g_signal_emit_by_name(state->ctx.serviceObj,
@@ -302,6 +389,110 @@ ToolsCore_DumpState(ToolsServiceState *state)
 }
 
 
+/**
+ * Marks the start of a startup phase.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  phase    The phase.
+ */
+
+void
+ToolsCore_PhaseBegin(ToolsServiceState *state,
+                     ToolsCorePhase phase)
+{
+   ASSERT(phase < TOOLS_PHASE_MAX);
+   state->phaseStart[phase] = Hostinfo_SystemTimerUS();
+}
+
+
+/**
+ * Marks the end of a startup phase and records its duration. Only the first
+ * run of a phase is recorded, so that later config reloads and the like do not
+ * overwrite the startup numbers.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  phase    The phase.
+ */
+
+void
+ToolsCore_PhaseEnd(ToolsServiceState *state,
+                   ToolsCorePhase phase)
+{
+   ASSERT(phase < TOOLS_PHASE_MAX);
+   if (state->phaseTime[phase] == 0 && state->phaseStart[phase] != 0) {
+      state->phaseTime[phase] = MAX(Hostinfo_SystemTimerUS() -
+                                    state->phaseStart[phase], 1);
+   }
+}
+
+
+/**
+ * Formats the startup timeline as a single line of "key=time" pairs.
+ *
+ * @param[in]  state    The service state.
+ *
+ * @return The timeline, to be freed with g_free().
+ */
+
+gchar *
+ToolsCore_FormatTimeline(ToolsServiceState *state)
+{
+   static const char *phaseNames[] = {
+      "config",
+      "setup",
+      "rpc.init",
+      "rpc.start",
+      "plugins.load",
+      "plugins.register",
+      "mainloop",
+   };
+   GString *str = g_string_new(NULL);
+   VmTimeType end;
+   guint i;
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(phaseNames) == TOOLS_PHASE_MAX);
+
+   /* The main loop phase ends at the first iteration of the loop. */
+   end = state->phaseStart[TOOLS_PHASE_MAINLOOP] +
+         state->phaseTime[TOOLS_PHASE_MAINLOOP];
+   g_string_append_printf(str, "total=%"FMT64"uus", end - state->startTime);
+
+   for (i = 0; i < TOOLS_PHASE_MAX; i++) {
+      if (state->phaseTime[i] != 0) {
+         g_string_append_printf(str, " %s=%"FMT64"uus",
+                                phaseNames[i], state->phaseTime[i]);
+      }
+   }
+
+   if (state->capsTime != 0) {
+      g_string_append_printf(str, " caps=%"FMT64"uus",
+                             state->capsTime - state->startTime);
+   }
+
+   ToolsCore_FormatPluginTimes(state, str);
+   return g_string_free(str, FALSE);
+}
+
+
+/**
+ * Rebuilds the startup timeline and publishes it in the service's
+ * TOOLS_CORE_PROP_TIMELINE property.
+ *
+ * @param[in]  state    The service state.
+ */
+
+void
+ToolsCore_PublishTimeline(ToolsServiceState *state)
+{
+   gchar *old = state->timeline;
+
+   state->timeline = ToolsCore_FormatTimeline(state);
+   g_object_set(state->ctx.serviceObj,
+                TOOLS_CORE_PROP_TIMELINE, state->timeline, NULL);
+   g_free(old);
+}
+
+
 /**
  * Returns the name of the TCLO app name. This will only return non-NULL
  * if the service is either the tools "guestd" or "userd" service.
@@ -341,6 +532,10 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
    gboolean first = state->ctx.config == NULL;
    gboolean loaded;
 
+   if (first) {
+      ToolsCore_PhaseBegin(state, TOOLS_PHASE_CONFIG);
+   }
+
    loaded = VMTools_LoadConfig(state->configFile,
                                G_KEY_FILE_NONE,
                                &state->ctx.config,
@@ -348,6 +543,7 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
 
    if (!first && loaded) {
       g_debug("Config file reloaded.\n");
+      ToolsCoreDispatch_LoadConfig(&state->ctx);
 
       /*
        * Inform plugins of config file update.
@@ -369,6 +565,10 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
                             TRUE,
                             reset);
    }
+
+   if (first) {
+      ToolsCore_PhaseEnd(state, TOOLS_PHASE_CONFIG);
+   }
 }
 
 
@@ -383,6 +583,9 @@ ToolsCore_Setup(ToolsServiceState *state)
 {
    GMainContext *gctx;
    ToolsServiceProperty ctxProp = { TOOLS_CORE_PROP_CTX };
+   ToolsServiceProperty timelineProp = { TOOLS_CORE_PROP_TIMELINE };
+
+   ToolsCore_PhaseBegin(state, TOOLS_PHASE_SETUP);
 
    if (!g_thread_supported()) {
       g_thread_init(NULL);
@@ -417,12 +620,17 @@ ToolsCore_Setup(ToolsServiceState *state)
    ToolsCoreService_RegisterProperty(state->ctx.serviceObj,
                                      &ctxProp);
    g_object_set(state->ctx.serviceObj, TOOLS_CORE_PROP_CTX, &state->ctx, NULL);
+   ToolsCoreService_RegisterProperty(state->ctx.serviceObj,
+                                     &timelineProp);
    ToolsCorePool_Init(&state->ctx);
+   ToolsCoreDispatch_Init(&state->ctx);
 
    /* Initializes the debug library if needed. */
    if (state->debugPlugin != NULL) {
       ToolsCoreInitializeDebug(state);
    }
+
+   ToolsCore_PhaseEnd(state, TOOLS_PHASE_SETUP);
 }
 
 
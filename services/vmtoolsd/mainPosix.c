@@ -170,6 +170,7 @@ main(int argc,
    char **argvCopy;
    GSource *src;
 
+   gState.startTime = Hostinfo_SystemTimerUS();
    Unicode_Init(argc, &argv, NULL);
 
    /*
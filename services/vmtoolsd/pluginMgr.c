@@ -20,13 +20,36 @@
  * @file pluginMgr.c
  *
  *    Provides functions for loading and manipulating Tools plugins.
+ *
+ *    When "plugins.lazyLoad" is set in the service's config group, plugins
+ *    that ship a manifest ("libfoo.manifest" next to "libfoo.so") are not
+ *    loaded at startup. Instead, stub handlers are registered for the RPCs
+ *    and signals listed in the manifest, and the plugin is loaded the first
+ *    time one of them is triggered. The manifest is a key file:
+ *
+ *    @verbatim
+ *    [plugin]
+ *    name=deployPkg
+ *    rpcs=deployPkg.begin;deployPkg.deploy
+ *    signals=tcs_reset
+ *    capabilities=foo
+ *    @endverbatim
+ *
+ *    "capabilities" lists old-style capabilities advertised on behalf of the
+ *    plugin while it is not loaded. Plugins that register app providers used
+ *    by other plugins should not have a manifest.
  */
 
+#include <stdio.h>
 #include <string.h>
+#if defined(__linux__)
+#  include <unistd.h>
+#endif
 #include "toolsCoreInt.h"
 
 #include "vm_assert.h"
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "serviceObj.h"
 #include "util.h"
 #include "vmware/tools/i18n.h"
@@ -34,14 +57,44 @@
 #include "vmware/tools/utils.h"
 
 
+#define TOOLSCORE_MANIFEST_SUFFIX   ".manifest"
+#define TOOLSCORE_MANIFEST_GROUP    "plugin"
+
+struct ToolsPluginManifest;
+
 /** Defines the internal data about a plugin. */
 typedef struct ToolsPlugin {
-   gchar               *fileName;
-   GModule             *module;
-   ToolsPluginOnLoad    onload;
-   ToolsPluginData     *data;
+   gchar                         *fileName;
+   GModule                       *module;
+   ToolsPluginOnLoad              onload;
+   ToolsPluginData               *data;
+   gchar                         *path;
+   struct ToolsPluginManifest    *manifest;
+   VmTimeType                     onloadTime;
 } ToolsPlugin;
 
+/** Stub connected to a signal on behalf of a plugin that is not loaded. */
+typedef struct ToolsCoreLazySignal {
+   gchar               *signame;
+   ToolsPlugin         *plugin;
+   GClosure            *stub;
+   gulong               handler;
+   GPtrArray           *closures;   // The plugin's own handlers, once loaded.
+} ToolsCoreLazySignal;
+
+/** Manifest of a plugin that is loaded on demand. */
+typedef struct ToolsPluginManifest {
+   gchar               *name;
+   ToolsServiceState   *state;
+   GArray              *rpcs;       // RpcChannelCallback stubs.
+   gboolean             rpcsRegistered;
+   GPtrArray           *signals;    // ToolsCoreLazySignal stubs.
+   gchar              **caps;
+   gulong               capsHandler;
+   gboolean             loaded;
+   gboolean             failed;
+} ToolsPluginManifest;
+
 
 #ifdef USE_APPLOADER
 static Bool (*LoadDependencies)(char *libName, Bool useShipped);
@@ -172,6 +225,62 @@ ToolsCoreDumpSignal(ToolsAppCtx *ctx,
 }
 
 
+/**
+ * Removes the stubs registered for a lazily loaded plugin and frees its
+ * manifest.
+ *
+ * @param[in]  plugin   ToolsPlugin instance.
+ */
+
+static void
+ToolsCoreFreeManifest(ToolsPlugin *plugin)
+{
+   ToolsPluginManifest *mf = plugin->manifest;
+   GObject *serviceObj = mf->state->ctx.serviceObj;
+   guint i;
+
+   if (mf->rpcsRegistered) {
+      for (i = 0; i < mf->rpcs->len; i++) {
+         RpcChannel_UnregisterCallback(mf->state->ctx.rpc,
+                                       &g_array_index(mf->rpcs,
+                                                      RpcChannelCallback, i));
+      }
+   }
+   for (i = 0; i < mf->rpcs->len; i++) {
+      g_free((gchar *) g_array_index(mf->rpcs, RpcChannelCallback, i).name);
+   }
+   g_array_free(mf->rpcs, TRUE);
+
+   for (i = 0; i < mf->signals->len; i++) {
+      ToolsCoreLazySignal *lsig = g_ptr_array_index(mf->signals, i);
+      guint j;
+
+      if (lsig->handler != 0 && serviceObj != NULL) {
+         g_signal_handler_disconnect(serviceObj, lsig->handler);
+      }
+      /* The stubs only exist once the plugins have been registered. */
+      if (lsig->stub != NULL) {
+         g_closure_unref(lsig->stub);
+      }
+      for (j = 0; j < lsig->closures->len; j++) {
+         g_closure_unref(g_ptr_array_index(lsig->closures, j));
+      }
+      g_ptr_array_free(lsig->closures, TRUE);
+      g_free(lsig->signame);
+      g_free(lsig);
+   }
+   g_ptr_array_free(mf->signals, TRUE);
+
+   if (mf->capsHandler != 0 && serviceObj != NULL) {
+      g_signal_handler_disconnect(serviceObj, mf->capsHandler);
+   }
+   g_strfreev(mf->caps);
+   g_free(mf->name);
+   g_free(mf);
+   plugin->manifest = NULL;
+}
+
+
 /**
  * Frees memory associated with a ToolsPlugin instance. If the plugin hasn't
  * been initialized yet, this will unload the shared object.
@@ -182,12 +291,16 @@ ToolsCoreDumpSignal(ToolsAppCtx *ctx,
 static void
 ToolsCoreFreePlugin(ToolsPlugin *plugin)
 {
+   if (plugin->manifest != NULL) {
+      ToolsCoreFreeManifest(plugin);
+   }
    if (plugin->module != NULL && !g_module_close(plugin->module)) {
       g_warning("Error unloading plugin '%s': %s\n",
                 plugin->fileName,
                 g_module_error());
    }
    g_free(plugin->fileName);
+   g_free(plugin->path);
    g_free(plugin);
 }
 
@@ -303,6 +416,71 @@ ToolsCoreRegisterProvider(ToolsServiceState *state,
 }
 
 
+/**
+ * Iterates through a plugin's app registration data, calling the given
+ * callback for each piece of data.
+ *
+ * @param[in]  state       Service state.
+ * @param[in]  plugin      The plugin.
+ * @param[in]  appRegCb    Callback called for each application registration.
+ */
+
+static void
+ToolsCoreForEachAppReg(ToolsServiceState *state,
+                       ToolsPlugin *plugin,
+                       PluginAppRegCallback appRegCb)
+{
+   GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
+   guint j;
+
+   if (regs == NULL) {
+      return;
+   }
+
+   for (j = 0; j < regs->len; j++) {
+      guint k;
+      guint pregIdx;
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
+      ToolsAppProviderReg *preg = NULL;
+
+      /* Find the provider for the desired reg type. */
+      for (k = 0; k < state->providers->len; k++) {
+         ToolsAppProviderReg *tmp = &g_array_index(state->providers,
+                                                   ToolsAppProviderReg,
+                                                   k);
+         if (tmp->prov->regType == reg->type) {
+            preg = tmp;
+            pregIdx = k;
+            break;
+         }
+      }
+
+      if (preg == NULL) {
+         g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
+                   reg->type, plugin->data->name);
+         if (plugin->data->errorCb != NULL &&
+             !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
+            break;
+         }
+         continue;
+      }
+
+      for (k = 0; k < reg->data->len; k++) {
+         gpointer appdata = &reg->data->data[preg->prov->regSize * k];
+         if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
+            return;
+         }
+
+         /*
+          * The registration callback may have modified the provider array,
+          * so we need to re-read the provider pointer.
+          */
+         preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
+      }
+   }
+}
+
+
 /**
  * Iterates through the list of plugins, and through each plugin's app
  * registration data, calling the appropriate callback for each piece
@@ -326,59 +504,13 @@ ToolsCoreForEachPlugin(ToolsServiceState *state,
 
    for (i = 0; i < state->plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
-      GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
-      guint j;
 
       if (pluginCb != NULL) {
          pluginCb(state, plugin->data);
       }
 
-      if (regs == NULL || appRegCb == NULL) {
-         continue;
-      }
-
-      for (j = 0; j < regs->len; j++) {
-         guint k;
-         guint pregIdx;
-         ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
-         ToolsAppProviderReg *preg = NULL;
-
-         /* Find the provider for the desired reg type. */
-         for (k = 0; k < state->providers->len; k++) {
-            ToolsAppProviderReg *tmp = &g_array_index(state->providers,
-                                                      ToolsAppProviderReg,
-                                                      k);
-            if (tmp->prov->regType == reg->type) {
-               preg = tmp;
-               pregIdx = k;
-               break;
-            }
-         }
-
-         if (preg == NULL) {
-            g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
-                      reg->type, plugin->data->name);
-            if (plugin->data->errorCb != NULL &&
-                !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
-               break;
-            }
-            continue;
-         }
-
-         for (k = 0; k < reg->data->len; k++) {
-            gpointer appdata = &reg->data->data[preg->prov->regSize * k];
-            if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
-               /* Break out of the outer loop. */
-               j = regs->len;
-               break;
-            }
-
-            /*
-             * The registration callback may have modified the provider array,
-             * so we need to re-read the provider pointer.
-             */
-            preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
-         }
+      if (appRegCb != NULL) {
+         ToolsCoreForEachAppReg(state, plugin, appRegCb);
       }
    }
 }
@@ -411,7 +543,7 @@ ToolsCoreRegisterProperty(ToolsAppCtx *ctx,
  *
  * @param[in]  ctx      The application context.
  * @param[in]  prov     Unused.
- * @param[in]  plugin   Unused.
+ * @param[in]  plugin   The plugin registering the RPC.
  * @param[in]  reg      The application registration data.
  *
  * @return TRUE.
@@ -423,17 +555,21 @@ ToolsCoreRegisterRPC(ToolsAppCtx *ctx,
                      ToolsPluginData *plugin,
                      gpointer reg)
 {
-   RpcChannel_RegisterCallback(ctx->rpc, reg);
+   RpcChannelCallback *rpc = reg;
+
+   RpcChannel_RegisterCallback(ctx->rpc, rpc);
+   ToolsCoreDispatch_SetRpcOwner(rpc->name, plugin->name);
    return TRUE;
 }
 
 
 /**
- * Registration callback for signal connections.
+ * Registration callback for signal connections. The time spent in the handler
+ * is accounted to the plugin in the main loop statistics.
  *
  * @param[in]  ctx      The application context.
  * @param[in]  prov     Unused.
- * @param[in]  plugin   Unused.
+ * @param[in]  plugin   The plugin connecting to the signal.
  * @param[in]  reg      The application registration data.
  *
  * @return TRUE if the signal exists.
@@ -456,10 +592,10 @@ ToolsCoreRegisterSignal(ToolsAppCtx *ctx,
                                &sigDetail,
                                FALSE);
    if (valid) {
-      g_signal_connect(ctx->serviceObj,
-                       sig->signame,
-                       sig->callback,
-                       sig->clientData);
+      GClosure *closure = g_cclosure_new(sig->callback, sig->clientData, NULL);
+
+      g_signal_connect_closure(ctx->serviceObj, sig->signame, closure, FALSE);
+      ToolsCoreDispatch_MonitorClosure(closure, plugin->name, sig->signame);
       return TRUE;
    }
 
@@ -488,19 +624,169 @@ ToolsCoreStrPtrCompare(gconstpointer _str1,
 }
 
 
+/**
+ * Opens a plugin's shared object and looks up its entry point.
+ *
+ * @param[in]  path        Path to the plugin.
+ * @param[in]  entry       File name of the plugin, for logging.
+ * @param[out] onload      Where to store the entry point.
+ *
+ * @return The module, or NULL on failure.
+ */
+
+static GModule *
+ToolsCoreOpenPlugin(const gchar *path,
+                    const gchar *entry,
+                    ToolsPluginOnLoad *onload)
+{
+   GModule *module;
+
+#ifdef USE_APPLOADER
+   /* Trying loading the plugins with system libraries */
+   if (!LoadDependencies((char *) path, FALSE)) {
+      g_warning("Loading of library dependencies for %s failed.\n", entry);
+      return NULL;
+   }
+#endif
+
+   module = g_module_open(path, G_MODULE_BIND_LOCAL);
+#ifdef USE_APPLOADER
+   if (module == NULL) {
+      /* Falling back to the shipped libraries */
+      if (!LoadDependencies((char *) path, TRUE)) {
+         g_warning("Loading of shipped library dependencies for %s failed.\n",
+                  entry);
+         return NULL;
+      }
+      module = g_module_open(path, G_MODULE_BIND_LOCAL);
+   }
+#endif
+   if (module == NULL) {
+      g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
+      return NULL;
+   }
+
+   if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) onload)) {
+      g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
+      if (!g_module_close(module)) {
+         g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
+      }
+      return NULL;
+   }
+
+   return module;
+}
+
+
+/**
+ * Reads the manifest of a plugin, if it has one.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  path     Path to the plugin.
+ *
+ * @return The manifest, or NULL if the plugin doesn't have a valid one.
+ */
+
+static ToolsPluginManifest *
+ToolsCoreReadManifest(ToolsServiceState *state,
+                      const gchar *path)
+{
+   gchar *mfPath;
+   gchar **rpcs = NULL;
+   gchar **signals = NULL;
+   GKeyFile *kf = NULL;
+   GError *err = NULL;
+   ToolsPluginManifest *mf = NULL;
+   guint i;
+
+   ASSERT(g_str_has_suffix(path, "." G_MODULE_SUFFIX));
+   mfPath = g_strdup_printf("%.*s" TOOLSCORE_MANIFEST_SUFFIX,
+                            (int) (strlen(path) - strlen("." G_MODULE_SUFFIX)),
+                            path);
+
+   if (!g_file_test(mfPath, G_FILE_TEST_IS_REGULAR)) {
+      goto exit;
+   }
+
+   kf = g_key_file_new();
+   if (!g_key_file_load_from_file(kf, mfPath, G_KEY_FILE_NONE, &err)) {
+      g_warning("Error reading plugin manifest '%s': %s\n", mfPath,
+                err->message);
+      g_clear_error(&err);
+      goto exit;
+   }
+
+   mf = g_malloc0(sizeof *mf);
+   mf->state = state;
+   mf->name = g_key_file_get_string(kf, TOOLSCORE_MANIFEST_GROUP, "name", NULL);
+   if (mf->name == NULL) {
+      g_warning("Plugin manifest '%s' has no name, ignoring.\n", mfPath);
+      g_free(mf);
+      mf = NULL;
+      goto exit;
+   }
+
+   rpcs = g_key_file_get_string_list(kf, TOOLSCORE_MANIFEST_GROUP, "rpcs",
+                                     NULL, NULL);
+   signals = g_key_file_get_string_list(kf, TOOLSCORE_MANIFEST_GROUP,
+                                        "signals", NULL, NULL);
+   mf->caps = g_key_file_get_string_list(kf, TOOLSCORE_MANIFEST_GROUP,
+                                         "capabilities", NULL, NULL);
+
+   mf->rpcs = g_array_new(FALSE, TRUE, sizeof (RpcChannelCallback));
+   for (i = 0; rpcs != NULL && rpcs[i] != NULL; i++) {
+      RpcChannelCallback rpc = { NULL, };
+
+      rpc.name = g_strstrip(rpcs[i]);
+      if (*rpc.name == '\0') {
+         g_free(rpcs[i]);
+         continue;
+      }
+      g_array_append_val(mf->rpcs, rpc);
+   }
+   /* Ownership of the strings was moved to the rpc array. */
+   g_free(rpcs);
+
+   mf->signals = g_ptr_array_new();
+   for (i = 0; signals != NULL && signals[i] != NULL; i++) {
+      ToolsCoreLazySignal *lsig;
+
+      if (*g_strstrip(signals[i]) == '\0') {
+         continue;
+      }
+      lsig = g_malloc0(sizeof *lsig);
+      lsig->signame = g_strdup(signals[i]);
+      lsig->closures = g_ptr_array_new();
+      g_ptr_array_add(mf->signals, lsig);
+   }
+   g_strfreev(signals);
+
+exit:
+   if (kf != NULL) {
+      g_key_file_free(kf);
+   }
+   g_free(mfPath);
+   return mf;
+}
+
+
 /**
  * Loads all the plugins found in the given directory, adding the registration
- * data to the given array.
+ * data to the given array. If lazy loading is enabled, plugins that have a
+ * manifest are not loaded; they're added to the lazy array instead.
  *
- * @param[in]  ctx         Application context.
+ * @param[in]  state       The service state.
  * @param[in]  pluginPath  Path where to look for plugins.
  * @param[out] regs        Array where to store plugin registration info.
+ * @param[out] lazy        Array where to store plugins to be loaded on
+ *                         demand, or NULL if lazy loading is disabled.
  */
 
 static gboolean
-ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
+ToolsCoreLoadDirectory(ToolsServiceState *state,
                        const gchar *pluginPath,
-                       GPtrArray *regs)
+                       GPtrArray *regs,
+                       GPtrArray *lazy)
 {
    gboolean ret = FALSE;
    const gchar *staticEntry;
@@ -536,59 +822,44 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
       gchar *path;
       GModule *module = NULL;
       ToolsPlugin *plugin = NULL;
-      ToolsPluginOnLoad onload;
+      ToolsPluginManifest *manifest = NULL;
+      ToolsPluginOnLoad onload = NULL;
 
       entry = g_ptr_array_index(plugins, i);
       path = g_strdup_printf("%s%c%s", pluginPath, DIRSEPC, entry);
 
       if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
          g_warning("File '%s' is not a regular file, skipping.\n", entry);
-         goto next;
+         g_free(entry);
+         g_free(path);
+         continue;
       }
 
-#ifdef USE_APPLOADER
-      /* Trying loading the plugins with system libraries */
-      if (!LoadDependencies(path, FALSE)) {
-         g_warning("Loading of library dependencies for %s failed.\n", entry);
-         goto next;
+      if (lazy != NULL) {
+         manifest = ToolsCoreReadManifest(state, path);
       }
-#endif
 
-      module = g_module_open(path, G_MODULE_BIND_LOCAL);
-#ifdef USE_APPLOADER
-      if (module == NULL) {
-         /* Falling back to the shipped libraries */
-         if (!LoadDependencies(path, TRUE)) {
-            g_warning("Loading of shipped library dependencies for %s failed.\n",
-                     entry);
-            goto next;
+      if (manifest == NULL) {
+         module = ToolsCoreOpenPlugin(path, entry, &onload);
+         if (module == NULL) {
+            g_free(entry);
+            g_free(path);
+            continue;
          }
-         module = g_module_open(path, G_MODULE_BIND_LOCAL);
-      }
-#endif
-      if (module == NULL) {
-         g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
-         goto next;
-      }
-
-      if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) &onload)) {
-         g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
-         goto next;
       }
 
-      plugin = g_malloc(sizeof *plugin);
+      plugin = g_malloc0(sizeof *plugin);
       plugin->fileName = entry;
-      plugin->data = NULL;
+      plugin->path = path;
       plugin->module = module;
       plugin->onload = onload;
-      g_ptr_array_add(regs, plugin);
+      plugin->manifest = manifest;
 
-   next:
-      g_free(path);
-      if (plugin == NULL && module != NULL) {
-         if (!g_module_close(module)) {
-            g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
-         }
+      if (manifest != NULL) {
+         g_message("Plugin '%s' will be loaded on demand.\n", manifest->name);
+         g_ptr_array_add(lazy, plugin);
+      } else {
+         g_ptr_array_add(regs, plugin);
       }
    }
 
@@ -600,6 +871,333 @@ exit:
 }
 
 
+/**
+ * Loads a plugin that was deferred because of its manifest, and registers
+ * its applications. The plugin's handlers for the signals listed in its
+ * manifest are attached to the stubs instead of being connected directly.
+ *
+ * @param[in]  plugin   The plugin.
+ *
+ * @return Whether the plugin is loaded.
+ */
+
+static gboolean
+ToolsCoreLoadLazyPlugin(ToolsPlugin *plugin)
+{
+   ToolsPluginManifest *mf = plugin->manifest;
+   ToolsServiceState *state = mf->state;
+   VmTimeType start;
+   GArray *regs;
+   guint i;
+
+   if (mf->loaded) {
+      return TRUE;
+   }
+   if (mf->failed) {
+      return FALSE;
+   }
+
+   start = Hostinfo_SystemTimerUS();
+   mf->failed = TRUE;
+
+   plugin->module = ToolsCoreOpenPlugin(plugin->path, plugin->fileName,
+                                        &plugin->onload);
+   if (plugin->module == NULL) {
+      return FALSE;
+   }
+
+   plugin->onloadTime = Hostinfo_SystemTimerUS();
+   plugin->data = plugin->onload(&state->ctx);
+   plugin->onloadTime = Hostinfo_SystemTimerUS() - plugin->onloadTime;
+   if (plugin->data == NULL) {
+      g_warning("Plugin '%s' didn't provide deployment data.\n",
+                plugin->fileName);
+      if (!g_module_close(plugin->module)) {
+         g_warning("Error unloading plugin '%s': %s\n", plugin->fileName,
+                   g_module_error());
+      }
+      plugin->module = NULL;
+      return FALSE;
+   }
+
+   ASSERT(plugin->data->name != NULL);
+   g_module_make_resident(plugin->module);
+   VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
+
+   /* Take over the plugin's handlers for the signals we have stubs for. */
+   regs = plugin->data->regs;
+   for (i = 0; regs != NULL && i < regs->len; i++) {
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, i);
+      guint k;
+
+      if (reg->type != TOOLS_APP_SIGNALS || reg->data == NULL) {
+         continue;
+      }
+
+      for (k = reg->data->len; k > 0; k--) {
+         ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                   ToolsPluginSignalCb,
+                                                   k - 1);
+         guint j;
+
+         for (j = 0; j < mf->signals->len; j++) {
+            ToolsCoreLazySignal *lsig = g_ptr_array_index(mf->signals, j);
+            GClosure *closure;
+
+            if (lsig->handler == 0 || strcmp(lsig->signame, sig->signame) != 0) {
+               continue;
+            }
+
+            closure = g_cclosure_new(sig->callback, sig->clientData, NULL);
+            g_closure_ref(closure);
+            g_closure_sink(closure);
+            /* The stub got the signal's marshaller when it was connected. */
+            g_closure_set_marshal(closure, lsig->stub->marshal);
+            ToolsCoreDispatch_MonitorClosure(closure, plugin->data->name,
+                                             lsig->signame);
+            g_ptr_array_add(lsig->closures, closure);
+            g_array_remove_index(reg->data, k - 1);
+            break;
+         }
+      }
+   }
+
+   /* Replace the RPC stubs with the plugin's own handlers. */
+   if (mf->rpcsRegistered) {
+      for (i = 0; i < mf->rpcs->len; i++) {
+         RpcChannel_UnregisterCallback(state->ctx.rpc,
+                                       &g_array_index(mf->rpcs,
+                                                      RpcChannelCallback, i));
+      }
+      mf->rpcsRegistered = FALSE;
+   }
+
+   mf->loaded = TRUE;
+   mf->failed = FALSE;
+   g_ptr_array_remove(state->lazyPlugins, plugin);
+   g_ptr_array_add(state->plugins, plugin);
+
+   ToolsCoreForEachAppReg(state, plugin, ToolsCoreRegisterProvider);
+   ToolsCoreForEachAppReg(state, plugin, ToolsCoreRegisterApp);
+
+   g_message("Plugin '%s' loaded on demand in %"FMT64"u us.\n",
+             plugin->data->name, Hostinfo_SystemTimerUS() - start);
+   return TRUE;
+}
+
+
+/**
+ * Stub handler for the RPCs listed in a plugin's manifest. Loads the plugin
+ * and dispatches the RPC again, now to the plugin's own handler.
+ *
+ * @param[in]  data     RPC data.
+ *
+ * @return The result of the plugin's handler.
+ */
+
+static gboolean
+ToolsCoreLazyRpc(RpcInData *data)
+{
+   ToolsPlugin *plugin = data->clientData;
+   ToolsServiceState *state = plugin->manifest->state;
+   size_t nameLen = strlen(data->name);
+   RpcInData real;
+   gboolean ret;
+
+   g_debug("Loading plugin '%s' for RPC '%s'.\n", plugin->manifest->name,
+           data->name);
+
+   if (!ToolsCoreLoadLazyPlugin(plugin)) {
+      return RPCIN_SETRETVALS(data, "Plugin failed to load", FALSE);
+   }
+
+   /* The arguments follow the command name in the original message. */
+   memset(&real, 0, sizeof real);
+   real.args = data->args - nameLen;
+   real.argsSize = data->argsSize + nameLen;
+   real.clientData = state->ctx.rpc;
+   real.appCtx = data->appCtx;
+
+   ret = RpcChannel_Dispatch(&real);
+
+   data->result = real.result;
+   data->resultLen = real.resultLen;
+   data->freeResult = real.freeResult;
+   return ret;
+}
+
+
+/**
+ * Meta marshaller of the signal stubs of plugins that are loaded on demand.
+ * Loads the plugin the first time the signal is emitted, and calls the
+ * plugin's handlers for the signal.
+ *
+ * If the plugin has more than one handler for a signal with a return value,
+ * only the last handler's return value is seen by the signal accumulator.
+ *
+ * @param[in]  closure        The stub closure.
+ * @param[out] returnValue    Signal return value.
+ * @param[in]  nParams        Number of parameters.
+ * @param[in]  params         Parameters.
+ * @param[in]  hint           Invocation hint.
+ * @param[in]  marshalData    The ToolsCoreLazySignal.
+ */
+
+static void
+ToolsCoreLazySignalMarshal(GClosure *closure,
+                           GValue *returnValue,
+                           guint nParams,
+                           const GValue *params,
+                           gpointer hint,
+                           gpointer marshalData)
+{
+   ToolsCoreLazySignal *lsig = marshalData;
+   guint i;
+
+   if (!lsig->plugin->manifest->loaded) {
+      g_debug("Loading plugin '%s' for signal '%s'.\n",
+              lsig->plugin->manifest->name, lsig->signame);
+      if (!ToolsCoreLoadLazyPlugin(lsig->plugin)) {
+         return;
+      }
+   }
+
+   for (i = 0; i < lsig->closures->len; i++) {
+      g_closure_invoke(g_ptr_array_index(lsig->closures, i), returnValue,
+                       nParams, params, hint);
+   }
+}
+
+
+/**
+ * Capabilities handler for plugins that are not loaded yet. Advertises the
+ * capabilities listed in the plugin's manifest.
+ *
+ * @param[in]  src      Unused.
+ * @param[in]  ctx      Unused.
+ * @param[in]  set      Whether setting or unsetting the capabilities.
+ * @param[in]  data     The plugin.
+ *
+ * @return The capabilities, or NULL if the plugin has been loaded.
+ */
+
+static GArray *
+ToolsCoreLazyCapabilities(gpointer src,
+                          ToolsAppCtx *ctx,
+                          gboolean set,
+                          gpointer data)
+{
+   ToolsPlugin *plugin = data;
+   GArray *caps;
+   guint i;
+
+   /* Once loaded, the plugin reports its own capabilities. */
+   if (plugin->manifest->loaded) {
+      return NULL;
+   }
+
+   caps = g_array_new(FALSE, TRUE, sizeof (ToolsAppCapability));
+   for (i = 0; plugin->manifest->caps[i] != NULL; i++) {
+      ToolsAppCapability cap = { TOOLS_CAP_OLD, NULL, 0, 0 };
+
+      cap.name = plugin->manifest->caps[i];
+      cap.value = set ? 1 : 0;
+      g_array_append_val(caps, cap);
+   }
+   return caps;
+}
+
+
+/**
+ * Registers the RPC and signal stubs of the plugins that are loaded on
+ * demand.
+ *
+ * @param[in]  state    The service state.
+ */
+
+static void
+ToolsCoreRegisterLazyStubs(ToolsServiceState *state)
+{
+   guint i;
+
+   for (i = 0; i < state->lazyPlugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->lazyPlugins, i);
+      ToolsPluginManifest *mf = plugin->manifest;
+      guint j;
+
+      if (state->ctx.rpc != NULL) {
+         for (j = 0; j < mf->rpcs->len; j++) {
+            RpcChannelCallback *rpc = &g_array_index(mf->rpcs,
+                                                     RpcChannelCallback, j);
+            rpc->callback = ToolsCoreLazyRpc;
+            rpc->clientData = plugin;
+            RpcChannel_RegisterCallback(state->ctx.rpc, rpc);
+            ToolsCoreDispatch_SetRpcOwner(rpc->name, mf->name);
+         }
+         mf->rpcsRegistered = TRUE;
+      }
+
+      for (j = 0; j < mf->signals->len; j++) {
+         ToolsCoreLazySignal *lsig = g_ptr_array_index(mf->signals, j);
+         guint sigId;
+         GQuark sigDetail;
+
+         lsig->plugin = plugin;
+         lsig->stub = g_closure_new_simple(sizeof (GClosure), NULL);
+         g_closure_ref(lsig->stub);
+         g_closure_sink(lsig->stub);
+         g_closure_set_meta_marshal(lsig->stub, lsig, ToolsCoreLazySignalMarshal);
+
+         if (!g_signal_parse_name(lsig->signame,
+                                  G_OBJECT_TYPE(state->ctx.serviceObj),
+                                  &sigId, &sigDetail, FALSE)) {
+            g_debug("Plugin '%s' unable to connect to signal '%s'.\n",
+                    mf->name, lsig->signame);
+            continue;
+         }
+         lsig->handler = g_signal_connect_closure(state->ctx.serviceObj,
+                                                  lsig->signame,
+                                                  lsig->stub,
+                                                  FALSE);
+      }
+
+      if (mf->caps != NULL && mf->caps[0] != NULL) {
+         mf->capsHandler = g_signal_connect(state->ctx.serviceObj,
+                                            TOOLS_CORE_SIG_CAPABILITIES,
+                                            G_CALLBACK(ToolsCoreLazyCapabilities),
+                                            plugin);
+      }
+   }
+}
+
+
+/**
+ * Returns the resident set size of the process, where available.
+ *
+ * @return RSS in KB, or 0 if unknown.
+ */
+
+static gsize
+ToolsCoreGetRss(void)
+{
+   gsize rss = 0;
+#if defined(__linux__)
+   FILE *f = fopen("/proc/self/statm", "r");
+
+   if (f != NULL) {
+      unsigned long size;
+      unsigned long resident;
+
+      if (fscanf(f, "%lu %lu", &size, &resident) == 2) {
+         rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+      }
+      fclose(f);
+   }
+#endif
+   return rss;
+}
+
+
 /**
  * State dump callback for logging information about loaded plugins.
  *
@@ -612,7 +1210,48 @@ ToolsCore_DumpPluginInfo(ToolsServiceState *state)
    if (state->plugins == NULL) {
       g_message("   No plugins loaded.");
    } else {
+      guint i;
+
       ToolsCoreForEachPlugin(state, ToolsCoreDumpPluginInfo, ToolsCoreDumpAppInfo);
+
+      for (i = 0; i < state->lazyPlugins->len; i++) {
+         ToolsPlugin *plugin = g_ptr_array_index(state->lazyPlugins, i);
+
+         ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                            "Plugin: %s (%s)\n", plugin->manifest->name,
+                            plugin->manifest->failed ? "failed to load"
+                                                     : "not loaded yet");
+      }
+   }
+}
+
+
+/**
+ * Appends the time each loaded plugin spent in its ToolsOnLoad() function to
+ * the startup timeline, as "plugin.<name>=<time>us" pairs.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  str      Where to append the plugin times.
+ */
+
+void
+ToolsCore_FormatPluginTimes(ToolsServiceState *state,
+                            GString *str)
+{
+   guint i;
+
+   if (state->plugins == NULL) {
+      return;
+   }
+
+   for (i = 0; i < state->plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
+
+      /* The debug plugin is not loaded through ToolsOnLoad(). */
+      if (plugin->module != NULL) {
+         g_string_append_printf(str, " plugin.%s=%"FMT64"uus",
+                                plugin->data->name, plugin->onloadTime);
+      }
    }
 }
 
@@ -632,9 +1271,11 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
 {
    gboolean pluginDirExists;
    gboolean ret = FALSE;
+   gboolean lazyLoad = FALSE;
    gchar *pluginRoot;
    guint i;
    GPtrArray *plugins = NULL;
+   VmTimeType start = Hostinfo_SystemTimerUS();
 
 #if defined(sun) && defined(__x86_64__)
    const char *subdir = "/amd64";
@@ -670,6 +1311,12 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
 #endif
 
    plugins = g_ptr_array_new();
+   state->lazyPlugins = g_ptr_array_new();
+
+   if (state->ctx.config != NULL) {
+      lazyLoad = g_key_file_get_boolean(state->ctx.config, state->name,
+                                        "plugins.lazyLoad", NULL);
+   }
 
    /*
     * First, load plugins from the common directory. The common directory
@@ -687,7 +1334,8 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (g_file_test(state->commonPath, G_FILE_TEST_IS_DIR) &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->commonPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->commonPath, plugins,
+                               lazyLoad ? state->lazyPlugins : NULL)) {
       goto exit;
    }
 
@@ -711,7 +1359,8 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (pluginDirExists &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->pluginPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->pluginPath, plugins,
+                               lazyLoad ? state->lazyPlugins : NULL)) {
       goto exit;
    }
 
@@ -725,7 +1374,9 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    for (i = 0; i < plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
 
+      plugin->onloadTime = Hostinfo_SystemTimerUS();
       plugin->data = plugin->onload(&state->ctx);
+      plugin->onloadTime = Hostinfo_SystemTimerUS() - plugin->onloadTime;
 
       if (plugin->data == NULL) {
          g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
@@ -751,14 +1402,16 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
     */
    if (state->debugData != NULL && state->debugData->debugPlugin->plugin != NULL) {
       ToolsPluginData *data = state->debugData->debugPlugin->plugin;
-      ToolsPlugin *plugin = g_malloc(sizeof *plugin);
-      plugin->fileName = NULL;
-      plugin->module = NULL;
+      ToolsPlugin *plugin = g_malloc0(sizeof *plugin);
       plugin->data = data;
       VMTools_BindTextDomain(data->name, NULL, NULL);
       g_ptr_array_add(state->plugins, plugin);
    }
 
+   g_message("%u plugins initialized, %u deferred, in %"FMT64"u us; "
+             "RSS %"FMTSZ"u KB.\n", state->plugins->len,
+             state->lazyPlugins->len, Hostinfo_SystemTimerUS() - start,
+             ToolsCoreGetRss());
    ret = TRUE;
 
 exit:
@@ -850,6 +1503,9 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
     * individual app providers as necessary.
     */
    ToolsCoreForEachPlugin(state, NULL, ToolsCoreRegisterApp);
+
+   /* Finally, hook up the plugins that will be loaded on demand. */
+   ToolsCoreRegisterLazyStubs(state);
 }
 
 
@@ -912,6 +1568,17 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
       }
    }
 
+   /* Don't load plugins on demand just to shut them down. */
+   while (state->lazyPlugins->len > 0) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->lazyPlugins,
+                                              state->lazyPlugins->len - 1);
+
+      g_ptr_array_remove_index(state->lazyPlugins, state->lazyPlugins->len - 1);
+      ToolsCoreFreePlugin(plugin);
+   }
+   g_ptr_array_free(state->lazyPlugins, TRUE);
+   state->lazyPlugins = NULL;
+
    g_signal_emit_by_name(state->ctx.serviceObj, TOOLS_CORE_SIG_SHUTDOWN, &state->ctx);
 
    while (state->plugins->len > 0) {
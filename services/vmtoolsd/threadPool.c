@@ -20,11 +20,20 @@
  * @file threadPool.c
  *
  * Implementation of the shared thread pool defined in threadPool.h.
+ *
+ * Queued tasks are kept in one queue per priority class. Tasks are only handed
+ * to the glib thread pool when they can start right away, so the order in
+ * which tasks run and the limits on concurrency are decided here: workers pick
+ * the oldest task of the most urgent class whose owner is below its limit of
+ * running tasks. Critical tasks ignore the per-owner limit and may use a few
+ * extra workers that other tasks never get, so they don't wait behind long
+ * running tasks.
  */
 
 #include <limits.h>
 #include <string.h>
 #include "vmware.h"
+#include "hostinfo.h"
 #include "toolsCoreInt.h"
 #include "serviceObj.h"
 #include "vmware/tools/threadPool.h"
@@ -32,13 +41,31 @@
 #define DEFAULT_MAX_IDLE_TIME       5000
 #define DEFAULT_MAX_THREADS         5
 #define DEFAULT_MAX_UNUSED_THREADS  0
+#define DEFAULT_RESERVED_THREADS    1
+
+/* Owner of tasks submitted by code that doesn't set a log domain. */
+#define UNKNOWN_OWNER               "unknown"
+
+typedef struct ThreadPoolLane {
+   GQueue        *queue;
+   guint          maxRunning;
+   guint          running;
+   guint          maxDepth;
+   guint64        started;
+   VmTimeType     totalWait;
+   VmTimeType     maxWait;
+} ThreadPoolLane;
+
 
 typedef struct ThreadPoolState {
    ToolsCorePool  funcs;
    gboolean       active;
    ToolsAppCtx   *ctx;
    GThreadPool   *pool;
-   GQueue        *workQueue;
+   ThreadPoolLane lanes[TOOLS_CORE_POOL_PRIORITY_MAX];
+   GHashTable    *owners;
+   guint          maxPerOwner;
+   guint          running;
    GPtrArray     *threads;
    GMutex        *lock;
    guint          nextWorkId;
@@ -46,11 +73,14 @@ typedef struct ThreadPoolState {
 
 
 typedef struct WorkerTask {
-   guint             id;
-   guint             srcId;
-   ToolsCorePoolCb   cb;
-   gpointer          data;
-   GDestroyNotify    dtor;
+   guint                   id;
+   guint                   srcId;
+   ToolsCorePoolCb         cb;
+   gpointer                data;
+   GDestroyNotify          dtor;
+   ToolsCorePoolPriority   priority;
+   gchar                  *owner;
+   VmTimeType              queued;
 } WorkerTask;
 
 
@@ -143,10 +173,159 @@ ToolsCorePoolDestroyTask(gpointer data)
    if (work->dtor != NULL) {
       work->dtor(work->data);
    }
+   g_free(work->owner);
    g_free(work);
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePoolFindTask --                                               */ /**
+ *
+ * Looks for a queued task in all the priority queues. Must be called with the
+ * pool lock held.
+ *
+ * @param[in]  id    Task ID.
+ * @param[out] lane  Where to store the lane holding the task.
+ *
+ * @return The queue link holding the task, or NULL if it's not queued.
+ *
+ *******************************************************************************
+ */
+
+static GList *
+ToolsCorePoolFindTask(guint id,
+                      ThreadPoolLane **lane)
+{
+   guint i;
+   WorkerTask search = { id, };
+
+   for (i = 0; i < ARRAYSIZE(gState.lanes); i++) {
+      GList *lnk = g_queue_find_custom(gState.lanes[i].queue, &search,
+                                       ToolsCorePoolCompareTask);
+      if (lnk != NULL) {
+         *lane = &gState.lanes[i];
+         return lnk;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePoolTaskStarted --                                            */ /**
+ *
+ * Updates the wait time statistics of the task's lane when the task starts
+ * running. Must be called with the pool lock held.
+ *
+ * @param[in] work   A WorkerTask.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCorePoolTaskStarted(WorkerTask *work)
+{
+   ThreadPoolLane *lane = &gState.lanes[work->priority];
+   VmTimeType wait = Hostinfo_SystemTimerUS() - work->queued;
+
+   lane->started++;
+   lane->totalWait += wait;
+   if (wait > lane->maxWait) {
+      lane->maxWait = wait;
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePoolNextTask --                                               */ /**
+ *
+ * Dequeues the next task that can start running now: the oldest task of the
+ * most urgent lane that has a free worker, skipping tasks whose owner already
+ * has as many tasks running as allowed. Critical tasks are not subject to the
+ * per-owner limit. Must be called with the pool lock held.
+ *
+ * @return The next task to run, or NULL if none can run now.
+ *
+ *******************************************************************************
+ */
+
+static WorkerTask *
+ToolsCorePoolNextTask(void)
+{
+   guint i;
+
+   for (i = 0; i < ARRAYSIZE(gState.lanes); i++) {
+      ThreadPoolLane *lane = &gState.lanes[i];
+      GList *lnk;
+
+      if (gState.running >= lane->maxRunning) {
+         continue;
+      }
+
+      /* Tasks are queued at the head, so the oldest one is at the tail. */
+      for (lnk = g_queue_peek_tail_link(lane->queue); lnk != NULL; lnk = lnk->prev) {
+         WorkerTask *work = lnk->data;
+
+         if (i == TOOLS_CORE_POOL_PRIORITY_CRITICAL ||
+             GPOINTER_TO_UINT(g_hash_table_lookup(gState.owners, work->owner)) <
+                gState.maxPerOwner) {
+            g_queue_delete_link(lane->queue, lnk);
+            return work;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * ToolsCorePoolSchedule --                                               */ /**
+ *
+ * Hands all the tasks that can start running now to the thread pool. Must be
+ * called with the pool lock held.
+ *
+ *******************************************************************************
+ */
+
+static void
+ToolsCorePoolSchedule(void)
+{
+   WorkerTask *work;
+
+   if (!gState.active) {
+      return;
+   }
+
+   while ((work = ToolsCorePoolNextTask()) != NULL) {
+      GError *err = NULL;
+      guint count = GPOINTER_TO_UINT(g_hash_table_lookup(gState.owners,
+                                                          work->owner));
+
+      g_hash_table_insert(gState.owners, g_strdup(work->owner),
+                          GUINT_TO_POINTER(count + 1));
+      gState.lanes[work->priority].running++;
+      gState.running++;
+
+      /*
+       * If glib can't start a new thread, it still queues the task, which will
+       * run as soon as one of the existing workers is free.
+       */
+      g_thread_pool_push(gState.pool, work, &err);
+      if (err != NULL) {
+         g_warning("error starting worker thread for task %u: %s",
+                   work->id, err->message);
+         g_clear_error(&err);
+      }
+   }
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePoolDoWork --                                                 */ /**
@@ -167,11 +346,12 @@ ToolsCorePoolDoWork(gpointer data)
 
    /*
     * In single threaded mode, remove the task being executed from the queue.
-    * In multi-threaded mode, the thread pool callback already did this.
+    * In multi-threaded mode, the scheduler already did this.
     */
    if (gState.pool == NULL) {
       g_mutex_lock(gState.lock);
-      g_queue_remove(gState.workQueue, work);
+      g_queue_remove(gState.lanes[work->priority].queue, work);
+      ToolsCorePoolTaskStarted(work);
       g_mutex_unlock(gState.lock);
    }
 
@@ -242,11 +422,12 @@ ToolsCorePoolRunThread(gpointer data)
  *******************************************************************************
  * ToolsCorePoolRunWorker --                                              */ /**
  *
- * Thread pool callback function. Dequeues the next work item from the work
- * queue and execute it.
+ * Thread pool callback function. Executes the task chosen by the scheduler,
+ * then schedules the tasks that were waiting for the worker it was using.
+ * Tasks that hadn't started when the pool was shut down are discarded.
  *
- * @param[in] state        Description of state.
- * @param[in] clientData   Description of clientData.
+ * @param[in] state        A WorkerTask.
+ * @param[in] clientData   Unused.
  *
  *******************************************************************************
  */
@@ -255,31 +436,53 @@ static void
 ToolsCorePoolRunWorker(gpointer state,
                        gpointer clientData)
 {
-   WorkerTask *work;
+   WorkerTask *work = state;
+   gboolean active;
+   guint count;
 
    g_mutex_lock(gState.lock);
-   work = g_queue_pop_tail(gState.workQueue);
+   active = gState.active;
+   if (active) {
+      ToolsCorePoolTaskStarted(work);
+   }
    g_mutex_unlock(gState.lock);
 
-   ASSERT(work != NULL);
+   if (active) {
+      ToolsCorePoolDoWork(work);
+   }
+
+   g_mutex_lock(gState.lock);
+   count = GPOINTER_TO_UINT(g_hash_table_lookup(gState.owners, work->owner));
+   ASSERT(count > 0);
+   if (count > 1) {
+      g_hash_table_insert(gState.owners, g_strdup(work->owner),
+                          GUINT_TO_POINTER(count - 1));
+   } else {
+      g_hash_table_remove(gState.owners, work->owner);
+   }
+   gState.lanes[work->priority].running--;
+   gState.running--;
+   ToolsCorePoolSchedule();
+   g_mutex_unlock(gState.lock);
 
-   ToolsCorePoolDoWork(work);
    ToolsCorePoolDestroyTask(work);
 }
 
 
 /*
  *******************************************************************************
- * ToolsCorePoolSubmit --                                                 */ /**
+ * ToolsCorePoolSubmitPriority --                                         */ /**
  *
  * Submits a new task for execution in one of the shared worker threads.
  *
- * @see ToolsCorePool_SubmitTask()
+ * @see ToolsCorePool_SubmitPriorityTask()
  *
- * @param[in] ctx    Application context.
- * @param[in] cb     Function to execute the task.
- * @param[in] data   Opaque data for the task.
- * @param[in] dtor   Destructor for the task data.
+ * @param[in] ctx       Application context.
+ * @param[in] cb        Function to execute the task.
+ * @param[in] data      Opaque data for the task.
+ * @param[in] dtor      Destructor for the task data.
+ * @param[in] priority  Priority class of the task.
+ * @param[in] owner     Who submitted the task, may be NULL.
  *
  * @return New task's ID, or 0 on error.
  *
@@ -287,22 +490,39 @@ ToolsCorePoolRunWorker(gpointer state,
  */
 
 static guint
-ToolsCorePoolSubmit(ToolsAppCtx *ctx,
-                    ToolsCorePoolCb cb,
-                    gpointer data,
-                    GDestroyNotify dtor)
+ToolsCorePoolSubmitPriority(ToolsAppCtx *ctx,
+                            ToolsCorePoolCb cb,
+                            gpointer data,
+                            GDestroyNotify dtor,
+                            ToolsCorePoolPriority priority,
+                            const gchar *owner)
 {
+   /* Main loop priority of the tasks in single threaded mode. */
+   static const gint idlePriorities[] = {
+      G_PRIORITY_HIGH_IDLE,
+      G_PRIORITY_DEFAULT_IDLE,
+      G_PRIORITY_LOW,
+   };
    guint id = 0;
-   WorkerTask *task = g_malloc0(sizeof *task);
+   ThreadPoolLane *lane;
+   WorkerTask *task;
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(idlePriorities) == TOOLS_CORE_POOL_PRIORITY_MAX);
+   g_return_val_if_fail((guint) priority < TOOLS_CORE_POOL_PRIORITY_MAX, 0);
 
+   task = g_malloc0(sizeof *task);
    task->srcId = 0;
    task->cb = cb;
    task->data = data;
    task->dtor = dtor;
+   task->priority = priority;
+   task->owner = g_strdup(owner != NULL ? owner : UNKNOWN_OWNER);
+   task->queued = Hostinfo_SystemTimerUS();
 
    g_mutex_lock(gState.lock);
 
    if (!gState.active) {
+      g_free(task->owner);
       g_free(task);
       goto exit;
    }
@@ -328,34 +548,58 @@ ToolsCorePoolSubmit(ToolsAppCtx *ctx,
     * that it can be canceled. In single threaded mode, it's unlikely someone
     * will be able to cancel it before it runs, but they can try.
     */
-   g_queue_push_head(gState.workQueue, task);
+   lane = &gState.lanes[priority];
+   g_queue_push_head(lane->queue, task);
+   if (g_queue_get_length(lane->queue) > lane->maxDepth) {
+      lane->maxDepth = g_queue_get_length(lane->queue);
+   }
 
    if (gState.pool != NULL) {
-      GError *err = NULL;
-
-      /* The client data pointer is bogus, just to avoid passing NULL. */
-      g_thread_pool_push(gState.pool, &gState, &err);
-      if (err == NULL) {
-         goto exit;
-      } else {
-         g_warning("error sending work request, executing in service thread: %s",
-                   err->message);
-         g_clear_error(&err);
-      }
+      ToolsCorePoolSchedule();
+   } else {
+      /* Run the task in the service's thread. */
+      task->srcId = g_idle_add_full(idlePriorities[priority],
+                                    ToolsCorePoolDoWork,
+                                    task,
+                                    ToolsCorePoolDestroyTask);
    }
 
-   /* Run the task in the service's thread. */
-   task->srcId = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                                 ToolsCorePoolDoWork,
-                                 task,
-                                 ToolsCorePoolDestroyTask);
-
 exit:
    g_mutex_unlock(gState.lock);
    return id;
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePoolSubmit --                                                 */ /**
+ *
+ * Submits a new task with normal priority and no owner. This is what plugins
+ * built before priorities were introduced call.
+ *
+ * @see ToolsCorePool_SubmitTask()
+ *
+ * @param[in] ctx    Application context.
+ * @param[in] cb     Function to execute the task.
+ * @param[in] data   Opaque data for the task.
+ * @param[in] dtor   Destructor for the task data.
+ *
+ * @return New task's ID, or 0 on error.
+ *
+ *******************************************************************************
+ */
+
+static guint
+ToolsCorePoolSubmit(ToolsAppCtx *ctx,
+                    ToolsCorePoolCb cb,
+                    gpointer data,
+                    GDestroyNotify dtor)
+{
+   return ToolsCorePoolSubmitPriority(ctx, cb, data, dtor,
+                                      TOOLS_CORE_POOL_PRIORITY_NORMAL, NULL);
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePoolCancel --                                                 */ /**
@@ -373,8 +617,8 @@ static void
 ToolsCorePoolCancel(guint id)
 {
    GList *taskLnk;
+   ThreadPoolLane *lane;
    WorkerTask *task = NULL;
-   WorkerTask search = { id, };
 
    g_return_if_fail(id != 0);
 
@@ -383,10 +627,10 @@ ToolsCorePoolCancel(guint id)
       goto exit;
    }
 
-   taskLnk = g_queue_find_custom(gState.workQueue, &search, ToolsCorePoolCompareTask);
+   taskLnk = ToolsCorePoolFindTask(id, &lane);
    if (taskLnk != NULL) {
       task = taskLnk->data;
-      g_queue_delete_link(gState.workQueue, taskLnk);
+      g_queue_delete_link(lane->queue, taskLnk);
    }
 
 exit:
@@ -468,6 +712,12 @@ exit:
  * can have different configuration. Exports the thread pool functions through
  * the service's object.
  *
+ * Besides the size of the pool, the configuration sets how many extra workers
+ * are reserved for critical tasks ("pool.reservedThreads") and how many tasks
+ * of the same owner may run at the same time ("pool.maxThreadsPerPlugin", by
+ * default all but one of the regular workers). Bulk tasks get all but one of
+ * the regular workers, so an enabled pool has at least two.
+ *
  * @param[in] ctx Application context.
  *
  *******************************************************************************
@@ -477,6 +727,9 @@ void
 ToolsCorePool_Init(ToolsAppCtx *ctx)
 {
    gint maxThreads;
+   gint reserved;
+   gint maxPerOwner;
+   guint i;
    GError *err = NULL;
 
    ToolsServiceProperty prop = { TOOLS_CORE_PROP_TPOOL };
@@ -484,6 +737,7 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
    gState.funcs.submit = ToolsCorePoolSubmit;
    gState.funcs.cancel = ToolsCorePoolCancel;
    gState.funcs.start = ToolsCorePoolStart;
+   gState.funcs.submitPriority = ToolsCorePoolSubmitPriority;
    gState.ctx = ctx;
 
    maxThreads = g_key_file_get_integer(ctx->config, ctx->name,
@@ -493,9 +747,37 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
       g_clear_error(&err);
    }
 
+   reserved = g_key_file_get_integer(ctx->config, ctx->name,
+                                     "pool.reservedThreads", &err);
+   if (err != NULL || reserved < 0) {
+      reserved = DEFAULT_RESERVED_THREADS;
+      g_clear_error(&err);
+   }
+
+   /*
+    * Bulk tasks must always leave a regular worker free, so a pool needs at
+    * least two of them.
+    */
+   if (maxThreads == 1) {
+      g_message("pool.maxThreads must be 0 or at least 2, using 2.");
+      maxThreads = 2;
+   }
+
+   maxPerOwner = g_key_file_get_integer(ctx->config, ctx->name,
+                                        "pool.maxThreadsPerPlugin", &err);
+   if (err != NULL || maxPerOwner <= 0) {
+      maxPerOwner = MAX(maxThreads - 1, 1);
+      g_clear_error(&err);
+   }
+
+   gState.maxPerOwner = maxPerOwner;
+   gState.lanes[TOOLS_CORE_POOL_PRIORITY_CRITICAL].maxRunning = maxThreads + reserved;
+   gState.lanes[TOOLS_CORE_POOL_PRIORITY_NORMAL].maxRunning = maxThreads;
+   gState.lanes[TOOLS_CORE_POOL_PRIORITY_BULK].maxRunning = MAX(maxThreads - 1, 0);
+
    if (maxThreads > 0) {
       gState.pool = g_thread_pool_new(ToolsCorePoolRunWorker,
-                                      NULL, maxThreads, FALSE, &err);
+                                      NULL, maxThreads + reserved, FALSE, &err);
       if (err == NULL) {
 #if GLIB_CHECK_VERSION(2, 10, 0)
          gint maxIdleTime;
@@ -528,13 +810,72 @@ ToolsCorePool_Init(ToolsAppCtx *ctx)
    gState.active = TRUE;
    gState.lock = g_mutex_new();
    gState.threads = g_ptr_array_new();
-   gState.workQueue = g_queue_new();
+   gState.owners = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+   for (i = 0; i < ARRAYSIZE(gState.lanes); i++) {
+      gState.lanes[i].queue = g_queue_new();
+   }
 
    ToolsCoreService_RegisterProperty(ctx->serviceObj, &prop);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, &gState.funcs, NULL);
 }
 
 
+/*
+ *******************************************************************************
+ * ToolsCorePool_DumpState --                                             */ /**
+ *
+ * Logs the state of each priority lane of the pool: how many tasks are queued
+ * and running, the deepest the queue has been, and how long tasks waited in
+ * the queue before starting.
+ *
+ *******************************************************************************
+ */
+
+void
+ToolsCorePool_DumpState(void)
+{
+   static const char *laneNames[] = {
+      "critical",
+      "normal",
+      "bulk",
+   };
+   guint i;
+
+   ASSERT_ON_COMPILE(ARRAYSIZE(laneNames) == TOOLS_CORE_POOL_PRIORITY_MAX);
+
+   if (gState.lock == NULL) {
+      return;
+   }
+
+   g_mutex_lock(gState.lock);
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Thread pool: %s, %u tasks running, at most %u per "
+                      "plugin\n",
+                      gState.pool != NULL ? "multi-threaded" : "single threaded",
+                      gState.running, gState.maxPerOwner);
+
+   for (i = 0; i < ARRAYSIZE(gState.lanes); i++) {
+      ThreadPoolLane *lane = &gState.lanes[i];
+
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "Thread pool %s lane: %u queued (max %u), %u running, "
+                         "%"FMT64"u started, wait avg %"FMT64"d us, "
+                         "max %"FMT64"d us\n",
+                         laneNames[i],
+                         g_queue_get_length(lane->queue),
+                         lane->maxDepth,
+                         lane->running,
+                         lane->started,
+                         lane->started > 0 ? lane->totalWait / (VmTimeType) lane->started
+                                           : 0,
+                         lane->maxWait);
+   }
+
+   g_mutex_unlock(gState.lock);
+}
+
+
 /*
  *******************************************************************************
  * ToolsCorePool_Shutdown --                                              */ /**
@@ -565,9 +906,12 @@ ToolsCorePool_Shutdown(ToolsAppCtx *ctx)
       }
    }
 
-   /* Stop the thread pool. */
+   /*
+    * Stop the thread pool. Tasks handed to the pool that haven't started yet
+    * are discarded by the workers, since the pool is no longer active.
+    */
    if (gState.pool != NULL) {
-      g_thread_pool_free(gState.pool, TRUE, TRUE);
+      g_thread_pool_free(gState.pool, FALSE, TRUE);
    }
 
    /* Join all spawned threads. */
@@ -577,18 +921,25 @@ ToolsCorePool_Shutdown(ToolsAppCtx *ctx)
    }
 
    /* Destroy all pending tasks. */
-   while (1) {
-      WorkerTask *task = g_queue_pop_tail(gState.workQueue);
-      if (task != NULL) {
-         ToolsCorePoolDestroyTask(task);
-      } else {
-         break;
+   for (i = 0; i < ARRAYSIZE(gState.lanes); i++) {
+      while (1) {
+         WorkerTask *task = g_queue_pop_tail(gState.lanes[i].queue);
+         if (task != NULL) {
+            if (task->srcId > 0) {
+               g_source_remove(task->srcId);
+            } else {
+               ToolsCorePoolDestroyTask(task);
+            }
+         } else {
+            break;
+         }
       }
+      g_queue_free(gState.lanes[i].queue);
    }
 
    /* Cleanup. */
    g_ptr_array_free(gState.threads, TRUE);
-   g_queue_free(gState.workQueue);
+   g_hash_table_destroy(gState.owners);
    g_mutex_free(gState.lock);
    memset(&gState, 0, sizeof gState);
    g_object_set(ctx->serviceObj, TOOLS_CORE_PROP_TPOOL, NULL, NULL);
@@ -32,6 +32,7 @@
 #include <glib-object.h>
 #include <gmodule.h>
 #include <time.h>
+#include "vm_basic_types.h"
 #include "vmware/tools/plugin.h"
 #include "vmware/tools/rpcdebug.h"
 
@@ -65,6 +66,20 @@ typedef struct ToolsAppProviderReg {
    ToolsAppProviderState   state;
 } ToolsAppProviderReg;
 
+/** Startup phases timed by the service, in the order they happen. */
+typedef enum {
+   TOOLS_PHASE_CONFIG,
+   TOOLS_PHASE_SETUP,
+   TOOLS_PHASE_RPC_INIT,
+   TOOLS_PHASE_RPC_START,
+   TOOLS_PHASE_PLUGINS_LOAD,
+   TOOLS_PHASE_PLUGINS_REGISTER,
+   TOOLS_PHASE_MAINLOOP,
+
+   /* Keep this as the last one, always. */
+   TOOLS_PHASE_MAX
+} ToolsCorePhase;
+
 /** Defines internal service state. */
 typedef struct ToolsServiceState {
    gchar         *name;
@@ -76,6 +91,7 @@ typedef struct ToolsServiceState {
    gchar         *commonPath;
    gchar         *pluginPath;
    GPtrArray     *plugins;
+   GPtrArray     *lazyPlugins;
 #if defined(_WIN32)
    gchar         *displayName;
 #else
@@ -86,6 +102,11 @@ typedef struct ToolsServiceState {
    RpcDebugLibData  *debugData;
    ToolsAppCtx    ctx;
    GArray        *providers;
+   VmTimeType     startTime;
+   VmTimeType     capsTime;
+   VmTimeType     phaseStart[TOOLS_PHASE_MAX];
+   VmTimeType     phaseTime[TOOLS_PHASE_MAX];
+   gchar         *timeline;
 } ToolsServiceState;
 
 
@@ -100,6 +121,13 @@ ToolsCore_DumpPluginInfo(ToolsServiceState *state);
 void
 ToolsCore_DumpState(ToolsServiceState *state);
 
+void
+ToolsCore_FormatPluginTimes(ToolsServiceState *state,
+                            GString *str);
+
+gchar *
+ToolsCore_FormatTimeline(ToolsServiceState *state);
+
 const char *
 ToolsCore_GetTcloName(ToolsServiceState *state);
 
@@ -122,6 +150,17 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
 void
 ToolsCore_RegisterPlugins(ToolsServiceState *state);
 
+void
+ToolsCore_PhaseBegin(ToolsServiceState *state,
+                     ToolsCorePhase phase);
+
+void
+ToolsCore_PhaseEnd(ToolsServiceState *state,
+                   ToolsCorePhase phase);
+
+void
+ToolsCore_PublishTimeline(ToolsServiceState *state);
+
 void
 ToolsCore_SetCapabilities(RpcChannel *chan,
                           GArray *caps,
@@ -135,11 +174,35 @@ void
 ToolsCore_CFRunLoop(ToolsServiceState *state);
 #endif
 
+void
+ToolsCorePool_DumpState(void);
+
 void
 ToolsCorePool_Init(ToolsAppCtx *ctx);
 
 void
 ToolsCorePool_Shutdown(ToolsAppCtx *ctx);
 
+void
+ToolsCoreDispatch_Init(ToolsAppCtx *ctx);
+
+void
+ToolsCoreDispatch_LoadConfig(ToolsAppCtx *ctx);
+
+void
+ToolsCoreDispatch_SetRpcOwner(const gchar *rpc,
+                              const gchar *owner);
+
+void
+ToolsCoreDispatch_MonitorClosure(GClosure *closure,
+                                 const gchar *owner,
+                                 const gchar *signame);
+
+void
+ToolsCoreDispatch_DumpState(void);
+
+void
+ToolsCoreDispatch_Shutdown(void);
+
 #endif /* _TOOLSCOREINT_H_ */
 
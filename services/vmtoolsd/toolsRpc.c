@@ -33,6 +33,7 @@
 #include "vm_basic_defs.h"
 #include "vm_assert.h"
 #include "conf.h"
+#include "hostinfo.h"
 #include "str.h"
 #include "strutil.h"
 #include "toolsCoreInt.h"
@@ -194,6 +195,12 @@ ToolsCoreRpcCapReg(RpcInData *data)
    }
 
    state->capsRegistered = TRUE;
+   if (state->capsTime == 0) {
+      state->capsTime = Hostinfo_SystemTimerUS();
+      if (state->timeline != NULL) {
+         ToolsCore_PublishTimeline(state);
+      }
+   }
    free(confPath);
    return RPCIN_SETRETVALS(data, "", TRUE);
 }
@@ -0,0 +1,438 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * diskInfoTest.c --
+ *
+ *      Checks that guestInfo only enumerates the partitions again when the
+ *      mount table changes. The test moves to a mount namespace of its own,
+ *      and mounts and unmounts tmpfs file systems there. After each step, it
+ *      gets the disk info, counts the enumerations (which the disk info code
+ *      logs), and compares the disk info with a fresh enumeration.
+ *
+ *      tmpfs file systems are not reported in the disk info, but mounting
+ *      them changes the mount table. When a reported partition exists, the
+ *      test also bind mounts it, which adds a partition, and checks how the
+ *      free space is updated.
+ *
+ *      Creating a mount namespace needs root; the test is skipped when it
+ *      can't be done.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#  include <sched.h>
+#  include <unistd.h>
+#  include <sys/mount.h>
+#  include <sys/stat.h>
+#endif
+
+#include "vmware.h"
+#include "guestInfoInt.h"
+#include <glib/gstdio.h>
+
+#if defined(__linux__)
+
+/* Size of the file written to change a partition's free space. */
+#define DISKINFO_TEST_FILE_SIZE  (4 * 1024 * 1024)
+
+static guint gEnumerations = 0;
+static gchar *gBase = NULL;
+static gboolean gFailed = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DiskInfoTestLog --
+ *
+ *      Debug log handler of the disk info code; counts the enumerations.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates gEnumerations.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+DiskInfoTestLog(const gchar *domain,      // IN
+                GLogLevelFlags level,     // IN
+                const gchar *message,     // IN
+                gpointer data)            // IN
+{
+   if (strstr(message, "Enumerating partitions") != NULL) {
+      gEnumerations++;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DiskInfoTestFind --
+ *
+ *      Looks for a partition in disk info.
+ *
+ * Results:
+ *      The partition's entry, or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static PPartitionEntry
+DiskInfoTestFind(GuestDiskInfo *di,       // IN
+                 const char *name)        // IN
+{
+   unsigned int i;
+
+   for (i = 0; i < di->numEntries; i++) {
+      if (strcmp(di->partitionList[i].name, name) == 0) {
+         return &di->partitionList[i];
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DiskInfoTestStep --
+ *
+ *      Gets the disk info, and checks the number of enumerations made and of
+ *      partitions found. Unless the free space is expected to be cached, the
+ *      disk info must match a fresh enumeration.
+ *
+ * Results:
+ *      The disk info, or NULL on failure. Free with GuestInfo_FreeDiskInfo.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static GuestDiskInfo *
+DiskInfoTestStep(const char *step,        // IN
+                 guint enumerations,      // IN
+                 unsigned int partitions, // IN
+                 gboolean cached)         // IN
+{
+   guint before = gEnumerations;
+   GuestDiskInfo *di = GuestInfo_GetDiskInfo();
+   GuestDiskInfo *fresh;
+   gboolean ok;
+   unsigned int i;
+
+   if (di == NULL) {
+      g_print("%-40s GuestInfo_GetDiskInfo failed: FAILED\n", step);
+      gFailed = TRUE;
+      return NULL;
+   }
+
+   ok = gEnumerations - before == enumerations &&
+        di->numEntries == partitions;
+
+   fresh = GuestInfoGetDiskInfoWiper();
+   if (fresh == NULL || fresh->numEntries != di->numEntries) {
+      ok = FALSE;
+   } else {
+      for (i = 0; i < di->numEntries; i++) {
+         PPartitionEntry entry = &di->partitionList[i];
+         PPartitionEntry freshEntry = DiskInfoTestFind(fresh, entry->name);
+
+         if (freshEntry == NULL ||
+             freshEntry->totalBytes != entry->totalBytes ||
+             (!cached && freshEntry->freeBytes != entry->freeBytes)) {
+            ok = FALSE;
+         }
+      }
+   }
+   GuestInfo_FreeDiskInfo(fresh);
+
+   g_print("%-40s %u enumerations, %u partitions: %s\n", step,
+           gEnumerations - before, di->numEntries, ok ? "ok" : "FAILED");
+   if (!ok) {
+      g_print("%-40s %u enumerations, %u partitions expected\n", "",
+              enumerations, partitions);
+      gFailed = TRUE;
+   }
+
+   return di;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DiskInfoTestMount --
+ *
+ *      Mounts a tmpfs file system, or bind mounts a directory, on a
+ *      directory under the test's base directory.
+ *
+ * Results:
+ *      The mount point, or NULL on failure. Free with g_free.
+ *
+ * Side effects:
+ *      Sets gFailed on failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gchar *
+DiskInfoTestMount(const char *name,       // IN
+                  const char *bindFrom)   // IN: NULL for tmpfs
+{
+   gchar *path = g_build_filename(gBase, name, NULL);
+   int rc;
+
+   g_mkdir(path, 0700);
+   if (bindFrom != NULL) {
+      rc = mount(bindFrom, path, NULL, MS_BIND, NULL);
+   } else {
+      rc = mount("diskInfoTest", path, "tmpfs", 0, "size=1m");
+   }
+
+   if (rc != 0) {
+      g_print("Cannot mount %s: %s\n", path, g_strerror(errno));
+      gFailed = TRUE;
+      g_rmdir(path);
+      g_free(path);
+      return NULL;
+   }
+
+   return path;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DiskInfoTestUnmount --
+ *
+ *      Unmounts a mount point made by DiskInfoTestMount.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees @path.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+DiskInfoTestUnmount(gchar *path)          // IN
+{
+   if (path != NULL) {
+      if (umount(path) != 0) {
+         g_print("Cannot unmount %s: %s\n", path, g_strerror(errno));
+         gFailed = TRUE;
+      }
+      g_rmdir(path);
+      g_free(path);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DiskInfoTestSpace --
+ *
+ *      Writes a file to a reported partition, and checks that its free space
+ *      is only updated when the space update interval allows.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes and deletes a file on the partition. Sets gFailed on failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+DiskInfoTestSpace(const char *partition,  // IN
+                  unsigned int partitions)// IN
+{
+   gchar *path = g_build_filename(partition, "diskInfoTest.tmp", NULL);
+   gchar *data = g_malloc0(DISKINFO_TEST_FILE_SIZE);
+   GuestDiskInfo *before;
+   GuestDiskInfo *after;
+   FILE *f;
+
+   GuestInfo_SetDiskSpaceInterval(3600);
+   before = DiskInfoTestStep("space interval set to 1h", 0, partitions, TRUE);
+
+   f = g_fopen(path, "w");
+   if (f == NULL ||
+       fwrite(data, DISKINFO_TEST_FILE_SIZE, 1, f) != 1 ||
+       fflush(f) != 0 ||
+       fsync(fileno(f)) != 0) {
+      g_print("Cannot write %s\n", path);
+      gFailed = TRUE;
+   }
+   if (f != NULL) {
+      fclose(f);
+   }
+
+   after = DiskInfoTestStep("file written, space cached", 0, partitions,
+                            TRUE);
+   if (before != NULL && after != NULL &&
+       DiskInfoTestFind(after, partition)->freeBytes !=
+       DiskInfoTestFind(before, partition)->freeBytes) {
+      g_print("%-40s free space changed: FAILED\n", "");
+      gFailed = TRUE;
+   }
+   GuestInfo_FreeDiskInfo(after);
+
+   GuestInfo_SetDiskSpaceInterval(0);
+   after = DiskInfoTestStep("space interval set to 0", 0, partitions, FALSE);
+   if (before != NULL && after != NULL &&
+       DiskInfoTestFind(after, partition)->freeBytes ==
+       DiskInfoTestFind(before, partition)->freeBytes) {
+      g_print("%-40s free space not updated: FAILED\n", "");
+      gFailed = TRUE;
+   }
+   GuestInfo_FreeDiskInfo(after);
+   GuestInfo_FreeDiskInfo(before);
+
+   g_unlink(path);
+   g_free(data);
+   g_free(path);
+}
+
+#endif // if defined(__linux__)
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the test steps.
+ *
+ * Results:
+ *      0 on success or when skipped, 1 on failure.
+ *
+ * Side effects:
+ *      Mounts file systems in a private mount namespace.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+#if defined(__linux__)
+   GuestDiskInfo *di;
+   gchar *partition = NULL;
+   gchar *first;
+   gchar *second;
+   unsigned int partitions;
+
+   if (unshare(CLONE_NEWNS) != 0 ||
+       mount("none", "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0) {
+      g_print("Cannot create a mount namespace (not root?).\nSKIPPED\n");
+      return 0;
+   }
+
+   g_log_set_handler("guestinfo", G_LOG_LEVEL_DEBUG, DiskInfoTestLog, NULL);
+
+   gBase = g_build_filename(g_get_tmp_dir(), "diskInfoTest.XXXXXX", NULL);
+   if (mkdtemp(gBase) == NULL) {
+      g_print("Cannot create %s.\nFAILED\n", gBase);
+      return 1;
+   }
+
+   di = GuestInfoGetDiskInfoWiper();
+   if (di == NULL) {
+      g_rmdir(gBase);
+      g_print("Cannot get the disk info.\nFAILED\n");
+      return 1;
+   }
+   partitions = di->numEntries;
+   if (partitions > 0) {
+      partition = g_strdup(di->partitionList[0].name);
+   }
+   GuestInfo_FreeDiskInfo(di);
+
+   GuestInfo_SetDiskSpaceInterval(0);
+
+   GuestInfo_FreeDiskInfo(DiskInfoTestStep("first call", 1, partitions,
+                                           FALSE));
+   GuestInfo_FreeDiskInfo(DiskInfoTestStep("no change", 0, partitions,
+                                           FALSE));
+
+   first = DiskInfoTestMount("first", NULL);
+   GuestInfo_FreeDiskInfo(DiskInfoTestStep("tmpfs mounted", 1, partitions,
+                                           FALSE));
+   GuestInfo_FreeDiskInfo(DiskInfoTestStep("no change", 0, partitions,
+                                           FALSE));
+
+   /* Several changes between two calls take one enumeration. */
+   second = DiskInfoTestMount("second", NULL);
+   DiskInfoTestUnmount(first);
+   GuestInfo_FreeDiskInfo(DiskInfoTestStep("tmpfs mounted and unmounted", 1,
+                                           partitions, FALSE));
+
+   if (partition != NULL) {
+      gchar *bind = DiskInfoTestMount("bind", partition);
+
+      GuestInfo_FreeDiskInfo(DiskInfoTestStep("partition bind mounted", 1,
+                                              partitions + 1, FALSE));
+      if (bind != NULL) {
+         DiskInfoTestSpace(bind, partitions + 1);
+      }
+      DiskInfoTestUnmount(bind);
+      GuestInfo_FreeDiskInfo(DiskInfoTestStep("bind mount unmounted", 1,
+                                              partitions, FALSE));
+   } else {
+      g_print("No partition reported, not testing bind mounts.\n");
+   }
+
+   DiskInfoTestUnmount(second);
+   GuestInfo_FreeDiskInfo(DiskInfoTestStep("tmpfs unmounted", 1, partitions,
+                                           FALSE));
+
+   GuestInfo_StopDiskInfoMonitor();
+   g_rmdir(gBase);
+   g_free(gBase);
+   g_free(partition);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+#else
+   g_print("Mount change detection is only available on Linux.\nSKIPPED\n");
+   return 0;
+#endif
+}
@@ -0,0 +1,449 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * fileLoggerTest.c --
+ *
+ *      Checks the rotation of the file logger's old log files, in a
+ *      temporary directory. Every log file starts with a line naming the
+ *      generation it was written in, and each generation fills a log file,
+ *      so that the test knows which generation each old log file must hold:
+ *
+ *       - old log files are renumbered, newest first, and the oldest ones
+ *         go once there are too many of them;
+ *       - with zlib, every old log file is compressed;
+ *       - the oldest files go once the old log files take too much space,
+ *         but the newest one is kept;
+ *       - rotated files left behind by a process that died before archiving
+ *         them are archived, in order, before the current log file.
+ *
+ *      Destroying a logger waits for its rotation worker, so the directory
+ *      is checked right after that. A stuck test is caught by an alarm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#if defined(HAVE_ZLIB)
+#  include <zlib.h>
+#endif
+
+#include "vmware.h"
+#include "glibUtils.h"
+
+/* Log file size used by the tests, in MB. */
+#define FILELOGGERTEST_MAX_SIZE     1
+
+/* Bytes written per generation: a bit more than a log file takes. */
+#define FILELOGGERTEST_GEN_SIZE     (FILELOGGERTEST_MAX_SIZE * 1024 * 1024 + \
+                                     64 * 1024)
+
+#define FILELOGGERTEST_GENERATIONS  5
+
+/* Seconds before a stuck test is killed. */
+#define FILELOGGERTEST_TIMEOUT      60
+
+static gchar *gDir;
+static gboolean gFailed = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestPath --
+ *
+ *      Builds the path of a file in the test directory.
+ *
+ * Results:
+ *      The path, to be freed with g_free().
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gchar *
+FileLoggerTestPath(const gchar *name)    // IN
+{
+   return g_build_filename(gDir, name, NULL);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestClean --
+ *
+ *      Deletes the files in the test directory.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileLoggerTestClean(void)
+{
+   GDir *dir = g_dir_open(gDir, 0, NULL);
+   const gchar *name;
+
+   if (dir == NULL) {
+      return;
+   }
+   while ((name = g_dir_read_name(dir)) != NULL) {
+      gchar *path = FileLoggerTestPath(name);
+      g_unlink(path);
+      g_free(path);
+   }
+   g_dir_close(dir);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestWriteGen --
+ *
+ *      Logs one generation: its name, then incompressible data, so that
+ *      the file sizes don't depend on how well zlib does.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Rotates the log file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileLoggerTestWriteGen(GlibLogger *logger,   // IN
+                       guint gen)            // IN
+{
+   static guint32 seed = 1;
+   gchar *msg = g_malloc(FILELOGGERTEST_GEN_SIZE + 1);
+   gint len;
+   gint i;
+
+   len = g_snprintf(msg, FILELOGGERTEST_GEN_SIZE, "gen %u\n", gen);
+   for (i = len; i < FILELOGGERTEST_GEN_SIZE; i++) {
+      seed = seed * 1103515245 + 12345;
+      msg[i] = (gchar) (1 + (seed >> 16) % 255);
+   }
+   msg[FILELOGGERTEST_GEN_SIZE] = '\0';
+
+   logger->logfn(G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE, msg, logger);
+   g_free(msg);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestWriteFile --
+ *
+ *      Creates a file holding a generation's name.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileLoggerTestWriteFile(const gchar *name,   // IN
+                        guint gen)           // IN
+{
+   gchar *path = FileLoggerTestPath(name);
+   gchar *contents = g_strdup_printf("gen %u\n", gen);
+
+   g_file_set_contents(path, contents, -1, NULL);
+   g_free(contents);
+   g_free(path);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestReadGen --
+ *
+ *      Reads the generation an old log file was written in.
+ *
+ * Results:
+ *      The generation, -1 if the file doesn't exist, -2 if it can't be read.
+ *      'compressed' tells whether the file has a ".gz" suffix.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gint
+FileLoggerTestReadGen(guint index,            // IN
+                      gboolean *compressed)   // OUT
+{
+   gchar *name = g_strdup_printf("test.%u.log", index);
+   gchar *path = FileLoggerTestPath(name);
+   gchar *gzpath = g_strconcat(path, ".gz", NULL);
+   gchar line[32] = "";
+   gboolean found = FALSE;
+   guint gen;
+
+   *compressed = g_file_test(gzpath, G_FILE_TEST_EXISTS);
+   if (*compressed) {
+#if defined(HAVE_ZLIB)
+      gzFile in = gzopen(gzpath, "rb");
+      if (in != NULL) {
+         if (gzgets(in, line, sizeof line) == NULL) {
+            line[0] = '\0';
+         }
+         gzclose(in);
+      }
+#endif
+      found = TRUE;
+   } else {
+      FILE *in = g_fopen(path, "rb");
+      if (in != NULL) {
+         found = TRUE;
+         if (fgets(line, sizeof line, in) == NULL) {
+            line[0] = '\0';
+         }
+         fclose(in);
+      }
+   }
+
+   g_free(gzpath);
+   g_free(path);
+   g_free(name);
+
+   if (!found) {
+      return -1;
+   }
+   return sscanf(line, "gen %u", &gen) == 1 ? (gint) gen : -2;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestCheck --
+ *
+ *      Compares a value with its expected value.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileLoggerTestCheck(const char *what,    // IN
+                    gint value,          // IN
+                    gint expected)       // IN
+{
+   gboolean ok = value == expected;
+
+   g_print("%-40s %4d: %s\n", what, value, ok ? "ok" : "FAILED");
+   if (!ok) {
+      g_print("%-40s %4d expected\n", "", expected);
+      gFailed = TRUE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestCheckOld --
+ *
+ *      Checks the generation held by each old log file, -1 meaning that
+ *      there must be no such file, and that the old log files are
+ *      compressed when zlib is available.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileLoggerTestCheckOld(const char *test,        // IN
+                       const gint *expected,    // IN
+                       guint count)             // IN
+{
+   guint i;
+
+   for (i = 0; i < count; i++) {
+      gboolean compressed;
+      gchar *what = g_strdup_printf("%s: old file %u", test, i + 1);
+      gint gen = FileLoggerTestReadGen(i + 1, &compressed);
+
+      FileLoggerTestCheck(what, gen, expected[i]);
+      g_free(what);
+      if (gen >= 0) {
+         what = g_strdup_printf("%s: old file %u compressed", test, i + 1);
+#if defined(HAVE_ZLIB)
+         FileLoggerTestCheck(what, compressed, TRUE);
+#else
+         FileLoggerTestCheck(what, compressed, FALSE);
+#endif
+         g_free(what);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileLoggerTestRun --
+ *
+ *      Logs a number of generations to a new logger, and destroys it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FileLoggerTestRun(guint firstGen,    // IN
+                  guint gens,        // IN
+                  guint maxFiles,    // IN
+                  guint maxSpace)    // IN
+{
+   gchar *path = FileLoggerTestPath("test.log");
+   GlibLogger *logger;
+   guint i;
+
+   logger = GlibUtils_CreateFileLogger(path, FALSE, FILELOGGERTEST_MAX_SIZE,
+                                       maxFiles, maxSpace);
+   for (i = 0; i < gens; i++) {
+      FileLoggerTestWriteGen(logger, firstGen + i);
+   }
+   logger->dtor(logger);
+   g_free(path);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the test steps.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   static const gint renumbered[] = { 4, 3, 2, -1 };
+   static const gint capped[] = { 4, 3, -1 };
+   static const gint newest[] = { 4, -1 };
+   static const gint recovered[] = { 3, 2, 1, 0, -1 };
+   gchar *tmpl;
+   gchar *path;
+
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+   alarm(FILELOGGERTEST_TIMEOUT);
+
+   tmpl = g_build_filename(g_get_tmp_dir(), "fileLoggerTestXXXXXX", NULL);
+   gDir = mkdtemp(tmpl);
+   if (gDir == NULL) {
+      g_print("Cannot create a temporary directory.\nFAILED\n");
+      return 1;
+   }
+
+   /*
+    * Five generations with three old log files kept, and plenty of space:
+    * the newest three are kept, newest first.
+    */
+   FileLoggerTestRun(0, FILELOGGERTEST_GENERATIONS, 3,
+                     100 * FILELOGGERTEST_MAX_SIZE);
+   FileLoggerTestCheckOld("renumbering", renumbered,
+                          G_N_ELEMENTS(renumbered));
+   FileLoggerTestClean();
+
+   /*
+    * Room for five old log files, but only three log files' worth of space:
+    * the third one goes over.
+    */
+   FileLoggerTestRun(0, FILELOGGERTEST_GENERATIONS, 5,
+                     3 * FILELOGGERTEST_MAX_SIZE);
+   FileLoggerTestCheckOld("space cap", capped, G_N_ELEMENTS(capped));
+   FileLoggerTestClean();
+
+   /* Space for less than one log file: the newest one is still kept. */
+   FileLoggerTestRun(0, FILELOGGERTEST_GENERATIONS, 5, 1);
+   FileLoggerTestCheckOld("newest kept", newest, G_N_ELEMENTS(newest));
+   FileLoggerTestClean();
+
+   /*
+    * Two rotated files left behind, and the log file written after them:
+    * opening the log file archives them first, then the log file, without
+    * overwriting them. The new generation then fills the log file.
+    */
+   FileLoggerTestWriteFile("test.log.rotating.0", 0);
+   FileLoggerTestWriteFile("test.log.rotating.1", 1);
+   FileLoggerTestWriteFile("test.log", 2);
+   FileLoggerTestRun(3, 1, 5, 100 * FILELOGGERTEST_MAX_SIZE);
+   FileLoggerTestCheckOld("recovery", recovered, G_N_ELEMENTS(recovered));
+   path = FileLoggerTestPath("test.log.rotating.0");
+   FileLoggerTestCheck("recovery: staged files left",
+                       g_file_test(path, G_FILE_TEST_EXISTS), FALSE);
+   g_free(path);
+   FileLoggerTestClean();
+
+   g_rmdir(gDir);
+   g_free(tmpl);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+}
@@ -0,0 +1,519 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsReplay.c --
+ *
+ *      Replays an HGFS request packet trace captured by the guest HGFS
+ *      server manager (see the hgfsServer plugin "traceFile" option)
+ *      against the local file system and reports per operation latency
+ *      distributions and overall throughput.
+ *
+ *      The guest policy exports the root of the file system, so the names
+ *      in a trace are absolute paths of the machine it was captured on.
+ *      Replays write, rename and delete those paths, so --root is
+ *      mandatory and must name a copy of that tree other than "/";
+ *      chroot(2) needs privileges, e.g. run the tool under "unshare -r".
+ *
+ *      File and search handles are not remapped. They match the capture
+ *      as long as the capture started with a fresh server and the same
+ *      opens succeed during the replay. Session ids are remapped.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define G_LOG_DOMAIN "hgfsReplay"
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServerManager.h"
+#include "hgfsTrace.h"
+#include <glib.h>
+
+#define HGFS_REPLAY_MAX_SESSIONS   16
+
+typedef struct HgfsReplayOpStats {
+   GArray *latency;          /* Replay latency samples, us (uint32). */
+   uint64 origLatency;       /* Sum of the captured latencies, us. */
+   uint32 errors;            /* Replies with a non-success status. */
+} HgfsReplayOpStats;
+
+typedef struct HgfsReplaySession {
+   uint64 captured;          /* Session id seen in the trace. */
+   uint64 live;              /* Session id issued by this server. */
+} HgfsReplaySession;
+
+typedef struct HgfsReplayState {
+   HgfsReplayOpStats ops[HGFS_OP_MAX];
+   HgfsReplaySession sessions[HGFS_REPLAY_MAX_SESSIONS];
+   uint32 sessionCount;
+   uint64 lastLiveSession;   /* Most recent session created by the replay. */
+   uint64 packets;
+   uint64 unknownOps;
+   uint64 bytesIn;
+   uint64 bytesOut;
+} HgfsReplayState;
+
+static gchar *gRoot = NULL;
+static gboolean gPaced = FALSE;
+static gint gIterations = 1;
+
+static GOptionEntry gOptions[] = {
+   { "root", 'r', 0, G_OPTION_ARG_FILENAME, &gRoot,
+     "chroot to DIR before replaying (required)", "DIR" },
+   { "paced", 'p', 0, G_OPTION_ARG_NONE, &gPaced,
+     "honor the captured inter-arrival times", NULL },
+   { "iterations", 'n', 0, G_OPTION_ARG_INT, &gIterations,
+     "replay the trace N times", "N" },
+   { NULL }
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReplayGetOp --
+ *
+ *      Extracts the operation and, for new style packets, the header
+ *      from a request packet.
+ *
+ * Results:
+ *      TRUE if the packet is large enough to hold a request header.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsReplayGetOp(const char *packet,     // IN: request packet
+                uint32 packetSize,      // IN: request packet size
+                HgfsOp *op,             // OUT: operation
+                HgfsHeader **header)    // OUT: new style header or NULL
+{
+   const HgfsRequest *request = (const HgfsRequest *)packet;
+
+   *header = NULL;
+   if (packetSize < sizeof *request) {
+      return FALSE;
+   }
+
+   if (request->op == HGFS_OP_NEW_HEADER) {
+      if (packetSize < sizeof (HgfsHeader)) {
+         return FALSE;
+      }
+      *header = (HgfsHeader *)packet;
+      *op = (*header)->op;
+   } else {
+      *op = request->op;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReplayMapSession --
+ *
+ *      Rewrites the session id in a new style request header so that it
+ *      names the session created by the replay instead of the captured one.
+ *
+ *      The first request seen for a captured session is assumed to belong
+ *      to the most recently created replay session.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Modifies the packet.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsReplayMapSession(HgfsReplayState *state,   // IN/OUT: replay state
+                     HgfsHeader *header)       // IN/OUT: request header
+{
+   uint32 i;
+
+   if (header->sessionId == 0 || header->op == HGFS_OP_CREATE_SESSION_V4) {
+      return;
+   }
+
+   for (i = 0; i < state->sessionCount; i++) {
+      if (state->sessions[i].captured == header->sessionId) {
+         header->sessionId = state->sessions[i].live;
+         return;
+      }
+   }
+
+   if (state->sessionCount < ARRAYSIZE(state->sessions)) {
+      state->sessions[state->sessionCount].captured = header->sessionId;
+      state->sessions[state->sessionCount].live = state->lastLiveSession;
+      state->sessionCount++;
+   }
+   header->sessionId = state->lastLiveSession;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReplayReplyFailed --
+ *
+ *      Checks the status of a reply packet and notes any session it created.
+ *
+ * Results:
+ *      TRUE if the reply reports an error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsReplayReplyFailed(HgfsReplayState *state,   // IN/OUT: replay state
+                      HgfsOp op,                // IN: request operation
+                      const char *reply,        // IN: reply packet
+                      size_t replySize)         // IN: reply packet size
+{
+   if (replySize >= sizeof (HgfsHeader) &&
+       ((const HgfsHeader *)reply)->dummy == HGFS_OP_NEW_HEADER) {
+      const HgfsHeader *header = (const HgfsHeader *)reply;
+
+      if (op == HGFS_OP_CREATE_SESSION_V4 && header->status == 0) {
+         state->lastLiveSession = header->sessionId;
+      }
+      return header->status != 0;
+   }
+   if (replySize >= sizeof (HgfsReply)) {
+      return ((const HgfsReply *)reply)->status != 0;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReplayTrace --
+ *
+ *      Replays every record of an open trace file through the HGFS server.
+ *
+ * Results:
+ *      TRUE if the whole trace was replayed.
+ *
+ * Side effects:
+ *      Whatever the replayed requests do to the file system.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsReplayTrace(FILE *trace,                  // IN: trace positioned at records
+                HgfsServerMgrData *mgrData,   // IN: registered hgfs server
+                HgfsReplayState *state)       // IN/OUT: replay state
+{
+   static char packet[HGFS_LARGE_PACKET_MAX];
+   static char reply[HGFS_LARGE_PACKET_MAX];
+   HgfsTraceRecord record;
+   VmTimeType replayStart = Hostinfo_SystemTimerUS();
+
+   while (fread(&record, sizeof record, 1, trace) == 1) {
+      HgfsHeader *header;
+      VmTimeType start;
+      VmTimeType latency;
+      size_t replySize;
+      HgfsOp op;
+      uint32 sample;
+
+      if (record.packetSize > sizeof packet ||
+          fread(packet, record.packetSize, 1, trace) != 1) {
+         g_warning("Truncated or corrupt trace record %"FMT64"u.\n",
+                   state->packets);
+         return FALSE;
+      }
+      state->packets++;
+
+      if (!HgfsReplayGetOp(packet, record.packetSize, &op, &header) ||
+          op >= HGFS_OP_MAX) {
+         state->unknownOps++;
+         continue;
+      }
+      if (NULL != header) {
+         HgfsReplayMapSession(state, header);
+      }
+
+      if (gPaced) {
+         VmTimeType elapsed = Hostinfo_SystemTimerUS() - replayStart;
+
+         if (record.timestamp > elapsed) {
+            usleep(record.timestamp - elapsed);
+         }
+      }
+
+      replySize = sizeof reply;
+      start = Hostinfo_SystemTimerUS();
+      if (!HgfsServerManager_ProcessPacket(mgrData, packet, record.packetSize,
+                                           reply, &replySize)) {
+         replySize = 0;
+      }
+      latency = Hostinfo_SystemTimerUS() - start;
+
+      sample = (uint32)MIN(latency, MAX_UINT32);
+      if (NULL == state->ops[op].latency) {
+         state->ops[op].latency = g_array_new(FALSE, FALSE, sizeof sample);
+      }
+      g_array_append_val(state->ops[op].latency, sample);
+      state->ops[op].origLatency += record.latency;
+      if (HgfsReplayReplyFailed(state, op, reply, replySize)) {
+         state->ops[op].errors++;
+      }
+      state->bytesIn += record.packetSize;
+      state->bytesOut += replySize;
+   }
+   return feof(trace);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReplayCompareLatency --
+ *
+ *      qsort comparison for latency samples.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsReplayCompareLatency(const void *a,   // IN
+                         const void *b)   // IN
+{
+   uint32 x = *(const uint32 *)a;
+   uint32 y = *(const uint32 *)b;
+
+   return (x > y) - (x < y);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReplayReport --
+ *
+ *      Prints the per operation latency distribution and throughput.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sorts the latency samples.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsReplayReport(HgfsReplayState *state,   // IN/OUT: replay state
+                 VmTimeType elapsed)       // IN: total replay time, us
+{
+   uint32 op;
+   double seconds = elapsed > 0 ? elapsed / 1000000.0 : 1e-6;
+
+   g_print("%4s %10s %8s %10s %10s %10s %10s %10s %10s\n", "op", "count",
+           "errors", "mean", "p50", "p90", "p99", "max", "orig mean");
+
+   for (op = 0; op < ARRAYSIZE(state->ops); op++) {
+      HgfsReplayOpStats *stats = &state->ops[op];
+      uint32 *samples;
+      uint64 sum = 0;
+      guint count;
+      guint i;
+
+      if (NULL == stats->latency) {
+         continue;
+      }
+      count = stats->latency->len;
+      samples = (uint32 *)stats->latency->data;
+      qsort(samples, count, sizeof *samples, HgfsReplayCompareLatency);
+      for (i = 0; i < count; i++) {
+         sum += samples[i];
+      }
+
+      g_print("%4u %10u %8u %10"FMT64"u %10u %10u %10u %10u %10"FMT64"u\n",
+              op, count, stats->errors, sum / count,
+              samples[count / 2], samples[(count * 9) / 10],
+              samples[(count * 99) / 100], samples[count - 1],
+              stats->origLatency / count);
+      g_array_free(stats->latency, TRUE);
+      stats->latency = NULL;
+   }
+
+   g_print("\n%"FMT64"u packets (%"FMT64"u skipped) in %.3f s: "
+           "%.0f ops/s, %.2f MB/s in, %.2f MB/s out. Latencies in us.\n",
+           state->packets, state->unknownOps, seconds,
+           (state->packets - state->unknownOps) / seconds,
+           state->bytesIn / seconds / (1024 * 1024),
+           state->bytesOut / seconds / (1024 * 1024));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReplayCheckRoot --
+ *
+ *      Checks the --root directory. The replay modifies the tree it runs
+ *      against, so the real root file system is refused, however it is
+ *      spelled.
+ *
+ * Results:
+ *      TRUE if the directory may be replayed against, FALSE otherwise.
+ *
+ * Side effects:
+ *      Prints an error on failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsReplayCheckRoot(const char *root)  // IN: --root argument or NULL
+{
+   char *resolved;
+   Bool ok;
+
+   if (NULL == root || '\0' == *root) {
+      g_printerr("--root is required.\n");
+      return FALSE;
+   }
+
+   resolved = realpath(root, NULL);
+   if (NULL == resolved) {
+      g_printerr("Cannot resolve %s: %s\n", root, strerror(errno));
+      return FALSE;
+   }
+
+   ok = strcmp(resolved, "/") != 0;
+   if (!ok) {
+      g_printerr("Refusing to replay against the root file system.\n");
+   }
+   free(resolved);
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Parses the options, registers an in process HGFS server and replays
+ *      the trace through it.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      See HgfsReplayTrace.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   GOptionContext *context;
+   GError *error = NULL;
+   HgfsServerMgrData mgrData;
+   HgfsTraceFileHeader header;
+   HgfsReplayState *state;
+   VmTimeType start;
+   Bool success = TRUE;
+   FILE *trace;
+   gint i;
+
+   context = g_option_context_new("TRACE - replay an HGFS packet trace");
+   g_option_context_add_main_entries(context, gOptions, NULL);
+   if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+      g_printerr("%s\n", error != NULL ? error->message :
+                                        "A trace file is required.");
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return 1;
+   }
+   g_option_context_free(context);
+
+   if (!HgfsReplayCheckRoot(gRoot)) {
+      return 1;
+   }
+
+   trace = fopen(argv[1], "rb");
+   if (NULL == trace) {
+      g_printerr("Cannot open %s: %s\n", argv[1], strerror(errno));
+      return 1;
+   }
+   if (fread(&header, sizeof header, 1, trace) != 1 ||
+       header.magic != HGFS_TRACE_MAGIC ||
+       header.version != HGFS_TRACE_VERSION ||
+       header.recordSize != sizeof (HgfsTraceRecord)) {
+      g_printerr("%s is not a supported HGFS trace.\n", argv[1]);
+      fclose(trace);
+      return 1;
+   }
+
+   if (chroot(gRoot) != 0 || chdir("/") != 0) {
+      g_printerr("Cannot chroot to %s: %s\n", gRoot, strerror(errno));
+      fclose(trace);
+      return 1;
+   }
+
+   HgfsServerManager_DataInit(&mgrData, "hgfsReplay", NULL, NULL);
+   if (!HgfsServerManager_Register(&mgrData)) {
+      g_printerr("Could not initialize the HGFS server.\n");
+      fclose(trace);
+      return 1;
+   }
+
+   state = g_new0(HgfsReplayState, 1);
+   start = Hostinfo_SystemTimerUS();
+   for (i = 0; success && i < MAX(gIterations, 1); i++) {
+      if (fseek(trace, header.headerSize, SEEK_SET) != 0) {
+         success = FALSE;
+         break;
+      }
+      state->sessionCount = 0;
+      success = HgfsReplayTrace(trace, &mgrData, state);
+   }
+   HgfsReplayReport(state, Hostinfo_SystemTimerUS() - start);
+
+   g_free(state);
+   HgfsServerManager_Unregister(&mgrData);
+   fclose(trace);
+
+   return success ? 0 : 1;
+}
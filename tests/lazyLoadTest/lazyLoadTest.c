@@ -0,0 +1,258 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file lazyLoadTest.c
+ *
+ * Tests the loading of plugins on demand. The same shared object is both a
+ * regular plugin, deferred by a manifest, and the debug plugin driving the
+ * test; since the service opens both through the same file, they share the
+ * static state below. The debug side checks that the plugin is not loaded
+ * at startup, and that the first RPC or signal listed in the manifest loads
+ * it and reaches the plugin's own handler:
+ *
+ *    - the RPC stub must dispatch the RPC again, arguments included, and
+ *      return the plugin's result;
+ *    - the signal stub must forward the emission, return value included, to
+ *      the plugin's handler, both when it triggers the load and afterwards.
+ *
+ * The lazyLoadTest.sh script in this directory sets up the plugin directory,
+ * manifest and config, and runs the service once with each trigger.
+ */
+
+#define G_LOG_DOMAIN "lazyLoadTest"
+
+#include <string.h>
+#include <glib-object.h>
+#include <CUnit/CUnit.h>
+
+#include "vm_basic_types.h"
+#include "vmware/tools/rpcdebug.h"
+
+#define LAZYLOADTEST_RPC      "test.lazy.echo"
+#define LAZYLOADTEST_ECHO     (LAZYLOADTEST_RPC " lazy args")
+#define LAZYLOADTEST_OPTION   ("Set_Option test.lazy.option 1")
+
+static gboolean
+LazyLoadTestValidateEcho(RpcInData *data, gboolean ret);
+
+static gboolean
+LazyLoadTestValidateOption(RpcInData *data, gboolean ret);
+
+/** The RPC is sent first: its stub loads the plugin. */
+static RpcDebugMsgMapping gRpcFirst[] = {
+   { LAZYLOADTEST_ECHO, sizeof LAZYLOADTEST_ECHO, LazyLoadTestValidateEcho, FALSE },
+   { LAZYLOADTEST_OPTION, sizeof LAZYLOADTEST_OPTION, LazyLoadTestValidateOption, FALSE },
+   { LAZYLOADTEST_ECHO, sizeof LAZYLOADTEST_ECHO, LazyLoadTestValidateEcho, FALSE },
+   { NULL, 0, NULL, FALSE }
+};
+
+/** The signal is emitted first: its stub loads the plugin. */
+static RpcDebugMsgMapping gSignalFirst[] = {
+   { LAZYLOADTEST_OPTION, sizeof LAZYLOADTEST_OPTION, LazyLoadTestValidateOption, FALSE },
+   { LAZYLOADTEST_ECHO, sizeof LAZYLOADTEST_ECHO, LazyLoadTestValidateEcho, FALSE },
+   { LAZYLOADTEST_OPTION, sizeof LAZYLOADTEST_OPTION, LazyLoadTestValidateOption, FALSE },
+   { NULL, 0, NULL, FALSE }
+};
+
+static gboolean gLoaded = FALSE;
+static guint gEchoCount = 0;
+static guint gOptionCount = 0;
+static guint gEchoSent = 0;
+static guint gOptionSent = 0;
+
+
+/**
+ * Echoes the RPC's arguments back.
+ *
+ * @param[in]  data     RPC data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+LazyLoadTestEcho(RpcInData *data)
+{
+   gEchoCount++;
+   while (data->argsSize > 0 && *data->args == ' ') {
+      data->args++;
+      data->argsSize--;
+   }
+   data->result = g_strndup(data->args, data->argsSize);
+   data->resultLen = strlen(data->result);
+   data->freeResult = TRUE;
+   return TRUE;
+}
+
+
+/**
+ * Handles the test option.
+ *
+ * @param[in]  src      Unused.
+ * @param[in]  ctx      Unused.
+ * @param[in]  option   Option being set.
+ * @param[in]  value    Option value.
+ * @param[in]  plugin   Unused.
+ *
+ * @return Whether the option is the test option.
+ */
+
+static gboolean
+LazyLoadTestSetOption(gpointer src,
+                      ToolsAppCtx *ctx,
+                      const gchar *option,
+                      const gchar *value,
+                      ToolsPluginData *plugin)
+{
+   if (strcmp(option, "test.lazy.option") != 0) {
+      return FALSE;
+   }
+   gOptionCount++;
+   return TRUE;
+}
+
+
+/**
+ * Validates the response of the echo RPC.
+ *
+ * @param[in]  data     RPC data.
+ * @param[in]  ret      RPC result.
+ *
+ * @return Whether the RPC succeeded.
+ */
+
+static gboolean
+LazyLoadTestValidateEcho(RpcInData *data,
+                         gboolean ret)
+{
+   CU_ASSERT(gLoaded);
+   CU_ASSERT(ret);
+   /* The plugin's handler ran once per RPC, never through the stub twice. */
+   CU_ASSERT_EQUAL(gEchoCount, ++gEchoSent);
+   RPCDEBUG_ASSERT(data->result != NULL, FALSE);
+   CU_ASSERT_STRING_EQUAL(data->result, "lazy args");
+   return ret;
+}
+
+
+/**
+ * Validates the response of the "Set_Option" RPC.
+ *
+ * @param[in]  data     RPC data.
+ * @param[in]  ret      RPC result.
+ *
+ * @return Whether the RPC succeeded.
+ */
+
+static gboolean
+LazyLoadTestValidateOption(RpcInData *data,
+                           gboolean ret)
+{
+   CU_ASSERT(gLoaded);
+   CU_ASSERT(ret);
+   CU_ASSERT_EQUAL(gOptionCount, ++gOptionSent);
+   return ret;
+}
+
+
+/**
+ * Sends the next message. Before the first one, checks that the manifest
+ * kept the plugin from being loaded at startup.
+ *
+ * @param[in]  rpcdata     Data for the injected RPC request data.
+ *
+ * @return TRUE if sending messages, FALSE if no more messages to be sent.
+ */
+
+static gboolean
+LazyLoadTestSendNext(RpcDebugMsgMapping *rpcdata)
+{
+   static RpcDebugMsgList msgList = { NULL, 0 };
+
+   if (msgList.mappings == NULL) {
+      const gchar *first = g_getenv("LAZYLOADTEST_FIRST");
+
+      CU_ASSERT(!gLoaded);
+      msgList.mappings = (first != NULL && strcmp(first, "signal") == 0)
+                         ? gSignalFirst : gRpcFirst;
+   }
+   return RpcDebug_SendNext(rpcdata, &msgList);
+}
+
+
+/**
+ * Entry point of the plugin side, called when the service loads the plugin
+ * on demand.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ * @return The registration data.
+ */
+
+TOOLS_MODULE_EXPORT ToolsPluginData *
+ToolsOnLoad(ToolsAppCtx *ctx)
+{
+   static ToolsPluginData regData = {
+      "lazyLoadTest",
+      NULL,
+      NULL,
+      NULL
+   };
+
+   RpcChannelCallback rpcs[] = {
+      { LAZYLOADTEST_RPC, LazyLoadTestEcho, NULL, NULL, NULL, 0 },
+   };
+   ToolsPluginSignalCb sigs[] = {
+      { TOOLS_CORE_SIG_SET_OPTION, LazyLoadTestSetOption, &regData },
+   };
+   ToolsAppReg regs[] = {
+      { TOOLS_APP_GUESTRPC, VMTOOLS_WRAP_ARRAY(rpcs) },
+      { TOOLS_APP_SIGNALS, VMTOOLS_WRAP_ARRAY(sigs) },
+   };
+
+   CU_ASSERT(!gLoaded);
+   gLoaded = TRUE;
+   regData.regs = VMTOOLS_WRAP_ARRAY(regs);
+   return &regData;
+}
+
+
+/**
+ * Entry point of the debug side.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ * @return The debug plugin's registration data.
+ */
+
+TOOLS_MODULE_EXPORT RpcDebugPlugin *
+RpcDebugOnLoad(ToolsAppCtx *ctx)
+{
+   static RpcDebugRecvMapping recvFns[] = {
+      { NULL, NULL }
+   };
+   static RpcDebugPlugin regData = {
+      recvFns,
+      NULL,
+      LazyLoadTestSendNext,
+      NULL,
+      NULL,
+   };
+
+   return &regData;
+}
@@ -0,0 +1,70 @@
+#!/bin/sh
+##########################################################
+# Copyright (C) 2015 VMware, Inc. All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published
+# by the Free Software Foundation version 2.1 and no later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+#
+##########################################################
+
+# Runs vmtoolsd with the lazyLoadTest plugin deferred by a manifest, once with
+# each of the triggers that load it on demand (an RPC, then a signal). The
+# same shared object is used as the debug plugin that drives the test.
+
+usage() {
+   echo "Usage: $0 [-s service] [-t vmtoolsd] /path/to/liblazyLoadTest.so"
+   exit 1
+}
+
+service=vmsvc
+vmtoolsd=vmtoolsd
+
+while getopts "s:t:" opt; do
+   case $opt in
+   s) service=$OPTARG ;;
+   t) vmtoolsd=$OPTARG ;;
+   *) usage ;;
+   esac
+done
+shift `expr $OPTIND - 1`
+
+if [ $# -ne 1 ]; then
+   usage
+fi
+plugin=$1
+
+dir=`mktemp -d` || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+mkdir "$dir/common" "$dir/plugins"
+ln -s "$plugin" "$dir/plugins/liblazyLoadTest.so"
+cat > "$dir/plugins/liblazyLoadTest.manifest" <<EOM
+[plugin]
+name=lazyLoadTest
+rpcs=test.lazy.echo
+signals=tcs_set_option
+EOM
+cat > "$dir/tools.conf" <<EOM
+[$service]
+plugins.lazyLoad=true
+EOM
+
+for first in rpc signal; do
+   if ! LAZYLOADTEST_FIRST=$first "$vmtoolsd" -n "$service" \
+         -c "$dir/tools.conf" --common-path "$dir/common" \
+         -p "$dir/plugins" -g "$plugin"; then
+      echo "Loading on demand from a $first failed." >&2
+      exit 1
+   fi
+done
+echo "Loading on demand passed."
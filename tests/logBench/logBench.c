@@ -0,0 +1,516 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * logBench.c --
+ *
+ *      Measures the cost of logging to a file through the vmtools logging
+ *      library. A number of threads log debug messages as fast as they
+ *      can, first with every thread writing its own messages, then with
+ *      the messages handed to the library's writer thread. For each mode,
+ *      reports the messages per second (including the time to write out
+ *      the queued messages), the latency seen by the logging threads, and
+ *      how many messages were dropped because the queue was full.
+ *
+ *      With glibc, the benchmark also counts the heap allocations made while
+ *      the threads are logging (the library's writer thread included) and
+ *      reports them per message. Those include the copy of the message made
+ *      by g_logv(), so it then also calls the library's log handler directly
+ *      and fails if, once warmed up, the handler allocates any memory.
+ */
+
+#if defined(__GLIBC__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE      /* RTLD_NEXT */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define G_LOG_DOMAIN "logBench"
+
+#if defined(__GLIBC__)
+#  include <dlfcn.h>
+#endif
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "vmware/tools/log.h"
+#include "vmware/tools/utils.h"
+#include <glib/gstdio.h>
+
+/* Marks the lines written by the benchmark threads. */
+#define LOG_BENCH_MARKER   "logBench-msg"
+
+/* Message logged when checking the handler's allocations; short enough for
+ * the library to format it without allocating. */
+#define LOG_BENCH_CHECK_MSG   "logBench-check handler allocation test\n"
+
+/* Handler calls made before, then while, counting allocations. */
+#define LOG_BENCH_WARMUP      100
+#define LOG_BENCH_CHECKS      10000
+
+typedef struct LogBenchThread {
+   guint id;
+   uint32 *latency;          /* Per message latency samples, us. */
+} LogBenchThread;
+
+static gint gThreads = 4;
+static gint gMessages = 100000;
+static gint gQueueSize = 1024;
+static gint gMsgSize = 100;
+static gchar *gLogFile = NULL;
+static gboolean gKeep = FALSE;
+
+static gchar *gPayload;
+
+#if defined(__GLIBC__)
+/*
+ * Counts the calls to malloc(), calloc() and realloc() while gCountAllocs is
+ * set. glib's own allocators end up in these (g_mem_set_vtable() is a no-op
+ * in recent glib, so hooking it doesn't work).
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static volatile gint gCountAllocs = 0;
+static volatile gint gAllocs = 0;
+
+
+void *
+malloc(size_t size)
+{
+   if (gCountAllocs) {
+      g_atomic_int_inc(&gAllocs);
+   }
+   return __libc_malloc(size);
+}
+
+
+void *
+calloc(size_t nmemb,
+       size_t size)
+{
+   if (gCountAllocs) {
+      g_atomic_int_inc(&gAllocs);
+   }
+   return __libc_calloc(nmemb, size);
+}
+
+
+void *
+realloc(void *ptr,
+        size_t size)
+{
+   if (gCountAllocs) {
+      g_atomic_int_inc(&gAllocs);
+   }
+   return __libc_realloc(ptr, size);
+}
+
+
+/*
+ * Records the default log handler installed by the library, so that the
+ * allocation check can call it without going through g_logv().
+ */
+static GLogFunc gLogHandler = NULL;
+static gpointer gLogHandlerData = NULL;
+
+
+GLogFunc
+g_log_set_default_handler(GLogFunc logFunc,   // IN
+                          gpointer userData)  // IN
+{
+   static GLogFunc (*realSet)(GLogFunc, gpointer) = NULL;
+
+   if (realSet == NULL) {
+      realSet = (GLogFunc (*)(GLogFunc, gpointer))
+                dlsym(RTLD_NEXT, "g_log_set_default_handler");
+   }
+   gLogHandler = logFunc;
+   gLogHandlerData = userData;
+   return realSet(logFunc, userData);
+}
+#endif
+
+static GOptionEntry gOptions[] = {
+   { "threads", 't', 0, G_OPTION_ARG_INT, &gThreads,
+     "number of logging threads (default 4)", "N" },
+   { "messages", 'm', 0, G_OPTION_ARG_INT, &gMessages,
+     "messages logged by each thread (default 100000)", "N" },
+   { "queue-size", 'q', 0, G_OPTION_ARG_INT, &gQueueSize,
+     "size of the log queue in asynchronous mode (default 1024)", "N" },
+   { "size", 's', 0, G_OPTION_ARG_INT, &gMsgSize,
+     "size of each message's payload, in bytes (default 100)", "N" },
+   { "file", 'f', 0, G_OPTION_ARG_FILENAME, &gLogFile,
+     "log file to write (default: in the temp directory)", "PATH" },
+   { "keep", 'k', 0, G_OPTION_ARG_NONE, &gKeep,
+     "don't delete the log file when done", NULL },
+   { NULL }
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogBenchConfig --
+ *
+ *      (Re)configures logging to send all messages of the benchmark's
+ *      domain to the log file, with the given log queue size.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Truncates the log file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+LogBenchConfig(gint queueSize)   // IN: log queue size, 0 for synchronous
+{
+   GKeyFile *cfg = g_key_file_new();
+
+   g_key_file_set_boolean(cfg, "logging", "log", TRUE);
+   g_key_file_set_integer(cfg, "logging", "asyncQueueSize", queueSize);
+   g_key_file_set_string(cfg, "logging", G_LOG_DOMAIN ".level", "debug");
+   g_key_file_set_string(cfg, "logging", G_LOG_DOMAIN ".handler", "file");
+   g_key_file_set_string(cfg, "logging", G_LOG_DOMAIN ".data", gLogFile);
+   g_key_file_set_integer(cfg, "logging", G_LOG_DOMAIN ".maxLogSize", 0);
+   g_key_file_set_integer(cfg, "logging", G_LOG_DOMAIN ".maxOldLogFiles", 0);
+
+   VMTools_ConfigLogging(G_LOG_DOMAIN, cfg, TRUE, TRUE);
+   g_key_file_free(cfg);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogBenchRun --
+ *
+ *      Thread body: logs the configured number of messages, timing each
+ *      call.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      Fills the thread's latency samples.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+LogBenchRun(gpointer data)   // IN: LogBenchThread
+{
+   LogBenchThread *thread = data;
+   gint i;
+
+   for (i = 0; i < gMessages; i++) {
+      VmTimeType start = Hostinfo_SystemTimerUS();
+
+      g_debug(LOG_BENCH_MARKER " %u %d %s\n", thread->id, i, gPayload);
+      thread->latency[i] = (uint32)(Hostinfo_SystemTimerUS() - start);
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogBenchCountMessages --
+ *
+ *      Counts the benchmark messages that made it to the log file.
+ *
+ * Results:
+ *      Number of messages in the log file.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint64
+LogBenchCountMessages(void)
+{
+   char line[1024];
+   guint64 count = 0;
+   FILE *f = g_fopen(gLogFile, "r");
+
+   if (f == NULL) {
+      return 0;
+   }
+
+   while (fgets(line, sizeof line, f) != NULL) {
+      if (strstr(line, LOG_BENCH_MARKER) != NULL) {
+         count++;
+      }
+   }
+   fclose(f);
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogBenchCompareLatency --
+ *
+ *      qsort comparison for latency samples.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+LogBenchCompareLatency(const void *a,   // IN
+                       const void *b)   // IN
+{
+   uint32 x = *(const uint32 *)a;
+   uint32 y = *(const uint32 *)b;
+
+   return (x > y) - (x < y);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogBenchMode --
+ *
+ *      Runs the benchmark with the given log queue size and prints one line
+ *      of results.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes the log file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+LogBenchMode(const char *name,   // IN: name of the mode
+             gint queueSize)     // IN: log queue size, 0 for synchronous
+{
+   LogBenchThread *threads = g_new0(LogBenchThread, gThreads);
+   GThread **handles = g_new0(GThread *, gThreads);
+   guint64 total = (guint64)gThreads * gMessages;
+   guint64 written;
+   uint32 *samples = g_new(uint32, total);
+   VmTimeType start;
+   VmTimeType produced;
+   VmTimeType elapsed;
+   uint64 sum = 0;
+   gchar *allocs;
+   guint64 i;
+   gint t;
+
+   LogBenchConfig(queueSize);
+
+#if defined(__GLIBC__)
+   g_atomic_int_set(&gAllocs, 0);
+   g_atomic_int_set(&gCountAllocs, 1);
+#endif
+   start = Hostinfo_SystemTimerUS();
+   for (t = 0; t < gThreads; t++) {
+      threads[t].id = t;
+      threads[t].latency = samples + (guint64)t * gMessages;
+      handles[t] = g_thread_create(LogBenchRun, &threads[t], TRUE, NULL);
+      if (handles[t] == NULL) {
+         g_printerr("Cannot create thread %d.\n", t);
+         exit(1);
+      }
+   }
+   for (t = 0; t < gThreads; t++) {
+      g_thread_join(handles[t]);
+   }
+   produced = Hostinfo_SystemTimerUS() - start;
+
+   VMTools_FlushLogs();
+   elapsed = Hostinfo_SystemTimerUS() - start;
+#if defined(__GLIBC__)
+   g_atomic_int_set(&gCountAllocs, 0);
+   allocs = g_strdup_printf("%.2f",
+                            (gdouble)g_atomic_int_get(&gAllocs) / total);
+#else
+   allocs = g_strdup("n/a");
+#endif
+   written = LogBenchCountMessages();
+
+   qsort(samples, total, sizeof *samples, LogBenchCompareLatency);
+   for (i = 0; i < total; i++) {
+      sum += samples[i];
+   }
+
+   g_print("%-6s %6d %12.0f %12.0f %8"FMT64"u %8u %8u %8u %10"FMT64"u "
+           "%10s\n",
+           name, queueSize,
+           total / (produced > 0 ? produced / 1000000.0 : 1e-6),
+           written / (elapsed > 0 ? elapsed / 1000000.0 : 1e-6),
+           sum / total, samples[total / 2], samples[(total * 99) / 100],
+           samples[total - 1], total - written, allocs);
+
+   g_free(allocs);
+   g_free(samples);
+   g_free(handles);
+   g_free(threads);
+}
+
+
+#if defined(__GLIBC__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogBenchCheckAllocs --
+ *
+ *      Calls the library's log handler directly, so that glib doesn't
+ *      allocate a copy of each message, and checks that once warmed up
+ *      (entry pool filled, log file open, timestamp cache set up), logging
+ *      a message doesn't allocate memory.
+ *
+ * Results:
+ *      TRUE if the handler made no allocations.
+ *
+ * Side effects:
+ *      Writes the log file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+LogBenchCheckAllocs(void)
+{
+   gint allocs;
+   gint i;
+
+   LogBenchConfig(0);
+   if (gLogHandler == NULL) {
+      g_printerr("The library did not install a default log handler.\n");
+      return FALSE;
+   }
+
+   for (i = 0; i < LOG_BENCH_WARMUP; i++) {
+      gLogHandler(G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, LOG_BENCH_CHECK_MSG,
+                  gLogHandlerData);
+   }
+
+   g_atomic_int_set(&gAllocs, 0);
+   g_atomic_int_set(&gCountAllocs, 1);
+   for (i = 0; i < LOG_BENCH_CHECKS; i++) {
+      gLogHandler(G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, LOG_BENCH_CHECK_MSG,
+                  gLogHandlerData);
+   }
+   g_atomic_int_set(&gCountAllocs, 0);
+   allocs = g_atomic_int_get(&gAllocs);
+
+   g_print("Handler allocations in %d messages after warm-up: %d: %s\n",
+           LOG_BENCH_CHECKS, allocs, allocs == 0 ? "ok" : "FAILED");
+   return allocs == 0;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Parses the options and runs the benchmark in synchronous, then
+ *      asynchronous, mode. With glibc, then checks that the log handler
+ *      doesn't allocate memory.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      Writes the log file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   GOptionContext *context;
+   GError *error = NULL;
+   int ret = 0;
+
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+   g_thread_init(NULL);
+#endif
+
+   context = g_option_context_new("- benchmark the vmtools file logger");
+   g_option_context_add_main_entries(context, gOptions, NULL);
+   if (!g_option_context_parse(context, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return 1;
+   }
+   g_option_context_free(context);
+
+   if (gThreads <= 0 || gMessages <= 0 || gQueueSize <= 0 || gMsgSize < 0) {
+      g_printerr("Thread count, message count and queue size must be "
+                 "positive.\n");
+      return 1;
+   }
+
+   if (gLogFile == NULL) {
+      gchar *name = g_strdup_printf("logBench.%u.log", (unsigned)getpid());
+      gLogFile = g_build_filename(g_get_tmp_dir(), name, NULL);
+      g_free(name);
+   }
+
+   gPayload = g_malloc(gMsgSize + 1);
+   memset(gPayload, 'x', gMsgSize);
+   gPayload[gMsgSize] = '\0';
+
+   g_print("%d threads x %d messages of %d bytes to %s\n",
+           gThreads, gMessages, gMsgSize, gLogFile);
+   g_print("%-6s %6s %12s %12s %8s %8s %8s %8s %10s %10s\n", "mode", "queue",
+           "calls/s", "written/s", "mean", "p50", "p99", "max", "dropped",
+           "allocs/msg");
+
+   LogBenchMode("sync", 0);
+   LogBenchMode("async", gQueueSize);
+   g_print("Caller latencies in us.\n");
+
+#if defined(__GLIBC__)
+   if (!LogBenchCheckAllocs()) {
+      ret = 1;
+   }
+#endif
+
+   if (!gKeep) {
+      g_unlink(gLogFile);
+   }
+   g_free(gPayload);
+   g_free(gLogFile);
+
+   return ret;
+}
@@ -0,0 +1,338 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * logLimitTest.c --
+ *
+ *      Checks the rate limiting of repeated log messages. The library's
+ *      monotonic clock is replaced with a fake one, so that the test can
+ *      control how the token buckets refill. Messages are logged to a file
+ *      with a limit of LOG_LIMIT_RATE similar warnings per minute, and the
+ *      file is checked for the expected messages and suppression summaries
+ *      after each step. Summaries of messages that stopped being logged
+ *      must come from the library's timer, from VMTools_FlushLogs(), or when
+ *      the group of the messages is forgotten to make room for others.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define G_LOG_DOMAIN "logLimitTest"
+
+#include "vmware.h"
+#include "vmware/tools/log.h"
+#include "vmware/tools/utils.h"
+#include <glib/gstdio.h>
+
+/* Marks the lines logged by the test. */
+#define LOG_LIMIT_MARKER   "logLimitTest-msg"
+
+/* Similar warnings allowed per minute. */
+#define LOG_LIMIT_RATE     10
+
+/* Different warnings logged to make the library forget older ones. */
+#define LOG_LIMIT_DISTINCT 1000
+
+typedef struct LogLimitCount {
+   guint messages;         /* Test messages, not counting summaries. */
+   guint summaries;
+   guint suppressed;       /* Sum of the counts in the summaries. */
+} LogLimitCount;
+
+static guint64 gNow = 1000;
+static gchar *gLogFile = NULL;
+static gboolean gFailed = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogLimitClock --
+ *
+ *      Fake monotonic clock.
+ *
+ * Results:
+ *      The fake time, in milliseconds.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint64
+LogLimitClock(void)
+{
+   return gNow;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogLimitConfig --
+ *
+ *      Configures logging to send the test's messages to the log file, with
+ *      a rate limit for warnings only.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Truncates the log file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+LogLimitConfig(void)
+{
+   GKeyFile *cfg = g_key_file_new();
+
+   g_key_file_set_boolean(cfg, "logging", "log", TRUE);
+   g_key_file_set_integer(cfg, "logging", "asyncQueueSize", 0);
+   g_key_file_set_string(cfg, "logging", G_LOG_DOMAIN ".level", "debug");
+   g_key_file_set_string(cfg, "logging", G_LOG_DOMAIN ".handler", "file");
+   g_key_file_set_string(cfg, "logging", G_LOG_DOMAIN ".data", gLogFile);
+   g_key_file_set_integer(cfg, "logging", G_LOG_DOMAIN ".maxLogSize", 0);
+   g_key_file_set_integer(cfg, "logging", G_LOG_DOMAIN ".rateLimit.warning",
+                          LOG_LIMIT_RATE);
+
+   VMTools_ConfigLogging(G_LOG_DOMAIN, cfg, TRUE, TRUE);
+   g_key_file_free(cfg);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogLimitCountLines --
+ *
+ *      Counts the test messages and suppression summaries in the log file.
+ *      Messages are written synchronously, so the logs aren't flushed: that
+ *      would also log the summaries that are due.
+ *
+ * Results:
+ *      The counts.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static LogLimitCount
+LogLimitCountLines(void)
+{
+   char line[1024];
+   LogLimitCount count = { 0, 0, 0 };
+   FILE *f;
+
+   f = g_fopen(gLogFile, "r");
+   if (f == NULL) {
+      return count;
+   }
+
+   while (fgets(line, sizeof line, f) != NULL) {
+      const char *summary = strstr(line, "similar messages suppressed");
+
+      if (summary != NULL) {
+         const char *p = summary;
+
+         /* The count is the number right before the summary text. */
+         while (p > line && p[-1] == ' ') {
+            p--;
+         }
+         while (p > line && g_ascii_isdigit(p[-1])) {
+            p--;
+         }
+         count.summaries++;
+         count.suppressed += (guint) strtoul(p, NULL, 10);
+      } else if (strstr(line, LOG_LIMIT_MARKER) != NULL) {
+         count.messages++;
+      }
+   }
+   fclose(f);
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LogLimitCheck --
+ *
+ *      Compares the log file's contents with the expected counts.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+LogLimitCheck(const char *step,        // IN
+              guint messages,          // IN
+              guint summaries,         // IN
+              guint suppressed)        // IN
+{
+   LogLimitCount count = LogLimitCountLines();
+   gboolean ok = count.messages == messages &&
+                 count.summaries == summaries &&
+                 count.suppressed == suppressed;
+
+   g_print("%-40s %4u messages, %u summaries, %4u suppressed: %s\n",
+           step, count.messages, count.summaries, count.suppressed,
+           ok ? "ok" : "FAILED");
+   if (!ok) {
+      g_print("%-40s %4u messages, %u summaries, %4u suppressed expected\n",
+              "", messages, summaries, suppressed);
+      gFailed = TRUE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the test steps.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      Writes and deletes the log file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   gchar *name;
+   gint i;
+
+   VMTools_SetMonotonicClock(LogLimitClock);
+
+   name = g_strdup_printf("logLimitTest.%u.log", (unsigned)getpid());
+   gLogFile = g_build_filename(g_get_tmp_dir(), name, NULL);
+   g_free(name);
+
+   LogLimitConfig();
+
+   /* A burst: only a minute's worth gets through. Digits don't matter. */
+   for (i = 0; i < 100; i++) {
+      g_warning(LOG_LIMIT_MARKER " operation %d failed, error %d\n", i, i * 7);
+   }
+   LogLimitCheck("burst of 100 warnings", 10, 0, 0);
+
+   /* Half a minute later, half of the bucket has been refilled. */
+   gNow += 30 * 1000;
+   for (i = 0; i < 100; i++) {
+      g_warning(LOG_LIMIT_MARKER " operation %d failed, error %d\n", i, i * 7);
+   }
+   LogLimitCheck("100 more after 30 seconds", 15, 0, 0);
+
+   /* Other messages, and other levels, have buckets of their own. */
+   for (i = 0; i < 3; i++) {
+      g_warning(LOG_LIMIT_MARKER " something else went wrong\n");
+   }
+   for (i = 0; i < 100; i++) {
+      g_debug(LOG_LIMIT_MARKER " operation %d failed, error %d\n", i, i * 7);
+   }
+   LogLimitCheck("other warnings, and debug messages", 118, 0, 0);
+
+   /*
+    * A minute after the first suppressed message, the next similar message
+    * comes with a summary of what was suppressed.
+    */
+   gNow += 61 * 1000;
+   g_warning(LOG_LIMIT_MARKER " operation %d failed, error %d\n", 0, 0);
+   LogLimitCheck("one more after a minute", 119, 1, 185);
+
+   /*
+    * A message logged at a steady rate above the limit gets through as the
+    * bucket refills (once every 6 seconds), and is summarized once a minute.
+    */
+   for (i = 0; i < 10; i++) {
+      g_warning(LOG_LIMIT_MARKER " retrying %d\n", i);
+   }
+   for (i = 0; i < 130; i++) {
+      gNow += 500;
+      g_warning(LOG_LIMIT_MARKER " retrying %d\n", i);
+   }
+   LogLimitCheck("steady stream for 65 seconds", 139, 2, 296);
+
+   /* Start over with an empty log file. */
+   LogLimitConfig();
+   LogLimitCheck("new log file", 0, 0, 0);
+
+   /* Messages that stop are summarized by the timer after a minute. */
+   for (i = 0; i < 20; i++) {
+      g_warning(LOG_LIMIT_MARKER " storm %d stopped\n", i);
+   }
+   gNow += 45 * 1000;
+   while (g_main_context_iteration(NULL, FALSE)) {
+   }
+   LogLimitCheck("storm stopped 45 seconds ago", 10, 0, 0);
+   gNow += 16 * 1000;
+   while (g_main_context_iteration(NULL, FALSE)) {
+   }
+   LogLimitCheck("storm stopped a minute ago, timer", 10, 1, 10);
+
+   /* Or when the logs are flushed. */
+   for (i = 0; i < 20; i++) {
+      g_warning(LOG_LIMIT_MARKER " storm %d flushed\n", i);
+   }
+   gNow += 61 * 1000;
+   VMTools_FlushLogs();
+   LogLimitCheck("storm stopped a minute ago, flush", 20, 2, 20);
+
+   /* Or when the library forgets them, whenever that happens. */
+   for (i = 0; i < 20; i++) {
+      g_warning(LOG_LIMIT_MARKER " storm %d forgotten\n", i);
+   }
+   gNow += 1;
+   for (i = 0; i < LOG_LIMIT_DISTINCT; i++) {
+      gchar shape[4];
+
+      shape[0] = 'a' + i % 26;
+      shape[1] = 'a' + (i / 26) % 26;
+      shape[2] = 'a' + (i / (26 * 26)) % 26;
+      shape[3] = '\0';
+      g_warning(LOG_LIMIT_MARKER " distinct message %s\n", shape);
+   }
+   LogLimitCheck("storm forgotten", 30 + LOG_LIMIT_DISTINCT, 3, 30);
+
+   VMTools_ConfigLogging(G_LOG_DOMAIN, NULL, FALSE, TRUE);
+   VMTools_SetMonotonicClock(NULL);
+   g_unlink(gLogFile);
+   g_free(gLogFile);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+}
@@ -0,0 +1,424 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * nicMonitorTest.c --
+ *
+ *      Checks the rtnetlink NIC monitor. The test moves to a network
+ *      namespace of its own, opens a monitor, and changes the namespace's
+ *      interfaces, addresses and routes with ip(8). After each step, it
+ *      waits for the monitor's notifications, and checks that the monitor
+ *      noticed the change and that the NIC info built from its model shows
+ *      the expected NICs, addresses and routes. A couple of steps skip the
+ *      notifications, and check that rebuilding the model catches up.
+ *
+ *      Creating a network namespace needs root; the test is skipped when it
+ *      can't be done.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#  include <sys/poll.h>
+#  include <sched.h>
+#  include <unistd.h>
+#endif
+
+#define G_LOG_DOMAIN "nicMonitorTest"
+
+#include "vmware.h"
+#include "nicInfo.h"
+#include "xdrutil.h"
+#include "vmware/tools/utils.h"
+
+#if defined(__linux__)
+
+/* How long to wait for the first notification of a change, in ms. */
+#define NICMON_TEST_WAIT      2000
+
+/* How long the monitor must be quiet for a change to be complete, in ms. */
+#define NICMON_TEST_SETTLE    200
+
+typedef struct NicMonTestCount {
+   guint nics;
+   guint ipv4;
+   guint ipv6;             /* Not counting link-local addresses. */
+   guint routes4;
+   gboolean defaultRoute;
+} NicMonTestCount;
+
+static NicInfoMonitor *gMonitor = NULL;
+static NicMonTestCount gLast = { 0, 0, 0, 0, FALSE };
+static gboolean gFailed = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NicMonTestRun --
+ *
+ *      Runs an ip(8) command.
+ *
+ * Results:
+ *      TRUE if the command succeeded.
+ *
+ * Side effects:
+ *      Changes the namespace's network configuration.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+NicMonTestRun(const char *args)     // IN
+{
+   gchar *cmd = g_strdup_printf("ip %s", args);
+   GError *err = NULL;
+   gint status = -1;
+   gboolean ok;
+
+   ok = g_spawn_command_line_sync(cmd, NULL, NULL, &status, &err) &&
+        status == 0;
+   if (!ok) {
+      g_print("'%s' failed: %s\n", cmd,
+              err != NULL ? err->message : "non-zero exit status");
+   }
+
+   g_clear_error(&err);
+   g_free(cmd);
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NicMonTestWait --
+ *
+ *      Waits for the monitor's notifications, and applies them until the
+ *      monitor stays quiet for NICMON_TEST_SETTLE.
+ *
+ * Results:
+ *      Whether the monitor reported a change.
+ *
+ * Side effects:
+ *      Sets gFailed if the monitor fails.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+NicMonTestWait(void)
+{
+   struct pollfd pfd;
+   gboolean changed = FALSE;
+   int timeout = NICMON_TEST_WAIT;
+
+   pfd.fd = GuestInfo_NicMonitorGetFd(gMonitor);
+   pfd.events = POLLIN;
+
+   while (poll(&pfd, 1, timeout) > 0) {
+      Bool stepChanged;
+
+      if (!GuestInfo_NicMonitorProcess(gMonitor, &stepChanged)) {
+         g_print("GuestInfo_NicMonitorProcess failed\n");
+         gFailed = TRUE;
+         break;
+      }
+      changed = changed || stepChanged;
+      timeout = NICMON_TEST_SETTLE;
+   }
+
+   return changed;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NicMonTestCountInfo --
+ *
+ *      Counts the NICs, addresses and IPv4 routes of the monitor's NIC info.
+ *
+ * Results:
+ *      The counts.
+ *
+ * Side effects:
+ *      Sets gFailed if the NIC info can't be built.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static NicMonTestCount
+NicMonTestCountInfo(void)
+{
+   NicMonTestCount count = { 0, 0, 0, 0, FALSE };
+   NicInfoV3 *info = NULL;
+   guint i;
+   guint j;
+
+   if (!GuestInfo_NicMonitorGetNicInfo(gMonitor, &info)) {
+      g_print("GuestInfo_NicMonitorGetNicInfo failed\n");
+      gFailed = TRUE;
+      return count;
+   }
+
+   count.nics = info->nics.nics_len;
+   XDRUTIL_FOREACH(i, info, nics) {
+      GuestNicV3 *nic = XDRUTIL_GETITEM(info, nics, i);
+
+      XDRUTIL_FOREACH(j, nic, ips) {
+         IpAddressEntry *ip = XDRUTIL_GETITEM(nic, ips, j);
+         TypedIpAddress *addr = &ip->ipAddressAddr;
+
+         if (addr->ipAddressAddrType == IAT_IPV4) {
+            count.ipv4++;
+         } else if (addr->ipAddressAddrType == IAT_IPV6 &&
+                    !(addr->ipAddressAddr.InetAddress_val[0] == 0xfe &&
+                      (addr->ipAddressAddr.InetAddress_val[1] & 0xc0) == 0x80)) {
+            count.ipv6++;
+         }
+      }
+   }
+
+   XDRUTIL_FOREACH(i, info, routes) {
+      InetCidrRouteEntry *route = XDRUTIL_GETITEM(info, routes, i);
+
+      if (route->inetCidrRouteDest.ipAddressAddrType == IAT_IPV4) {
+         count.routes4++;
+         if (route->inetCidrRoutePfxLen == 0) {
+            count.defaultRoute = TRUE;
+         }
+      }
+   }
+
+   GuestInfo_FreeNicInfo(info);
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NicMonTestStep --
+ *
+ *      Runs a test step: applies a change with ip(8), waits for the monitor
+ *      to notice it, and compares the monitor's NIC info with the expected
+ *      counts. Not every change shows in the NIC info (bringing a link up
+ *      doesn't, unless IPv6 gives it a link-local address), so the monitor
+ *      only has to report a change when the counts have changed.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+NicMonTestStep(const char *args,          // IN
+               guint nics,                // IN
+               guint ipv4,                // IN
+               guint ipv6,                // IN
+               guint routes4,             // IN
+               gboolean defaultRoute)     // IN
+{
+   NicMonTestCount count;
+   gboolean changed;
+   gboolean ok;
+
+   if (!NicMonTestRun(args)) {
+      gFailed = TRUE;
+      return;
+   }
+
+   changed = NicMonTestWait();
+   count = NicMonTestCountInfo();
+   ok = (changed || memcmp(&count, &gLast, sizeof count) == 0) &&
+        count.nics == nics &&
+        count.ipv4 == ipv4 &&
+        count.ipv6 == ipv6 &&
+        count.routes4 == routes4 &&
+        count.defaultRoute == defaultRoute;
+
+   g_print("%-45s %s, %u nics, %u ipv4, %u ipv6, %u routes%s: %s\n",
+           args, changed ? "changed" : "unchanged", count.nics, count.ipv4,
+           count.ipv6, count.routes4, count.defaultRoute ? " (default)" : "",
+           ok ? "ok" : "FAILED");
+   if (!ok) {
+      g_print("%-45s %u nics, %u ipv4, %u ipv6, %u routes%s expected\n",
+              "", nics, ipv4, ipv6, routes4,
+              defaultRoute ? " (default)" : "");
+      gFailed = TRUE;
+   }
+   gLast = count;
+}
+
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NicMonTestResync --
+ *
+ *      Applies a change with ip(8) without looking at the monitor's
+ *      notifications, as if they had been missed, and checks that rebuilding
+ *      the model picks the change up. The notifications are applied after
+ *      that, and must not change the NIC info again.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+NicMonTestResync(const char *args,          // IN
+                 guint nics,                // IN
+                 guint ipv4,                // IN
+                 guint ipv6,                // IN
+                 guint routes4,             // IN
+                 gboolean defaultRoute)     // IN
+{
+   NicMonTestCount count;
+   NicMonTestCount after;
+   gboolean ok;
+
+   if (!NicMonTestRun(args)) {
+      gFailed = TRUE;
+      return;
+   }
+
+   if (!GuestInfo_NicMonitorResync(gMonitor)) {
+      g_print("GuestInfo_NicMonitorResync failed\n");
+      gFailed = TRUE;
+      return;
+   }
+   count = NicMonTestCountInfo();
+   NicMonTestWait();
+   after = NicMonTestCountInfo();
+
+   ok = memcmp(&count, &after, sizeof count) == 0 &&
+        count.nics == nics &&
+        count.ipv4 == ipv4 &&
+        count.ipv6 == ipv6 &&
+        count.routes4 == routes4 &&
+        count.defaultRoute == defaultRoute;
+
+   g_print("%-45s resync, %u nics, %u ipv4, %u ipv6, %u routes%s: %s\n",
+           args, count.nics, count.ipv4, count.ipv6, count.routes4,
+           count.defaultRoute ? " (default)" : "", ok ? "ok" : "FAILED");
+   if (!ok) {
+      g_print("%-45s %u nics, %u ipv4, %u ipv6, %u routes%s expected\n",
+              "", nics, ipv4, ipv6, routes4,
+              defaultRoute ? " (default)" : "");
+      gFailed = TRUE;
+   }
+   gLast = after;
+}
+
+#endif // if defined(__linux__)
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the test steps.
+ *
+ * Results:
+ *      0 on success or when skipped, 1 on failure.
+ *
+ * Side effects:
+ *      Changes the network configuration of a private network namespace.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+#if defined(__linux__)
+   if (unshare(CLONE_NEWNET) != 0 || !NicMonTestRun("link set lo up")) {
+      g_print("Cannot create a network namespace (not root?).\nSKIPPED\n");
+      return 0;
+   }
+
+   gMonitor = GuestInfo_NicMonitorOpen();
+   if (gMonitor == NULL) {
+      g_print("Cannot open the NIC monitor.\nFAILED\n");
+      return 1;
+   }
+
+   /* Loopback isn't an Ethernet link, so there are no NICs to start with. */
+   NicMonTestWait();
+   gLast = NicMonTestCountInfo();
+   if (gLast.nics != 0) {
+      g_print("%u nics in an empty namespace\n", gLast.nics);
+      gFailed = TRUE;
+   }
+
+   NicMonTestStep("link add nicmon0 type dummy", 1, 0, 0, 0, FALSE);
+   NicMonTestStep("link set nicmon0 up", 1, 0, 0, 0, FALSE);
+   NicMonTestStep("addr add 192.0.2.10/24 dev nicmon0", 1, 1, 0, 1, FALSE);
+   NicMonTestStep("addr add 2001:db8::10/64 dev nicmon0 nodad",
+                  1, 1, 1, 1, FALSE);
+   NicMonTestStep("route add default via 192.0.2.1", 1, 1, 1, 2, TRUE);
+   NicMonTestStep("route add 198.51.100.0/24 via 192.0.2.2",
+                  1, 1, 1, 3, TRUE);
+   NicMonTestStep("route del 198.51.100.0/24", 1, 1, 1, 2, TRUE);
+
+   /* A second NIC; veth pairs are two Ethernet links. */
+   NicMonTestStep("link add nicmon1 type veth peer name nicmon2",
+                  3, 1, 1, 2, TRUE);
+   NicMonTestStep("link del nicmon1", 1, 1, 1, 2, TRUE);
+   NicMonTestStep("addr del 2001:db8::10/64 dev nicmon0", 1, 1, 0, 2, TRUE);
+
+   /*
+    * The kernel removes the IPv4 routes of a link that goes down, or of an
+    * address that goes away, without notifications.
+    */
+   NicMonTestStep("link set nicmon0 down", 1, 1, 0, 0, FALSE);
+   NicMonTestStep("link set nicmon0 up", 1, 1, 0, 1, FALSE);
+   NicMonTestStep("route add default via 192.0.2.1", 1, 1, 0, 2, TRUE);
+   NicMonTestStep("addr del 192.0.2.10/24 dev nicmon0", 1, 0, 0, 0, FALSE);
+
+   /* A missed change is picked up by rebuilding the model. */
+   NicMonTestResync("addr add 192.0.2.20/24 dev nicmon0", 1, 1, 0, 1, FALSE);
+   NicMonTestResync("addr del 192.0.2.20/24 dev nicmon0", 1, 0, 0, 0, FALSE);
+
+   NicMonTestStep("link del nicmon0", 0, 0, 0, 0, FALSE);
+
+   GuestInfo_NicMonitorClose(gMonitor);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+#else
+   g_print("The NIC monitor is only available on Linux.\nSKIPPED\n");
+   return 0;
+#endif
+}
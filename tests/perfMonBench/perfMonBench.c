@@ -0,0 +1,234 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * perfMonBench.c --
+ *
+ *      Measures the CPU cost of a guestInfo perfmon collection. The
+ *      collector (perfMonLinux.c, built into the benchmark) reads recorded
+ *      snapshots of the /proc files from the fixtures directory instead of
+ *      /proc. The benchmark runs a number of collections and reports the
+ *      user and system time spent per collection.
+ *
+ *      Since the snapshots don't change, every collection after the first
+ *      encodes the same stats; the benchmark checks that it does. It also
+ *      checks that shutting the collector down closes the files it opened,
+ *      and that collecting again afterwards starts over.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "vmware.h"
+#include "dynbuf.h"
+#include "guestInfoInt.h"
+
+static gint gCollections = 10000;
+
+static GOptionEntry gOptions[] = {
+   { "collections", 'n', 0, G_OPTION_ARG_INT, &gCollections,
+     "number of collections (default 10000)", "N" },
+   { NULL }
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PerfMonBenchCpuTime --
+ *
+ *      Gets the CPU time used by the process so far.
+ *
+ * Results:
+ *      User and system time, in us.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PerfMonBenchCpuTime(guint64 *user,     // OUT
+                    guint64 *sys)      // OUT
+{
+   struct rusage usage;
+
+   getrusage(RUSAGE_SELF, &usage);
+   *user = (guint64)usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec;
+   *sys = (guint64)usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PerfMonBenchCountFds --
+ *
+ *      Counts the process's open file descriptors.
+ *
+ * Results:
+ *      The number of open file descriptors.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint
+PerfMonBenchCountFds(void)
+{
+   guint count = 0;
+   int fd;
+
+   for (fd = 0; fd < getdtablesize(); fd++) {
+      if (fcntl(fd, F_GETFD) != -1) {
+         count++;
+      }
+   }
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PerfMonBenchCollect --
+ *
+ *      Runs a collection.
+ *
+ * Results:
+ *      TRUE on success; @stats holds the encoded stats.
+ *
+ * Side effects:
+ *      Resets @stats.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+PerfMonBenchCollect(DynBuf *stats)     // IN/OUT
+{
+   DynBuf_Destroy(stats);
+   DynBuf_Init(stats);
+
+   return GuestInfo_PerfMon(stats);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the collections and reports their cost.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   GOptionContext *context;
+   GError *error = NULL;
+   DynBuf first;
+   DynBuf stats;
+   guint64 user0, sys0, user1, sys1;
+   guint fds;
+   gboolean ok = TRUE;
+   gint i;
+
+   context = g_option_context_new("- benchmark the guestInfo perfmon "
+                                  "collector");
+   g_option_context_add_main_entries(context, gOptions, NULL);
+   if (!g_option_context_parse(context, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return 1;
+   }
+   g_option_context_free(context);
+
+   if (gCollections <= 0) {
+      g_printerr("The number of collections must be positive.\n");
+      return 1;
+   }
+
+   DynBuf_Init(&first);
+   DynBuf_Init(&stats);
+   fds = PerfMonBenchCountFds();
+
+   /* The first collection has no previous one to compute rates from. */
+   if (!PerfMonBenchCollect(&stats) || !PerfMonBenchCollect(&first)) {
+      g_print("Collection failed.\nFAILED\n");
+      return 1;
+   }
+
+   PerfMonBenchCpuTime(&user0, &sys0);
+   for (i = 0; i < gCollections && ok; i++) {
+      ok = PerfMonBenchCollect(&stats) &&
+           DynBuf_GetSize(&stats) == DynBuf_GetSize(&first) &&
+           memcmp(DynBuf_Get(&stats), DynBuf_Get(&first),
+                  DynBuf_GetSize(&first)) == 0;
+   }
+   PerfMonBenchCpuTime(&user1, &sys1);
+
+   if (!ok) {
+      g_print("Collection %d differs from the first one.\nFAILED\n", i);
+   } else {
+      g_print("%d collections of %u bytes: %.2f us user, %.2f us system "
+              "per collection\n", gCollections,
+              (guint)DynBuf_GetSize(&first),
+              (double)(user1 - user0) / gCollections,
+              (double)(sys1 - sys0) / gCollections);
+
+      /* Starting over takes a first collection again. */
+      GuestInfo_PerfMonShutdown();
+      if (PerfMonBenchCountFds() != fds) {
+         g_print("Files left open after the shutdown.\nFAILED\n");
+         ok = FALSE;
+      } else if (!PerfMonBenchCollect(&stats) ||
+                 !PerfMonBenchCollect(&stats) ||
+                 DynBuf_GetSize(&stats) != DynBuf_GetSize(&first) ||
+                 memcmp(DynBuf_Get(&stats), DynBuf_Get(&first),
+                        DynBuf_GetSize(&first)) != 0) {
+         g_print("Collection after the shutdown differs from the first "
+                 "one.\nFAILED\n");
+         ok = FALSE;
+      }
+      GuestInfo_PerfMonShutdown();
+   }
+
+   DynBuf_Destroy(&first);
+   DynBuf_Destroy(&stats);
+
+   return ok ? 0 : 1;
+}
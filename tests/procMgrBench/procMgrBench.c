@@ -0,0 +1,511 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * procMgrBench.c --
+ *
+ *      Measures the cost of ProcMgr_ListProcesses on Linux. The benchmark
+ *      starts a number of sleeping child processes, and lists the processes
+ *      a few times, both with ProcMgr_ListProcesses and with a reference
+ *      scan that reads /proc the way ProcMgr_ListProcesses used to: one
+ *      path per file, a stat() of /proc/<pid>, and a getpwuid() per
+ *      process. It reports the wall time of both, and the number of system
+ *      calls of one listing, counted with ptrace when it is allowed.
+ *
+ *      Every child must be listed, with the right owner and command line.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "vmware.h"
+#include "procMgr.h"
+#include "vmware/tools/utils.h"
+
+static gint gProcesses = 2000;
+static gint gIterations = 5;
+
+static GOptionEntry gOptions[] = {
+   { "processes", 'n', 0, G_OPTION_ARG_INT, &gProcesses,
+     "number of sleeping processes (default 2000)", "N" },
+   { "iterations", 'i', 0, G_OPTION_ARG_INT, &gIterations,
+     "number of timed listings (default 5)", "N" },
+   { NULL }
+};
+
+static pid_t *gChildren = NULL;
+static gint gStarted = 0;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchStart --
+ *
+ *      Starts the sleeping child processes.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      Sets gChildren and gStarted.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+ProcMgrBenchStart(void)
+{
+   gChildren = g_new0(pid_t, gProcesses);
+
+   for (gStarted = 0; gStarted < gProcesses; gStarted++) {
+      pid_t pid = fork();
+
+      if (pid == -1) {
+         g_print("Cannot start process %d: %s\n", gStarted, g_strerror(errno));
+         return FALSE;
+      }
+      if (pid == 0) {
+         for (;;) {
+            pause();
+         }
+      }
+      gChildren[gStarted] = pid;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchStop --
+ *
+ *      Kills and reaps the child processes.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ProcMgrBenchStop(void)
+{
+   gint i;
+
+   for (i = 0; i < gStarted; i++) {
+      kill(gChildren[i], SIGKILL);
+   }
+   for (i = 0; i < gStarted; i++) {
+      waitpid(gChildren[i], NULL, 0);
+   }
+   g_free(gChildren);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchReadFile --
+ *
+ *      Reads a small /proc file, the way ProcMgr_ListProcesses used to.
+ *
+ * Results:
+ *      TRUE if something was read.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+ProcMgrBenchReadFile(const char *path)     // IN
+{
+   char buf[512];
+   int fd = open(path, O_RDONLY);
+   ssize_t numRead;
+   ssize_t total = 0;
+
+   if (fd == -1) {
+      return FALSE;
+   }
+   while ((numRead = read(fd, buf, sizeof buf)) > 0) {
+      total += numRead;
+   }
+   close(fd);
+
+   return total > 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchReference --
+ *
+ *      Lists the processes the way ProcMgr_ListProcesses used to, reading
+ *      the same files, without keeping the results.
+ *
+ * Results:
+ *      The number of processes listed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint
+ProcMgrBenchReference(void)
+{
+   DIR *dir = opendir("/proc");
+   struct dirent *ent;
+   guint count = 0;
+
+   if (dir == NULL) {
+      return 0;
+   }
+
+   while ((ent = readdir(dir)) != NULL) {
+      struct stat fileStat;
+      char path[1024];
+
+      if (strspn(ent->d_name, "0123456789") != strlen(ent->d_name)) {
+         continue;
+      }
+
+      snprintf(path, sizeof path, "/proc/%s/cmdline", ent->d_name);
+      if (!ProcMgrBenchReadFile(path)) {
+         snprintf(path, sizeof path, "/proc/%s/status", ent->d_name);
+         ProcMgrBenchReadFile(path);
+      }
+      snprintf(path, sizeof path, "/proc/%s", ent->d_name);
+      if (stat(path, &fileStat) != 0) {
+         continue;
+      }
+      snprintf(path, sizeof path, "/proc/%s/stat", ent->d_name);
+      if (!ProcMgrBenchReadFile(path)) {
+         continue;
+      }
+      getpwuid(fileStat.st_uid);
+      count++;
+   }
+   closedir(dir);
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchList --
+ *
+ *      Lists the processes with ProcMgr_ListProcesses.
+ *
+ * Results:
+ *      The number of processes listed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint
+ProcMgrBenchList(void)
+{
+   ProcMgrProcInfoArray *procList = ProcMgr_ListProcesses();
+   guint count;
+
+   if (procList == NULL) {
+      return 0;
+   }
+   count = ProcMgrProcInfoArray_Count(procList);
+   ProcMgr_FreeProcList(procList);
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchTime --
+ *
+ *      Times gIterations listings.
+ *
+ * Results:
+ *      The wall time per listing, in ms.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+ProcMgrBenchTime(guint (*list)(void),     // IN
+                 guint *count)            // OUT
+{
+   gint64 start = g_get_monotonic_time();
+   gint i;
+
+   for (i = 0; i < gIterations; i++) {
+      *count = list();
+   }
+
+   return (g_get_monotonic_time() - start) / 1000.0 / gIterations;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchSyscalls --
+ *
+ *      Counts the system calls of one listing: a child process does the
+ *      listing, while this one traces it and counts the system call stops.
+ *      Each call stops once on entry and once on exit. The count includes
+ *      the few calls that stop the child and make it exit.
+ *
+ * Results:
+ *      The number of system calls, or -1 if the child cannot be traced.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gint64
+ProcMgrBenchSyscalls(guint (*list)(void))     // IN
+{
+   gint64 stops = 0;
+   int status;
+   pid_t pid = fork();
+
+   if (pid == -1) {
+      return -1;
+   }
+
+   if (pid == 0) {
+      /*
+       * Warm up first, then stop so the tracer only counts the second
+       * listing (plus the raise() and the exit).
+       */
+      list();
+      if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) {
+         _exit(2);
+      }
+      raise(SIGSTOP);
+      list();
+      _exit(0);
+   }
+
+   if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+      waitpid(pid, &status, 0);
+      return -1;
+   }
+
+   ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD);
+   for (;;) {
+      if (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) == -1 ||
+          waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+         break;
+      }
+      if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+         stops++;
+      }
+   }
+
+   if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      return -1;
+   }
+
+   return (stops + 1) / 2;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcMgrBenchCheck --
+ *
+ *      Checks that every child is listed, with the right owner and command
+ *      line.
+ *
+ * Results:
+ *      TRUE if they all are.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+ProcMgrBenchCheck(void)
+{
+   ProcMgrProcInfoArray *procList = ProcMgr_ListProcesses();
+   GHashTable *children = g_hash_table_new(NULL, NULL);
+   struct passwd *pwd = getpwuid(getuid());
+   gchar *owner = pwd != NULL ? g_strdup(pwd->pw_name) :
+                                g_strdup_printf("%d", (int)getuid());
+   gchar *cmdLine = NULL;
+   gboolean ok = TRUE;
+   guint i;
+
+   if (procList == NULL) {
+      g_print("No processes listed.\n");
+      ok = FALSE;
+      goto exit;
+   }
+
+   for (i = 0; i < gStarted; i++) {
+      g_hash_table_insert(children, GINT_TO_POINTER(gChildren[i]),
+                          GINT_TO_POINTER(1));
+   }
+
+   for (i = 0; i < ProcMgrProcInfoArray_Count(procList); i++) {
+      ProcMgrProcInfo *info = ProcMgrProcInfoArray_AddressOf(procList, i);
+
+      if (info->procId == getpid()) {
+         cmdLine = g_strdup(info->procCmdLine);
+      }
+   }
+
+   for (i = 0; i < ProcMgrProcInfoArray_Count(procList); i++) {
+      ProcMgrProcInfo *info = ProcMgrProcInfoArray_AddressOf(procList, i);
+
+      if (!g_hash_table_remove(children, GINT_TO_POINTER(info->procId))) {
+         continue;
+      }
+      if (info->procOwner == NULL || strcmp(info->procOwner, owner) != 0 ||
+          cmdLine == NULL || info->procCmdLine == NULL ||
+          strcmp(info->procCmdLine, cmdLine) != 0) {
+         g_print("Unexpected process %d: owner %s, command line %s\n",
+                 (int)info->procId, info->procOwner, info->procCmdLine);
+         ok = FALSE;
+      }
+   }
+
+   if (g_hash_table_size(children) != 0) {
+      g_print("%u processes not listed.\n", g_hash_table_size(children));
+      ok = FALSE;
+   }
+
+   ProcMgr_FreeProcList(procList);
+
+exit:
+   g_hash_table_destroy(children);
+   g_free(owner);
+   g_free(cmdLine);
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the listings and reports their cost.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   GOptionContext *context;
+   GError *error = NULL;
+   gboolean failed = FALSE;
+   guint count;
+   double ms;
+   gint64 syscalls;
+
+   context = g_option_context_new("- benchmark ProcMgr_ListProcesses");
+   g_option_context_add_main_entries(context, gOptions, NULL);
+   if (!g_option_context_parse(context, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return 1;
+   }
+   g_option_context_free(context);
+
+   if (gProcesses <= 0 || gIterations <= 0) {
+      g_printerr("The counts must be positive.\n");
+      return 1;
+   }
+
+   if (!ProcMgrBenchStart()) {
+      failed = TRUE;
+      goto exit;
+   }
+
+   failed = !ProcMgrBenchCheck();
+
+   ms = ProcMgrBenchTime(ProcMgrBenchReference, &count);
+   syscalls = ProcMgrBenchSyscalls(ProcMgrBenchReference);
+   g_print("reference:              %6u processes, %8.2f ms, ", count, ms);
+   if (syscalls < 0) {
+      g_print("syscalls unavailable\n");
+   } else {
+      g_print("%8"G_GINT64_FORMAT" syscalls\n", syscalls);
+   }
+
+   ms = ProcMgrBenchTime(ProcMgrBenchList, &count);
+   syscalls = ProcMgrBenchSyscalls(ProcMgrBenchList);
+   g_print("ProcMgr_ListProcesses:  %6u processes, %8.2f ms, ", count, ms);
+   if (syscalls < 0) {
+      g_print("syscalls unavailable\n");
+   } else {
+      g_print("%8"G_GINT64_FORMAT" syscalls\n", syscalls);
+   }
+
+exit:
+   ProcMgrBenchStop();
+
+   g_print("%s\n", failed ? "FAILED" : "PASSED");
+   return failed ? 1 : 0;
+}
@@ -0,0 +1,577 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * procSamplerBench.c --
+ *
+ *      Measures the CPU cost of the guestInfo per-process sampler
+ *      (procSamplerLinux.c, built into the benchmark), and checks its
+ *      results. The benchmark builds a fake /proc with a number of
+ *      processes in a temporary directory, and between samples, advances
+ *      the CPU time and IO counters of every process by a different amount
+ *      and a fake clock by SAMPLE_INTERVAL. The top processes reported must
+ *      be the ones that were advanced the most, with the expected rates.
+ *
+ *      Then it samples with a time budget, using a clock that ticks on every
+ *      read, and checks that each sample stops after the expected number of
+ *      processes, that a pass still covers all of them, and that every
+ *      sample ranks all of them.
+ *
+ *      With --proc, it samples a real /proc instead, and reports the cost
+ *      and the top processes.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "vmware.h"
+#include "guestInfoInt.h"
+#include "vmware/tools/utils.h"
+#include <glib/gstdio.h>
+
+/* The fake clock's time between two samples, in ms. */
+#define SAMPLE_INTERVAL 20000
+
+/* Processes sampled between two budget checks, see procSamplerLinux.c. */
+#define CHECK_INTERVAL 64
+
+static gint gProcesses = 10000;
+static gint gSamples = 5;
+static gint gTop = 10;
+static gchar *gProcDir = NULL;
+
+static GOptionEntry gOptions[] = {
+   { "processes", 'n', 0, G_OPTION_ARG_INT, &gProcesses,
+     "number of fake processes (default 10000)", "N" },
+   { "samples", 's', 0, G_OPTION_ARG_INT, &gSamples,
+     "number of timed samples (default 5)", "N" },
+   { "top", 't', 0, G_OPTION_ARG_INT, &gTop,
+     "number of top processes (default 10)", "N" },
+   { "proc", 'p', 0, G_OPTION_ARG_FILENAME, &gProcDir,
+     "sample this procfs instead of a fake one", "DIR" },
+   { NULL }
+};
+
+static gchar *gBase = NULL;
+static guint64 gNow = 0;
+static gboolean gTicking = FALSE;
+static gboolean gFailed = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchClock --
+ *
+ *      The fake monotonic clock. When ticking, every read advances it by
+ *      1 ms.
+ *
+ * Results:
+ *      The time, in ms.
+ *
+ * Side effects:
+ *      May advance gNow.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint64
+ProcSamplerBenchClock(void)
+{
+   return gTicking ? gNow++ : gNow;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchCpuTime --
+ *
+ *      Gets the CPU time used by the process so far.
+ *
+ * Results:
+ *      User and system time, in us.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ProcSamplerBenchCpuTime(guint64 *user,     // OUT
+                        guint64 *sys)      // OUT
+{
+   struct rusage usage;
+
+   getrusage(RUSAGE_SELF, &usage);
+   *user = (guint64)usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec;
+   *sys = (guint64)usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchTicks --
+ *
+ *      How many CPU ticks a fake process uses between two samples. The
+ *      amounts are distinct for up to 10006 processes.
+ *
+ * Results:
+ *      The ticks.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint64
+ProcSamplerBenchTicks(gint pid)     // IN
+{
+   return ((guint64)pid * 7919) % 10007;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchWrite --
+ *
+ *      Writes the stat and io files of the fake processes, as they are
+ *      after @round intervals.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      Creates the process directories on the first round.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+ProcSamplerBenchWrite(guint round)     // IN
+{
+   gint pid;
+
+   for (pid = 1; pid <= gProcesses; pid++) {
+      gchar *dir = g_strdup_printf("%s/%d", gBase, pid);
+      gchar *path;
+      gchar *data;
+      gboolean ok;
+
+      if (round == 0 && g_mkdir(dir, 0700) != 0) {
+         g_print("Cannot create %s: %s\n", dir, g_strerror(errno));
+         g_free(dir);
+         return FALSE;
+      }
+
+      /* The name has a blank, which the sampler replaces. */
+      data = g_strdup_printf("%d (bench %d) R 1 %d %d 0 -1 4194304 100 0 0 0 "
+                             "%"G_GUINT64_FORMAT" 0 0 0 20 0 1 0 %d "
+                             "10000000 %d 18446744073709551615 1 1 0 0 0 0 "
+                             "0 0 0 0 0 0 17 0 0 0 0 0 0\n",
+                             pid, pid, pid, pid,
+                             round * ProcSamplerBenchTicks(pid),
+                             1000 + pid, 100 + pid);
+      path = g_strdup_printf("%s/stat", dir);
+      ok = g_file_set_contents(path, data, -1, NULL);
+      g_free(path);
+      g_free(data);
+
+      data = g_strdup_printf("rchar: 0\nwchar: 0\nsyscr: 0\nsyscw: 0\n"
+                             "read_bytes: %"G_GUINT64_FORMAT"\n"
+                             "write_bytes: %"G_GUINT64_FORMAT"\n"
+                             "cancelled_write_bytes: 0\n",
+                             (guint64)round * pid * 512,
+                             (guint64)round * pid * 4096);
+      path = g_strdup_printf("%s/io", dir);
+      ok = ok && g_file_set_contents(path, data, -1, NULL);
+      g_free(path);
+      g_free(data);
+      g_free(dir);
+
+      if (!ok) {
+         g_print("Cannot write process %d.\n", pid);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchRemove --
+ *
+ *      Removes the fake /proc.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ProcSamplerBenchRemove(void)
+{
+   gint pid;
+
+   for (pid = 1; pid <= gProcesses; pid++) {
+      gchar *path = g_strdup_printf("%s/%d/stat", gBase, pid);
+
+      g_unlink(path);
+      g_free(path);
+      path = g_strdup_printf("%s/%d/io", gBase, pid);
+      g_unlink(path);
+      g_free(path);
+      path = g_strdup_printf("%s/%d", gBase, pid);
+      g_rmdir(path);
+      g_free(path);
+   }
+   g_rmdir(gBase);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchCompareTicks --
+ *
+ *      qsort() callback that sorts tick amounts in decreasing order.
+ *
+ * Results:
+ *      <0, 0 or >0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+ProcSamplerBenchCompareTicks(const void *a,     // IN
+                             const void *b)     // IN
+{
+   guint64 ta = *(const guint64 *)a;
+   guint64 tb = *(const guint64 *)b;
+
+   return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchCheck --
+ *
+ *      Checks the top processes of a sample: they must be the ones with the
+ *      most ticks, in order, with the rates of the fake processes.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ProcSamplerBenchCheck(const GuestInfoProcUsage *top,     // IN
+                      guint found)                       // IN
+{
+   double ticksPerSec = sysconf(_SC_CLK_TCK);
+   guint64 *ticks = g_new(guint64, gProcesses);
+   guint expected = MIN(gTop, gProcesses);
+   guint i;
+
+   for (i = 0; i < gProcesses; i++) {
+      ticks[i] = ProcSamplerBenchTicks(i + 1);
+   }
+   qsort(ticks, gProcesses, sizeof *ticks, ProcSamplerBenchCompareTicks);
+
+   if (found != expected) {
+      g_print("%u top processes, %u expected\n", found, expected);
+      gFailed = TRUE;
+   }
+
+   for (i = 0; i < found && i < expected; i++) {
+      const GuestInfoProcUsage *usage = &top[i];
+      gchar *name = g_strdup_printf("bench_%d", usage->pid);
+      double cpu = ticks[i] * 100000.0 / (ticksPerSec * SAMPLE_INTERVAL);
+
+      if (ProcSamplerBenchTicks(usage->pid) != ticks[i] ||
+          strncmp(usage->name, name, sizeof usage->name - 1) != 0 ||
+          usage->cpu < cpu * 0.999999 || usage->cpu > cpu * 1.000001 ||
+          usage->rss != (guint64)(100 + usage->pid) * (getpagesize() / 1024) ||
+          usage->readRate != usage->pid * 512 * 1000.0 / SAMPLE_INTERVAL ||
+          usage->writeRate != usage->pid * 4096 * 1000.0 / SAMPLE_INTERVAL) {
+         g_print("Unexpected top process %u: %d (%s) cpu %.2f%% rss %"
+                 G_GUINT64_FORMAT"KiB read %.0fB/s write %.0fB/s\n", i,
+                 usage->pid, usage->name, usage->cpu, usage->rss,
+                 usage->readRate, usage->writeRate);
+         gFailed = TRUE;
+      }
+      g_free(name);
+   }
+
+   g_free(ticks);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchBudget --
+ *
+ *      Samples with a budget of @budget ms, on a clock that ticks on every
+ *      read: the sampler checks the clock every CHECK_INTERVAL processes, so
+ *      each sample must stop after @budget * CHECK_INTERVAL processes, and
+ *      the samples of a pass must cover every process once.
+ *
+ *      The counters of the fake processes are not advanced during the pass,
+ *      so a process has no CPU usage once the pass has sampled it again, and
+ *      keeps its previous usage until then. Every sample must rank all the
+ *      processes, whichever call sampled them last.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ProcSamplerBenchBudget(GuestInfoProcSampler *sampler,     // IN
+                       guint budget)                      // IN
+{
+   GuestInfoProcUsage *top = g_new(GuestInfoProcUsage, gProcesses);
+   guint perSample = budget * CHECK_INTERVAL;
+   guint samples = (gProcesses + perSample - 1) / perSample;
+   guint total = 0;
+   guint i;
+
+   gTicking = TRUE;
+   for (i = 0; i < samples; i++) {
+      guint found;
+      guint idle = 0;
+      guint j;
+
+      gNow += SAMPLE_INTERVAL;
+      found = GuestInfo_ProcSamplerSample(sampler, budget, top, gProcesses);
+
+      for (j = 0; j < found; j++) {
+         if (top[j].cpu == 0) {
+            idle++;
+         }
+      }
+
+      if (found != gProcesses) {
+         g_print("Budget sample %u: %u processes ranked, %d expected\n", i,
+                 found, gProcesses);
+         gFailed = TRUE;
+      }
+      if (idle - total != MIN(perSample, gProcesses - total)) {
+         g_print("Budget sample %u: %u processes, %u expected\n", i,
+                 idle - total, MIN(perSample, gProcesses - total));
+         gFailed = TRUE;
+      }
+      total = idle;
+   }
+   gTicking = FALSE;
+
+   g_print("Budget of %u ms: %u samples of up to %u processes cover %u "
+           "processes: %s\n", budget, samples, perSample, total,
+           total == gProcesses ? "ok" : "FAILED");
+   if (total != gProcesses) {
+      gFailed = TRUE;
+   }
+
+   g_free(top);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ProcSamplerBenchReal --
+ *
+ *      Samples a real procfs, and reports the cost and the top processes.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+ProcSamplerBenchReal(void)
+{
+   GuestInfoProcSampler *sampler = GuestInfo_ProcSamplerOpen(gProcDir);
+   GuestInfoProcUsage *top = g_new(GuestInfoProcUsage, gTop);
+   guint64 user0, sys0, user1, sys1;
+   guint found = 0;
+   gint i;
+
+   if (sampler == NULL) {
+      g_print("Cannot open %s.\nFAILED\n", gProcDir);
+      return 1;
+   }
+
+   GuestInfo_ProcSamplerSample(sampler, 0, top, gTop);
+   ProcSamplerBenchCpuTime(&user0, &sys0);
+   for (i = 0; i < gSamples; i++) {
+      sleep(1);
+      found = GuestInfo_ProcSamplerSample(sampler, 0, top, gTop);
+   }
+   ProcSamplerBenchCpuTime(&user1, &sys1);
+
+   g_print("%d samples of %s: %.0f us user, %.0f us system per sample\n",
+           gSamples, gProcDir, (double)(user1 - user0) / gSamples,
+           (double)(sys1 - sys0) / gSamples);
+   for (i = 0; i < found; i++) {
+      g_print("%8d %-15s %6.1f%% %10"G_GUINT64_FORMAT"KiB %10.0fB/s "
+              "%10.0fB/s\n", top[i].pid, top[i].name, top[i].cpu, top[i].rss,
+              top[i].readRate, top[i].writeRate);
+   }
+
+   GuestInfo_ProcSamplerClose(sampler);
+   g_free(top);
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the samples and reports their cost.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   GOptionContext *context;
+   GError *error = NULL;
+   GuestInfoProcSampler *sampler;
+   GuestInfoProcUsage *top;
+   guint64 user = 0;
+   guint64 sys = 0;
+   gint i;
+
+   context = g_option_context_new("- benchmark the guestInfo process "
+                                  "sampler");
+   g_option_context_add_main_entries(context, gOptions, NULL);
+   if (!g_option_context_parse(context, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return 1;
+   }
+   g_option_context_free(context);
+
+   if (gProcesses <= 0 || gSamples <= 0 || gTop <= 0) {
+      g_printerr("The counts must be positive.\n");
+      return 1;
+   }
+
+   if (gProcDir != NULL) {
+      return ProcSamplerBenchReal();
+   }
+
+   VMTools_SetMonotonicClock(ProcSamplerBenchClock);
+
+   gBase = g_build_filename(g_get_tmp_dir(), "procSamplerBench.XXXXXX", NULL);
+   if (mkdtemp(gBase) == NULL) {
+      g_print("Cannot create %s.\nFAILED\n", gBase);
+      return 1;
+   }
+
+   top = g_new(GuestInfoProcUsage, gTop);
+   sampler = GuestInfo_ProcSamplerOpen(gBase);
+   if (sampler == NULL || !ProcSamplerBenchWrite(0)) {
+      gFailed = TRUE;
+      goto exit;
+   }
+
+   /* The first sample has nothing to compare to. */
+   GuestInfo_ProcSamplerSample(sampler, 0, top, gTop);
+
+   for (i = 1; i <= gSamples && !gFailed; i++) {
+      guint64 user0, sys0, user1, sys1;
+      guint found;
+
+      if (!ProcSamplerBenchWrite(i)) {
+         gFailed = TRUE;
+         break;
+      }
+      gNow += SAMPLE_INTERVAL;
+
+      ProcSamplerBenchCpuTime(&user0, &sys0);
+      found = GuestInfo_ProcSamplerSample(sampler, 0, top, gTop);
+      ProcSamplerBenchCpuTime(&user1, &sys1);
+      user += user1 - user0;
+      sys += sys1 - sys0;
+
+      ProcSamplerBenchCheck(top, found);
+   }
+
+   if (!gFailed) {
+      g_print("%d samples of %d processes: %.0f us user, %.0f us system "
+              "per sample (%.2f us per process)\n", gSamples, gProcesses,
+              (double)user / gSamples, (double)sys / gSamples,
+              (double)(user + sys) / gSamples / gProcesses);
+      ProcSamplerBenchBudget(sampler, 10);
+   }
+
+exit:
+   GuestInfo_ProcSamplerClose(sampler);
+   ProcSamplerBenchRemove();
+   g_free(top);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+}
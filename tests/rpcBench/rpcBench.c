@@ -0,0 +1,204 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file rpcBench.c
+ *
+ * A debug plugin that measures the cost of TCLO command dispatch. Once the
+ * service is running, it pushes a large number of messages through the
+ * vmrpcdbg channel straight into RpcChannel_Dispatch(), and prints the
+ * dispatch rate for known commands, unknown commands and unknown commands
+ * longer than any registered name. Run it with:
+ *
+ *    vmtoolsd -n vmsvc -g /path/to/librpcBench.so
+ *
+ * The number of messages per case can be changed in the tools config file:
+ *
+ *    [rpcBench]
+ *    iterations=1000000
+ */
+
+#define G_LOG_DOMAIN "rpcBench"
+
+#include <string.h>
+#include <glib-object.h>
+
+#include "vm_basic_types.h"
+#include "hostinfo.h"
+#include "vmware/tools/rpcdebug.h"
+
+#define RPCBENCH_DEFAULT_ITERATIONS 1000000
+
+#define RPCBENCH_ECHO_CMD "test.bench.echo"
+
+typedef struct RpcBenchCase {
+   const char *desc;
+   const char *message;
+   gboolean expected;
+} RpcBenchCase;
+
+static RpcBenchCase gBenchCases[] = {
+   { "known command", RPCBENCH_ECHO_CMD " payload", TRUE },
+   { "built-in ping", "ping", TRUE },
+   { "unknown command", "test.bench.unknown", FALSE },
+   { "unknown long command",
+     "test.bench.unknown.command.with.a.name.longer.than.any.registered.one",
+     FALSE },
+};
+
+static ToolsAppCtx *gCtx;
+
+
+/**
+ * Handler for the benchmark's own RPC. Does nothing, so that the cost
+ * measured is the dispatch itself.
+ *
+ * @param[in]  data  RPC request data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+RpcBenchEcho(RpcInData *data)
+{
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+
+
+/**
+ * Dispatches the message of one benchmark case repeatedly and prints the
+ * resulting rate.
+ *
+ * @param[in]  bench       The benchmark case.
+ * @param[in]  iterations  Number of messages to dispatch.
+ *
+ * @return Whether every dispatch returned the expected result.
+ */
+
+static gboolean
+RpcBenchRunCase(const RpcBenchCase *bench,
+                guint iterations)
+{
+   size_t len = strlen(bench->message) + 1;
+   VmTimeType start;
+   VmTimeType elapsed;
+   gboolean ok = TRUE;
+   guint i;
+
+   start = Hostinfo_SystemTimerUS();
+   for (i = 0; i < iterations; i++) {
+      RpcInData data;
+
+      memset(&data, 0, sizeof data);
+      data.clientData = gCtx->rpc;
+      data.appCtx = gCtx;
+      data.args = bench->message;
+      data.argsSize = len;
+
+      if (RpcChannel_Dispatch(&data) != bench->expected) {
+         ok = FALSE;
+      }
+      if (data.freeResult) {
+         vm_free(data.result);
+      }
+   }
+   elapsed = MAX(Hostinfo_SystemTimerUS() - start, 1);
+
+   g_print("%-22s %10u msgs %8.1f ns/msg %12.0f msgs/s%s\n",
+           bench->desc, iterations, 1000.0 * elapsed / iterations,
+           1000000.0 * iterations / elapsed,
+           ok ? "" : " (unexpected result)");
+   return ok;
+}
+
+
+/**
+ * Runs the benchmark the first time the debug channel asks for a message,
+ * then tells the channel there is nothing else to send.
+ *
+ * @param[in]  rpcdata     Unused.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+RpcBenchSendNext(RpcDebugMsgMapping *rpcdata)
+{
+   gint iterations = 0;
+   size_t i;
+
+   if (gCtx->config != NULL) {
+      iterations = g_key_file_get_integer(gCtx->config, "rpcBench",
+                                          "iterations", NULL);
+   }
+   if (iterations <= 0) {
+      iterations = RPCBENCH_DEFAULT_ITERATIONS;
+   }
+
+   for (i = 0; i < ARRAYSIZE(gBenchCases); i++) {
+      if (!RpcBenchRunCase(&gBenchCases[i], iterations)) {
+         VMTOOLSAPP_ERROR(gCtx, 1);
+      }
+   }
+
+   return FALSE;
+}
+
+
+/**
+ * Returns the benchmark plugin's registration data.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ * @return The application data.
+ */
+
+TOOLS_MODULE_EXPORT RpcDebugPlugin *
+RpcDebugOnLoad(ToolsAppCtx *ctx)
+{
+   static RpcDebugRecvMapping recvFns[] = {
+      { NULL, NULL }
+   };
+   static ToolsPluginData pluginData = {
+      "rpcBench",
+      NULL,
+      NULL,
+      NULL,
+   };
+   static RpcDebugPlugin regData = {
+      recvFns,
+      NULL,
+      RpcBenchSendNext,
+      NULL,
+      &pluginData,
+   };
+
+   {
+      RpcChannelCallback rpcs[] = {
+         { RPCBENCH_ECHO_CMD, RpcBenchEcho, NULL, NULL, NULL, 0 },
+      };
+      ToolsAppReg regs[] = {
+         { TOOLS_APP_GUESTRPC, VMTOOLS_WRAP_ARRAY(rpcs) },
+      };
+
+      pluginData.regs = VMTOOLS_WRAP_ARRAY(regs);
+   }
+
+   gCtx = ctx;
+   return &regData;
+}
@@ -0,0 +1,691 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rpcChannelAsyncTest.c --
+ *
+ *      Checks RpcChannel_SendAsync against a fake channel implementation
+ *      whose pipelined transport is an in-memory "host" that can be told to
+ *      stop replying. The test checks that
+ *
+ *       - no more than RPCCHANNEL_ASYNC_MAX_OUTSTANDING requests are in
+ *         flight, and replies complete the requests in send order;
+ *       - queuing a request doesn't wait for a synchronous send in
+ *         progress;
+ *       - stopping the channel fails the request waiting for its reply,
+ *         without sending it again, and closes the pipelined connection;
+ *       - a request queued while the channel is stopped is held until the
+ *         channel is started, and then opens a new connection;
+ *       - shutting down while the host does not reply does not hang, and
+ *         fails the request waiting for its reply.
+ *
+ *      A stuck worker is caught by an alarm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "rpcChannelInt.h"
+
+#define RPC_ASYNC_BURST             20
+
+/* Real time a held request is given to be sent too early, in us. */
+#define RPC_ASYNC_HOLD_WAIT         (100 * 1000)
+
+/* Seconds before a stuck test is killed. */
+#define RPC_ASYNC_TIMEOUT           30
+
+typedef struct FakeConn {
+   GQueue *pending;        /* Requests sent, not replied to yet. */
+   gboolean aborted;
+   char reply[64];
+} FakeConn;
+
+static GMutex *gLock;
+static GCond *gCond;
+static gboolean gHostReplies = TRUE;
+static gboolean gHoldOpen = FALSE;
+static gboolean gHoldSync = FALSE;
+static guint gSyncSent;
+static guint gOpened;
+static guint gClosed;
+static guint gSent;
+static guint gMaxOutstanding;
+static guint gCompleted;
+static guint gFailedReqs;
+static gboolean gFailed = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeStart --
+ *
+ *      Start function of the fake channel.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+FakeStart(RpcChannel *chan)    // IN
+{
+   chan->outStarted = TRUE;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeStop --
+ *
+ *      Stop function of the fake channel.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FakeStop(RpcChannel *chan)    // IN
+{
+   chan->outStarted = FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeSend --
+ *
+ *      Synchronous send function of the fake channel; echoes the request.
+ *      Waits while the test holds synchronous sends back.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      Counts the request.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+FakeSend(RpcChannel *chan,     // IN
+         char const *data,     // IN
+         size_t dataLen,       // IN
+         char **result,        // OUT
+         size_t *resultLen)    // OUT
+{
+   g_mutex_lock(gLock);
+   gSyncSent++;
+   g_cond_broadcast(gCond);
+   while (gHoldSync) {
+      g_cond_wait(gCond, gLock);
+   }
+   g_mutex_unlock(gLock);
+
+   *result = malloc(dataLen + 1);
+   memcpy(*result, data, dataLen);
+   (*result)[dataLen] = '\0';
+   *resultLen = dataLen;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeGetType --
+ *
+ *      Type function of the fake channel.
+ *
+ * Results:
+ *      RPCCHANNEL_TYPE_PRIV_VSOCK.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static RpcChannelType
+FakeGetType(RpcChannel *chan)    // IN
+{
+   return RPCCHANNEL_TYPE_PRIV_VSOCK;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeAsyncOpen --
+ *
+ *      Opens a pipelined connection to the fake host. Waits while the test
+ *      holds connections back, so that it can queue requests first.
+ *
+ * Results:
+ *      The connection.
+ *
+ * Side effects:
+ *      Counts the connection.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+FakeAsyncOpen(RpcChannel *chan)    // IN
+{
+   FakeConn *conn = g_new0(FakeConn, 1);
+
+   conn->pending = g_queue_new();
+   g_mutex_lock(gLock);
+   while (gHoldOpen) {
+      g_cond_wait(gCond, gLock);
+   }
+   gOpened++;
+   g_mutex_unlock(gLock);
+   return conn;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeAsyncSend --
+ *
+ *      Hands a request to the fake host.
+ *
+ * Results:
+ *      TRUE unless the connection was aborted.
+ *
+ * Side effects:
+ *      Tracks the number of requests in flight.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+FakeAsyncSend(gpointer _conn,       // IN
+              char const *data,     // IN
+              size_t dataLen)       // IN
+{
+   FakeConn *conn = _conn;
+   gboolean ok;
+
+   g_mutex_lock(gLock);
+   ok = !conn->aborted;
+   if (ok) {
+      g_queue_push_tail(conn->pending, g_strndup(data, dataLen));
+      gMaxOutstanding = MAX(gMaxOutstanding,
+                            g_queue_get_length(conn->pending));
+      gSent++;
+      g_cond_broadcast(gCond);
+   }
+   g_mutex_unlock(gLock);
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeAsyncRecv --
+ *
+ *      Waits for the fake host to reply to the oldest pending request; the
+ *      reply echoes the request.
+ *
+ * Results:
+ *      TRUE with the reply, FALSE if the connection was aborted.
+ *
+ * Side effects:
+ *      Blocks while the host is told not to reply.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+FakeAsyncRecv(gpointer _conn,          // IN
+              gboolean *status,        // OUT
+              const char **reply,      // OUT
+              size_t *replyLen)        // OUT
+{
+   FakeConn *conn = _conn;
+   gchar *req;
+
+   g_mutex_lock(gLock);
+   while (!conn->aborted &&
+          (!gHostReplies || g_queue_is_empty(conn->pending))) {
+      g_cond_wait(gCond, gLock);
+   }
+
+   if (conn->aborted) {
+      g_mutex_unlock(gLock);
+      *reply = "aborted";
+      *replyLen = strlen(*reply);
+      return FALSE;
+   }
+
+   req = g_queue_pop_head(conn->pending);
+   g_mutex_unlock(gLock);
+
+   g_strlcpy(conn->reply, req, sizeof conn->reply);
+   g_free(req);
+   *status = TRUE;
+   *reply = conn->reply;
+   *replyLen = strlen(conn->reply);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeAsyncAbort --
+ *
+ *      Aborts a pipelined connection, failing any blocked receive.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FakeAsyncAbort(gpointer _conn)    // IN
+{
+   FakeConn *conn = _conn;
+
+   g_mutex_lock(gLock);
+   conn->aborted = TRUE;
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeAsyncClose --
+ *
+ *      Closes a pipelined connection.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts the connection.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FakeAsyncClose(gpointer _conn)    // IN
+{
+   FakeConn *conn = _conn;
+   gchar *req;
+
+   while ((req = g_queue_pop_head(conn->pending)) != NULL) {
+      g_free(req);
+   }
+   g_queue_free(conn->pending);
+   g_free(conn);
+
+   g_mutex_lock(gLock);
+   gClosed++;
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+}
+
+
+static RpcChannelFuncs gFakeFuncs = {
+   FakeStart,
+   FakeStop,
+   FakeSend,
+   NULL,
+   NULL,
+   FakeGetType,
+   NULL,
+   NULL,
+   FakeAsyncOpen,
+   FakeAsyncSend,
+   FakeAsyncRecv,
+   FakeAsyncAbort,
+   FakeAsyncClose
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcAsyncDone --
+ *
+ *      Completion callback. Requests are numbered in the order they are
+ *      queued and must complete in that order; the expected status is in
+ *      the request text.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on an unexpected result.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcAsyncDone(gboolean status,        // IN
+             const char *result,     // IN
+             size_t resultLen,       // IN
+             gpointer data)          // IN
+{
+   guint index = GPOINTER_TO_UINT(data);
+
+   g_mutex_lock(gLock);
+   if (status) {
+      gchar *expected = g_strdup_printf("req %u", index);
+
+      if (index != gCompleted + gFailedReqs ||
+          strcmp(result, expected) != 0) {
+         g_print("request %u: unexpected reply \"%s\" after %u\n",
+                 index, result, gCompleted + gFailedReqs);
+         gFailed = TRUE;
+      }
+      g_free(expected);
+      gCompleted++;
+   } else {
+      gFailedReqs++;
+   }
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcAsyncQueue --
+ *
+ *      Queues request number 'index'.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed if the request cannot be queued.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcAsyncQueue(RpcChannel *chan,    // IN
+              guint index)         // IN
+{
+   gchar *req = g_strdup_printf("req %u", index);
+
+   if (!RpcChannel_SendAsync(chan, req, strlen(req), RpcAsyncDone,
+                             GUINT_TO_POINTER(index))) {
+      g_print("request %u could not be queued\n", index);
+      gFailed = TRUE;
+   }
+   g_free(req);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcAsyncWait --
+ *
+ *      Waits until *counter reaches 'target'. The alarm catches a counter
+ *      that never gets there.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcAsyncWait(guint *counter,    // IN
+             guint target)      // IN
+{
+   g_mutex_lock(gLock);
+   while (*counter < target) {
+      g_cond_wait(gCond, gLock);
+   }
+   g_mutex_unlock(gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcAsyncCheck --
+ *
+ *      Compares a counter with its expected value.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcAsyncCheck(const char *what,    // IN
+              guint value,         // IN
+              guint expected)      // IN
+{
+   gboolean ok = value == expected;
+
+   g_print("%-40s %4u: %s\n", what, value, ok ? "ok" : "FAILED");
+   if (!ok) {
+      g_print("%-40s %4u expected\n", "", expected);
+      gFailed = TRUE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcAsyncSyncThread --
+ *
+ *      Sends a synchronous request, which holds the channel's send lock
+ *      until the test lets the fake channel reply.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      Sets gFailed if the request fails.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+RpcAsyncSyncThread(gpointer data)    // IN
+{
+   RpcChannel *chan = data;
+   char *result = NULL;
+   size_t resultLen;
+
+   if (!RpcChannel_Send(chan, "sync", 4, &result, &resultLen)) {
+      g_print("synchronous request failed\n");
+      gFailed = TRUE;
+   }
+   RpcChannel_Free(result);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the test steps.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   RpcChannel *chan;
+   GThread *thread;
+   guint sent;
+   guint i;
+
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+   gLock = g_mutex_new();
+   gCond = g_cond_new();
+   alarm(RPC_ASYNC_TIMEOUT);
+
+   chan = RpcChannel_Create();
+   chan->funcs = &gFakeFuncs;
+   g_static_mutex_init(&chan->outLock);
+
+   /*
+    * A burst while the host is busy only fills the pipeline. The connection
+    * is held back until the whole burst is queued, otherwise the worker may
+    * send the first request and wait for its reply before the rest arrive.
+    */
+   gHostReplies = FALSE;
+   gHoldOpen = TRUE;
+   for (i = 0; i < RPC_ASYNC_BURST; i++) {
+      RpcAsyncQueue(chan, i);
+   }
+   g_mutex_lock(gLock);
+   gHoldOpen = FALSE;
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+   RpcAsyncWait(&gSent, RPCCHANNEL_ASYNC_MAX_OUTSTANDING);
+   g_usleep(100 * 1000);
+   RpcAsyncCheck("requests sent while the host is busy", gSent,
+                 RPCCHANNEL_ASYNC_MAX_OUTSTANDING);
+
+   g_mutex_lock(gLock);
+   gHostReplies = TRUE;
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+   RpcAsyncWait(&gCompleted, RPC_ASYNC_BURST);
+   RpcAsyncCheck("requests completed in order", gCompleted, RPC_ASYNC_BURST);
+   RpcAsyncCheck("most requests in flight", gMaxOutstanding,
+                 RPCCHANNEL_ASYNC_MAX_OUTSTANDING);
+   RpcAsyncCheck("connections opened", gOpened, 1);
+
+   /*
+    * A synchronous send holds the send lock for its whole round trip; async
+    * requests are queued and sent meanwhile. The alarm catches a hang.
+    */
+   gHoldSync = TRUE;
+   thread = g_thread_create(RpcAsyncSyncThread, chan, TRUE, NULL);
+   RpcAsyncWait(&gSyncSent, 1);
+   RpcAsyncQueue(chan, RPC_ASYNC_BURST);
+   RpcAsyncWait(&gCompleted, RPC_ASYNC_BURST + 1);
+   RpcAsyncCheck("requests completed during a sync send", gCompleted,
+                 RPC_ASYNC_BURST + 1);
+   g_mutex_lock(gLock);
+   gHoldSync = FALSE;
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+   g_thread_join(thread);
+
+   /*
+    * Stopping the channel fails the request waiting for its reply, and
+    * closes the connection; the request is not sent again.
+    */
+   g_mutex_lock(gLock);
+   gHostReplies = FALSE;
+   g_mutex_unlock(gLock);
+   RpcAsyncQueue(chan, RPC_ASYNC_BURST + 1);
+   RpcAsyncWait(&gSent, RPC_ASYNC_BURST + 2);
+   RpcChannel_Stop(chan);
+   RpcAsyncWait(&gFailedReqs, 1);
+   RpcAsyncWait(&gClosed, 1);
+   RpcAsyncCheck("requests failed by stop", gFailedReqs, 1);
+   RpcAsyncCheck("connections closed after stop", gClosed, 1);
+
+   /* A request queued while stopped waits for the channel to start. */
+   g_mutex_lock(gLock);
+   gHostReplies = TRUE;
+   g_mutex_unlock(gLock);
+   RpcAsyncQueue(chan, RPC_ASYNC_BURST + 2);
+   g_usleep(RPC_ASYNC_HOLD_WAIT);
+   g_mutex_lock(gLock);
+   sent = gSent;
+   g_mutex_unlock(gLock);
+   RpcAsyncCheck("requests sent while stopped", sent, RPC_ASYNC_BURST + 2);
+   RpcAsyncCheck("connections opened while stopped", gOpened, 1);
+
+   RpcChannel_Start(chan);
+   RpcAsyncWait(&gCompleted, RPC_ASYNC_BURST + 2);
+   RpcAsyncCheck("requests sent after start", gSent, RPC_ASYNC_BURST + 3);
+   RpcAsyncCheck("connections opened after start", gOpened, 2);
+
+   /* Shutting down does not wait for a host that does not reply. */
+   g_mutex_lock(gLock);
+   gHostReplies = FALSE;
+   g_mutex_unlock(gLock);
+   RpcAsyncQueue(chan, RPC_ASYNC_BURST + 3);
+   RpcAsyncWait(&gSent, RPC_ASYNC_BURST + 4);
+   RpcChannel_ShutdownAsync(chan);
+   RpcAsyncCheck("requests failed by shutdown", gFailedReqs, 2);
+   RpcAsyncCheck("connections closed after shutdown", gClosed, 2);
+   RpcAsyncCheck("synchronous sends", gSyncSent, 1);
+
+   g_static_mutex_free(&chan->outLock);
+   g_free(chan);
+   g_cond_free(gCond);
+   g_mutex_free(gLock);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+}
@@ -0,0 +1,647 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * slashProcNetRef.c --
+ *
+ *      The GRegex-based /proc/net parsers that lib/slashProc used before it
+ *      switched to tokenizing the nodes in place. slashProcNetTest checks
+ *      that the current parsers return the same results as these for
+ *      captured and fuzzed nodes, and compares their speed.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "vmware.h"
+#include "slashProc.h"
+#include "slashProcNetRef.h"
+
+
+/*
+ * Evaluates an expression with a regular expression match, available as
+ * MATCH, then frees the match.
+ */
+#define MATCHEXPR(matchInfo, matchIndex, expr) do {                     \
+   gchar *MATCH = g_match_info_fetch(matchInfo, matchIndex);            \
+   expr;                                                                \
+   g_free(MATCH);                                                       \
+} while(0)
+
+
+static void Ip6StringToIn6Addr(const char *ip6String,
+                               struct in6_addr *in6_addr);
+static guint64 MatchToGuint64(const GMatchInfo *matchInfo,
+                              const gint matchIndex,
+                              gint base);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SlashProcNetRef_GetSnmp --
+ *
+ *      Parses a /proc/net/snmp node like SlashProcNet_GetSnmp used to.
+ *
+ * Results:
+ *      See SlashProcNet_GetSnmp.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+GHashTable *
+SlashProcNetRef_GetSnmp(const char *path)   // IN
+{
+   GHashTable *myHashTable = NULL;
+   GIOChannel *myChannel = NULL;
+   GIOStatus keyIoStatus = G_IO_STATUS_ERROR;
+   GIOStatus valIoStatus = G_IO_STATUS_ERROR;
+   gchar *myKeyLine = NULL;
+   gchar *myValLine = NULL;
+   Bool parseError = FALSE;
+   int fd = -1;
+
+   static GRegex *myKeyRegex = NULL;
+   static GRegex *myValRegex = NULL;
+
+   if (myKeyRegex == NULL) {
+      myKeyRegex = g_regex_new("^(\\w+): (\\w+ )*(\\w+)$", G_REGEX_OPTIMIZE,
+                               0, NULL);
+      myValRegex = g_regex_new("^(\\w+): (-?\\d+ )*(-?\\d+)$", G_REGEX_OPTIMIZE,
+                               0, NULL);
+      ASSERT(myKeyRegex);
+      ASSERT(myValRegex);
+   }
+
+   if ((fd = g_open(path, O_RDONLY)) == -1) {
+      return NULL;
+   }
+
+   myChannel = g_io_channel_unix_new(fd);
+
+   myHashTable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+   /*
+    * Expected format:
+    *
+    * pfx0: key0 key1 key2 ... keyN
+    * pfx0: val0 val1 val2 ... valN
+    * ...
+    * pfxN: ...
+    */
+
+   while ((keyIoStatus = g_io_channel_read_line(myChannel, &myKeyLine, NULL, NULL,
+                                                NULL)) == G_IO_STATUS_NORMAL &&
+          (valIoStatus = g_io_channel_read_line(myChannel, &myValLine, NULL, NULL,
+                                                NULL)) == G_IO_STATUS_NORMAL) {
+
+      GMatchInfo *keyMatchInfo = NULL;
+      GMatchInfo *valMatchInfo = NULL;
+
+      gchar **myKeys = NULL;
+      gchar **myVals = NULL;
+
+      gchar **myKey = NULL;
+      gchar **myVal = NULL;
+
+      gchar *keyPrefix = NULL;
+      gchar *valPrefix = NULL;
+
+      /*
+       * Per format above, we expect a pair of lines with a matching prefix.
+       */
+      {
+         if (!g_regex_match(myKeyRegex, myKeyLine, 0, &keyMatchInfo) ||
+             !g_regex_match(myValRegex, myValLine, 0, &valMatchInfo)) {
+            parseError = TRUE;
+            goto badIteration;
+         }
+
+         keyPrefix = g_match_info_fetch(keyMatchInfo, 1);
+         valPrefix = g_match_info_fetch(valMatchInfo, 1);
+
+         ASSERT(keyPrefix);
+         ASSERT(valPrefix);
+
+         if (strcmp(keyPrefix, valPrefix)) {
+            parseError = TRUE;
+            goto badIteration;
+         }
+      }
+
+      myKeys = g_strsplit(myKeyLine, " ", 0);
+      myVals = g_strsplit(myValLine, " ", 0);
+
+      /*
+       * Iterate over the columns, combining the column keys with the prefix
+       * to form the new key name.  (I.e., "Ip: InDiscards" => "IpInDiscards".)
+       */
+      for (myKey = &myKeys[1], myVal = &myVals[1];
+           *myKey && *myVal;
+           myKey++, myVal++) {
+         gchar *hashKey;
+         guint64 *myIntVal = NULL;
+
+         hashKey = g_strjoin(NULL, keyPrefix, *myKey, NULL);
+         g_strstrip(hashKey);
+
+         /*
+          * By virtue of having matched the above regex, this conversion
+          * must hold.
+          */
+         myIntVal = g_new(guint64, 1);
+         *myIntVal = g_ascii_strtoull(*myVal, NULL, 10);
+
+         /*
+          * If our input contains duplicate keys, which I really don't see
+          * happening, the latter value overrides the former.
+          *
+          * NB: myHashTable claims ownership of hashKey.
+          */
+         g_hash_table_insert(myHashTable, hashKey, myIntVal);
+      }
+
+      /*
+       * Make sure the column counts matched.  If we succeeded, both pointers
+       * should now be NULL.
+       */
+      if (*myKey || *myVal) {
+         parseError = TRUE;
+      }
+
+badIteration:
+      g_match_info_free(keyMatchInfo);
+      g_match_info_free(valMatchInfo);
+
+      g_free(keyPrefix);
+      g_free(valPrefix);
+
+      g_strfreev(myKeys);
+      g_strfreev(myVals);
+
+      g_free(myKeyLine);
+      g_free(myValLine);
+      myKeyLine = NULL;
+      myValLine = NULL;
+
+      if (parseError) {
+         break;
+      }
+   }
+
+   /*
+    * Error conditions:
+    *    Hash table empty:      Unable to parse any input.
+    *    myKeyLine != NULL:     Failed to read "key" and "value" lines during
+    *                           same loop iteration.
+    *    parseError == TRUE:    See loop body above.
+    */
+   if (keyIoStatus == G_IO_STATUS_ERROR ||
+       valIoStatus == G_IO_STATUS_ERROR ||
+       g_hash_table_size(myHashTable) == 0 ||
+       parseError) {
+      g_hash_table_destroy(myHashTable);
+      myHashTable = NULL;
+   }
+
+   g_free(myKeyLine);
+   g_free(myValLine);
+   myKeyLine = NULL;
+   myValLine = NULL;
+
+   close(fd);
+   g_io_channel_unref(myChannel);
+
+   return myHashTable;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SlashProcNetRef_GetSnmp6 --
+ *
+ *      Parses a /proc/net/snmp6 node like SlashProcNet_GetSnmp6 used to.
+ *
+ * Results:
+ *      See SlashProcNet_GetSnmp6.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+GHashTable *
+SlashProcNetRef_GetSnmp6(const char *path)   // IN
+{
+   GHashTable *myHashTable = NULL;
+   GIOChannel *myChannel = NULL;
+   GIOStatus ioStatus;
+   gchar *myInputLine = NULL;
+   Bool parseError = FALSE;
+   int fd = -1;
+
+   static GRegex *myRegex = NULL;
+
+   if (myRegex == NULL) {
+      myRegex = g_regex_new("^(\\w+)\\s+(-?\\d+)\\s*$", G_REGEX_OPTIMIZE,
+                            0, NULL);
+      ASSERT(myRegex);
+   }
+
+   if ((fd = g_open(path, O_RDONLY)) == -1) {
+      return NULL;
+   }
+
+   myChannel = g_io_channel_unix_new(fd);
+
+   myHashTable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+   /*
+    * Expected format:
+    *
+    * key1                              value1
+    * key2                              value2
+    * ...
+    * keyN                              valueN
+    */
+
+   while ((ioStatus = g_io_channel_read_line(myChannel, &myInputLine, NULL,
+                                             NULL, NULL)) == G_IO_STATUS_NORMAL) {
+      GMatchInfo *matchInfo = NULL;
+
+      if (g_regex_match(myRegex, myInputLine, 0, &matchInfo)) {
+         gchar *myKey = NULL;
+         gchar *myVal = NULL;
+         guint64 *myIntVal = NULL;
+
+         myKey = g_match_info_fetch(matchInfo, 1);
+         myVal = g_match_info_fetch(matchInfo, 2);
+
+         /*
+          * By virtue of having matched the above regex, this conversion
+          * must hold.
+          */
+         myIntVal = g_new(guint64, 1);
+         *myIntVal = g_ascii_strtoull(myVal, NULL, 10);
+
+         /*
+          * The hash table will take ownership of myKey and myIntVal.  We're
+          * still responsible for myVal.
+          */
+         g_hash_table_insert(myHashTable, myKey, myIntVal);
+         g_free(myVal);
+      } else {
+         parseError = TRUE;
+      }
+
+      g_match_info_free(matchInfo);
+      g_free(myInputLine);
+      myInputLine = NULL;
+
+      if (parseError) {
+         break;
+      }
+   }
+
+   if (ioStatus == G_IO_STATUS_ERROR ||
+       g_hash_table_size(myHashTable) == 0 ||
+       parseError) {
+      g_hash_table_destroy(myHashTable);
+      myHashTable = NULL;
+   }
+
+   close(fd);
+   g_io_channel_unref(myChannel);
+
+   return myHashTable;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SlashProcNetRef_GetRoute --
+ *
+ *      Parses a /proc/net/route node like SlashProcNet_GetRoute used to.
+ *
+ * Results:
+ *      See SlashProcNet_GetRoute. Free with SlashProcNet_FreeRoute.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+GPtrArray *
+SlashProcNetRef_GetRoute(const char *path)   // IN
+{
+   GIOChannel *myChannel = NULL;
+   GIOStatus myIoStatus;
+   GPtrArray *myArray = NULL;
+   gchar *myLine = NULL;
+   int fd = -1;
+
+   static GRegex *myFieldsRE = NULL;
+   static GRegex *myValuesRE = NULL;
+
+   if (myFieldsRE == NULL) {
+      myFieldsRE = g_regex_new("^Iface\\s+Destination\\s+Gateway\\s+Flags\\s+"
+                               "RefCnt\\s+Use\\s+Metric\\s+Mask\\s+MTU\\s+"
+                               "Window\\s+IRTT\\s*$", 0, 0, NULL);
+      myValuesRE = g_regex_new("^(\\S+)\\s+([[:xdigit:]]{8})\\s+"
+                               "([[:xdigit:]]{8})\\s+([[:xdigit:]]{4})\\s+"
+                               "\\d+\\s+\\d+\\s+(\\d+)\\s+"
+                               "([[:xdigit:]]{8})\\s+(\\d+)\\s+\\d+\\s+(\\d+)\\s*$",
+                               0, 0, NULL);
+      ASSERT(myFieldsRE);
+      ASSERT(myValuesRE);
+   }
+
+   /*
+    * 1.  Open path, associate it with a GIOChannel.
+    */
+
+   if ((fd = g_open(path, O_RDONLY)) == -1) {
+      return NULL;
+   }
+
+   myChannel = g_io_channel_unix_new(fd);
+
+   /*
+    * 2.  Sanity check the header, making sure it matches what we expect.
+    *     (It's -extremely- unlikely this will change, but we should check
+    *     anyway.)
+    */
+
+   myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL, NULL);
+   if (myIoStatus != G_IO_STATUS_NORMAL ||
+       g_regex_match(myFieldsRE, myLine, 0, NULL) == FALSE) {
+      goto out;
+   }
+
+   g_free(myLine);
+   myLine = NULL;
+
+   myArray = g_ptr_array_new();
+
+   /*
+    * 3.  For each line...
+    */
+
+   while ((myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL,
+                                               NULL)) == G_IO_STATUS_NORMAL) {
+      GMatchInfo *myMatchInfo = NULL;
+      struct rtentry *myEntry = NULL;
+      struct sockaddr_in *sin = NULL;
+      Bool parseError = FALSE;
+
+      /*
+       * 3a. Validate with regex.
+       */
+      if (!g_regex_match(myValuesRE, myLine, 0, &myMatchInfo)) {
+         parseError = TRUE;
+         goto badIteration;
+      }
+
+      /*
+       * 3b. Allocate new rtentry, add to array.  This simplifies the cleanup
+       *     code path.
+       */
+      myEntry = g_new0(struct rtentry, 1);
+      g_ptr_array_add(myArray, myEntry);
+
+      /*
+       * 3c. Copy contents to new struct rtentry.
+       */
+      myEntry->rt_dev = g_match_info_fetch(myMatchInfo, 1);
+
+      sin = (struct sockaddr_in *)&myEntry->rt_dst;
+      sin->sin_family = AF_INET;
+      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 2, 16);
+
+      sin = (struct sockaddr_in *)&myEntry->rt_gateway;
+      sin->sin_family = AF_INET;
+      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 3, 16);
+
+      sin = (struct sockaddr_in *)&myEntry->rt_genmask;
+      sin->sin_family = AF_INET;
+      sin->sin_addr.s_addr = MatchToGuint64(myMatchInfo, 6, 16);
+
+      myEntry->rt_flags = MatchToGuint64(myMatchInfo, 4, 16);
+      myEntry->rt_metric = MatchToGuint64(myMatchInfo, 5, 10);
+      myEntry->rt_mtu = MatchToGuint64(myMatchInfo, 7, 10);
+      myEntry->rt_irtt = MatchToGuint64(myMatchInfo, 8, 10);
+
+badIteration:
+      g_free(myLine);
+      myLine = NULL;
+
+      g_match_info_free(myMatchInfo);
+      myMatchInfo = NULL;
+
+      if (parseError) {
+         break;
+      }
+   }
+
+   if (myArray && myIoStatus != G_IO_STATUS_EOF) {
+      SlashProcNet_FreeRoute(myArray);
+      myArray = NULL;
+   }
+
+out:
+   g_free(myLine);
+   close(fd);
+   g_io_channel_unref(myChannel);
+
+   return myArray;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SlashProcNetRef_GetRoute6 --
+ *
+ *      Parses a /proc/net/ipv6_route node like SlashProcNet_GetRoute6 used
+ *      to.
+ *
+ * Results:
+ *      See SlashProcNet_GetRoute6. Free with SlashProcNet_FreeRoute6.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+GPtrArray *
+SlashProcNetRef_GetRoute6(const char *path)   // IN
+{
+   GIOChannel *myChannel = NULL;
+   GIOStatus myIoStatus;
+   GPtrArray *myArray = NULL;
+   gchar *myLine = NULL;
+   Bool parseError = FALSE;
+   int fd = -1;
+
+   static GRegex *myValuesRE = NULL;
+
+   if (myValuesRE == NULL) {
+      myValuesRE = g_regex_new("^([[:xdigit:]]{32}) ([[:xdigit:]]{2}) "
+                                "([[:xdigit:]]{32}) ([[:xdigit:]]{2}) "
+                                "([[:xdigit:]]{32}) ([[:xdigit:]]{8}) "
+                                "[[:xdigit:]]{8} [[:xdigit:]]{8} "
+                                "([[:xdigit:]]{8})\\s+(\\S+)\\s*$", 0, 0,
+                                NULL);
+      ASSERT(myValuesRE);
+   }
+
+   /*
+    * 1.  Open path, associate it with a GIOChannel.
+    */
+
+   if ((fd = g_open(path, O_RDONLY)) == -1) {
+      return NULL;
+   }
+
+   myChannel = g_io_channel_unix_new(fd);
+
+   myArray = g_ptr_array_new();
+
+   while ((myIoStatus = g_io_channel_read_line(myChannel, &myLine, NULL, NULL,
+                                               NULL)) == G_IO_STATUS_NORMAL) {
+      struct in6_rtmsg *myEntry = NULL;
+      GMatchInfo *myMatchInfo = NULL;
+
+      if (!g_regex_match(myValuesRE, myLine, 0, &myMatchInfo)) {
+         parseError = TRUE;
+         goto badIteration;
+      }
+
+      myEntry = g_new0(struct in6_rtmsg, 1);
+      g_ptr_array_add(myArray, myEntry);
+
+      MATCHEXPR(myMatchInfo, 1, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_dst));
+      MATCHEXPR(myMatchInfo, 3, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_src));
+      MATCHEXPR(myMatchInfo, 5, Ip6StringToIn6Addr(MATCH, &myEntry->rtmsg_gateway));
+
+      myEntry->rtmsg_dst_len = MatchToGuint64(myMatchInfo, 2, 16);
+      myEntry->rtmsg_src_len = MatchToGuint64(myMatchInfo, 4, 16);
+      myEntry->rtmsg_metric = MatchToGuint64(myMatchInfo, 6, 16);
+      myEntry->rtmsg_flags = MatchToGuint64(myMatchInfo, 7, 16);
+
+      MATCHEXPR(myMatchInfo, 8, myEntry->rtmsg_ifindex = if_nametoindex(MATCH));
+
+badIteration:
+      g_free(myLine);
+      myLine = NULL;
+
+      g_match_info_free(myMatchInfo);
+      myMatchInfo = NULL;
+
+      if (parseError) {
+         break;
+      }
+   }
+
+   if (myArray && myIoStatus != G_IO_STATUS_EOF) {
+      SlashProcNet_FreeRoute6(myArray);
+      myArray = NULL;
+   }
+
+   g_free(myLine);
+   myLine = NULL;
+
+   close(fd);
+   g_io_channel_unref(myChannel);
+
+   return myArray;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Ip6StringToIn6Addr --
+ *
+ *      Parses a /proc/net/ipv6_route hexadecimal IPv6 address.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Ip6StringToIn6Addr(const char *ip6String,     // IN
+                   struct in6_addr *in6_addr) // OUT
+{
+   unsigned int i;
+
+   ASSERT(strlen(ip6String) == 32);
+
+   for (i = 0; i < 16; i++) {
+      int nmatched;
+      nmatched = sscanf(&ip6String[2 * i], "%2hhx", &in6_addr->s6_addr[i]);
+      ASSERT(nmatched == 1);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MatchToGuint64 --
+ *
+ *      Converts a regular expression match to an integer.
+ *
+ * Results:
+ *      The integer.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint64
+MatchToGuint64(const GMatchInfo *matchInfo,  // IN
+               const gint matchIndex,       // IN
+               gint base)                   // IN
+{
+   guint64 retval;
+   MATCHEXPR(matchInfo, matchIndex, retval = g_ascii_strtoull(MATCH, NULL, base));
+   return retval;
+}
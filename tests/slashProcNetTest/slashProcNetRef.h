@@ -0,0 +1,35 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * slashProcNetRef.h --
+ *
+ *      Reference /proc/net parsers, see slashProcNetRef.c.
+ */
+
+#ifndef _SLASHPROCNETREF_H_
+#define _SLASHPROCNETREF_H_
+
+#include <glib.h>
+
+GHashTable *SlashProcNetRef_GetSnmp(const char *path);
+GHashTable *SlashProcNetRef_GetSnmp6(const char *path);
+GPtrArray *SlashProcNetRef_GetRoute(const char *path);
+GPtrArray *SlashProcNetRef_GetRoute6(const char *path);
+
+#endif // ifndef _SLASHPROCNETREF_H_
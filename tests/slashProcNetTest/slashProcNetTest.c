@@ -0,0 +1,641 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * slashProcNetTest.c --
+ *
+ *      Checks the /proc/net parsers of lib/slashProc against the GRegex-based
+ *      parsers they replaced (see slashProcNetRef.c). Each captured node in
+ *      the fixtures directory must parse, and give the same results with
+ *      both parsers. Then the nodes are fuzzed: random bytes and lines are
+ *      replaced, inserted, duplicated or removed, and both parsers must agree
+ *      on every mutated node, whether they accept it or not.
+ *
+ *      With --bench, the test instead times both parsers on generated
+ *      /proc/net/route and /proc/net/ipv6_route nodes with the given number
+ *      of routes.
+ *
+ *      Lines are assumed to end with '\n', as they do in /proc, so the fuzzer
+ *      doesn't insert '\r' or NUL characters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/route.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "slashProc.h"
+#include "slashProcNetInt.h"
+#include "slashProcNetRef.h"
+#include <glib/gstdio.h>
+
+/* Characters the fuzzer inserts: separators, and bits of keys and values. */
+#define FUZZ_ALPHABET      " \t\n:-_0179afAFxzI"
+
+/* A valid UTF-8 character, for interface names. */
+#define FUZZ_UTF8          "\xc3\xa9"
+
+/* Number of times each parser is run by the benchmark. */
+#define BENCH_RUNS         5
+
+typedef gboolean (*NodeCompareFn)(const char *path, gboolean *parsed);
+
+typedef struct SlashProcNetNode {
+   const char *name;                   /* File name in the fixtures dir. */
+   void (*setPath)(const char *path);
+   NodeCompareFn compare;
+   gboolean utf8;                      /* Whether to insert UTF-8 chars. */
+} SlashProcNetNode;
+
+typedef struct SnmpCompare {
+   GHashTable *other;
+   gboolean equal;
+} SnmpCompare;
+
+static gchar *gFixtures = SLASHPROCNETTEST_FIXTURES;
+static gint gIterations = 1000;
+static gint gSeed = 1;
+static gint gBenchRoutes = 0;
+static gchar *gTmpFile = NULL;
+static gboolean gFailed = FALSE;
+
+static GOptionEntry gOptions[] = {
+   { "fixtures", 'f', 0, G_OPTION_ARG_FILENAME, &gFixtures,
+     "directory with the captured nodes", "DIR" },
+   { "iterations", 'n', 0, G_OPTION_ARG_INT, &gIterations,
+     "mutated nodes checked per captured node (default 1000)", "N" },
+   { "seed", 's', 0, G_OPTION_ARG_INT, &gSeed,
+     "seed of the fuzzer (default 1)", "N" },
+   { "bench", 'b', 0, G_OPTION_ARG_INT, &gBenchRoutes,
+     "benchmark the route parsers on N routes instead", "N" },
+   { NULL }
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CompareSnmpEntry --
+ *
+ *      g_hash_table_foreach callback: checks that an entry has the same
+ *      value in the other table.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Clears the equal flag on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CompareSnmpEntry(gpointer key,      // IN
+                 gpointer value,    // IN
+                 gpointer data)     // IN/OUT
+{
+   SnmpCompare *cmp = data;
+   guint64 *other = g_hash_table_lookup(cmp->other, key);
+
+   if (other == NULL || *other != *(guint64 *)value) {
+      cmp->equal = FALSE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CompareSnmpTables --
+ *
+ *      Compares the results of two snmp parsers.
+ *
+ * Results:
+ *      TRUE if both failed, or both returned the same keys and values.
+ *
+ * Side effects:
+ *      Frees the tables.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+CompareSnmpTables(GHashTable *table,      // IN
+                  GHashTable *ref,        // IN
+                  gboolean *parsed)       // OUT
+{
+   SnmpCompare cmp = { ref, TRUE };
+
+   *parsed = table != NULL;
+   if (table == NULL || ref == NULL) {
+      cmp.equal = table == ref;
+   } else if (g_hash_table_size(table) != g_hash_table_size(ref)) {
+      cmp.equal = FALSE;
+   } else {
+      g_hash_table_foreach(table, CompareSnmpEntry, &cmp);
+   }
+
+   if (table != NULL) {
+      g_hash_table_destroy(table);
+   }
+   if (ref != NULL) {
+      g_hash_table_destroy(ref);
+   }
+   return cmp.equal;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CompareSnmp --
+ * CompareSnmp6 --
+ *
+ *      Parses a node with both snmp (or snmp6) parsers.
+ *
+ * Results:
+ *      TRUE if the results are the same.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+CompareSnmp(const char *path,       // IN
+            gboolean *parsed)       // OUT
+{
+   return CompareSnmpTables(SlashProcNet_GetSnmp(),
+                            SlashProcNetRef_GetSnmp(path), parsed);
+}
+
+static gboolean
+CompareSnmp6(const char *path,      // IN
+             gboolean *parsed)      // OUT
+{
+   return CompareSnmpTables(SlashProcNet_GetSnmp6(),
+                            SlashProcNetRef_GetSnmp6(path), parsed);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CompareRoute --
+ *
+ *      Parses a node with both /proc/net/route parsers.
+ *
+ * Results:
+ *      TRUE if both failed, or both returned the same routes.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+CompareRoute(const char *path,      // IN
+             gboolean *parsed)      // OUT
+{
+   GPtrArray *routes = SlashProcNet_GetRoute();
+   GPtrArray *ref = SlashProcNetRef_GetRoute(path);
+   gboolean equal;
+   guint i;
+
+   *parsed = routes != NULL;
+   if (routes == NULL || ref == NULL) {
+      equal = routes == ref;
+   } else {
+      equal = routes->len == ref->len;
+      for (i = 0; equal && i < routes->len; i++) {
+         struct rtentry *a = g_ptr_array_index(routes, i);
+         struct rtentry *b = g_ptr_array_index(ref, i);
+
+         equal = strcmp(a->rt_dev, b->rt_dev) == 0 &&
+                 memcmp(&a->rt_dst, &b->rt_dst, sizeof a->rt_dst) == 0 &&
+                 memcmp(&a->rt_gateway, &b->rt_gateway,
+                        sizeof a->rt_gateway) == 0 &&
+                 memcmp(&a->rt_genmask, &b->rt_genmask,
+                        sizeof a->rt_genmask) == 0 &&
+                 a->rt_flags == b->rt_flags &&
+                 a->rt_metric == b->rt_metric &&
+                 a->rt_mtu == b->rt_mtu &&
+                 a->rt_irtt == b->rt_irtt;
+      }
+   }
+
+   SlashProcNet_FreeRoute(routes);
+   SlashProcNet_FreeRoute(ref);
+   return equal;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CompareRoute6 --
+ *
+ *      Parses a node with both /proc/net/ipv6_route parsers.
+ *
+ * Results:
+ *      TRUE if both failed, or both returned the same routes.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+CompareRoute6(const char *path,     // IN
+              gboolean *parsed)     // OUT
+{
+   GPtrArray *routes = SlashProcNet_GetRoute6();
+   GPtrArray *ref = SlashProcNetRef_GetRoute6(path);
+   gboolean equal;
+   guint i;
+
+   *parsed = routes != NULL;
+   if (routes == NULL || ref == NULL) {
+      equal = routes == ref;
+   } else {
+      /* Both parsers zero the entries, so they can be compared whole. */
+      equal = routes->len == ref->len;
+      for (i = 0; equal && i < routes->len; i++) {
+         equal = memcmp(g_ptr_array_index(routes, i),
+                        g_ptr_array_index(ref, i),
+                        sizeof (struct in6_rtmsg)) == 0;
+      }
+   }
+
+   SlashProcNet_FreeRoute6(routes);
+   SlashProcNet_FreeRoute6(ref);
+   return equal;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Mutate --
+ *
+ *      Applies a random mutation to a node's contents.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Modifies data.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Mutate(GRand *rand,        // IN
+       GString *data,      // IN/OUT
+       gboolean utf8)      // IN
+{
+   static const char alphabet[] = FUZZ_ALPHABET;
+   gsize pos = data->len > 0 ? g_rand_int_range(rand, 0, data->len) : 0;
+   gchar c = alphabet[g_rand_int_range(rand, 0, sizeof alphabet - 1)];
+   const gchar *lineStart;
+   const gchar *lineEnd;
+
+   switch (g_rand_int_range(rand, 0, 7)) {
+   case 0:     /* Replace a character. */
+      if (data->len > 0) {
+         data->str[pos] = c;
+      }
+      break;
+   case 1:     /* Remove a character. */
+      if (data->len > 0) {
+         g_string_erase(data, pos, 1);
+      }
+      break;
+   case 2:     /* Insert a character. */
+      if (utf8 && g_rand_int_range(rand, 0, 4) == 0) {
+         g_string_insert(data, pos, FUZZ_UTF8);
+      } else {
+         g_string_insert_c(data, pos, c);
+      }
+      break;
+   case 3:     /* Double a separator. */
+      while (pos < data->len && data->str[pos] != ' ' &&
+             data->str[pos] != '\t') {
+         pos++;
+      }
+      if (pos < data->len) {
+         g_string_insert_c(data, pos, data->str[pos] == ' ' ? '\t' : ' ');
+      }
+      break;
+   case 4:     /* Duplicate a line. */
+   case 5:     /* Remove a line. */
+      lineStart = data->str + pos;
+      while (lineStart > data->str && lineStart[-1] != '\n') {
+         lineStart--;
+      }
+      lineEnd = strchr(data->str + pos, '\n');
+      lineEnd = (lineEnd != NULL) ? lineEnd + 1 : data->str + data->len;
+      if (lineEnd > lineStart) {
+         gsize start = lineStart - data->str;
+         gsize len = lineEnd - lineStart;
+
+         if (g_rand_int_range(rand, 4, 6) == 4) {
+            gchar *line = g_strndup(lineStart, len);
+            g_string_insert(data, start, line);
+            g_free(line);
+         } else {
+            g_string_erase(data, start, len);
+         }
+      }
+      break;
+   default:    /* Truncate. */
+      g_string_truncate(data, pos);
+      break;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckNode --
+ *
+ *      Checks a captured node, then fuzzes it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch, and keeps the mismatching node.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CheckNode(const SlashProcNetNode *node)     // IN
+{
+   gchar *fixture = g_build_filename(gFixtures, node->name, NULL);
+   gchar *contents = NULL;
+   gsize len;
+   GRand *rand;
+   guint accepted = 0;
+   gboolean failed = FALSE;
+   gboolean parsed;
+   gint i;
+
+   if (!g_file_get_contents(fixture, &contents, &len, NULL)) {
+      g_print("%-12s cannot read %s: FAILED\n", node->name, fixture);
+      gFailed = TRUE;
+      g_free(fixture);
+      return;
+   }
+
+   node->setPath(fixture);
+   if (!node->compare(fixture, &parsed) || !parsed) {
+      g_print("%-12s captured node %s: FAILED\n", node->name,
+              parsed ? "differs" : "rejected");
+      failed = TRUE;
+   }
+
+   node->setPath(gTmpFile);
+   rand = g_rand_new_with_seed(gSeed);
+
+   for (i = 0; i < gIterations; i++) {
+      GString *data = g_string_new_len(contents, len);
+      gint mutations = g_rand_int_range(rand, 1, 5);
+
+      while (mutations-- > 0) {
+         Mutate(rand, data, node->utf8);
+      }
+
+      if (!g_file_set_contents(gTmpFile, data->str, data->len, NULL)) {
+         g_print("%-12s cannot write %s: FAILED\n", node->name, gTmpFile);
+         failed = TRUE;
+         g_string_free(data, TRUE);
+         break;
+      }
+
+      if (!node->compare(gTmpFile, &parsed)) {
+         gchar *keep = g_strdup_printf("%s.%s.%d", gTmpFile, node->name, i);
+
+         g_print("%-12s mutation %d differs, kept as %s: FAILED\n",
+                 node->name, i, keep);
+         g_file_set_contents(keep, data->str, data->len, NULL);
+         g_free(keep);
+         failed = TRUE;
+      } else if (parsed) {
+         accepted++;
+      }
+
+      g_string_free(data, TRUE);
+   }
+
+   g_print("%-12s %d mutations, %u accepted: %s\n", node->name, gIterations,
+           accepted, failed ? "FAILED" : "ok");
+   gFailed = gFailed || failed;
+
+   g_rand_free(rand);
+   node->setPath(NULL);
+   g_free(contents);
+   g_free(fixture);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNode --
+ *
+ *      Times a parser and its reference on a generated node.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed if the parsers disagree.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchNode(const char *name,                         // IN
+          const GString *data,                      // IN
+          void (*setPath)(const char *),            // IN
+          GPtrArray *(*get)(void),                  // IN
+          GPtrArray *(*getRef)(const char *),       // IN
+          void (*freeRoutes)(GPtrArray *),          // IN
+          NodeCompareFn compare)                    // IN
+{
+   VmTimeType best = 0;
+   VmTimeType bestRef = 0;
+   gboolean parsed;
+   gint i;
+
+   g_file_set_contents(gTmpFile, data->str, data->len, NULL);
+   setPath(gTmpFile);
+
+   for (i = 0; i < BENCH_RUNS; i++) {
+      VmTimeType start = Hostinfo_SystemTimerUS();
+      VmTimeType elapsed;
+
+      freeRoutes(get());
+      elapsed = Hostinfo_SystemTimerUS() - start;
+      best = (i == 0 || elapsed < best) ? elapsed : best;
+
+      start = Hostinfo_SystemTimerUS();
+      freeRoutes(getRef(gTmpFile));
+      elapsed = Hostinfo_SystemTimerUS() - start;
+      bestRef = (i == 0 || elapsed < bestRef) ? elapsed : bestRef;
+   }
+
+   if (!compare(gTmpFile, &parsed) || !parsed) {
+      g_print("%-12s parsers disagree: FAILED\n", name);
+      gFailed = TRUE;
+   }
+
+   g_print("%-12s %d routes, %" G_GSIZE_FORMAT " bytes: %.1f ms "
+           "(GRegex: %.1f ms, %.1fx)\n", name, gBenchRoutes, data->len,
+           best / 1000.0, bestRef / 1000.0,
+           best > 0 ? (double)bestRef / best : 0.0);
+
+   setPath(NULL);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Bench --
+ *
+ *      Generates route tables with gBenchRoutes routes, and times the
+ *      parsers on them.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      See BenchNode.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Bench(void)
+{
+   static const char *ifaces[] = { "eth0", "eth1", "docker0", "lo" };
+   GString *data = g_string_new("Iface\tDestination\tGateway \tFlags\tRefCnt\t"
+                                "Use\tMetric\tMask\t\tMTU\tWindow\tIRTT"
+                                "                                    \n");
+   gint i;
+
+   for (i = 0; i < gBenchRoutes; i++) {
+      g_string_append_printf(data, "%s\t%08X\t%08X\t%04X\t0\t0\t%d\t%08X\t"
+                             "0\t0\t0                                    "
+                             "                                          \n",
+                             ifaces[i % 3], GUINT32_TO_BE(0x0a000000 | i),
+                             (i % 4) ? GUINT32_TO_BE(0x0a000001) : 0,
+                             (i % 4) ? 3 : 1, i % 100, 0x00ffffff);
+   }
+   BenchNode("route", data, SlashProcNetSetPathRoute, SlashProcNet_GetRoute,
+             SlashProcNetRef_GetRoute, SlashProcNet_FreeRoute, CompareRoute);
+
+   g_string_truncate(data, 0);
+   for (i = 0; i < gBenchRoutes; i++) {
+      g_string_append_printf(data, "20010db8%08x0000000000000000 40 "
+                             "00000000000000000000000000000000 00 "
+                             "%s %08x 00000001 00000000 %08x %8s\n",
+                             i,
+                             (i % 4) ? "fe800000000000000000000000000001" :
+                                       "00000000000000000000000000000000",
+                             i % 1024, (i % 4) ? 0x3 : 0x1,
+                             ifaces[i % G_N_ELEMENTS(ifaces)]);
+   }
+   BenchNode("ipv6_route", data, SlashProcNetSetPathRoute6,
+             SlashProcNet_GetRoute6, SlashProcNetRef_GetRoute6,
+             SlashProcNet_FreeRoute6, CompareRoute6);
+
+   g_string_free(data, TRUE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the tests, or the benchmark.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      Writes and deletes a temporary file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   static const SlashProcNetNode nodes[] = {
+      { "snmp",       SlashProcNetSetPathSnmp,   CompareSnmp,   FALSE },
+      { "snmp6",      SlashProcNetSetPathSnmp6,  CompareSnmp6,  FALSE },
+      { "route",      SlashProcNetSetPathRoute,  CompareRoute,  TRUE },
+      { "ipv6_route", SlashProcNetSetPathRoute6, CompareRoute6, TRUE },
+   };
+   GOptionContext *context;
+   GError *error = NULL;
+   gchar *name;
+   guint i;
+
+   context = g_option_context_new("- check the /proc/net parsers");
+   g_option_context_add_main_entries(context, gOptions, NULL);
+   if (!g_option_context_parse(context, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_clear_error(&error);
+      g_option_context_free(context);
+      return 1;
+   }
+   g_option_context_free(context);
+
+   name = g_strdup_printf("slashProcNetTest.%u", (unsigned)getpid());
+   gTmpFile = g_build_filename(g_get_tmp_dir(), name, NULL);
+   g_free(name);
+
+   if (gBenchRoutes > 0) {
+      Bench();
+   } else {
+      g_print("fixtures in %s, seed %d\n", gFixtures, gSeed);
+      for (i = 0; i < G_N_ELEMENTS(nodes); i++) {
+         CheckNode(&nodes[i]);
+      }
+   }
+
+   g_unlink(gTmpFile);
+   g_free(gTmpFile);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file startupBench.c
+ *
+ * A debug plugin used to measure the service's startup time. Once the main
+ * loop is running, it sends the "Capabilities_Register" RPC the way the VMX
+ * does when the service starts, prints the service's startup timeline to
+ * stdout and asks the service to stop. Run it with:
+ *
+ *    vmtoolsd -n vmsvc -g /path/to/libstartupBench.so
+ *
+ * The startupBench.sh script in this directory runs the service a number of
+ * times with this plugin and prints percentiles for each phase.
+ */
+
+#define G_LOG_DOMAIN "startupBench"
+
+#include <string.h>
+#include <glib-object.h>
+
+#include "vm_basic_types.h"
+#include "vmware/tools/rpcdebug.h"
+
+#define STARTUPBENCH_CAPS_CMD "Capabilities_Register"
+
+typedef enum {
+   STARTUPBENCH_WAIT_MAINLOOP,
+   STARTUPBENCH_SEND_CAPS,
+   STARTUPBENCH_DONE,
+} StartupBenchStep;
+
+static ToolsAppCtx *gCtx;
+static StartupBenchStep gStep = STARTUPBENCH_WAIT_MAINLOOP;
+
+
+/**
+ * Returns the service's current startup timeline.
+ *
+ * @return The timeline, or NULL if the main loop hasn't started yet. Should
+ *         be freed with g_free().
+ */
+
+static gchar *
+StartupBenchGetTimeline(void)
+{
+   gchar *timeline = NULL;
+
+   g_object_get(gCtx->serviceObj, TOOLS_CORE_PROP_TIMELINE, &timeline, NULL);
+   return timeline;
+}
+
+
+/**
+ * Drives the benchmark each time the debug channel asks for a message: waits
+ * for the main loop to start, sends the capabilities registration, then prints
+ * the timeline and tells the channel there is nothing else to send.
+ *
+ * @param[out] rpcdata     Where to store the message to send.
+ *
+ * @return Whether to keep the debug channel running.
+ */
+
+static gboolean
+StartupBenchSendNext(RpcDebugMsgMapping *rpcdata)
+{
+   gchar *timeline;
+
+   switch (gStep) {
+   case STARTUPBENCH_WAIT_MAINLOOP:
+      timeline = StartupBenchGetTimeline();
+      if (timeline != NULL) {
+         rpcdata->message = STARTUPBENCH_CAPS_CMD;
+         rpcdata->messageLen = sizeof STARTUPBENCH_CAPS_CMD;
+         gStep = STARTUPBENCH_SEND_CAPS;
+         g_free(timeline);
+      }
+      return TRUE;
+
+   case STARTUPBENCH_SEND_CAPS:
+      timeline = StartupBenchGetTimeline();
+      g_print("%s\n", timeline);
+      g_free(timeline);
+      gStep = STARTUPBENCH_DONE;
+      /* Fall through. */
+
+   default:
+      return FALSE;
+   }
+}
+
+
+/**
+ * Returns the benchmark plugin's registration data.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ * @return The application data.
+ */
+
+TOOLS_MODULE_EXPORT RpcDebugPlugin *
+RpcDebugOnLoad(ToolsAppCtx *ctx)
+{
+   static RpcDebugRecvMapping recvFns[] = {
+      { NULL, NULL }
+   };
+   static RpcDebugPlugin regData = {
+      recvFns,
+      NULL,
+      StartupBenchSendNext,
+      NULL,
+      NULL,
+   };
+
+   gCtx = ctx;
+   return &regData;
+}
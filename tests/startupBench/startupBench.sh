@@ -0,0 +1,74 @@
+#!/bin/sh
+##########################################################
+# Copyright (C) 2015 VMware, Inc. All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published
+# by the Free Software Foundation version 2.1 and no later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+#
+##########################################################
+
+# Starts and stops vmtoolsd a number of times with the startupBench debug
+# plugin, and prints the percentiles of each entry of the startup timeline.
+# Each run is a separate process, so that every run pays for the dynamic
+# linking and plugin loading a real service start does.
+
+usage() {
+   echo "Usage: $0 [-n runs] [-s service] [-t vmtoolsd] /path/to/libstartupBench.so"
+   exit 1
+}
+
+runs=20
+service=vmsvc
+vmtoolsd=vmtoolsd
+
+while getopts "n:s:t:" opt; do
+   case $opt in
+   n) runs=$OPTARG ;;
+   s) service=$OPTARG ;;
+   t) vmtoolsd=$OPTARG ;;
+   *) usage ;;
+   esac
+done
+shift `expr $OPTIND - 1`
+
+if [ $# -ne 1 ]; then
+   usage
+fi
+plugin=$1
+
+samples=`mktemp` || exit 1
+trap 'rm -f "$samples"' EXIT
+
+i=0
+while [ $i -lt $runs ]; do
+   line=`"$vmtoolsd" -n "$service" -g "$plugin" 2>/dev/null | grep '^total='`
+   if [ -z "$line" ]; then
+      echo "Run $i did not print a startup timeline." >&2
+      exit 1
+   fi
+   # One "key value" pair per line.
+   echo "$line" | tr ' ' '\n' | sed -e 's/us$//' -e 's/=/ /' >> "$samples"
+   i=`expr $i + 1`
+done
+
+echo "$runs runs, times in microseconds"
+printf "%-24s %10s %10s %10s %10s\n" "phase" "p50" "p90" "p99" "max"
+sort -k1,1 -k2,2n "$samples" | awk '
+   function report() {
+      printf "%-24s %10d %10d %10d %10d\n", key,
+             v[int((n - 1) * 0.50) + 1], v[int((n - 1) * 0.90) + 1],
+             v[int((n - 1) * 0.99) + 1], v[n]
+   }
+   $1 != key { if (n > 0) report(); key = $1; n = 0 }
+   { v[++n] = $2 }
+   END { if (n > 0) report() }'
@@ -0,0 +1,455 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * threadPoolTest.c --
+ *
+ *      Checks the scheduling of the service's shared thread pool, built from
+ *      services/vmtoolsd/threadPool.c, with the smallest configuration
+ *      ("pool.maxThreads=1", which the pool raises to two regular workers,
+ *      plus the default reserved worker). Tasks block until released, so the
+ *      test controls which workers are busy. It checks that
+ *
+ *       - bulk tasks never take the last regular worker, counting the tasks
+ *         of all lanes;
+ *       - a normal task runs beside a bulk task, and is preferred over a
+ *         waiting bulk task when a worker frees up;
+ *       - critical tasks use the reserved worker and ignore the per-plugin
+ *         limit;
+ *       - a plugin can't use more than "pool.maxThreadsPerPlugin" workers.
+ *
+ *      A stuck pool is caught by an alarm.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "toolsCoreInt.h"
+#include "serviceObj.h"
+#include "vmware/tools/threadPool.h"
+
+/* Seconds before a stuck test is killed. */
+#define POOL_TEST_TIMEOUT     30
+
+/* How long to give a task that should not start the chance to start. */
+#define POOL_TEST_SETTLE_MS   100
+
+typedef struct PoolTestTask {
+   gboolean started;
+   gboolean released;
+} PoolTestTask;
+
+typedef GObject PoolTestService;
+typedef GObjectClass PoolTestServiceClass;
+
+static GMutex *gLock;
+static GCond *gCond;
+static gpointer gPool;
+static gboolean gFailed = FALSE;
+
+G_DEFINE_TYPE(PoolTestService, PoolTestService, G_TYPE_OBJECT)
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestServiceGetProperty --
+ *
+ *      Returns the pool published by the thread pool.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestServiceGetProperty(GObject *object,     // IN
+                           guint id,            // IN
+                           GValue *value,       // OUT
+                           GParamSpec *pspec)   // IN
+{
+   g_value_set_pointer(value, gPool);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestServiceSetProperty --
+ *
+ *      Stores the pool published by the thread pool.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestServiceSetProperty(GObject *object,        // IN
+                           guint id,               // IN
+                           const GValue *value,    // IN
+                           GParamSpec *pspec)      // IN
+{
+   gPool = g_value_get_pointer(value);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestService_class_init --
+ *
+ *      Installs the thread pool property, which the service object gets when
+ *      the pool registers it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestService_class_init(PoolTestServiceClass *klass)   // IN
+{
+   klass->get_property = PoolTestServiceGetProperty;
+   klass->set_property = PoolTestServiceSetProperty;
+   g_object_class_install_property(klass, 1,
+                                   g_param_spec_pointer(TOOLS_CORE_PROP_TPOOL,
+                                                        TOOLS_CORE_PROP_TPOOL,
+                                                        TOOLS_CORE_PROP_TPOOL,
+                                                        G_PARAM_READWRITE));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestService_init --
+ *
+ *      Instance initializer of the fake service object.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestService_init(PoolTestService *obj)   // IN
+{
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ToolsCoreService_RegisterProperty --
+ *
+ *      Replaces the service object's function: the fake service object has
+ *      the pool property from the start.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+ToolsCoreService_RegisterProperty(ToolsCoreService *obj,     // IN
+                                  ToolsServiceProperty *prop)  // IN
+{
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestRun --
+ *
+ *      Pool task: marks itself started and blocks until released.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestRun(ToolsAppCtx *ctx,   // IN
+            gpointer data)      // IN
+{
+   PoolTestTask *task = data;
+
+   g_mutex_lock(gLock);
+   task->started = TRUE;
+   g_cond_broadcast(gCond);
+   while (!task->released) {
+      g_cond_wait(gCond, gLock);
+   }
+   g_mutex_unlock(gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestSubmit --
+ *
+ *      Submits a task on behalf of the given owner.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestSubmit(ToolsAppCtx *ctx,                // IN
+               PoolTestTask *task,              // IN
+               ToolsCorePoolPriority priority,  // IN
+               const gchar *owner)              // IN
+{
+   ToolsCorePool *pool = ToolsCorePool_GetPool(ctx);
+
+   pool->submitPriority(ctx, PoolTestRun, task, NULL, priority, owner);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestStarted --
+ *
+ *      Tells whether a task has started. If it is expected to start, waits
+ *      for it; otherwise gives it some time to start anyway.
+ *
+ * Results:
+ *      Whether the task has started.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+PoolTestStarted(PoolTestTask *task,   // IN
+                gboolean expected)    // IN
+{
+   gboolean started;
+
+   if (expected) {
+      g_mutex_lock(gLock);
+      while (!task->started) {
+         g_cond_wait(gCond, gLock);
+      }
+      g_mutex_unlock(gLock);
+   } else {
+      g_usleep(POOL_TEST_SETTLE_MS * 1000);
+   }
+
+   g_mutex_lock(gLock);
+   started = task->started;
+   g_mutex_unlock(gLock);
+   return started;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestRelease --
+ *
+ *      Lets a task finish.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestRelease(PoolTestTask *task)   // IN
+{
+   g_mutex_lock(gLock);
+   task->released = TRUE;
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PoolTestCheck --
+ *
+ *      Checks whether a task has started as expected.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PoolTestCheck(const char *what,      // IN
+              PoolTestTask *task,    // IN
+              gboolean expected)     // IN
+{
+   gboolean ok = PoolTestStarted(task, expected) == expected;
+
+   g_print("%-48s %s: %s\n", what, expected ? "runs" : "waits",
+           ok ? "ok" : "FAILED");
+   if (!ok) {
+      gFailed = TRUE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the test steps.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   static const gchar config[] = "[vmsvc]\npool.maxThreads=1\n";
+   ToolsAppCtx ctx;
+   PoolTestTask bulk1 = { FALSE, FALSE };
+   PoolTestTask bulk2 = { FALSE, FALSE };
+   PoolTestTask normal1 = { FALSE, FALSE };
+   PoolTestTask normal2 = { FALSE, FALSE };
+   PoolTestTask critical = { FALSE, FALSE };
+   PoolTestTask ownerA1 = { FALSE, FALSE };
+   PoolTestTask ownerA2 = { FALSE, FALSE };
+   PoolTestTask ownerB = { FALSE, FALSE };
+
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+   g_type_init();
+   gLock = g_mutex_new();
+   gCond = g_cond_new();
+   alarm(POOL_TEST_TIMEOUT);
+
+   memset(&ctx, 0, sizeof ctx);
+   ctx.name = "vmsvc";
+   ctx.config = g_key_file_new();
+   g_key_file_load_from_data(ctx.config, config, sizeof config - 1,
+                             G_KEY_FILE_NONE, NULL);
+   ctx.serviceObj = g_object_new(PoolTestService_get_type(), NULL);
+   ToolsCorePool_Init(&ctx);
+
+   /* Bulk tasks leave a regular worker free. */
+   PoolTestSubmit(&ctx, &bulk1, TOOLS_CORE_POOL_PRIORITY_BULK, "bulk1");
+   PoolTestSubmit(&ctx, &bulk2, TOOLS_CORE_POOL_PRIORITY_BULK, "bulk2");
+   PoolTestCheck("first bulk task", &bulk1, TRUE);
+   PoolTestCheck("second bulk task", &bulk2, FALSE);
+
+   PoolTestSubmit(&ctx, &normal1, TOOLS_CORE_POOL_PRIORITY_NORMAL, "normal");
+   PoolTestCheck("normal task beside a bulk task", &normal1, TRUE);
+
+   /* All regular workers are busy. */
+   PoolTestSubmit(&ctx, &normal2, TOOLS_CORE_POOL_PRIORITY_NORMAL, "other");
+   PoolTestCheck("normal task with all workers busy", &normal2, FALSE);
+
+   /* Same owner as a running task, which a critical task may ignore. */
+   PoolTestSubmit(&ctx, &critical, TOOLS_CORE_POOL_PRIORITY_CRITICAL, "normal");
+   PoolTestCheck("critical task on the reserved worker", &critical, TRUE);
+
+   /* Critical tasks count against the regular workers while they run. */
+   PoolTestRelease(&critical);
+   PoolTestCheck("normal task once the critical task is done", &normal2,
+                 FALSE);
+
+   /* The waiting normal task goes before the waiting bulk task. */
+   PoolTestRelease(&normal1);
+   PoolTestCheck("normal task when a worker frees up", &normal2, TRUE);
+   PoolTestCheck("bulk task behind a normal task", &bulk2, FALSE);
+
+   /* Bulk tasks only start while all but one regular worker is idle. */
+   PoolTestRelease(&bulk1);
+   PoolTestCheck("bulk task with two tasks running", &bulk2, FALSE);
+   PoolTestRelease(&normal2);
+   PoolTestCheck("bulk task once the pool is idle", &bulk2, TRUE);
+   PoolTestRelease(&bulk2);
+
+   /* One task per plugin with the default per-plugin limit. */
+   PoolTestSubmit(&ctx, &ownerA1, TOOLS_CORE_POOL_PRIORITY_NORMAL, "a");
+   PoolTestSubmit(&ctx, &ownerA2, TOOLS_CORE_POOL_PRIORITY_NORMAL, "a");
+   PoolTestSubmit(&ctx, &ownerB, TOOLS_CORE_POOL_PRIORITY_NORMAL, "b");
+   PoolTestCheck("first task of a plugin", &ownerA1, TRUE);
+   PoolTestCheck("other plugin's task", &ownerB, TRUE);
+   PoolTestCheck("second task of a plugin", &ownerA2, FALSE);
+
+   PoolTestRelease(&ownerA1);
+   PoolTestCheck("second task once the first is done", &ownerA2, TRUE);
+   PoolTestRelease(&ownerA2);
+   PoolTestRelease(&ownerB);
+
+   ToolsCorePool_Shutdown(&ctx);
+   g_object_unref(ctx.serviceObj);
+   g_key_file_free(ctx.config);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+}
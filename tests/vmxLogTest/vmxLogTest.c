@@ -0,0 +1,369 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vmxLogTest.c --
+ *
+ *      Checks that the "vmx" log handler batches messages. The VMX logger
+ *      code is built into the test, which provides the channel it sends
+ *      "log" RPCs on, and replaces the library's monotonic clock it reads,
+ *      so that the number of RPCs does not depend on how fast the test runs:
+ *
+ *       - while the clock stands still, a burst of messages is sent in full
+ *         RPCs only, and the final flush sends the rest: the burst takes
+ *         exactly as many RPCs as it takes full ones to carry it;
+ *       - a partial batch is not sent before the flush delay, and is sent
+ *         in a single RPC once the clock moves past it.
+ *
+ *      Messages may be dropped if the burst outruns the flusher thread, but
+ *      every message must be either received or counted as dropped. A stuck
+ *      test is caught by an alarm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define G_LOG_DOMAIN "vmxLogTest"
+
+#include "vmware.h"
+#include "vmtoolsInt.h"
+#include "rpcChannelInt.h"
+#include "vmware/tools/log.h"
+
+/* Marks the lines logged by the test. */
+#define VMXLOGTEST_MARKER           "vmxLogTest-msg"
+
+/* Length of each line, newline included. */
+#define VMXLOGTEST_LINE_LEN         100
+
+/* Lines in a full RPC. */
+#define VMXLOGTEST_LINES_PER_RPC    (VMXLOGGER_RPC_SIZE / VMXLOGTEST_LINE_LEN)
+
+#define VMXLOGTEST_BURST            10000
+#define VMXLOGTEST_PARTIAL          10
+
+/* Real time the partial batch is given to be sent too early, in us. */
+#define VMXLOGTEST_EARLY_WAIT       (4 * VMXLOGGER_FLUSH_DELAY * 1000)
+
+/* Seconds before a stuck test is killed. */
+#define VMXLOGTEST_TIMEOUT          30
+
+static GMutex *gLock;
+static GCond *gCond;
+static guint gRpcs;
+static guint gLines;
+static gboolean gFailed = FALSE;
+
+/* Time returned by the fake clock, in ms. 0 would mean "nothing queued". */
+static volatile gint gNow = 1000;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMXLogTestClock --
+ *
+ *      Fake monotonic clock read by the VMX logger: only moves when the
+ *      test says so.
+ *
+ * Results:
+ *      The fake time, in milliseconds.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static guint64
+VMXLogTestClock(void)
+{
+   return (guint64) g_atomic_int_get(&gNow);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeSend --
+ *
+ *      Send function of the fake channel: counts the "log" RPCs and the
+ *      test's lines they carry.
+ *
+ * Results:
+ *      TRUE.
+ *
+ * Side effects:
+ *      Sets gFailed if an RPC carries more lines than fit in one.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+FakeSend(RpcChannel *chan,     // IN
+         char const *data,     // IN
+         size_t dataLen,       // IN
+         char **result,        // OUT
+         size_t *resultLen)    // OUT
+{
+   const char *end = data + dataLen;
+   const char *line = data;
+   guint lines = 0;
+
+   while ((line = g_strstr_len(line, end - line, VMXLOGTEST_MARKER)) != NULL) {
+      lines++;
+      line += sizeof VMXLOGTEST_MARKER - 1;
+   }
+
+   g_mutex_lock(gLock);
+   if (lines > VMXLOGTEST_LINES_PER_RPC) {
+      g_print("RPC %u carries %u lines\n", gRpcs, lines);
+      gFailed = TRUE;
+   }
+   gRpcs++;
+   gLines += lines;
+   g_cond_broadcast(gCond);
+   g_mutex_unlock(gLock);
+
+   *result = NULL;
+   *resultLen = 0;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FakeGetType --
+ *
+ *      Type function of the fake channel.
+ *
+ * Results:
+ *      RPCCHANNEL_TYPE_PRIV_VSOCK.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static RpcChannelType
+FakeGetType(RpcChannel *chan)    // IN
+{
+   return RPCCHANNEL_TYPE_PRIV_VSOCK;
+}
+
+
+static RpcChannelFuncs gFakeFuncs = {
+   NULL,
+   NULL,
+   FakeSend,
+   NULL,
+   NULL,
+   FakeGetType,
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMXLogTestLog --
+ *
+ *      Logs 'count' lines of VMXLOGTEST_LINE_LEN bytes.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMXLogTestLog(GlibLogger *logger,   // IN
+              guint count)          // IN
+{
+   char line[VMXLOGTEST_LINE_LEN + 1];
+   guint i;
+
+   for (i = 0; i < count; i++) {
+      gint len;
+
+      memset(line, 'x', sizeof line);
+      len = g_snprintf(line, sizeof line, VMXLOGTEST_MARKER " %06u ", i);
+      line[len] = 'x';
+      line[VMXLOGTEST_LINE_LEN - 1] = '\n';
+      line[VMXLOGTEST_LINE_LEN] = '\0';
+      logger->logfn(G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, line, logger);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMXLogTestReset --
+ *
+ *      Resets the RPC counters.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMXLogTestReset(void)
+{
+   g_mutex_lock(gLock);
+   gRpcs = 0;
+   gLines = 0;
+   g_mutex_unlock(gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMXLogTestCheck --
+ *
+ *      Compares a counter with its expected value.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets gFailed on mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMXLogTestCheck(const char *what,    // IN
+                guint value,         // IN
+                guint expected)      // IN
+{
+   gboolean ok = value == expected;
+
+   g_print("%-40s %6u: %s\n", what, value, ok ? "ok" : "FAILED");
+   if (!ok) {
+      g_print("%-40s %6u expected\n", "", expected);
+      gFailed = TRUE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *      Runs the test steps.
+ *
+ * Results:
+ *      0 on success, 1 on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   VMToolsVMXLogStats before;
+   VMToolsVMXLogStats after;
+   RpcChannel *chan;
+   GlibLogger *logger;
+   guint dropped;
+   guint rpcs;
+
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+   gLock = g_mutex_new();
+   gCond = g_cond_new();
+   alarm(VMXLOGTEST_TIMEOUT);
+   VMTools_SetMonotonicClock(VMXLogTestClock);
+
+   chan = RpcChannel_Create();
+   chan->funcs = &gFakeFuncs;
+   g_static_mutex_init(&chan->outLock);
+
+   logger = VMToolsCreateVMXLogger();
+   VMTools_SetVMXLogChannel(chan);
+
+   /*
+    * A burst while the clock stands still: the flusher only sends full RPCs,
+    * and the flush sends what's left.
+    */
+   VMTools_GetVMXLogStats(&before);
+   VMXLogTestLog(logger, VMXLOGTEST_BURST);
+   VMToolsVMXLoggerFlush();
+   VMTools_GetVMXLogStats(&after);
+
+   dropped = (guint) (after.dropped - before.dropped);
+   VMXLogTestCheck("burst lines received or dropped", gLines + dropped,
+                   VMXLOGTEST_BURST);
+   VMXLogTestCheck("burst RPCs", gRpcs,
+                   (gLines + VMXLOGTEST_LINES_PER_RPC - 1) /
+                   VMXLOGTEST_LINES_PER_RPC);
+   g_print("%u lines dropped\n", dropped);
+
+   /*
+    * A partial batch waits for the flush delay, whatever the real time, and
+    * then goes in one RPC.
+    */
+   VMXLogTestReset();
+   VMXLogTestLog(logger, VMXLOGTEST_PARTIAL);
+   g_usleep(VMXLOGTEST_EARLY_WAIT);
+   g_mutex_lock(gLock);
+   rpcs = gRpcs;
+   g_mutex_unlock(gLock);
+   VMXLogTestCheck("RPCs before the flush delay", rpcs, 0);
+
+   g_atomic_int_add(&gNow, VMXLOGGER_FLUSH_DELAY);
+   g_mutex_lock(gLock);
+   while (gRpcs == 0) {
+      g_cond_wait(gCond, gLock);
+   }
+   g_mutex_unlock(gLock);
+   VMToolsVMXLoggerFlush();
+   VMXLogTestCheck("RPCs after the flush delay", gRpcs, 1);
+   VMXLogTestCheck("lines after the flush delay", gLines, VMXLOGTEST_PARTIAL);
+
+   VMTools_SetVMXLogChannel(NULL);
+   logger->dtor(logger);
+
+   g_static_mutex_free(&chan->outLock);
+   g_free(chan);
+   VMTools_SetMonotonicClock(NULL);
+   g_cond_free(gCond);
+   g_mutex_free(gLock);
+
+   g_print("%s\n", gFailed ? "FAILED" : "PASSED");
+   return gFailed ? 1 : 0;
+}